@@ -0,0 +1,29 @@
+# - Find zstd
+# This module finds an installed zstd package.
+#
+# It sets the following variables:
+#  ZSTD_FOUND       - Set to false, or undefined, if zstd isn't found.
+#  ZSTD_INCLUDE_DIR - The zstd include directory.
+#  ZSTD_LIBRARY     - The zstd library to link against.
+
+FIND_PATH(ZSTD_INCLUDE_DIR zstd.h PATHS $ENV{ZSTD_ROOT_DIR}/include $ENV{ZSTD_ROOT_DIR})
+
+FIND_LIBRARY(ZSTD_LIBRARY NAMES zstd PATHS $ENV{ZSTD_ROOT_DIR}/lib $ENV{ZSTD_ROOT_DIR})
+
+IF (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+   SET(ZSTD_FOUND TRUE)
+   SET(ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR})
+   SET(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+ENDIF (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+
+IF (ZSTD_FOUND)
+   # show which zstd was found only if not quiet
+   IF (NOT ZSTD_FIND_QUIETLY)
+      MESSAGE(STATUS "Found zstd: ${ZSTD_INCLUDE_DIRS} ${ZSTD_LIBRARIES}")
+   ENDIF (NOT ZSTD_FIND_QUIETLY)
+ELSE (ZSTD_FOUND)
+   # fatal error if zstd is required but not found
+   IF (ZSTD_FIND_REQUIRED)
+      MESSAGE(FATAL_ERROR "Could not find zstd")
+   ENDIF (ZSTD_FIND_REQUIRED)
+ENDIF (ZSTD_FOUND)
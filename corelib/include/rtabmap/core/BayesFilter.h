@@ -59,19 +59,38 @@ public:
 	const std::vector<double> & getPredictionLC() const; // {Vp, Lc, l1, l2, l3, l4...}
 	std::string getPredictionLCStr() const; // for convenience {Vp, Lc, l1, l2, l3, l4...}
 
+	// Dense prediction matrix (for debugging, the filter uses a sparse representation)
 	cv::Mat generatePrediction(const Memory * memory, const std::vector<int> & ids);
 
+public:
+	/**
+	 * A column of the prediction matrix (the prior of a location). Only
+	 * the rows of the neighbors are explicitly stored, all other rows
+	 * (from defaultStart) have the same value defaultValue.
+	 */
+	class PredictionColumn
+	{
+	public:
+		PredictionColumn() : defaultValue(0.0f), defaultStart(0) {}
+		float & at(int row); // inserted if not explicitly stored yet
+		std::vector<std::pair<int, float> > values; // <row, value> sorted by row
+		float defaultValue;
+		int defaultStart; // 0 or 1 (when the first row is the virtual place)
+	};
+
 private:
-	cv::Mat updatePrediction(const cv::Mat & oldPrediction,
+	void generatePrediction(const Memory * memory, const std::vector<int> & ids, std::vector<PredictionColumn> & prediction);
+	void updatePrediction(const std::vector<PredictionColumn> & oldPrediction,
 			const Memory * memory,
 			const std::vector<int> & oldIds,
-			const std::vector<int> & newIds);
+			const std::vector<int> & newIds,
+			std::vector<PredictionColumn> & prediction);
 	void updatePosterior(const Memory * memory, const std::vector<int> & likelihoodIds);
-	void normalize(cv::Mat & prediction, unsigned int index, float addedProbabilitiesSum, bool virtualPlaceUsed) const;
+	void normalize(PredictionColumn & column, unsigned int index, unsigned int size, float addedProbabilitiesSum, bool virtualPlaceUsed) const;
 
 private:
 	std::map<int, float> _posterior;
-	cv::Mat _prediction;
+	std::vector<PredictionColumn> _prediction; // columns
 	float _virtualPlacePrior;
 	std::vector<double> _predictionLC; // {Vp, Lc, l1, l2, l3, l4...}
 	bool _fullPredictionUpdate;
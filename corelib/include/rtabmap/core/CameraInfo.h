@@ -48,6 +48,10 @@ public:
 		timeScanFromDepth(0.0f),
 		timeUndistortDepth(0.0f),
 		timeBilateralFiltering(0.0f),
+		timePipelineWait(0.0f),
+		timePipelineReorder(0.0f),
+		pipelineInputQueueSize(0),
+		pipelineOutputQueueSize(0),
 		timeTotal(0.0f),
 		odomCovariance(cv::Mat::eye(6,6,CV_64FC1))
 	{
@@ -65,6 +69,11 @@ public:
 	float timeScanFromDepth;
 	float timeUndistortDepth;
 	float timeBilateralFiltering;
+	// With CameraThread::setPipelineWorkers()
+	float timePipelineWait;       // time waiting for a worker
+	float timePipelineReorder;    // time waiting for previous frames to be published
+	int pipelineInputQueueSize;   // frames waiting for a worker when this frame was captured
+	int pipelineOutputQueueSize;  // frames processed but not published yet when this frame was published
 	float timeTotal;
 	Transform odomPose;
 	cv::Mat odomCovariance;
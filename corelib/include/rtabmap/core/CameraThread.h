@@ -46,6 +46,7 @@ class CameraInfo;
 class SensorData;
 class StereoDense;
 class IMUFilter;
+class CameraPipeline;
 
 /**
  * Class CameraThread
@@ -92,6 +93,16 @@ public:
 		_scanForceGroundNormalsUp = forceGroundNormalsUp;
 	}
 
+	/**
+	 * Post-process captured frames (postUpdate()) in "workers" threads, so that
+	 * capture of the next frames is done at the same time. Frames are still
+	 * published in capture order. Capture waits when "workers + queueSize"
+	 * frames are captured but not published yet. Set workers to 0 to
+	 * post-process frames in the capture thread (default). Should be set
+	 * before starting the thread.
+	 */
+	void setPipelineWorkers(int workers, int queueSize = 1);
+
 	void postUpdate(SensorData * data, CameraInfo * info = 0) const;
 
 	//getters
@@ -101,10 +112,16 @@ public:
 	Camera * camera() {return _camera;} // return null if not set, valid until CameraThread is deleted
 
 private:
+	friend class CameraPipeline;
 	virtual void mainLoopBegin();
 	virtual void mainLoop();
 	virtual void mainLoopKill();
 
+	// postUpdate() is split to filter IMU in capture order with the pipeline
+	void preprocess(SensorData * data, CameraInfo * info) const;
+	void filterIMU(SensorData & data) const;
+	void publish(const SensorData & data, const CameraInfo & info) const;
+
 private:
 	Camera * _camera;
 	bool _mirroring;
@@ -126,6 +143,9 @@ private:
 	float _bilateralSigmaS;
 	float _bilateralSigmaR;
 	IMUFilter * _imuFilter;
+	int _pipelineWorkers;
+	int _pipelineQueueSize;
+	CameraPipeline * _pipeline;
 };
 
 } // namespace rtabmap
@@ -30,57 +30,78 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
 
-#include <rtabmap/utilite/UThread.h>
+#include <rtabmap/utilite/UThreadPool.h>
 #include <opencv2/opencv.hpp>
 
 namespace rtabmap {
 
 /**
- * Compress image or data
+ * Compress image or data. The job is executed by the
+ * shared UThreadPool, no thread is created per job.
  *
  * Example compression:
  *   cv::Mat image;// an image
  *   CompressionThread ct(image);
  *   ct.start();
- *   ct.join();
+ *   ct.wait();
  *   std::vector<unsigned char> bytes = ct.getCompressedData();
  *
  * Example uncompression
  *   std::vector<unsigned char> bytes;// a compressed image
  *   CompressionThread ct(bytes);
  *   ct.start();
- *   ct.join();
+ *   ct.wait();
  *   cv::Mat image = ct.getUncompressedData();
  */
-class RTABMAP_EXP CompressionThread : public UThread
+class RTABMAP_EXP CompressionThread : public UTask
 {
 public:
-	// format : ".png" ".jpg" "" (empty is general)
-	CompressionThread(const cv::Mat & mat, const std::string & format = "");
+	// format : ".png" ".jpg" ".rvl" "" (empty is general)
+	// codec/level : see compressData2() for general data, level is PNG level for ".png" images
+	CompressionThread(const cv::Mat & mat, const std::string & format = "", int codec = 0, int level = -1);
 	CompressionThread(const cv::Mat & bytes, bool isImage);
+	virtual ~CompressionThread() {this->wait();}
+	// kept for compatibility, same as wait()
+	void join() {this->wait();}
 	const cv::Mat & getCompressedData() const {return compressedData_;}
 	cv::Mat & getUncompressedData() {return uncompressedData_;}
 protected:
-	virtual void mainLoop();
+	virtual void run();
 private:
 	cv::Mat compressedData_;
 	cv::Mat uncompressedData_;
 	std::string format_;
+	int codec_;
+	int level_;
 	bool image_;
 	bool compressMode_;
 };
 
-std::vector<unsigned char> RTABMAP_EXP compressImage(const cv::Mat & image, const std::string & format = ".png");
-cv::Mat RTABMAP_EXP compressImage2(const cv::Mat & image, const std::string & format = ".png");
+/**
+ * Compress an image.
+ * @param format ".png", ".jpg" or ".rvl". ".rvl" is a fast lossless codec for
+ *        depth images (16UC1 or 32FC1), other images are compressed in ".png" with this format.
+ *        32FC1 images are saved as 8UC4 with ".png".
+ * @param pngLevel PNG compression level (0-9) when format is ".png", -1 means OpenCV's default
+ */
+std::vector<unsigned char> RTABMAP_EXP compressImage(const cv::Mat & image, const std::string & format = ".png", int pngLevel = -1);
+cv::Mat RTABMAP_EXP compressImage2(const cv::Mat & image, const std::string & format = ".png", int pngLevel = -1);
 
 cv::Mat RTABMAP_EXP uncompressImage(const cv::Mat & bytes);
 cv::Mat RTABMAP_EXP uncompressImage(const std::vector<unsigned char> & bytes);
 
-std::vector<unsigned char> RTABMAP_EXP compressData(const cv::Mat & data);
-cv::Mat RTABMAP_EXP compressData2(const cv::Mat & data);
+/**
+ * Compress general data.
+ * @param codec 0=zlib, 1=zstd (if rtabmap is not built with zstd, zlib is used), 2=lz4.
+ *        The codec is saved with the compressed data, uncompressData() detects it.
+ * @param level compression level of the codec, -1 means codec's default (for lz4, > 0 uses LZ4 HC).
+ */
+std::vector<unsigned char> RTABMAP_EXP compressData(const cv::Mat & data, int codec = 0, int level = -1);
+cv::Mat RTABMAP_EXP compressData2(const cv::Mat & data, int codec = 0, int level = -1);
 
 cv::Mat RTABMAP_EXP uncompressData(const cv::Mat & bytes);
 cv::Mat RTABMAP_EXP uncompressData(const std::vector<unsigned char> & bytes);
+// Returns an empty matrix if the data is corrupted or truncated.
 cv::Mat RTABMAP_EXP uncompressData(const unsigned char * bytes, unsigned long size);
 
 cv::Mat RTABMAP_EXP compressString(const std::string & str);
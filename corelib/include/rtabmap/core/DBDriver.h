@@ -284,6 +284,9 @@ private:
 	virtual void mainLoop();
 
 private:
+	static const int kTrashSignaturesBatchSize;
+	static const int kTrashVisualWordsBatchSize;
+
 	UMutex _transactionMutex;
 	std::map<int, Signature *> _trashSignatures;//<id, Signature*>
 	std::map<int, VisualWord *> _trashVisualWords; //<id, VisualWord*>
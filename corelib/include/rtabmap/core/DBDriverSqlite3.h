@@ -49,6 +49,7 @@ public:
 	void setCacheSize(unsigned int cacheSize);
 	void setSynchronous(int synchronous);
 	void setTempStore(int tempStore);
+	void setMmapSize(unsigned int mmapSize);
 
 protected:
 	virtual bool connectDatabaseQuery(const std::string & url, bool overwritten = false);
@@ -187,6 +188,7 @@ private:
 	int _journalMode;
 	int _synchronous;
 	int _tempStore;
+	unsigned int _mmapSize;
 };
 
 }
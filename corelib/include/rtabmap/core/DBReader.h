@@ -42,6 +42,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap {
 
 class DBDriver;
+class DBReaderPrefetcher;
 
 class RTABMAP_EXP DBReader : public Camera {
 public:
@@ -71,6 +72,14 @@ public:
 	virtual std::string getSerial() const;
 	virtual bool odomProvided() const {return !_odometryIgnored;}
 
+	/**
+	 * Number of nodes loaded and decompressed ahead in a background
+	 * thread (0 = disabled, default). Nodes are loaded in batches of
+	 * half the window and their data are decompressed in parallel.
+	 * Should be set before init().
+	 */
+	void setReadAhead(int window);
+
 protected:
 	virtual SensorData captureImage(CameraInfo * info = 0);
 
@@ -96,6 +105,8 @@ private:
 	int _previousMapID;
 	bool _calibrated;
 	int _framesPublished;
+	int _readAheadWindow;
+	DBReaderPrefetcher * _prefetcher;
 };
 
 } /* namespace rtabmap */
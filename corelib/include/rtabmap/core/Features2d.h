@@ -170,6 +170,12 @@ private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat()) = 0;
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const = 0;
 
+	// Can generateKeypointsImpl() be called concurrently on different grid cells?
+	virtual bool isKeypointsDetectionParallelizable() const {return true;}
+	// Can generateDescriptorsImpl() be called concurrently on chunks of keypoints? Should be true
+	// only if the cost of the extractor is per keypoint (no pyramid rebuilt on each call).
+	virtual bool isDescriptorsExtractionParallelizable() const {return false;}
+
 private:
 	ParametersMap parameters_;
 	int maxFeatures_;
@@ -181,6 +187,7 @@ private:
 	double _subPixEps;
 	int gridRows_;
 	int gridCols_;
+	bool parallelExtraction_;
 	// Stereo stuff
 	Stereo * _stereo;
 };
@@ -198,6 +205,8 @@ public:
 private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat());
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const;
+	virtual bool isKeypointsDetectionParallelizable() const {return !gpuVersion_;}
+	virtual bool isDescriptorsExtractionParallelizable() const {return !gpuVersion_;}
 
 private:
 	double hessianThreshold_;
@@ -248,6 +257,7 @@ public:
 private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat());
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const;
+	virtual bool isKeypointsDetectionParallelizable() const {return !gpu_;}
 
 private:
 	float scaleFactor_;
@@ -279,6 +289,7 @@ public:
 private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat());
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const {return cv::Mat();}
+	virtual bool isKeypointsDetectionParallelizable() const {return !gpu_ && fastCV_==0;}
 
 private:
 	int threshold_;
@@ -314,6 +325,7 @@ public:
 
 private:
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const;
+	virtual bool isDescriptorsExtractionParallelizable() const {return true;}
 
 private:
 	int bytes_;
@@ -377,6 +389,7 @@ public:
 
 private:
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const;
+	virtual bool isDescriptorsExtractionParallelizable() const {return true;}
 
 private:
 	int bytes_;
@@ -485,6 +498,8 @@ public:
 private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat());
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const;
+	// descriptors are computed with the keypoints in a member variable
+	virtual bool isKeypointsDetectionParallelizable() const {return false;}
 
 private:
 	float scaleFactor_;
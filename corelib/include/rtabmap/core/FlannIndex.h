@@ -99,6 +99,28 @@ public:
 			float eps = 0.0,
 			bool sorted = true) const;
 
+	/**
+	 * Exact k-nearest neighbors search of binary descriptors (CV_8UC1) with
+	 * Hamming distance. Query rows are searched in parallel (OpenMP) and the
+	 * distance uses AVX-512/AVX2 popcount when rtabmap is built with these
+	 * instructions enabled (e.g., -march=native), 64-bit popcount otherwise.
+	 * Results are sorted by distance like cv::DescriptorMatcher::knnMatch(),
+	 * less than knn matches are returned if features has less than knn rows.
+	 */
+	static void hammingKnnMatch(
+			const cv::Mat & query,
+			const cv::Mat & features,
+			std::vector<std::vector<cv::DMatch> > & matches,
+			int knn = 2);
+
+	/**
+	 * Distance kernels used by hammingKnnMatch() and VisualMatcher, see
+	 * above for the instructions used. l2SqrDistance() returns the squared
+	 * L2 distance (like cv::NORM_L2SQR) with SSE/AVX when available.
+	 */
+	static int hammingDistance(const unsigned char * a, const unsigned char * b, int size);
+	static float l2SqrDistance(const float * a, const float * b, int size);
+
 private:
 	void * index_;
 	unsigned int nextIndex_;
@@ -210,7 +210,7 @@ void reduceGraph(
  * @param links The graph's links (from node id -> to node id)
  * @param from initial node
  * @param to final node
- * @param updateNewCosts Keep up-to-date costs while traversing the graph.
+ * @param updateNewCosts Not used, costs are always kept up-to-date (see PathGraph).
  * @return the path ids from id "from" to id "to" including initial and final nodes.
  */
 std::list<std::pair<int, Transform> > RTABMAP_EXP computePath(
@@ -243,7 +243,7 @@ std::list<int> RTABMAP_EXP computePath(
  * @param toId final node
  * @param memory The graph's memory
  * @param lookInDatabase check links in database
- * @param updateNewCosts Keep up-to-date costs while traversing the graph.
+ * @param updateNewCosts Not used, costs are always kept up-to-date (see PathGraph).
  * @return the path ids from id "fromId" to id "toId" including initial and final nodes (Identity pose for the first node).
  */
 std::list<std::pair<int, Transform> > RTABMAP_EXP computePath(
@@ -0,0 +1,184 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CORELIB_SRC_ICPENGINE_H_
+#define CORELIB_SRC_ICPENGINE_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+
+#include <rtabmap/core/Transform.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * ICP used by RegistrationIcp. The target cloud is indexed once in its
+ * own frame in a voxel hash (cells sized from the point density, at most
+ * the max correspondence distance), then any number of source clouds can be
+ * registered on it with different target poses: the same engine can be kept
+ * while the target doesn't change. The nearest point is searched cell ring
+ * by ring around the query point until no closer point can be found.
+ * Correspondences are searched in parallel (OpenMP), distances to the points
+ * of a cell and normal equations are computed with SIMD (SSE2/AVX) when available.
+ * Once the target is set, all const methods are thread-safe.
+ *
+ * Results are the same than util3d::icp() and util3d::icpPointToPlane()
+ * (same convergence criteria than PCL), except that with force3DoF, point
+ * to plane is directly estimated in 3DoF instead of being projected afterwards.
+ */
+class RTABMAP_EXP IcpEngine
+{
+public:
+	class Statistics
+	{
+	public:
+		Statistics() :
+			iterations(0),
+			correspondences(0),
+			rmse(0.0f),
+			converged(false),
+			maxIterationsReached(false)
+		{}
+		int iterations;
+		int correspondences; // at the last iteration
+		float rmse;          // at the last iteration
+		bool converged;
+		bool maxIterationsReached; // false if converged before max iterations
+	};
+
+public:
+	IcpEngine();
+	~IcpEngine();
+
+	/**
+	 * Index the target cloud. All points must be finite.
+	 */
+	void setTarget(const pcl::PointCloud<pcl::PointXYZ> & cloud, float maxCorrespondenceDistance);
+	/**
+	 * Index the target cloud with its normals (required for point to plane). All points/normals must be finite.
+	 */
+	void setTarget(const pcl::PointCloud<pcl::PointNormal> & cloud, float maxCorrespondenceDistance);
+	void clear();
+
+	bool isEmpty() const {return x_.empty();}
+	int size() const {return (int)x_.size();}
+	bool hasNormals() const {return !nx_.empty();}
+	float maxCorrespondenceDistance() const {return maxCorrespondenceDistance_;}
+
+	/**
+	 * Point to point ICP.
+	 * @param source the cloud to register (all points must be finite)
+	 * @param targetPose pose of the target in source frame
+	 * @param force3DoF estimate only x, y and yaw
+	 * @param registered source transformed by the returned transform
+	 * @return transform to apply to source to be aligned with target (like util3d::icp()).
+	 */
+	Transform icp(
+			const pcl::PointCloud<pcl::PointXYZ> & source,
+			const Transform & targetPose,
+			int maxIterations,
+			float epsilon,
+			bool force3DoF,
+			bool & hasConverged,
+			pcl::PointCloud<pcl::PointXYZ> & registered,
+			Statistics * stats = 0) const;
+
+	/**
+	 * Point to plane ICP, target should have normals (see setTarget()).
+	 */
+	Transform icpPointToPlane(
+			const pcl::PointCloud<pcl::PointNormal> & source,
+			const Transform & targetPose,
+			int maxIterations,
+			float epsilon,
+			bool force3DoF,
+			bool & hasConverged,
+			pcl::PointCloud<pcl::PointNormal> & registered,
+			Statistics * stats = 0) const;
+
+	/**
+	 * Like util3d::computeVarianceAndCorrespondences(), but the
+	 * nearest target point is always searched for each source point.
+	 */
+	void computeVarianceAndCorrespondences(
+			const pcl::PointCloud<pcl::PointXYZ> & source,
+			const Transform & targetPose,
+			double & variance,
+			int & correspondences) const;
+	/**
+	 * With normals, correspondences with normals angle over maxCorrespondenceAngle are ignored (if > 0).
+	 */
+	void computeVarianceAndCorrespondences(
+			const pcl::PointCloud<pcl::PointNormal> & source,
+			const Transform & targetPose,
+			float maxCorrespondenceAngle,
+			double & variance,
+			int & correspondences) const;
+
+private:
+	IcpEngine(const IcpEngine &);
+	IcpEngine & operator=(const IcpEngine &);
+
+	struct Cells;
+	/**
+	 * Index points of the cloud, order is set to the cloud indices of the sorted points.
+	 */
+	template<typename PointT>
+	void indexPoints(const pcl::PointCloud<PointT> & cloud, float maxCorrespondenceDistance, std::vector<int> & order);
+	/**
+	 * @return key of the cell, -1 if the cell is outside the bounds of the target.
+	 */
+	long long cellKey(int x, int y, int z) const;
+	/**
+	 * @param x,y,z query point in target frame
+	 * @return index of the nearest target point in max correspondence distance, -1 if none.
+	 */
+	int nearestPoint(float x, float y, float z, float & sqrDistance) const;
+	void searchCell(int i, int j, int k, float x, float y, float z, float & bestDistance, int & best) const;
+
+private:
+	float maxCorrespondenceDistance_;
+	// target points sorted by cell (SoA)
+	std::vector<float> x_;
+	std::vector<float> y_;
+	std::vector<float> z_;
+	std::vector<float> nx_;
+	std::vector<float> ny_;
+	std::vector<float> nz_;
+	float cellSize_;
+	int minCell_[3]; // bounds of the target cells
+	int maxCell_[3];
+	bool flat_; // all target points in the same z cell (2D scan), only this layer is searched
+	Cells * cells_; // hashed if built with C++11, see IcpEngine.cpp
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_ICPENGINE_H_ */
@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CORELIB_INCLUDE_RTABMAP_CORE_LASERSCANCHANNELS_H_
+#define CORELIB_INCLUDE_RTABMAP_CORE_LASERSCANCHANNELS_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+
+#include <rtabmap/core/LaserScan.h>
+#include <rtabmap/core/Transform.h>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * Structure-of-arrays copy of the points of a LaserScan: x, y, z and
+ * normals are stored in separate channels, aligned on 32 bytes and padded
+ * to a multiple of 8 points, so that the kernels below process 8 (AVX)
+ * or 4 (SSE2) points at once without branching on the scan format.
+ * For 2D scans, z is always 0. Used by util3d::transformLaserScan(),
+ * util3d::rangeFiltering(), util3d::downsample(), util3d::voxelize(),
+ * util3d::computeNormals() and util3d::commonFiltering().
+ */
+class RTABMAP_EXP LaserScanChannels
+{
+public:
+	LaserScanChannels();
+	/**
+	 * @param scan scan with float data (not compressed)
+	 * @param normals copy also the normals (if the scan has normals)
+	 * @param indices if set, only these points of the scan are copied (in this order)
+	 */
+	LaserScanChannels(const LaserScan & scan, bool normals = true, const std::vector<int> * indices = 0);
+
+	int size() const {return size_;}
+	bool isEmpty() const {return size_ == 0;}
+	bool hasNormals() const {return channels_ == 6;}
+	bool is2d() const {return is2d_;}
+	const float * x() const {return channel(0);}
+	const float * y() const {return channel(1);}
+	const float * z() const {return channel(2);}
+	const float * nx() const {return hasNormals()?channel(3):0;}
+	const float * ny() const {return hasNormals()?channel(4):0;}
+	const float * nz() const {return hasNormals()?channel(5):0;}
+	// index of the point i in the source scan
+	int index(int i) const {return indices_.empty()?i:indices_[i];}
+
+	/**
+	 * Rigid transform of the points, normals are rotated.
+	 */
+	void transform(const Transform & transform);
+
+	/**
+	 * Indices in the source scan of the points with range
+	 * between rangeMin and rangeMax (0 means no limit).
+	 */
+	std::vector<int> rangeFiltering(float rangeMin, float rangeMax) const;
+
+	/**
+	 * Integer coordinates of the voxel containing each point, i.e.
+	 * floor(p/voxelSize). Arrays should have size() elements. Coordinates
+	 * of non-finite points are undefined.
+	 */
+	void voxelCoordinates(float voxelSize, int * vx, int * vy, int * vz) const;
+
+	/**
+	 * Data of the source scan (only the points copied) with x, y, z and
+	 * normals of the channels. Other channels (intensity, rgb) are copied
+	 * from the source scan.
+	 */
+	cv::Mat data(const LaserScan & scan) const;
+
+	/**
+	 * Copy the points at indices of the scan data.
+	 */
+	static cv::Mat select(const cv::Mat & data, const std::vector<int> & indices);
+
+private:
+	// the channels are aligned on the buffer, not copyable
+	LaserScanChannels(const LaserScanChannels &);
+	LaserScanChannels & operator=(const LaserScanChannels &);
+
+	const float * channel(int i) const {return buffer_.empty()?0:&buffer_[offset_ + i*step_];}
+	float * channel(int i) {return buffer_.empty()?0:&buffer_[offset_ + i*step_];}
+
+private:
+	int size_;
+	int channels_;
+	int step_; // padded size of a channel
+	bool is2d_;
+	std::vector<float> buffer_;
+	int offset_; // first float of buffer_ aligned on 32 bytes
+	std::vector<int> indices_;
+};
+
+}
+
+#endif /* CORELIB_INCLUDE_RTABMAP_CORE_LASERSCANCHANNELS_H_ */
@@ -167,6 +167,9 @@ public:
 	const std::map<int, std::set<int> > & getLandmarksIndex() const {return _landmarksIndex;}
 	const std::map<int, std::set<int> > & getLandmarksInvertedIndex() const {return _landmarksInvertedIndex;}
 	bool allNodesInWM() const {return _allNodesInWM;}
+	// Nodes with links added, updated or removed since the last clearLinksModifiedIds()
+	const std::set<int> & getLinksModifiedIds() const {return _linksModifiedIds;}
+	void clearLinksModifiedIds() {_linksModifiedIds.clear();}
 
 	/**
 	 * Set user data. Detect automatically if raw or compressed. If raw, the data is
@@ -245,6 +248,23 @@ public:
 			const std::map<int, Transform> & poses,
 			RegistrationInfo * info = 0);
 
+	// Batched versions of computeTransform() and computeIcpTransformMulti(): the
+	// registrations are done in parallel, results are in the same order than the inputs.
+	std::vector<Transform> computeTransforms(
+			const std::vector<std::pair<Signature*, Signature*> > & signatures,
+			const std::vector<Transform> & guesses,
+			std::vector<RegistrationInfo> * infos = 0,
+			bool useKnownCorrespondencesIfPossible = false) const;
+	std::vector<Transform> computeTransforms(
+			const std::vector<std::pair<int, int> > & ids,
+			const std::vector<Transform> & guesses,
+			std::vector<RegistrationInfo> * infos = 0,
+			bool useKnownCorrespondencesIfPossible = false);
+	std::vector<Transform> computeIcpTransformsMulti(
+			int newId,
+			const std::vector<std::pair<int, std::map<int, Transform> > > & oldIdsAndPoses,
+			std::vector<RegistrationInfo> * infos = 0);
+
 private:
 	void preUpdate();
 	void addSignatureToStm(Signature * signature, const cv::Mat & covariance);
@@ -276,6 +296,22 @@ private:
 	void cleanUnusedWords();
 	int getNi(int signatureId) const;
 
+	//registration stuff
+	void loadRegistrationData(Signature & s) const;
+	void uncompressRegistrationData(Signature & s) const;
+	Transform computeTransformImpl(
+			const Signature & fromS,
+			const Signature & toS,
+			Transform guess,
+			RegistrationInfo * info,
+			bool useKnownCorrespondencesIfPossible) const;
+	bool assembleScansMulti(
+			int fromId,
+			int toId,
+			const std::map<int, Transform> & poses,
+			SensorData & assembledData,
+			Transform & guess);
+
 protected:
 	DBDriver * _dbDriver;
 
@@ -289,6 +325,7 @@ private:
 	bool _notLinkedNodesKeptInDb;
 	bool _saveIntermediateNodeData;
 	std::string _rgbCompressionFormat;
+	std::string _depthCompressionFormat;
 	bool _incrementalMemory;
 	bool _reduceGraph;
 	int _maxStMemSize;
@@ -302,6 +339,8 @@ private:
 	int _imagePreDecimation;
 	int _imagePostDecimation;
 	bool _compressionParallelized;
+	int _compressionCodec;
+	int _compressionPngLevel;
 	float _laserScanDownsampleStepSize;
 	float _laserScanVoxelSize;
 	int _laserScanNormalK;
@@ -337,6 +376,7 @@ private:
 
 	std::map<int, Signature *> _signatures; // TODO : check if a signature is already added? although it is not supposed to occur...
 	std::set<int> _stMem; // id
+	std::set<int> _linksModifiedIds;
 	std::map<int, double> _workingMem; // id,age
 	std::map<int, Transform> _groundTruths;
 	std::map<int, std::string> _labels;
@@ -353,6 +393,24 @@ private:
 	Registration * _registrationPipeline;
 	RegistrationIcp * _registrationIcpMulti;
 
+	// Scans assembled by computeIcpTransformMulti(), kept to be
+	// reused when the same path is registered again.
+	class AssembledScans
+	{
+	public:
+		bool isSame(const AssembledScans & other) const;
+
+		int toId;
+		std::vector<std::pair<int, Transform> > poses; // relative to toId
+		std::vector<cv::Mat> scans; // compressed scans, kept so that their data cannot be reused by other scans
+		LaserScan::Format format;
+		int maxPoints;
+		float rangeMax;
+		Transform localTransform;
+		SensorData data;
+	};
+	std::list<AssembledScans> _icpMultiAssembledScans; // most recent first
+
 	OccupancyGrid * _occupancy;
 
 	MarkerDetector * _markerDetector;
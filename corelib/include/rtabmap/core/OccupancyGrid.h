@@ -100,6 +100,21 @@ public:
 	bool update(const std::map<int, Transform> & poses); // return true if map has changed
 	cv::Mat getMap(float & xMin, float & yMin) const;
 	cv::Mat getProbMap(float & xMin, float & yMin) const;
+	/**
+	 * Only the region (in cells) of the map is returned, xMin and yMin
+	 * are the origin of the region. Used with getDirtyRegion() to
+	 * publish only cells that have changed.
+	 */
+	cv::Mat getMap(float & xMin, float & yMin, const cv::Rect & region) const;
+	cv::Mat getProbMap(float & xMin, float & yMin, const cv::Rect & region) const;
+	/**
+	 * Region (in cells) of the map modified by update() since the last
+	 * clearDirtyRegion(), with the neighbor cells if the map is eroded. The
+	 * whole map when it has been reallocated (its origin may have changed)
+	 * or rebuilt after graph optimization.
+	 */
+	const cv::Rect & getDirtyRegion() const {return dirtyRegion_;}
+	void clearDirtyRegion() {dirtyRegion_ = cv::Rect();}
 	const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & getMapGround() const {return assembledGround_;}
 	const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & getMapObstacles() const {return assembledObstacles_;}
 	const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & getMapEmptyCells() const {return assembledEmptyCells_;}
@@ -147,6 +162,7 @@ private:
 	std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> > cache_; //<node id, < <ground, obstacles>, empty> >
 	cv::Mat map_;
 	cv::Mat mapInfo_;
+	cv::Rect dirtyRegion_;
 	std::map<int, std::pair<int, int> > cellCount_; //<node Id, cells>
 	float xMin_;
 	float yMin_;
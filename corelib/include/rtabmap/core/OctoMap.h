@@ -41,6 +41,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <map>
 #include <string>
+#include <vector>
 
 namespace rtabmap {
 
@@ -65,6 +66,15 @@ public:
 	int getOccupancyType() const {return type_;}
 	const octomap::point3d & getPointRef() const {return pointRef_;}
 
+	// also copy the node reference, so that cells keep it when they are pruned or expanded
+	void copyData(const RtabmapColorOcTreeNode& from)
+	{
+		ColorOcTreeNode::copyData(from);
+		nodeRefId_ = from.nodeRefId_;
+		type_ = from.type_;
+		pointRef_ = from.pointRef_;
+	}
+
 	// following methods defined for octomap < 1.8 compatibility
 	RtabmapColorOcTreeNode* getChild(unsigned int i);
 	const RtabmapColorOcTreeNode* getChild(unsigned int i) const;
@@ -95,13 +105,24 @@ class RtabmapColorOcTree : public octomap::OccupancyOcTreeBase <RtabmapColorOcTr
      /**
      * Prunes a node when it is collapsible. This overloaded
      * version only considers the node occupancy for pruning,
-     * different colors of child nodes are ignored.
+     * different colors of child nodes are ignored. With
+     * setPruneByNodeRef(true), node reference and type are also
+     * compared and ground/obstacle cells are not pruned (they keep
+     * their point reference).
      * @return true if pruning was successful
      */
     virtual bool pruneNode(RtabmapColorOcTreeNode* node);
 
     virtual bool isNodeCollapsible(const RtabmapColorOcTreeNode* node) const;
 
+    /**
+     * Keep node references of the cells when pruning, required to move the
+     * cells of a node in place. This keeps more leaves in the tree (octomap >= 1.8 only,
+     * with older versions node references are always kept).
+     */
+    void setPruneByNodeRef(bool enabled) {pruneByNodeRef_ = enabled;}
+    bool isPruneByNodeRef() const {return pruneByNodeRef_;}
+
     // set node color at given key or coordinate. Replaces previous color.
     RtabmapColorOcTreeNode* setNodeColor(const octomap::OcTreeKey& key, uint8_t r,
                                  uint8_t g, uint8_t b);
@@ -165,6 +186,8 @@ class RtabmapColorOcTree : public octomap::OccupancyOcTreeBase <RtabmapColorOcTr
     /// static member to ensure static initialization (only once)
     static StaticMemberInitializer RtabmapColorOcTreeMemberInit;
 
+  private:
+    bool pruneByNodeRef_;
   };
 
 class RTABMAP_EXP OctoMap {
@@ -216,6 +239,11 @@ public:
 	bool hasColor() const {return hasColor_;}
 
 private:
+	/**
+	 * Set reference node of the cell and remember the cell in the node's
+	 * cells (without full update), to move only cells of the nodes that have moved on graph optimization.
+	 */
+	void setCellNodeRef(RtabmapColorOcTreeNode * n, const octomap::OcTreeKey & key, int nodeId);
 	void updateMinMax(const octomap::point3d & point);
 
 private:
@@ -223,6 +251,8 @@ private:
 	std::map<int, std::pair<const pcl::PointCloud<pcl::PointXYZRGB>::Ptr, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr> > cacheClouds_; // [id: <ground, obstacles>]
 	std::map<int, cv::Point3f> cacheViewPoints_;
 	RtabmapColorOcTree * octree_;
+	std::map<int, std::vector<octomap::OcTreeKey> > nodeCells_; // [id: cells], may contain cells now referred by other nodes
+	octomap::KeySet temporaryCells_; // cells added by temporary clouds (id<=0)
 	std::map<int, Transform> addedNodes_;
 	bool hasColor_;
 	bool fullUpdate_;
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
 
 #include <map>
+#include <set>
 #include <list>
 #include <rtabmap/core/Link.h>
 #include <rtabmap/core/Parameters.h>
@@ -91,6 +92,7 @@ public:
 	bool priorsIgnored() const {return priorsIgnored_;}
 	bool landmarksIgnored() const {return landmarksIgnored_;}
 	float gravitySigma() const {return gravitySigma_;}
+	bool isIncremental() const {return incremental_;}
 
 	// setters
 	void setIterations(int iterations) {iterations_ = iterations;}
@@ -101,6 +103,7 @@ public:
 	void setPriorsIgnored(bool enabled) {priorsIgnored_ = enabled;}
 	void setLandmarksIgnored(bool enabled) {landmarksIgnored_ = enabled;}
 	void setGravitySigma(float value) {gravitySigma_ = value;}
+	void setIncremental(bool enabled) {incremental_ = enabled;}
 
 	virtual void parseParameters(const ParametersMap & parameters);
 
@@ -161,6 +164,50 @@ public:
 			const std::map<int, std::map<int, FeatureBA> > & wordReferences,
 			std::set<int> * outliers = 0);
 
+	/**
+	 * Incremental optimization: the graph and its last solution are kept
+	 * between calls to update(), so that only new poses and constraints are
+	 * added. Get the poses and constraints of "poses" and "constraints" not yet
+	 * in the incremental graph, and those of the incremental graph not in
+	 * "poses" and "constraints" anymore (a modified constraint is both
+	 * removed and new).
+	 * @return true if the incremental graph has only to be extended
+	 */
+	bool getIncrementalDelta(
+			const std::map<int, Transform> & poses,
+			const std::multimap<int, Link> & constraints,
+			std::map<int, Transform> & newPoses,
+			std::multimap<int, Link> & newConstraints,
+			std::set<int> & removedPoses,
+			std::multimap<int, Link> & removedConstraints) const;
+	/**
+	 * Add poses and constraints to the incremental graph. Poses already
+	 * in the graph are ignored, the constraints should all be new.
+	 */
+	void addConstraints(
+			const std::map<int, Transform> & newPoses,
+			const std::multimap<int, Link> & newConstraints);
+	/**
+	 * Remove poses and constraints from the incremental graph, the
+	 * constraints linked to a removed pose should be removed too.
+	 */
+	void removeConstraints(
+			const std::set<int> & removedPoses,
+			const std::multimap<int, Link> & removedConstraints);
+	/**
+	 * Optimize the incremental graph with the constraints added since the last update.
+	 * New poses are initialized from their links to poses already optimized.
+	 * @return the optimized poses, empty if the optimization failed (the incremental graph is reset)
+	 */
+	std::map<int, Transform> update(
+			int rootId,
+			cv::Mat & outputCovariance,
+			double * finalError = 0,
+			int * iterationsDone = 0);
+	virtual void resetIncremental();
+	const std::map<int, Transform> & getIncrementalPoses() const {return incPoses_;}
+	const std::multimap<int, Link> & getIncrementalConstraints() const {return incConstraints_;}
+
 	void computeBACorrespondences(
 			const std::map<int, Transform> & poses,
 			const std::multimap<int, Link> & links,
@@ -181,6 +228,22 @@ protected:
 			float gravitySigma     = Parameters::defaultOptimizerGravitySigma());
 	Optimizer(const ParametersMap & parameters);
 
+	// Called by update(): "poses" are the last optimized poses with the new
+	// poses initialized, "constraints" contain the new constraints. Removed
+	// poses and constraints are not anymore in "poses" and "constraints". By
+	// default, the whole graph is optimized from these poses (warm start).
+	virtual std::map<int, Transform> updateIncremental(
+			int rootId,
+			const std::map<int, Transform> & poses,
+			const std::multimap<int, Link> & constraints,
+			const std::map<int, Transform> & newPoses,
+			const std::multimap<int, Link> & newConstraints,
+			const std::set<int> & removedPoses,
+			const std::multimap<int, Link> & removedConstraints,
+			cv::Mat & outputCovariance,
+			double * finalError,
+			int * iterationsDone);
+
 private:
 	int iterations_;
 	bool slam2d_;
@@ -190,6 +253,17 @@ private:
 	bool priorsIgnored_;
 	bool landmarksIgnored_;
 	float gravitySigma_;
+	bool incremental_;
+
+	// incremental graph
+	std::map<int, Transform> incPoses_;
+	std::multimap<int, Link> incConstraints_;
+	std::map<int, Transform> incNewPoses_;
+	std::multimap<int, Link> incNewConstraints_;
+	std::set<int> incRemovedPoses_;
+	std::multimap<int, Link> incRemovedConstraints_;
+	int incRootId_;
+	cv::Mat incCovariance_;
 };
 
 } /* namespace rtabmap */
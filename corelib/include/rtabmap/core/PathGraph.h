@@ -0,0 +1,170 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_PATHGRAPH_H_
+#define CORELIB_SRC_PATHGRAPH_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+
+#include <rtabmap/core/Transform.h>
+#include <rtabmap/core/Link.h>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * Graph used for path planning. Node ids are mapped to dense indices and
+ * links are kept in a compact adjacency array (CSR), so that the graph can
+ * be kept between planning requests: links added or removed are
+ * kept apart and merged in the array when there are enough of them.
+ *
+ * Paths are computed with A* using an indexed binary heap (decrease-key). The
+ * heuristic is the euclidean distance to the goal if all nodes have a pose (see
+ * setPose()), and/or the ALT heuristic if reference nodes are set (see
+ * setReferenceNodes()). Both are kept admissible while the graph changes.
+ *
+ * Not thread-safe, search buffers are kept between calls.
+ */
+class RTABMAP_EXP PathGraph
+{
+public:
+	PathGraph();
+
+	void clear();
+	int size() const {return (int)idToIndex_.size();}
+	bool contains(int id) const {return idToIndex_.find(id) != idToIndex_.end();}
+
+	/**
+	 * Add a directed link, the cost is the norm of the transform. If there
+	 * is already a link between these nodes, it is replaced. Nodes are created if needed.
+	 */
+	void addLink(int from, int to, const Transform & transform);
+	/**
+	 * Add links (links to self are ignored). Links to landmarks (negative ids) are
+	 * also added in the inverse direction so that paths can go from a landmark.
+	 */
+	void addLinks(const std::multimap<int, Link> & links);
+	/**
+	 * Replace all links from a node by the links (which should all be from
+	 * this node). Nothing is changed if the links are the same.
+	 * @return true if links of the node have changed
+	 */
+	bool setLinks(int from, const std::multimap<int, Link> & links);
+	void removeLink(int from, int to);
+	void removeNode(int id);
+
+	/**
+	 * Node pose, used for the euclidean heuristic. Poses don't have to match
+	 * the links: the euclidean distance is scaled by the smallest ratio between
+	 * link cost and pose distance, so that it never overestimates the cost. The
+	 * heuristic is not used while some nodes don't have a pose.
+	 */
+	void setPose(int id, const Transform & pose);
+
+	/**
+	 * Number of reference nodes (landmarks) used for the ALT heuristic, 0 to disable.
+	 * The distances from the reference nodes are computed on the next computePath().
+	 * They are then updated incrementally when links are added or get a lower
+	 * cost, and computed again only after links are removed or get a higher cost.
+	 * The graph is assumed to be symmetric (links in both directions with same cost).
+	 */
+	void setReferenceNodes(int count);
+
+	/**
+	 * @param linearVelocity if >0, costs are times (m/sec)
+	 * @param angularVelocity if >0, costs are times and include the rotation to
+	 *        align with the link (rad/sec)
+	 * @return the path from "from" to "to" including both nodes, with poses
+	 *         chained from the links (Identity for "from"). Empty if there is no path.
+	 */
+	std::list<std::pair<int, Transform> > computePath(
+			int from,
+			int to,
+			float linearVelocity = 0.0f,
+			float angularVelocity = 0.0f);
+
+private:
+	struct Edge
+	{
+		Edge(int t, const Transform & tf) : to(t), cost(tf.getNorm()), transform(tf) {}
+		int to; // index, -1 if removed
+		float cost;
+		Transform transform;
+	};
+
+	int addNode(int id);
+	Edge * findEdge(int from, int to);
+	bool setEdge(int from, int to, const Transform & transform);
+	void edgeAdded(int from, int to, float cost);
+	void removeEdges(int from);
+	void compact();
+	void computePoseScale();
+	void computeReferenceDistances();
+	void updateReferenceDistances(int reference, int to, float distance);
+	void dijkstra(int source, float * distances);
+	float heuristic(int index, int goal) const;
+	void heapPush(int index);
+	int heapPop();
+	void heapUpdate(int index);
+	void resetSearch();
+
+private:
+	std::map<int, int> idToIndex_;
+	std::vector<int> ids_; // 0 for removed nodes
+	std::vector<Transform> poses_;
+	int posesMissing_; // nodes without pose
+	float poseScale_; // smallest link cost / pose distance
+	bool poseScaleValid_;
+	std::vector<int> offsets_; // edges of node i are edges_[offsets_[i]] to edges_[offsets_[i+1]-1]
+	std::vector<Edge> edges_;
+	std::vector<std::vector<Edge> > newEdges_; // edges added since the last compact()
+	int newEdgesCount_;
+	int removedCount_;
+
+	// ALT
+	int referenceNodes_;
+	int referenceCount_; // reference nodes selected
+	bool referenceDistancesValid_;
+	std::vector<float> referenceDistances_; // nodes x referenceCount_
+
+	// search buffers
+	float heuristicScale_;
+	std::vector<float> costs_;
+	std::vector<float> keys_;
+	std::vector<float> heuristics_;
+	std::vector<int> parents_;
+	std::vector<int> heapIndex_; // -1=not visited, -2=closed
+	std::vector<int> heap_;
+	std::vector<int> visited_;
+	std::vector<Transform> chainedPoses_;
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_PATHGRAPH_H_ */
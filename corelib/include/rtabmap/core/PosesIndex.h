@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_POSESINDEX_H_
+#define CORELIB_SRC_POSESINDEX_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+
+#include <rtabmap/core/Transform.h>
+#include <map>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * Spatial index of poses (voxel hash on their positions) that can be kept
+ * between queries: update() only moves the poses that have been added, removed or
+ * changed since the last call, instead of rebuilding a kd-tree each time.
+ * For radius queries, the cell size should be around the radius used.
+ */
+class RTABMAP_EXP PosesIndex
+{
+public:
+	PosesIndex(float cellSize = 1.0f);
+	~PosesIndex();
+
+	void clear();
+	void setCellSize(float cellSize);
+	float cellSize() const {return cellSize_;}
+	int size() const {return (int)entries_.size();}
+	bool contains(int id) const {return entries_.find(id) != entries_.end();}
+
+	/**
+	 * Synchronize the index with the poses.
+	 * @return the number of poses added, removed or moved
+	 */
+	int update(const std::map<int, Transform> & poses);
+	void add(int id, const Transform & pose);
+	void remove(int id);
+
+	/**
+	 * @return <id, squared distance> of the poses in the radius, excluding "excludedId"
+	 */
+	std::map<int, float> radiusSearch(const Transform & pose, float radius, int excludedId = 0) const;
+
+	/**
+	 * @return ids of the k nearest poses sorted by distance
+	 */
+	std::vector<int> knnSearch(const Transform & pose, int k, bool ignoreLandmarks = false) const;
+
+	/**
+	 * Poses inside the frustum of the pose (x forward, y left, z up).
+	 * @param horizontalFOV horizontal field of view (rad)
+	 * @param verticalFOV vertical field of view (rad)
+	 * @return <id, squared distance>
+	 */
+	std::map<int, float> frustumSearch(
+			const Transform & pose,
+			float horizontalFOV,
+			float verticalFOV,
+			float nearDistance,
+			float farDistance,
+			int excludedId = 0) const;
+
+private:
+	PosesIndex(const PosesIndex &);
+	PosesIndex & operator=(const PosesIndex &);
+
+	struct Entry
+	{
+		float x;
+		float y;
+		float z;
+		long long key;
+	};
+	struct Point
+	{
+		int id;
+		float x;
+		float y;
+		float z;
+	};
+	struct Cells;
+	void cellOf(float x, float y, float z, int & cx, int & cy, int & cz) const;
+	static long long cellKey(int cx, int cy, int cz);
+	void insertInCell(int id, Entry & entry);
+	void removeFromCell(int id, const Entry & entry);
+
+private:
+	float cellSize_;
+	std::map<int, Entry> entries_;
+	Cells * cells_; // hashed if built with C++11, see PosesIndex.cpp
+	int minCell_[3]; // bounds of the cells ever used
+	int maxCell_[3];
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_POSESINDEX_H_ */
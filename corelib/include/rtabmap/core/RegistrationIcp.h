@@ -32,6 +32,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/Registration.h>
 #include <rtabmap/core/Signature.h>
+#include <rtabmap/utilite/UMutex.h>
+#include <list>
 
 namespace rtabmap {
 
@@ -55,6 +57,23 @@ protected:
 	virtual bool canUseGuessImpl() const {return true;}
 	virtual float getMinGeometryCorrespondencesRatioImpl() const {return _correspondenceRatio;}
 
+private:
+	// A prepared target is shared between concurrent registrations, it is
+	// deleted when it is released and not in the cache anymore
+	class PreparedTarget;
+	const PreparedTarget * acquirePreparedTarget(
+			const LaserScan & scan,
+			bool normalsInScan,
+			bool pointToPlane) const;
+	void releasePreparedTarget(const PreparedTarget * target) const;
+	void clearPreparedTargets();
+
+	// PM::ICP keeps state during a registration, each concurrent
+	// registration takes its own instance from the pool
+	void * acquireLibpointmatcherICP() const;
+	void releaseLibpointmatcherICP(void * icp) const;
+	void clearLibpointmatcherICPs();
+
 private:
 	float _maxTranslation;
 	float _maxRotation;
@@ -75,7 +94,12 @@ private:
 	int _libpointmatcherKnn;
 	float _libpointmatcherEpsilon;
 	float _libpointmatcherOutlierRatio;
-	void * _libpointmatcherICP;
+	mutable std::list<void*> _libpointmatcherICPs;
+	mutable UMutex _libpointmatcherICPsMutex;
+
+	// last target scans filtered and indexed, most recent first
+	mutable std::list<PreparedTarget*> _preparedTargets;
+	mutable UMutex _preparedTargetsMutex;
 };
 
 }
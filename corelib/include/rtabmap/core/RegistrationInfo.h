@@ -43,7 +43,9 @@ public:
 		icpInliersRatio(0),
 		icpTranslation(0.0f),
 		icpRotation(0.0f),
-		icpStructuralComplexity(0.0f)
+		icpStructuralComplexity(0.0f),
+		icpIterations(0),
+		icpRMS(0.0f)
 
 	{
 	}
@@ -62,6 +64,8 @@ public:
 		output.icpTranslation = icpTranslation;
 		output.icpRotation = icpRotation;
 		output.icpStructuralComplexity = icpStructuralComplexity;
+		output.icpIterations = icpIterations;
+		output.icpRMS = icpRMS;
 		return output;
 	}
 
@@ -83,6 +87,8 @@ public:
 	float icpTranslation;
 	float icpRotation;
 	float icpStructuralComplexity;
+	int icpIterations; // iterations done before convergence
+	float icpRMS;      // root mean square distance of the correspondences at the last iteration
 };
 
 }
@@ -32,10 +32,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/Registration.h>
 #include <rtabmap/core/Signature.h>
+#include <rtabmap/utilite/UMutex.h>
+#include <list>
 
 namespace rtabmap {
 
 class Feature2D;
+class VisualMatcher;
 
 // Visual registration
 class RTABMAP_EXP RegistrationVis : public Registration
@@ -64,6 +67,29 @@ protected:
 	virtual bool canUseGuessImpl() const {return _correspondencesApproach != 0 || _guessWinSize>0;}
 	virtual int getMinVisualCorrespondencesImpl() const {return _minInliers;}
 
+private:
+	// Matching buffers are kept between calls (one matcher per concurrent call)
+	VisualMatcher * acquireMatcher() const;
+	void releaseMatcher(VisualMatcher * matcher) const;
+
+	// Gives the matcher back to the pool when going out of scope
+	class MatcherGuard
+	{
+	public:
+		MatcherGuard(const RegistrationVis & registration) :
+			registration_(registration),
+			matcher_(registration.acquireMatcher())
+		{}
+		~MatcherGuard() {registration_.releaseMatcher(matcher_);}
+		VisualMatcher * operator->() const {return matcher_;}
+	private:
+		MatcherGuard(const MatcherGuard &);
+		MatcherGuard & operator=(const MatcherGuard &);
+		const RegistrationVis & registration_;
+		VisualMatcher * matcher_;
+	};
+	friend class MatcherGuard;
+
 private:
 	int _minInliers;
 	float _inlierDistance;
@@ -90,6 +116,9 @@ private:
 
 	ParametersMap _featureParameters;
 	ParametersMap _bundleParameters;
+
+	mutable std::list<VisualMatcher*> _matchers;
+	mutable UMutex _matchersMutex;
 };
 
 }
@@ -49,6 +49,8 @@ class Memory;
 class BayesFilter;
 class Signature;
 class Optimizer;
+class PathGraph;
+class PosesIndex;
 
 class RTABMAP_EXP Rtabmap
 {
@@ -160,7 +162,7 @@ public:
 			std::map<int, Transform> & poses,
 			std::multimap<int, Link> & constraints,
 			bool optimized,
-			bool global) const;
+			bool global);
 	void getGraph(std::map<int, Transform> & poses,
 			std::multimap<int, Link> & constraints,
 			bool optimized,
@@ -201,7 +203,8 @@ private:
 			cv::Mat & covariance,
 			std::multimap<int, Link> * constraints = 0,
 			double * error = 0,
-			int * iterationsDone = 0) const;
+			int * iterationsDone = 0);
+	// not const: the incremental graph of the optimizer is updated
 	std::map<int, Transform> optimizeGraph(
 			int fromId,
 			const std::set<int> & ids,
@@ -210,9 +213,13 @@ private:
 			cv::Mat & covariance,
 			std::multimap<int, Link> * constraints = 0,
 			double * error = 0,
-			int * iterationsDone = 0) const;
+			int * iterationsDone = 0,
+			bool incremental = false);
 	void updateGoalIndex();
 	bool computePath(int targetNode, std::map<int, Transform> nodes, const std::multimap<int, rtabmap::Link> & constraints);
+	void updatePathGraph();
+	void clearPathGraph();
+	const PosesIndex & getOptimizedPosesIndex() const;
 
 	void setupLogFiles(bool overwrite = false);
 	void flushStatisticLogs();
@@ -266,6 +273,7 @@ private:
 	int _pathStuckIterations;
 	float _pathLinearVelocity;
 	float _pathAngularVelocity;
+	int _pathReferenceNodes;
 	bool _savedLocalizationIgnored;
 	bool _loopCovLimited;
 	bool _loopGPS;
@@ -296,6 +304,7 @@ private:
 	std::string _wDir;
 
 	std::map<int, Transform> _optimizedPoses;
+	PosesIndex * _optimizedPosesIndex; // updated with _optimizedPoses
 	std::multimap<int, Link> _constraints;
 	Transform _mapCorrection;
 	Transform _mapCorrectionBackup; // used in localization mode when odom is lost
@@ -315,6 +324,8 @@ private:
 	Transform _pathTransformToGoal;
 	int _pathStuckCount;
 	float _pathStuckDistance;
+	PathGraph * _pathGraph; // whole graph kept between global plannings
+	std::set<int> _pathGraphStaleIds; // nodes to reload in _pathGraph
 
 };
 
@@ -226,13 +226,14 @@ public:
 	const cv::Mat & userDataRaw() const {return _userDataRaw;}
 	const cv::Mat & userDataCompressed() const {return _userDataCompressed;}
 
-	// detect automatically if raw or compressed. If raw, the data will be compressed.
+	// detect automatically if raw or compressed. If raw, the data will be compressed with codec (see compressData()).
 	void setOccupancyGrid(
 			const cv::Mat & ground,
 			const cv::Mat & obstacles,
 			const cv::Mat & empty,
 			float cellSize,
-			const cv::Point3f & viewPoint);
+			const cv::Point3f & viewPoint,
+			int codec = 0);
 	// remove raw occupancy grids
 	void clearOccupancyGridRaw() {_groundCellsRaw = cv::Mat(); _obstacleCellsRaw = cv::Mat();}
 	const cv::Mat & gridGroundCellsRaw() const {return _groundCellsRaw;}
@@ -48,7 +48,7 @@ public:
 	Transform(float r11, float r12, float r13, float o14,
 		      float r21, float r22, float r23, float o24,
 			  float r31, float r32, float r33, float o34);
-	// should have 3 rows, 4 cols and type CV_32FC1
+	// should have 3 rows, 4 cols and type CV_32FC1 or CV_64FC1 (data is copied)
 	Transform(const cv::Mat & transformationMatrix);
 	// x,y,z, roll,pitch,yaw
 	Transform(float x, float y, float z, float roll, float pitch, float yaw);
@@ -84,9 +84,10 @@ public:
 	void setNull();
 	void setIdentity();
 
-	const cv::Mat & dataMatrix() const {return data_;}
-	const float * data() const {return (const float *)data_.data;}
-	float * data() {return (float *)data_.data;}
+	// 3x4 CV_32FC1 header on the internal data (not copied, valid while this transform exists)
+	cv::Mat dataMatrix() const {return cv::Mat(3, 4, CV_32FC1, (void*)data_);}
+	const float * data() const {return data_;}
+	float * data() {return data_;}
 	int size() const {return 12;}
 
 	float & x() {return data()[3];}
@@ -159,7 +160,9 @@ public:
 				double * stampDiff), "Use Transform::getTransform() instead to get always accurate transforms.");
 
 private:
-	cv::Mat data_;
+	// 3x4 row-major matrix stored inline: copying a
+	// transform doesn't require any heap allocation.
+	float data_[12];
 };
 
 RTABMAP_EXP std::ostream& operator<<(std::ostream& os, const Transform& s);
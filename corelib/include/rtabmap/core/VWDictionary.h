@@ -42,6 +42,7 @@ namespace rtabmap
 class DBDriver;
 class VisualWord;
 class FlannIndex;
+class FlannIndexBuildTask;
 
 class RTABMAP_EXP VWDictionary
 {
@@ -52,6 +53,7 @@ public:
 		kNNFlannLSH,
 		kNNBruteForce,
 		kNNBruteForceGPU,
+		kNNBruteForceHamming,
 		kNNUndef};
 	static const int ID_START;
 	static const int ID_INVALID;
@@ -106,6 +108,13 @@ public:
 protected:
 	int getNextId();
 
+private:
+	void storeDescriptor(VisualWord * vw);
+	void releaseDescriptor(VisualWord * vw, bool keepDescriptor = true);
+	void startFlannRebuild();
+	void finishFlannRebuild();
+	void cancelFlannRebuild();
+
 protected:
 	std::map<int, VisualWord *> _visualWords; //<id,VisualWord*>
 	int _totalActiveReferences; // keep track of all references for updating the common signature
@@ -114,6 +123,7 @@ private:
 	bool _incrementalDictionary;
 	bool _incrementalFlann;
 	float _rebalancingFactor;
+	bool _rebalancingAsync;
 	float _nndrRatio;
 	std::string _dictionaryPath; // a pre-computed dictionary (.txt or .db)
 	std::string _newDictionaryPath; // a pre-computed dictionary (.txt or .db)
@@ -128,6 +138,20 @@ private:
 	std::map<int, VisualWord*> _unusedWords; //<id,VisualWord*>, note that these words stay in _visualWords
 	std::set<int> _notIndexedWords; // Words that are not indexed in the dictionary
 	std::set<int> _removedIndexedWords; // Words not anymore in the dictionary but still indexed in the dictionary
+
+	// Incremental FLANN index rebalancing
+	unsigned int _flannSizeAtBuild;
+	unsigned int _flannPointsAdded; // since last build
+	FlannIndexBuildTask * _flannBuildTask; // next index being built in background
+	std::set<int> _flannBuildAddedWords; // Words added to current index since the background build started
+	std::set<int> _flannBuildRemovedWords; // Words removed from current index since the background build started
+
+	// Descriptors of the words, stored in blocks of rows that are never
+	// reallocated so that words (and FLANN) can refer to them directly.
+	std::vector<cv::Mat> _descriptorBlocks;
+	std::vector<int> _freeDescriptorIndices; // rows of removed words, reused first
+	std::vector<int> _pendingFreeDescriptorIndices; // rows of removed words, may still be referenced by the search index until next update()
+	int _descriptorsCount; // rows used in the blocks (including free ones)
 };
 
 } // namespace rtabmap
@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_VISUALMATCHER_H_
+#define CORELIB_SRC_VISUALMATCHER_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * Matching engine used by RegistrationVis. Descriptors are matched
+ * directly from their cv::Mat rows (binary with Hamming distance, float
+ * with squared L2 distance) and 2D points are indexed in a uniform grid
+ * for radius searches. Buffers are kept between calls, so the same
+ * object should be reused from frame to frame. Not thread-safe.
+ */
+class RTABMAP_EXP VisualMatcher
+{
+public:
+	VisualMatcher();
+
+	/**
+	 * Match all "to" descriptors with all "from" descriptors. The ids returned
+	 * are the same than adding "from" descriptors and then "to" descriptors
+	 * to an incremental VWDictionary with exact nearest neighbor search
+	 * (VWDictionary::kNNBruteForce): a descriptor takes the id of its nearest
+	 * word if it passes the NNDR test (nearest <= nndr * second nearest),
+	 * otherwise a new id is created.
+	 * @param fromIds ids of the "from" descriptors. If empty, ids are generated from 1.
+	 * @param newWordsComparedTogether see Parameters::kKpNewWordsComparedTogether().
+	 */
+	void matchGlobal(
+			const cv::Mat & descriptorsFrom,
+			const std::vector<int> & fromIds,
+			const cv::Mat & descriptorsTo,
+			float nndr,
+			bool newWordsComparedTogether,
+			std::vector<int> & fromWordIds,
+			std::vector<int> & toWordIds);
+
+	/**
+	 * Index 2D points in a uniform grid for radiusSearch().
+	 */
+	void setPoints(const std::vector<cv::Point2f> & points, float radius);
+
+	/**
+	 * @return indices of the points (see setPoints()) strictly inside the radius
+	 * around pt, sorted by distance. The reference is valid until the next call.
+	 */
+	const std::vector<int> & radiusSearch(const cv::Point2f & pt);
+
+	/**
+	 * Find the nearest neighbor of the query descriptor among the
+	 * candidate rows of descriptors, with the ratio test
+	 * nearest < nndr * second nearest.
+	 * @return the position in candidates of the match, -1 if the ratio test failed.
+	 */
+	int matchNNDR(
+			const cv::Mat & query,
+			const cv::Mat & descriptors,
+			const std::vector<int> & candidates,
+			float nndr) const;
+
+private:
+	// Like VWDictionary::addNewWords(), words are
+	// the rows wordRows_ of "words" with ids wordIds_.
+	void addNewWords(
+			const cv::Mat & words,
+			const cv::Mat & query,
+			float nndr,
+			bool newWordsComparedTogether,
+			int & lastId,
+			std::vector<int> & queryIds);
+
+private:
+	// global matching
+	std::vector<int> wordRows_;
+	std::vector<int> wordIds_;
+	std::vector<int> newRows_;
+	std::vector<int> knnIndices_;
+	std::vector<float> knnDists_;
+
+	// 2D grid
+	std::vector<cv::Point2f> points_;
+	float radius_;
+	float cellSize_;
+	float minX_;
+	float minY_;
+	int gridCols_;
+	int gridRows_;
+	std::vector<int> pointCells_;
+	std::vector<int> cellStart_; // points of cell i are cellPoints_[cellStart_[i]] to cellPoints_[cellStart_[i+1]-1]
+	std::vector<int> cellPoints_;
+	std::vector<std::pair<float, int> > neighbors_;
+	std::vector<int> neighborIndices_;
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_VISUALMATCHER_H_ */
@@ -52,9 +52,15 @@ public:
 	bool isSaved() const {return _saved;}
 	void setSaved(bool saved) {_saved = saved;}
 
+	// Index of the descriptor in the storage of the dictionary (-1 if
+	// the word owns its descriptor), see VWDictionary.
+	int getDescriptorIndex() const {return _descriptorIndex;}
+	void setDescriptor(const cv::Mat & descriptor, int descriptorIndex = -1) {_descriptor = descriptor; _descriptorIndex = descriptorIndex;}
+
 private:
 	int _id;
 	cv::Mat _descriptor;
+	int _descriptorIndex;
 	bool _saved; // If it's saved to db
 
 	int _totalReferences;
@@ -32,6 +32,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/Optimizer.h>
 
+namespace gtsam {
+class ISAM2;
+}
+
 namespace rtabmap {
 
 class RTABMAP_EXP OptimizerGTSAM : public Optimizer
@@ -42,15 +46,22 @@ public:
 public:
 	OptimizerGTSAM(const ParametersMap & parameters = ParametersMap()) :
 		Optimizer(parameters),
-		optimizer_(Parameters::defaultGTSAMOptimizer())
+		optimizer_(Parameters::defaultGTSAMOptimizer()),
+		relinearizeThreshold_(Parameters::defaultGTSAMIncRelinearizeThreshold()),
+		relinearizeSkip_(Parameters::defaultGTSAMIncRelinearizeSkip()),
+		isam_(0),
+		isamRootId_(0),
+		isamGpsPriorOnly_(false),
+		isamSwitchCounter_(0)
 	{
 		parseParameters(parameters);
 	}
-	virtual ~OptimizerGTSAM() {}
+	virtual ~OptimizerGTSAM();
 
 	virtual Type type() const {return kTypeGTSAM;}
 
 	virtual void parseParameters(const ParametersMap & parameters);
+	virtual void resetIncremental();
 
 	virtual std::map<int, Transform> optimize(
 			int rootId,
@@ -61,8 +72,35 @@ public:
 			double * finalError = 0,
 			int * iterationsDone = 0);
 
+protected:
+	// iSAM2: only new factors are added, only affected variables are relinearized
+	virtual std::map<int, Transform> updateIncremental(
+			int rootId,
+			const std::map<int, Transform> & poses,
+			const std::multimap<int, Link> & constraints,
+			const std::map<int, Transform> & newPoses,
+			const std::multimap<int, Link> & newConstraints,
+			const std::set<int> & removedPoses,
+			const std::multimap<int, Link> & removedConstraints,
+			cv::Mat & outputCovariance,
+			double * finalError,
+			int * iterationsDone);
+
 private:
 	int optimizer_;
+	double relinearizeThreshold_;
+	int relinearizeSkip_;
+
+	gtsam::ISAM2 * isam_;
+	int isamRootId_;
+	bool isamGpsPriorOnly_;
+	int isamSwitchCounter_;
+	std::map<int, bool> isamLandmarksWithRotation_;
+	// iSAM2 factor index of each link (key=from), to remove the factor with the link
+	std::multimap<int, std::pair<Link, size_t> > isamLinkFactors_;
+	// iSAM2 prior factor index of the removed poses, their variables are kept
+	// anchored in iSAM2 until they come back in the graph or iSAM2 is restarted
+	std::map<int, size_t> isamAnchors_;
 };
 
 } /* namespace rtabmap */
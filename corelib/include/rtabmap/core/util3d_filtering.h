@@ -85,6 +85,19 @@ pcl::PointCloud<pcl::PointXYZINormal>::Ptr RTABMAP_EXP downsample(
 		const pcl::PointCloud<pcl::PointXYZINormal>::Ptr & cloud,
 		int step);
 
+/**
+ * Voxel filtering directly on the scan: all channels of the points
+ * in the same voxel are averaged (rgb per color, normals are
+ * normalized). Voxels are hashed with 21 bits per axis, so the scan
+ * extent should be less than 2^21 voxels on each axis (e.g., 20 km
+ * with 1 cm voxels), otherwise distant voxels would be merged.
+ * Voxels are returned in order of their first point,
+ * non-finite points are ignored. Max points is adjusted to the
+ * reduction ratio.
+ */
+LaserScan RTABMAP_EXP voxelize(
+		const LaserScan & scan,
+		float voxelSize);
 pcl::PointCloud<pcl::PointXYZ>::Ptr RTABMAP_EXP voxelize(
 		const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud,
 		const pcl::IndicesPtr & indices,
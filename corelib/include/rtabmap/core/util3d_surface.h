@@ -261,8 +261,15 @@ bool RTABMAP_EXP multiBandTexturing(
 		const std::map<int, std::map<int, cv::Vec4d> > & gains = std::map<int, std::map<int, cv::Vec4d> >(),       // optional output of util3d::mergeTextures()
 		const std::map<int, std::map<int, cv::Mat> > & blendingGains = std::map<int, std::map<int, cv::Mat> >());  // optional output of util3d::mergeTextures()
 
-cv::Mat RTABMAP_EXP computeNormals(
-		const cv::Mat & laserScan,
+/**
+ * Compute normals of the scan (k nearest neighbors, all neighbors in radius
+ * or k nearest neighbors in radius), oriented toward the sensor. Neighbors are
+ * searched in a voxel hash in parallel, without conversion to PCL. Points for
+ * which a normal cannot be estimated are removed. Existing normals are
+ * overwritten.
+ */
+LaserScan RTABMAP_EXP computeNormals(
+		const LaserScan & laserScan,
 		int searchK,
 		float searchRadius);
 pcl::PointCloud<pcl::Normal>::Ptr RTABMAP_EXP computeNormals(
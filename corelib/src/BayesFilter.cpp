@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Parameters.h"
 #include <iostream>
 #include <set>
+#include <algorithm>
 #if __cplusplus >= 201103L
 #include <unordered_map>
 #include <unordered_set>
@@ -138,10 +139,49 @@ std::string BayesFilter::getPredictionLCStr() const
 void BayesFilter::reset()
 {
 	_posterior.clear();
-	_prediction = cv::Mat();
+	_prediction.clear();
 	_neighborsIndex.clear();
 }
 
+static bool predictionRowLess(const std::pair<int, float> & a, const std::pair<int, float> & b)
+{
+	return a.first < b.first;
+}
+
+float & BayesFilter::PredictionColumn::at(int row)
+{
+	std::pair<int, float> value(row, 0.0f);
+	std::vector<std::pair<int, float> >::iterator iter = std::lower_bound(values.begin(), values.end(), value, predictionRowLess);
+	if(iter == values.end() || iter->first != row)
+	{
+		iter = values.insert(iter, value);
+	}
+	return iter->second;
+}
+
+static cv::Mat predictionToMat(const std::vector<BayesFilter::PredictionColumn> & prediction)
+{
+	int size = (int)prediction.size();
+	cv::Mat mat = cv::Mat::zeros(size, size, CV_32FC1);
+	float * dataPtr = (float*)mat.data;
+	for(int i=0; i<size; ++i)
+	{
+		const BayesFilter::PredictionColumn & column = prediction[i];
+		if(column.defaultValue != 0.0f)
+		{
+			for(int j=column.defaultStart; j<size; ++j)
+			{
+				dataPtr[i + j*size] = column.defaultValue;
+			}
+		}
+		for(unsigned int j=0; j<column.values.size(); ++j)
+		{
+			dataPtr[i + column.values[j].first*size] = column.values[j].second;
+		}
+	}
+	return mat;
+}
+
 const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory, const std::map<int, float> & likelihood)
 {
 	ULOGGER_DEBUG("");
@@ -167,34 +207,58 @@ const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory
 	UTimer timer;
 	timer.start();
 
-	cv::Mat prior;
-	cv::Mat posterior;
+	std::vector<float> prior;
+	std::vector<float> posterior;
 
 	float sum = 0;
 	int j=0;
 	// Recursive Bayes estimation...
 	// STEP 1 - Prediction : Prior*lastPosterior
-	_prediction = this->generatePrediction(memory, uKeys(likelihood));
+	std::vector<PredictionColumn> prediction;
+	this->generatePrediction(memory, uKeys(likelihood), prediction);
+	_prediction.swap(prediction);
 
-	UDEBUG("STEP1-generate prior=%fs, rows=%d, cols=%d", timer.ticks(), _prediction.rows, _prediction.cols);
-	//std::cout << "Prediction=" << _prediction << std::endl;
+	UDEBUG("STEP1-generate prior=%fs, size=%d", timer.ticks(), (int)_prediction.size());
 
 	// Adjust the last posterior if some images were
 	// reactivated or removed from the working memory
-	posterior = cv::Mat(likelihood.size(), 1, CV_32FC1);
+	posterior.resize(likelihood.size());
 	this->updatePosterior(memory, uKeys(likelihood));
 	j=0;
 	for(std::map<int, float>::const_iterator i=_posterior.begin(); i!= _posterior.end(); ++i)
 	{
-		((float*)posterior.data)[j++] = (*i).second;
+		posterior[j++] = (*i).second;
 	}
-	ULOGGER_DEBUG("STEP1-update posterior=%fs, posterior=%d, _posterior size=%d", posterior.rows, _posterior.size());
-	//std::cout << "LastPosterior=" << posterior << std::endl;
+	ULOGGER_DEBUG("STEP1-update posterior=%fs, posterior=%d, _posterior size=%d", timer.ticks(), (int)posterior.size(), (int)_posterior.size());
 
 	// Multiply prediction matrix with the last posterior
 	// (m,m) X (m,1) = (m,1)
-	prior = _prediction * posterior;
-	ULOGGER_DEBUG("STEP1-matrix mult time=%fs", timer.ticks());
+	UASSERT(_prediction.size() == posterior.size());
+	prior.resize(posterior.size(), 0.0f);
+	float defaultSums[2] = {0.0f, 0.0f}; // for rows >= 0 and rows >= 1
+	int explicitValues = 0;
+	for(unsigned int i=0; i<_prediction.size(); ++i)
+	{
+		float p = posterior[i];
+		if(p != 0.0f)
+		{
+			const PredictionColumn & column = _prediction[i];
+			UASSERT(column.defaultStart == 0 || column.defaultStart == 1);
+			defaultSums[column.defaultStart] += column.defaultValue * p;
+			for(unsigned int k=0; k<column.values.size(); ++k)
+			{
+				int row = column.values[k].first;
+				float defaultValue = row >= column.defaultStart?column.defaultValue:0.0f;
+				prior[row] += (column.values[k].second - defaultValue) * p;
+			}
+			explicitValues += (int)column.values.size();
+		}
+	}
+	for(unsigned int i=0; i<prior.size(); ++i)
+	{
+		prior[i] += i==0?defaultSums[0]:defaultSums[0]+defaultSums[1];
+	}
+	ULOGGER_DEBUG("STEP1-matrix mult time=%fs (values=%d)", timer.ticks(), explicitValues);
 	//std::cout << "ResultingPrior=" << prior << std::endl;
 
 	ULOGGER_DEBUG("STEP1-matrix mult time=%fs", timer.ticks());
@@ -208,7 +272,7 @@ const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory
 		std::map<int, float>::iterator p =_posterior.find((*i).first);
 		if(p!= _posterior.end())
 		{
-			(*p).second = (*i).second * ((float*)prior.data)[j++];
+			(*p).second = (*i).second * prior[j++];
 			sum+=(*p).second;
 		}
 		else
@@ -234,8 +298,7 @@ const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory
 	return _posterior;
 }
 
-float addNeighborProb(cv::Mat & prediction,
-			unsigned int col,
+float addNeighborProb(BayesFilter::PredictionColumn & column,
 			const std::map<int, int> & neighbors,
 			const std::vector<double> & predictionLC,
 #if __cplusplus >= 201103L
@@ -245,11 +308,9 @@ float addNeighborProb(cv::Mat & prediction,
 #endif
 			)
 {
-	UASSERT(col < (unsigned int)prediction.cols &&
-			col < (unsigned int)prediction.rows);
-
 	float sum=0.0f;
-	float * dataPtr = (float*)prediction.data;
+	column.values.clear();
+	column.values.reserve(neighbors.size());
 	for(std::map<int, int>::const_iterator iter=neighbors.begin(); iter!=neighbors.end(); ++iter)
 	{
 		if(iter->first>=0)
@@ -262,26 +323,37 @@ float addNeighborProb(cv::Mat & prediction,
 			if(jter != idToIndex.end())
 			{
 				UASSERT((iter->second+1) < (int)predictionLC.size());
-				sum += dataPtr[col + jter->second*prediction.cols] = predictionLC[iter->second+1];
+				column.values.push_back(std::make_pair(jter->second, (float)predictionLC[iter->second+1]));
+				sum += column.values.back().second;
 			}
 		}
 	}
+	std::sort(column.values.begin(), column.values.end(), predictionRowLess);
 	return sum;
 }
 
 
 cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector<int> & ids)
+{
+	std::vector<PredictionColumn> prediction;
+	this->generatePrediction(memory, ids, prediction);
+	return predictionToMat(prediction);
+}
+
+void BayesFilter::generatePrediction(const Memory * memory, const std::vector<int> & ids, std::vector<PredictionColumn> & prediction)
 {
 	std::vector<int> oldIds = uKeys(_posterior);
 	if(oldIds.size() == ids.size() &&
 		memcmp(oldIds.data(), ids.data(), oldIds.size()*sizeof(int)) == 0)
 	{
-		return _prediction;
+		prediction = _prediction;
+		return;
 	}
 
 	if(!_fullPredictionUpdate && !_prediction.empty())
 	{
-		return updatePrediction(_prediction, memory, oldIds, ids);
+		updatePrediction(_prediction, memory, oldIds, ids, prediction);
+		return;
 	}
 	UDEBUG("");
 
@@ -309,9 +381,8 @@ cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector
 	}
 
 
-	//int rows = prediction.rows;
-	cv::Mat prediction = cv::Mat::zeros(ids.size(), ids.size(), CV_32FC1);
-	int cols = prediction.cols;
+	prediction = std::vector<PredictionColumn>(ids.size());
+	int cols = (int)prediction.size();
 
 	// Each prior is a column vector
 	UDEBUG("_predictionLC.size()=%d",_predictionLC.size());
@@ -367,28 +438,27 @@ cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector
 
 					float sum = 0.0f; // sum values added
 					int index = idToIndexMap.at(*iter);
-					sum += addNeighborProb(prediction, index, neighbors, _predictionLC, idToIndexMap);
+					sum += addNeighborProb(prediction[index], neighbors, _predictionLC, idToIndexMap);
 					idsDone.insert(*iter);
-					this->normalize(prediction, index, sum, ids[0]<0);
+					this->normalize(prediction[index], index, cols, sum, ids[0]<0);
 				}
 			}
 			else
 			{
 				// Set the virtual place prior
+				PredictionColumn & column = prediction[i];
+				column.values.clear();
 				if(_virtualPlacePrior > 0)
 				{
 					if(cols>1) // The first must be the virtual place
 					{
-						((float*)prediction.data)[i] = _virtualPlacePrior;
-						float val = (1.0-_virtualPlacePrior)/(cols-1);
-						for(int j=1; j<cols; j++)
-						{
-							((float*)prediction.data)[i + j*cols] = val;
-						}
+						column.at(0) = _virtualPlacePrior;
+						column.defaultValue = (1.0-_virtualPlacePrior)/(cols-1);
+						column.defaultStart = 1;
 					}
 					else if(cols>0)
 					{
-						((float*)prediction.data)[i] = 1;
+						column.at(0) = 1;
 					}
 				}
 				else
@@ -397,15 +467,12 @@ cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector
 					// when _virtualPlacePrior=0, set all priors to the same value
 					if(cols>1)
 					{
-						float val = 1.0/cols;
-						for(int j=0; j<cols; j++)
-						{
-							((float*)prediction.data)[i + j*cols] = val;
-						}
+						column.defaultValue = 1.0/cols;
+						column.defaultStart = 0;
 					}
 					else if(cols>0)
 					{
-						((float*)prediction.data)[i] = 1;
+						column.at(0) = 1;
 					}
 				}
 			}
@@ -413,20 +480,19 @@ cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector
 	}
 
 	ULOGGER_DEBUG("time = %fs", timerGlobal.ticks());
-
-	return prediction;
 }
 
-void BayesFilter::normalize(cv::Mat & prediction, unsigned int index, float addedProbabilitiesSum, bool virtualPlaceUsed) const
+void BayesFilter::normalize(PredictionColumn & column, unsigned int index, unsigned int size, float addedProbabilitiesSum, bool virtualPlaceUsed) const
 {
-	UASSERT(index < (unsigned int)prediction.rows && index < (unsigned int)prediction.cols);
+	UASSERT(index < size);
 
-	int cols = prediction.cols;
+	int cols = size;
+	int start = virtualPlaceUsed?1:0;
 	// ADD values of not found neighbors to loop closure
 	if(addedProbabilitiesSum < _totalPredictionLCValues-_predictionLC[0])
 	{
 		float delta = _totalPredictionLCValues-_predictionLC[0]-addedProbabilitiesSum;
-		((float*)prediction.data)[index + index*cols] += delta;
+		column.at(index) += delta;
 		addedProbabilitiesSum+=delta;
 	}
 
@@ -437,57 +503,69 @@ void BayesFilter::normalize(cv::Mat & prediction, unsigned int index, float adde
 	}
 
 	// Set all loop events to small values according to the model
+	column.defaultValue = 0.0f;
+	column.defaultStart = start;
 	if(allOtherPlacesValue > 0 && cols>1)
 	{
 		float value = allOtherPlacesValue / float(cols - 1);
-		for(int j=virtualPlaceUsed?1:0; j<cols; ++j)
+		int defaultRows = cols - start;
+		for(unsigned int j=0; j<column.values.size(); ++j)
 		{
-			if(((float*)prediction.data)[index + j*cols] == 0)
+			if(column.values[j].first >= start)
 			{
-				((float*)prediction.data)[index + j*cols] = value;
-				addedProbabilitiesSum += ((float*)prediction.data)[index + j*cols];
+				if(column.values[j].second == 0)
+				{
+					column.values[j].second = value;
+					addedProbabilitiesSum += value;
+				}
+				--defaultRows;
 			}
 		}
+		column.defaultValue = value;
+		addedProbabilitiesSum += value * float(defaultRows);
 	}
 
-	//normalize this row
+	//normalize this column
 	float maxNorm = 1 - (virtualPlaceUsed?_predictionLC[0]:0); // 1 - virtual place probability
 	if(addedProbabilitiesSum<maxNorm-0.0001 || addedProbabilitiesSum>maxNorm+0.0001)
 	{
-		for(int j=virtualPlaceUsed?1:0; j<cols; ++j)
+		for(unsigned int j=0; j<column.values.size(); ++j)
 		{
-			((float*)prediction.data)[index + j*cols] *= maxNorm / addedProbabilitiesSum;
-			if(((float*)prediction.data)[index + j*cols] < _predictionEpsilon)
+			if(column.values[j].first >= start)
 			{
-				((float*)prediction.data)[index + j*cols] = 0.0f;
+				column.values[j].second *= maxNorm / addedProbabilitiesSum;
+				if(column.values[j].second < _predictionEpsilon)
+				{
+					column.values[j].second = 0.0f;
+				}
 			}
 		}
+		column.defaultValue *= maxNorm / addedProbabilitiesSum;
+		if(column.defaultValue < _predictionEpsilon)
+		{
+			column.defaultValue = 0.0f;
+		}
 		addedProbabilitiesSum = maxNorm;
 	}
 
 	// ADD virtual place prob
 	if(virtualPlaceUsed)
 	{
-		((float*)prediction.data)[index] = _predictionLC[0];
-		addedProbabilitiesSum += ((float*)prediction.data)[index];
+		column.at(0) = _predictionLC[0];
+		addedProbabilitiesSum += _predictionLC[0];
 	}
 
-	//debug
-	//for(int j=0; j<cols; ++j)
-	//{
-	//	ULOGGER_DEBUG("test col=%d = %f", i, prediction.data.fl[i + j*cols]);
-	//}
-
 	if(addedProbabilitiesSum<0.99 || addedProbabilitiesSum > 1.01)
 	{
 		UWARN("Prediction is not normalized sum=%f", addedProbabilitiesSum);
 	}
 }
 
-cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
+void BayesFilter::updatePrediction(const std::vector<PredictionColumn> & oldPrediction,
 		const Memory * memory,
 		const std::vector<int> & oldIds,
-		const std::vector<int> & newIds)
+		const std::vector<int> & newIds,
+		std::vector<PredictionColumn> & prediction)
 {
 	UTimer timer;
 	UDEBUG("");
@@ -495,10 +573,9 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 	UASSERT(memory &&
 		oldIds.size() &&
 		newIds.size() &&
-		oldIds.size() == (unsigned int)oldPrediction.cols &&
-		oldIds.size() == (unsigned int)oldPrediction.rows);
+		oldIds.size() == oldPrediction.size());
 
-	cv::Mat prediction = cv::Mat::zeros(newIds.size(), newIds.size(), CV_32FC1);
+	prediction = std::vector<PredictionColumn>(newIds.size());
 	UDEBUG("time creating prediction = %fs", timer.restart());
 
 	// Create id to index maps
@@ -543,7 +620,7 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 		newIds.size() > oldIds.size() &&
 		memcmp(oldIds.data(), newIds.data(), oldIds.size()*sizeof(int)) == 0)
 	{
-		oldPrediction.copyTo(cv::Mat(prediction, cv::Range(0, oldPrediction.rows), cv::Range(0, oldPrediction.cols)));
+		std::copy(oldPrediction.begin(), oldPrediction.end(), prediction.begin());
 		oldAllCopied = true;
 		UDEBUG("Copied all old prediction: = %fs", timer.ticks());
 	}
@@ -557,7 +634,7 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 		{
 			if(removedIds.find(oldIds[i]) != removedIds.end())
 			{
-				unsigned int cols = oldPrediction.cols;
+				unsigned int cols = oldPrediction.size();
 				int count = 0;
 				for(unsigned int j=0; j<cols; ++j)
 				{
@@ -590,8 +667,8 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 			const std::map<int, int> & neighbors = _neighborsIndex.at(newIds[i]);
 			//std::map<int, int> neighbors = memory->getNeighborsId(newIds[i], _predictionLC.size()-1, 0, false, false, true, true);
 
-			float sum = addNeighborProb(prediction, i, neighbors, _predictionLC, newIdToIndexMap);
-			this->normalize(prediction, i, sum, newIds[0]<0);
+			float sum = addNeighborProb(prediction[i], neighbors, _predictionLC, newIdToIndexMap);
+			this->normalize(prediction[i], i, prediction.size(), sum, newIds[0]<0);
 
 			++added;
 			int count = 0;
@@ -627,10 +704,10 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 			//std::map<int, int> neighbors = memory->getNeighborsId(id, _predictionLC.size()-1, 0, false, false, true, true);
 			e1+=t1.ticks();
 
-			float sum = addNeighborProb(prediction, index, neighbors, _predictionLC, newIdToIndexMap);
+			float sum = addNeighborProb(prediction[index], neighbors, _predictionLC, newIdToIndexMap);
 			e3+=t1.ticks();
 
-			this->normalize(prediction, index, sum, newIds[0]<0);
+			this->normalize(prediction[index], index, prediction.size(), sum, newIds[0]<0);
 			++modified;
 			e4+=t1.ticks();
 		}
@@ -640,29 +717,23 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 	int copied = 0;
 	if(!oldAllCopied)
 	{
-		//UDEBUG("oldIds.size()=%d, oldPrediction.cols=%d, oldPrediction.rows=%d", oldIds.size(), oldPrediction.cols, oldPrediction.rows);
-		//UDEBUG("newIdToIndexMap.size()=%d, prediction.cols=%d, prediction.rows=%d", newIdToIndexMap.size(), prediction.cols, prediction.rows);
 		// copy not changed probabilities
 		for(unsigned int i=0; i<oldIds.size(); ++i)
 		{
 			if(oldIds[i]>0 && removedIds.find(oldIds[i]) == removedIds.end() && idsToUpdate.find(oldIds[i]) == idsToUpdate.end())
 			{
-				for(int j=0; j<oldPrediction.cols; ++j)
+				const PredictionColumn & oldColumn = oldPrediction[i];
+				PredictionColumn & column = prediction[newIdToIndexMap.at(oldIds[i])];
+				column.defaultValue = oldColumn.defaultValue;
+				column.defaultStart = oldColumn.defaultStart;
+				column.values.reserve(oldColumn.values.size());
+				// ids are sorted, so rows stay sorted
+				for(unsigned int k=0; k<oldColumn.values.size(); ++k)
 				{
+					int j = oldColumn.values[k].first;
 					if(oldIds[j]>0 && removedIds.find(oldIds[j]) == removedIds.end())
 					{
-						//UDEBUG("i=%d, j=%d", i, j);
-						//UDEBUG("oldIds[i]=%d, oldIds[j]=%d", oldIds[i], oldIds[j]);
-						//UDEBUG("newIdToIndexMap.at(oldIds[i])=%d", newIdToIndexMap.at(oldIds[i]));
-						//UDEBUG("newIdToIndexMap.at(oldIds[j])=%d", newIdToIndexMap.at(oldIds[j]));
-						float v = ((const float *)oldPrediction.data)[i + j*oldPrediction.cols];
-						int ii = newIdToIndexMap.at(oldIds[i]);
-						int jj = newIdToIndexMap.at(oldIds[j]);
-						((float *)prediction.data)[ii + jj*prediction.cols] = v;
-						//if(ii != jj)
-						//{
-						//	((float *)prediction.data)[jj + ii*prediction.cols] = v;
-						//}
+						column.values.push_back(std::make_pair(newIdToIndexMap.at(oldIds[j]), oldColumn.values[k].second));
 					}
 				}
 				++copied;
@@ -674,25 +745,26 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 	//update virtual place
 	if(newIds[0] < 0)
 	{
-		if(prediction.cols>1) // The first must be the virtual place
+		PredictionColumn & column = prediction[0];
+		column.values.clear();
+		if(prediction.size()>1) // The first must be the virtual place
 		{
-			((float*)prediction.data)[0] = _virtualPlacePrior;
-			float val = (1.0-_virtualPlacePrior)/(prediction.cols-1);
-			for(int j=1; j<prediction.cols; j++)
+			column.at(0) = _virtualPlacePrior;
+			column.defaultValue = (1.0-_virtualPlacePrior)/(prediction.size()-1);
+			column.defaultStart = 1;
+			for(unsigned int j=1; j<prediction.size(); j++)
 			{
-				((float*)prediction.data)[j*prediction.cols] = val;
-				((float*)prediction.data)[j] = _predictionLC[0];
+				prediction[j].at(0) = _predictionLC[0];
 			}
 		}
-		else if(prediction.cols>0)
+		else if(prediction.size()>0)
 		{
-			((float*)prediction.data)[0] = 1;
+			column.at(0) = 1;
 		}
 	}
 	UDEBUG("time updating virtual place = %fs", timer.restart());
 
 	UDEBUG("Modified=%d, Added=%d, Copied=%d", modified, added, copied);
-	return prediction;
 }
 
 void BayesFilter::updatePosterior(const Memory * memory, const std::vector<int> & likelihoodIds)
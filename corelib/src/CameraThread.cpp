@@ -40,12 +40,189 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/stitching/detail/exposure_compensate.hpp>
 #include <rtabmap/utilite/UTimer.h>
 #include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UThread.h>
+#include <rtabmap/utilite/UMutex.h>
+#include <rtabmap/utilite/USemaphore.h>
 
 #include <pcl/io/io.h>
 
+#include <list>
+#include <map>
+#include <vector>
+
 namespace rtabmap
 {
 
+class CameraPipelineWorker : public UThread
+{
+public:
+	CameraPipelineWorker(CameraPipeline * pipeline) : pipeline_(pipeline) {}
+	virtual ~CameraPipelineWorker() {join(true);}
+private:
+	virtual void mainLoopBegin() {ULogger::registerCurrentThread("CameraWorker");}
+	virtual void mainLoop();
+	virtual void mainLoopKill();
+private:
+	CameraPipeline * pipeline_;
+};
+
+/**
+ * Stages of the pipeline: capture (CameraThread), post-processing
+ * (workers, any order) and publishing (capture order, IMU filtering).
+ * The stages are connected by queues, the number of frames in the
+ * pipeline is bounded.
+ */
+class CameraPipeline
+{
+public:
+	CameraPipeline(const CameraThread * thread, int workers, int queueSize) :
+		thread_(thread),
+		maxFrames_(workers+queueSize),
+		slots_(workers+queueSize),
+		captured_(0),
+		published_(0),
+		killed_(false)
+	{
+		UASSERT(workers > 0 && queueSize >= 0);
+		for(int i=0; i<workers; ++i)
+		{
+			workers_.push_back(new CameraPipelineWorker(this));
+			workers_.back()->start();
+		}
+	}
+	~CameraPipeline()
+	{
+		kill();
+		for(unsigned int i=0; i<workers_.size(); ++i)
+		{
+			delete workers_[i];
+		}
+	}
+
+	// Capture stage, waits if the pipeline is full. Return false if the pipeline is killed.
+	bool add(const SensorData & data, const CameraInfo & info, double captureStamp)
+	{
+		slots_.acquire();
+		mutex_.lock();
+		if(killed_)
+		{
+			mutex_.unlock();
+			return false;
+		}
+		Frame frame;
+		frame.id = captured_++;
+		frame.data = data;
+		frame.info = info;
+		frame.info.pipelineInputQueueSize = (int)input_.size();
+		frame.captureStamp = captureStamp;
+		frame.stamp = UTimer::now();
+		input_.push_back(frame);
+		mutex_.unlock();
+		inputAdded_.release();
+		return true;
+	}
+
+	// Wait until all captured frames are published
+	void waitAll()
+	{
+		slots_.acquire(maxFrames_);
+		slots_.release(maxFrames_);
+	}
+
+	void kill()
+	{
+		mutex_.lock();
+		killed_ = true;
+		mutex_.unlock();
+		for(unsigned int i=0; i<workers_.size(); ++i)
+		{
+			workers_[i]->kill();
+		}
+		// unblock capture
+		slots_.release(maxFrames_);
+	}
+
+	// Post-processing stage
+	void process()
+	{
+		inputAdded_.acquire();
+		Frame frame;
+		mutex_.lock();
+		if(killed_ || input_.empty())
+		{
+			mutex_.unlock();
+			return;
+		}
+		frame = input_.front();
+		input_.pop_front();
+		mutex_.unlock();
+
+		frame.info.timePipelineWait = UTimer::now() - frame.stamp;
+		thread_->preprocess(&frame.data, &frame.info);
+		frame.stamp = UTimer::now();
+
+		// publish stage
+		mutex_.lock();
+		output_.insert(std::make_pair(frame.id, frame));
+		std::map<int, Frame>::iterator iter;
+		int publishedFrames = 0;
+		while(!killed_ && (iter = output_.find(published_)) != output_.end())
+		{
+			Frame & next = iter->second;
+			thread_->filterIMU(next.data);
+			double now = UTimer::now();
+			next.info.timePipelineReorder = now - next.stamp;
+			next.info.pipelineOutputQueueSize = (int)output_.size()-1;
+			next.info.timeTotal = now - next.captureStamp;
+			thread_->publish(next.data, next.info);
+			output_.erase(iter);
+			++published_;
+			++publishedFrames;
+		}
+		mutex_.unlock();
+		if(publishedFrames)
+		{
+			slots_.release(publishedFrames);
+		}
+	}
+
+	void releaseWorker()
+	{
+		inputAdded_.release();
+	}
+
+private:
+	struct Frame
+	{
+		int id;
+		SensorData data;
+		CameraInfo info;
+		double captureStamp;
+		double stamp; // when entering the current queue
+	};
+	const CameraThread * thread_;
+	std::vector<CameraPipelineWorker*> workers_;
+	int maxFrames_;
+	UMutex mutex_;
+	USemaphore slots_;
+	USemaphore inputAdded_;
+	std::list<Frame> input_;
+	std::map<int, Frame> output_;
+	int captured_;
+	int published_;
+	bool killed_;
+};
+
+void CameraPipelineWorker::mainLoop()
+{
+	pipeline_->process();
+}
+
+void CameraPipelineWorker::mainLoopKill()
+{
+	pipeline_->releaseWorker();
+}
+
 // ownership transferred
 CameraThread::CameraThread(Camera * camera, const ParametersMap & parameters) :
 		_camera(camera),
@@ -67,7 +244,10 @@ CameraThread::CameraThread(Camera * camera, const ParametersMap & parameters) :
 		_bilateralFiltering(false),
 		_bilateralSigmaS(10),
 		_bilateralSigmaR(0.1),
-		_imuFilter(0)
+		_imuFilter(0),
+		_pipelineWorkers(0),
+		_pipelineQueueSize(1),
+		_pipeline(0)
 {
 	UASSERT(_camera != 0);
 }
@@ -76,6 +256,7 @@ CameraThread::~CameraThread()
 {
 	UDEBUG("");
 	join(true);
+	delete _pipeline;
 	delete _camera;
 	delete _distortionModel;
 	delete _stereoDense;
@@ -130,29 +311,61 @@ void CameraThread::disableIMUFiltering()
 	_imuFilter = 0;
 }
 
+void CameraThread::setPipelineWorkers(int workers, int queueSize)
+{
+	UASSERT(workers >= 0 && queueSize >= 0);
+	if(this->isRunning())
+	{
+		UERROR("Pipeline cannot be changed while the camera thread is running.");
+		return;
+	}
+	_pipelineWorkers = workers;
+	_pipelineQueueSize = queueSize;
+}
+
 void CameraThread::mainLoopBegin()
 {
 	ULogger::registerCurrentThread("Camera");
 	_camera->resetTimer();
+	// the pipeline of the previous run (killed) is deleted here, not in
+	// mainLoopEnd(), as mainLoopKill() may still be using it
+	delete _pipeline;
+	_pipeline = 0;
+	if(_pipelineWorkers > 0)
+	{
+		_pipeline = new CameraPipeline(this, _pipelineWorkers, _pipelineQueueSize);
+	}
 }
 
 void CameraThread::mainLoop()
 {
 	UTimer totalTime;
+	double captureStamp = UTimer::now();
 	UDEBUG("");
 	CameraInfo info;
 	SensorData data = _camera->takeImage(&info);
 
 	if(!data.imageRaw().empty() || (dynamic_cast<DBReader*>(_camera) != 0 && data.id()>0)) // intermediate nodes could not have image set
 	{
-		postUpdate(&data, &info);
-
 		info.cameraName = _camera->getSerial();
-		info.timeTotal = totalTime.ticks();
-		this->post(new CameraEvent(data, info));
+		if(_pipeline)
+		{
+			_pipeline->add(data, info, captureStamp);
+		}
+		else
+		{
+			postUpdate(&data, &info);
+
+			info.timeTotal = totalTime.ticks();
+			this->post(new CameraEvent(data, info));
+		}
 	}
 	else if(!this->isKilled())
 	{
+		if(_pipeline)
+		{
+			_pipeline->waitAll();
+		}
 		UWARN("no more images...");
 		this->kill();
 		this->post(new CameraEvent());
@@ -162,6 +375,10 @@ void CameraThread::mainLoop()
 void CameraThread::mainLoopKill()
 {
 	UDEBUG("");
+	if(_pipeline)
+	{
+		_pipeline->kill();
+	}
 	if(dynamic_cast<CameraFreenect2*>(_camera) != 0)
 	{
 		int i=20;
@@ -186,6 +403,18 @@ void CameraThread::mainLoopKill()
 }
 
 void CameraThread::postUpdate(SensorData * dataPtr, CameraInfo * info) const
+{
+	UASSERT(dataPtr!=0);
+	preprocess(dataPtr, info);
+	filterIMU(*dataPtr);
+}
+
+void CameraThread::publish(const SensorData & data, const CameraInfo & info) const
+{
+	this->post(new CameraEvent(data, info));
+}
+
+void CameraThread::preprocess(SensorData * dataPtr, CameraInfo * info) const
 {
 	UASSERT(dataPtr!=0);
 	SensorData & data = *dataPtr;
@@ -401,8 +630,10 @@ void CameraThread::postUpdate(SensorData * dataPtr, CameraInfo * info) const
 		// filter the scan after registration
 		data.setLaserScan(util3d::commonFiltering(data.laserScanRaw(), _scanDownsampleStep, _scanRangeMin, _scanRangeMax, _scanVoxelSize, _scanNormalsK, _scanNormalsRadius, _scanForceGroundNormalsUp));
 	}
+}
 
-	// IMU filtering
+void CameraThread::filterIMU(SensorData & data) const
+{
 	if(_imuFilter && !data.imu().empty())
 	{
 		if(data.imu().angularVelocity()[0] == 0 &&
@@ -26,30 +26,40 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "rtabmap/core/Compression.h"
+#include "rtabmap/core/Version.h"
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <opencv2/opencv.hpp>
 
 #include <zlib.h>
+#ifdef RTABMAP_ZSTD
+#include <zstd.h>
+#endif
+#include "rtflann/ext/lz4.h"
+#include "rtflann/ext/lz4hc.h"
 
 namespace rtabmap {
 
 // format : ".png" ".jpg" "" (empty is general)
-CompressionThread::CompressionThread(const cv::Mat & mat, const std::string & format) :
+CompressionThread::CompressionThread(const cv::Mat & mat, const std::string & format, int codec, int level) :
 	uncompressedData_(mat),
 	format_(format),
+	codec_(codec),
+	level_(level),
 	image_(!format.empty()),
 	compressMode_(true)
 {
-	UASSERT(format.empty() || format.compare(".png") == 0 || format.compare(".jpg") == 0);
+	UASSERT(format.empty() || format.compare(".png") == 0 || format.compare(".jpg") == 0 || format.compare(".rvl") == 0);
 }
 // assume image
 CompressionThread::CompressionThread(const cv::Mat & bytes, bool isImage) :
 	compressedData_(bytes),
+	codec_(0),
+	level_(-1),
 	image_(isImage),
 	compressMode_(false)
 {}
-void CompressionThread::mainLoop()
+void CompressionThread::run()
 {
 	try
 	{
@@ -59,11 +69,11 @@ void CompressionThread::mainLoop()
 			{
 				if(image_)
 				{
-					compressedData_ = compressImage2(uncompressedData_, format_);
+					compressedData_ = compressImage2(uncompressedData_, format_, level_);
 				}
 				else
 				{
-					compressedData_ = compressData2(uncompressedData_);
+					compressedData_ = compressData2(uncompressedData_, codec_, level_);
 				}
 			}
 		}
@@ -93,33 +103,261 @@ void CompressionThread::mainLoop()
 			uncompressedData_ = cv::Mat();
 		}
 	}
-	this->kill();
 }
 
-// ".png" or ".jpg"
-std::vector<unsigned char> compressImage(const cv::Mat & image, const std::string & format)
+// RVL lossless depth codec (A. D. Wilson, "Fast Lossless Depth Image Compression", ISS 2017).
+// Runs of zeros (no depth) and runs of valid values are stored as variable-length
+// nibbles (3 bits + continuation bit), valid values as zigzag-encoded differences
+// with the previous valid value. 16UC1 values are encoded directly and 32FC1 values
+// through their bit pattern (positive floats keep their order as integers, so close
+// depths give small differences), so both are restored exactly.
+static const char kRvlMagic[4] = {'R', 'V', 'L', '1'};
+static const int kRvlHeaderSize = 4+3*sizeof(int); // magic, rows, cols, type
+
+class RvlWriter
+{
+public:
+	RvlWriter(std::vector<unsigned int> & words) : words_(words), word_(0), nibbles_(0) {}
+	void write(unsigned int value)
+	{
+		do
+		{
+			unsigned int nibble = value & 0x7;
+			value >>= 3;
+			if(value)
+			{
+				nibble |= 0x8;
+			}
+			word_ = (word_ << 4) | nibble;
+			if(++nibbles_ == 8)
+			{
+				words_.push_back(word_);
+				word_ = 0;
+				nibbles_ = 0;
+			}
+		}
+		while(value);
+	}
+	void flush()
+	{
+		if(nibbles_)
+		{
+			words_.push_back(word_ << (4*(8-nibbles_)));
+			word_ = 0;
+			nibbles_ = 0;
+		}
+	}
+private:
+	std::vector<unsigned int> & words_;
+	unsigned int word_;
+	int nibbles_;
+};
+
+class RvlReader
+{
+public:
+	RvlReader(const unsigned char * data, unsigned long size) : data_(data), end_(data+size), word_(0), nibbles_(0), error_(false) {}
+	unsigned int read()
+	{
+		unsigned int value = 0;
+		int shift = 0;
+		unsigned int nibble = 0;
+		do
+		{
+			if(nibbles_ == 0)
+			{
+				if(data_+sizeof(unsigned int) > end_ || shift > 30)
+				{
+					error_ = true;
+					return 0;
+				}
+				memcpy(&word_, data_, sizeof(unsigned int));
+				data_ += sizeof(unsigned int);
+				nibbles_ = 8;
+			}
+			nibble = word_ >> 28;
+			word_ <<= 4;
+			--nibbles_;
+			value |= (nibble & 0x7) << shift;
+			shift += 3;
+		}
+		while(nibble & 0x8);
+		return value;
+	}
+	bool error() const {return error_;}
+private:
+	const unsigned char * data_;
+	const unsigned char * end_;
+	unsigned int word_;
+	int nibbles_;
+	bool error_;
+};
+
+template<typename T>
+static void rvlEncode(const T * input, int size, RvlWriter & writer)
+{
+	const T * end = input + size;
+	unsigned int previous = 0;
+	while(input != end)
+	{
+		int zeros = 0;
+		while(input != end && *input == 0)
+		{
+			++input;
+			++zeros;
+		}
+		writer.write(zeros);
+		int nonzeros = 0;
+		for(const T * p = input; p != end && *p != 0; ++p)
+		{
+			++nonzeros;
+		}
+		writer.write(nonzeros);
+		for(int i=0; i<nonzeros; ++i)
+		{
+			unsigned int current = *input++;
+			int delta = (int)(current - previous); // modulo 2^32
+			writer.write(((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31)); // zigzag
+			previous = current;
+		}
+	}
+	writer.flush();
+}
+
+template<typename T>
+static bool rvlDecode(RvlReader & reader, T * output, int size)
+{
+	T * end = output + size;
+	unsigned int previous = 0;
+	while(output != end)
+	{
+		unsigned int zeros = reader.read();
+		if(reader.error() || zeros > (unsigned int)(end - output))
+		{
+			return false;
+		}
+		memset(output, 0, zeros*sizeof(T));
+		output += zeros;
+		unsigned int nonzeros = reader.read();
+		if(reader.error() || nonzeros > (unsigned int)(end - output))
+		{
+			return false;
+		}
+		for(unsigned int i=0; i<nonzeros; ++i)
+		{
+			unsigned int zigzag = reader.read();
+			int delta = (int)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+			previous += (unsigned int)delta;
+			*output++ = (T)previous;
+		}
+		if(reader.error())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static std::vector<unsigned char> compressDepthRvl(const cv::Mat & depth)
+{
+	UASSERT(depth.type() == CV_16UC1 || depth.type() == CV_32FC1);
+	cv::Mat continuousDepth = depth.isContinuous()?depth:depth.clone();
+	std::vector<unsigned int> words;
+	// ~12 bits per valid value for smooth depth, reserve for the worst case is not useful
+	words.reserve(continuousDepth.total()/2+1);
+	RvlWriter writer(words);
+	if(depth.type() == CV_16UC1)
+	{
+		rvlEncode((const unsigned short *)continuousDepth.data, (int)continuousDepth.total(), writer);
+	}
+	else
+	{
+		rvlEncode((const unsigned int *)continuousDepth.data, (int)continuousDepth.total(), writer);
+	}
+	std::vector<unsigned char> bytes(kRvlHeaderSize + words.size()*sizeof(unsigned int));
+	memcpy(bytes.data(), kRvlMagic, 4);
+	int info[3] = {depth.rows, depth.cols, depth.type()};
+	memcpy(bytes.data()+4, info, sizeof(info));
+	if(words.size())
+	{
+		memcpy(bytes.data()+kRvlHeaderSize, words.data(), words.size()*sizeof(unsigned int));
+	}
+	return bytes;
+}
+
+static bool isRvl(const unsigned char * bytes, unsigned long size)
+{
+	return bytes && size >= (unsigned long)kRvlHeaderSize && memcmp(bytes, kRvlMagic, 4) == 0;
+}
+
+static cv::Mat uncompressDepthRvl(const unsigned char * bytes, unsigned long size)
+{
+	int info[3];
+	memcpy(info, bytes+4, sizeof(info));
+	if(info[0] <= 0 || info[1] <= 0 || (info[2] != CV_16UC1 && info[2] != CV_32FC1))
+	{
+		UERROR("Wrong RVL depth header (%dx%d, type=%d)", info[0], info[1], info[2]);
+		return cv::Mat();
+	}
+	cv::Mat depth(info[0], info[1], info[2]);
+	RvlReader reader(bytes+kRvlHeaderSize, size-kRvlHeaderSize);
+	bool ok;
+	if(depth.type() == CV_16UC1)
+	{
+		ok = rvlDecode(reader, (unsigned short *)depth.data, (int)depth.total());
+	}
+	else
+	{
+		ok = rvlDecode(reader, (unsigned int *)depth.data, (int)depth.total());
+	}
+	if(!ok)
+	{
+		UERROR("RVL depth data (%dx%d, type=%d) is truncated or corrupted!", info[0], info[1], info[2]);
+		return cv::Mat();
+	}
+	return depth;
+}
+
+// ".png", ".jpg" or ".rvl"
+std::vector<unsigned char> compressImage(const cv::Mat & image, const std::string & format, int pngLevel)
 {
 	std::vector<unsigned char> bytes;
 	if(!image.empty())
 	{
+		if(format.compare(".rvl") == 0)
+		{
+			if(image.type() == CV_16UC1 || image.type() == CV_32FC1)
+			{
+				return compressDepthRvl(image);
+			}
+			UWARN("\".rvl\" format is only for depth images (16UC1 or 32FC1), "
+				  "using \".png\" for this image (type=%d).", image.type());
+			return compressImage(image, ".png", pngLevel);
+		}
+		std::vector<int> params;
+		if(pngLevel >= 0 && format.compare(".png") == 0)
+		{
+			params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+			params.push_back(pngLevel>9?9:pngLevel);
+		}
 		if(image.type() == CV_32FC1)
 		{
 			//save in 8bits-4channel
 			cv::Mat bgra(image.size(), CV_8UC4, image.data);
-			cv::imencode(format, bgra, bytes);
+			cv::imencode(format, bgra, bytes, params);
 		}
 		else
 		{
-			cv::imencode(format, image, bytes);
+			cv::imencode(format, image, bytes, params);
 		}
 	}
 	return bytes;
 }
 
-// ".png" or ".jpg"
-cv::Mat compressImage2(const cv::Mat & image, const std::string & format)
+// ".png", ".jpg" or ".rvl"
+cv::Mat compressImage2(const cv::Mat & image, const std::string & format, int pngLevel)
 {
-	std::vector<unsigned char> bytes = compressImage(image, format);
+	std::vector<unsigned char> bytes = compressImage(image, format, pngLevel);
 	if(bytes.size())
 	{
 		return cv::Mat(1, (int)bytes.size(), CV_8UC1, bytes.data()).clone();
@@ -130,7 +368,12 @@ cv::Mat compressImage2(const cv::Mat & image, const std::string & format)
 cv::Mat uncompressImage(const cv::Mat & bytes)
 {
 	 cv::Mat image;
-	if(!bytes.empty())
+	if(!bytes.empty() && isRvl(bytes.data, bytes.total()*bytes.elemSize()))
+	{
+		UASSERT(bytes.isContinuous());
+		image = uncompressDepthRvl(bytes.data, bytes.total()*bytes.elemSize());
+	}
+	else if(!bytes.empty())
 	{
 #if CV_MAJOR_VERSION>2 || (CV_MAJOR_VERSION >=2 && CV_MINOR_VERSION >=4)
 		image = cv::imdecode(bytes, cv::IMREAD_UNCHANGED);
@@ -152,7 +395,11 @@ cv::Mat uncompressImage(const cv::Mat & bytes)
 cv::Mat uncompressImage(const std::vector<unsigned char> & bytes)
 {
 	 cv::Mat image;
-	if(bytes.size())
+	if(isRvl(bytes.data(), bytes.size()))
+	{
+		image = uncompressDepthRvl(bytes.data(), bytes.size());
+	}
+	else if(bytes.size())
 	{
 #if CV_MAJOR_VERSION>2 || (CV_MAJOR_VERSION >=2 && CV_MINOR_VERSION >=4)
 		image = cv::imdecode(bytes, cv::IMREAD_UNCHANGED);
@@ -167,24 +414,92 @@ cv::Mat uncompressImage(const std::vector<unsigned char> & bytes)
 	return image;
 }
 
-std::vector<unsigned char> compressData(const cv::Mat & data)
+// Magic numbers appended after the matrix info of data compressed with zstd or
+// lz4. Data compressed with zlib (always the case before other codecs) ends with
+// the matrix type, which cannot be equal to these numbers.
+static const int kZstdMagic = 0x5A535444; // "ZSTD"
+static const int kLz4Magic = 0x4C5A3420; // "LZ4 "
+
+static int validCodec(int codec, unsigned long sourceLen)
 {
-	std::vector<unsigned char> bytes;
-	if(!data.empty())
+#ifndef RTABMAP_ZSTD
+	if(codec == 1)
 	{
-		uLong sourceLen = uLong(data.total())*uLong(data.elemSize());
-		uLong destLen = compressBound(sourceLen);
-		bytes.resize(destLen);
-		int errCode = compress(
-						(Bytef *)bytes.data(),
-						&destLen,
-						(const Bytef *)data.data,
-						sourceLen);
+		UWARN("RTAB-Map is not built with zstd, using zlib to compress data.");
+		return 0;
+	}
+#endif
+	if(codec == 2 && sourceLen > (unsigned long)LZ4_MAX_INPUT_SIZE)
+	{
+		UWARN("Data too large for lz4 (%ld bytes), using zlib to compress data.", sourceLen);
+		return 0;
+	}
+	return codec == 1 || codec == 2?codec:0;
+}
 
-		bytes.resize(destLen+3*sizeof(int));
-		*((int*)&bytes[destLen]) = data.rows;
-		*((int*)&bytes[destLen+sizeof(int)]) = data.cols;
-		*((int*)&bytes[destLen+2*sizeof(int)]) = data.type();
+static unsigned long compressDataBound(unsigned long sourceLen, int codec)
+{
+#ifdef RTABMAP_ZSTD
+	if(codec == 1)
+	{
+		return ZSTD_compressBound(sourceLen)+4*sizeof(int);
+	}
+#endif
+	if(codec == 2)
+	{
+		return LZ4_compressBound((int)sourceLen)+4*sizeof(int);
+	}
+	return compressBound(uLong(sourceLen))+3*sizeof(int);
+}
+
+// Compress data in dst (of size compressDataBound()), followed by the matrix info. Returns the size used, 0 on error.
+static unsigned long compressDataTo(const cv::Mat & data, int codec, int level, unsigned char * dst, unsigned long dstLen)
+{
+	UASSERT(data.isContinuous());
+	unsigned long sourceLen = (unsigned long)data.total()*(unsigned long)data.elemSize();
+	unsigned long destLen = 0;
+	int trailer = 3;
+#ifdef RTABMAP_ZSTD
+	if(codec == 1)
+	{
+		trailer = 4;
+		size_t result = ZSTD_compress(
+				dst,
+				dstLen-trailer*sizeof(int),
+				data.data,
+				sourceLen,
+				level<0?1:level); // 1 is the fastest level
+		if(ZSTD_isError(result))
+		{
+			UERROR("ZSTD error: %s", ZSTD_getErrorName(result));
+			return 0;
+		}
+		destLen = result;
+	}
+#endif
+	if(codec == 2)
+	{
+		trailer = 4;
+		int result = level<=0?
+				LZ4_compress_default((const char*)data.data, (char*)dst, (int)sourceLen, int(dstLen-trailer*sizeof(int))):
+				LZ4_compress_HC((const char*)data.data, (char*)dst, (int)sourceLen, int(dstLen-trailer*sizeof(int)), level);
+		if(result <= 0)
+		{
+			UERROR("LZ4 compression failed (%d bytes)", (int)sourceLen);
+			return 0;
+		}
+		destLen = result;
+	}
+	else if(codec == 0)
+	{
+		uLong zlibDestLen = uLong(dstLen-trailer*sizeof(int));
+		int errCode = compress2(
+						(Bytef *)dst,
+						&zlibDestLen,
+						(const Bytef *)data.data,
+						uLong(sourceLen),
+						level<0?Z_DEFAULT_COMPRESSION:level);
+		destLen = zlibDestLen;
 
 		if(errCode == Z_MEM_ERROR)
 		{
@@ -195,35 +510,40 @@ std::vector<unsigned char> compressData(const cv::Mat & data)
 			UERROR("Z_BUF_ERROR : The buffer dest was not large enough to hold the uncompressed data.");
 		}
 	}
+	int info[4] = {data.rows, data.cols, data.type(), codec==1?kZstdMagic:kLz4Magic};
+	memcpy(dst+destLen, info, trailer*sizeof(int));
+	return destLen+trailer*sizeof(int);
+}
+
+std::vector<unsigned char> compressData(const cv::Mat & data, int codec, int level)
+{
+	std::vector<unsigned char> bytes;
+	if(!data.empty())
+	{
+		cv::Mat continuousData = data.isContinuous()?data:data.clone();
+		unsigned long sourceLen = (unsigned long)data.total()*(unsigned long)data.elemSize();
+		codec = validCodec(codec, sourceLen);
+		bytes.resize(compressDataBound(sourceLen, codec));
+		bytes.resize(compressDataTo(continuousData, codec, level, bytes.data(), bytes.size()));
+	}
 	return bytes;
 }
 
-cv::Mat compressData2(const cv::Mat & data)
+cv::Mat compressData2(const cv::Mat & data, int codec, int level)
 {
 	cv::Mat bytes;
 	if(!data.empty())
 	{
-		uLong sourceLen = uLong(data.total())*uLong(data.elemSize());
-		uLong destLen = compressBound(sourceLen);
-		bytes = cv::Mat(1, destLen+3*sizeof(int), CV_8UC1);
-		int errCode = compress(
-						(Bytef *)bytes.data,
-						&destLen,
-						(const Bytef *)data.data,
-						sourceLen);
-		bytes = cv::Mat(bytes, cv::Rect(0,0, destLen+3*sizeof(int), 1));
-		*((int*)&bytes.data[destLen]) = data.rows;
-		*((int*)&bytes.data[destLen+sizeof(int)]) = data.cols;
-		*((int*)&bytes.data[destLen+2*sizeof(int)]) = data.type();
-
-		if(errCode == Z_MEM_ERROR)
+		cv::Mat continuousData = data.isContinuous()?data:data.clone();
+		unsigned long sourceLen = (unsigned long)data.total()*(unsigned long)data.elemSize();
+		codec = validCodec(codec, sourceLen);
+		bytes = cv::Mat(1, (int)compressDataBound(sourceLen, codec), CV_8UC1);
+		unsigned long size = compressDataTo(continuousData, codec, level, bytes.data, bytes.cols);
+		if(size == 0)
 		{
-			UERROR("Z_MEM_ERROR : Insufficient memory.");
-		}
-		else if(errCode == Z_BUF_ERROR)
-		{
-			UERROR("Z_BUF_ERROR : The buffer dest was not large enough to hold the uncompressed data.");
+			return cv::Mat();
 		}
+		bytes = cv::Mat(bytes, cv::Rect(0,0, size, 1));
 	}
 	return bytes;
 }
@@ -242,7 +562,55 @@ cv::Mat uncompressData(const std::vector<unsigned char> & bytes)
 cv::Mat uncompressData(const unsigned char * bytes, unsigned long size)
 {
 	cv::Mat data;
-	if(bytes && size>=3*sizeof(int))
+	int magic = 0;
+	if(bytes && size>=4*sizeof(int))
+	{
+		memcpy(&magic, &bytes[size-sizeof(int)], sizeof(int));
+	}
+	if(magic == kZstdMagic || magic == kLz4Magic)
+	{
+		//last 4 int elements are matrix size, type and codec magic number
+		int height = *((int*)&bytes[size-4*sizeof(int)]);
+		int width = *((int*)&bytes[size-3*sizeof(int)]);
+		int type = *((int*)&bytes[size-2*sizeof(int)]);
+		unsigned long compressedSize = size-4*sizeof(int);
+		if(magic == kLz4Magic)
+		{
+			data = cv::Mat(height, width, type);
+			int totalUncompressed = int(data.total()*data.elemSize());
+			int result = LZ4_decompress_safe((const char*)bytes, (char*)data.data, (int)compressedSize, totalUncompressed);
+			if(result != totalUncompressed)
+			{
+				UERROR("LZ4 data (%dx%d, type=%d) is truncated or corrupted (%d/%d bytes uncompressed)!", height, width, type, result, totalUncompressed);
+				data = cv::Mat();
+			}
+		}
+		else
+		{
+#ifdef RTABMAP_ZSTD
+			data = cv::Mat(height, width, type);
+			size_t totalUncompressed = data.total()*data.elemSize();
+			size_t result = ZSTD_decompress(
+					data.data,
+					totalUncompressed,
+					bytes,
+					compressedSize);
+			if(ZSTD_isError(result))
+			{
+				UERROR("ZSTD error: %s", ZSTD_getErrorName(result));
+				data = cv::Mat();
+			}
+			else if(result != totalUncompressed)
+			{
+				UERROR("ZSTD data (%dx%d, type=%d) is truncated (%ld/%ld bytes uncompressed)!", height, width, type, (long)result, (long)totalUncompressed);
+				data = cv::Mat();
+			}
+#else
+			UERROR("Data (%dx%d, type=%d) is compressed with zstd, but RTAB-Map is not built with zstd!", height, width, type);
+#endif
+		}
+	}
+	else if(bytes && size>=3*sizeof(int))
 	{
 		//last 3 int elements are matrix size and type
 		int height = *((int*)&bytes[size-3*sizeof(int)]);
@@ -250,7 +618,8 @@ cv::Mat uncompressData(const unsigned char * bytes, unsigned long size)
 		int type = *((int*)&bytes[size-1*sizeof(int)]);
 
 		data = cv::Mat(height, width, type);
-		uLongf totalUncompressed = uLongf(data.total())*uLongf(data.elemSize());
+		uLongf expectedSize = uLongf(data.total())*uLongf(data.elemSize());
+		uLongf totalUncompressed = expectedSize;
 
 		int errCode = uncompress(
 						(Bytef*)data.data,
@@ -270,6 +639,15 @@ cv::Mat uncompressData(const unsigned char * bytes, unsigned long size)
 		{
 			UERROR("Z_DATA_ERROR : The compressed data (referenced by source) was corrupted.");
 		}
+		else if(totalUncompressed != expectedSize)
+		{
+			UERROR("Compressed data (%dx%d, type=%d) is truncated (%ld/%ld bytes uncompressed)!", height, width, type, (long)totalUncompressed, (long)expectedSize);
+			errCode = Z_DATA_ERROR;
+		}
+		if(errCode != Z_OK)
+		{
+			data = cv::Mat();
+		}
 	}
 	return data;
 }
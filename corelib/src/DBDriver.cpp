@@ -38,6 +38,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace rtabmap {
 
+// Maximum number of signatures or words saved per transaction when emptying trashes
+const int DBDriver::kTrashSignaturesBatchSize = 50;
+const int DBDriver::kTrashVisualWordsBatchSize = 5000;
+
 DBDriver * DBDriver::create(const ParametersMap & parameters)
 {
 	// well, we only have Sqlite3 database type for now :P
@@ -320,63 +324,85 @@ void DBDriver::emptyTrashes(bool async)
 	UTimer totalTime;
 	totalTime.start();
 
-	std::map<int, Signature*> signatures;
-	std::map<int, VisualWord*> visualWords;
+	// Only what is in the trashes now is saved, items
+	// added while saving will be saved on next call.
+	int signaturesLeft = 0;
+	int visualWordsLeft = 0;
 	_trashesMutex.lock();
 	{
 		ULOGGER_DEBUG("signatures=%d, visualWords=%d", _trashSignatures.size(), _trashVisualWords.size());
-		signatures = _trashSignatures;
-		visualWords = _trashVisualWords;
-		_trashSignatures.clear();
-		_trashVisualWords.clear();
-
-		_dbSafeAccessMutex.lock();
+		signaturesLeft = (int)_trashSignatures.size();
+		visualWordsLeft = (int)_trashVisualWords.size();
 	}
 	_trashesMutex.unlock();
 
-	if(signatures.size() || visualWords.size())
+	// Save by batches, each one in its own transaction. The database
+	// is unlocked between batches, so other queries (like retrieval)
+	// don't have to wait that all the trashes are saved.
+	UTimer timer;
+	timer.start();
+	while(signaturesLeft > 0 || visualWordsLeft > 0)
 	{
-		this->beginTransaction();
-		UTimer timer;
-		timer.start();
-		if(signatures.size())
+		std::vector<Signature *> signatures;
+		std::vector<VisualWord *> visualWords;
+		_trashesMutex.lock();
 		{
-			if(this->isConnected())
+			while(signaturesLeft > 0 && (int)signatures.size() < kTrashSignaturesBatchSize && _trashSignatures.size())
 			{
-				//Only one query to the database
-				this->saveOrUpdate(uValues(signatures));
+				signatures.push_back(_trashSignatures.begin()->second);
+				_trashSignatures.erase(_trashSignatures.begin());
+				--signaturesLeft;
 			}
-
-			for(std::map<int, Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+			if(signatures.empty())
 			{
-				delete iter->second;
+				signaturesLeft = 0; // may have been taken back from the trash
+				while(visualWordsLeft > 0 && (int)visualWords.size() < kTrashVisualWordsBatchSize && _trashVisualWords.size())
+				{
+					visualWords.push_back(_trashVisualWords.begin()->second);
+					_trashVisualWords.erase(_trashVisualWords.begin());
+					--visualWordsLeft;
+				}
+				if(visualWords.empty())
+				{
+					visualWordsLeft = 0;
+				}
 			}
-			signatures.clear();
-			ULOGGER_DEBUG("Time emptying memory signatures trash = %f...", timer.ticks());
+
+			// Lock the database before unlocking the trashes, so an item
+			// not found in the trashes is found in the database.
+			_dbSafeAccessMutex.lock();
 		}
-		if(visualWords.size())
+		_trashesMutex.unlock();
+
+		if(this->isConnected() && (signatures.size() || visualWords.size()))
 		{
-			if(this->isConnected())
+			this->beginTransaction();
+			if(signatures.size())
 			{
-				//Only one query to the database
-				this->saveOrUpdate(uValues(visualWords));
+				this->saveOrUpdate(signatures);
 			}
-
-			for(std::map<int, VisualWord *>::iterator iter=visualWords.begin(); iter!=visualWords.end(); ++iter)
+			if(visualWords.size())
 			{
-				delete (*iter).second;
+				this->saveOrUpdate(visualWords);
 			}
-			visualWords.clear();
-			ULOGGER_DEBUG("Time emptying memory visualWords trash = %f...", timer.ticks());
+			this->commit();
 		}
 
-		this->commit();
+		_dbSafeAccessMutex.unlock();
+
+		for(unsigned int i=0; i<signatures.size(); ++i)
+		{
+			delete signatures[i];
+		}
+		for(unsigned int i=0; i<visualWords.size(); ++i)
+		{
+			delete visualWords[i];
+		}
+		ULOGGER_DEBUG("Time emptying batch of %d signatures and %d visualWords = %f...", (int)signatures.size(), (int)visualWords.size(), timer.ticks());
 	}
 
 	_emptyTrashesTime = totalTime.ticks();
 	ULOGGER_DEBUG("Total time emptying trashes = %fs...", _emptyTrashesTime);
-
-	_dbSafeAccessMutex.unlock();
 }
 
 void DBDriver::asyncSave(Signature * s)
@@ -865,12 +891,14 @@ void DBDriver::getAllNodeIds(std::set<int> & ids, bool ignoreChildren, bool igno
 
 void DBDriver::getAllLinks(std::multimap<int, Link> & links, bool ignoreNullLinks, bool withLandmarks) const
 {
+	// Keep the trash locked while querying the database, so
+	// that no signatures are saved between the two look ups.
+	_trashesMutex.lock();
 	_dbSafeAccessMutex.lock();
 	this->getAllLinksQuery(links, ignoreNullLinks, withLandmarks);
 	_dbSafeAccessMutex.unlock();
 
 	// look in the trash
-	_trashesMutex.lock();
 	if(_trashSignatures.size())
 	{
 		for(std::map<int, Signature*>::const_iterator iter=_trashSignatures.begin(); iter!=_trashSignatures.end(); ++iter)
@@ -49,7 +49,8 @@ DBDriverSqlite3::DBDriverSqlite3(const ParametersMap & parameters) :
 	_cacheSize(Parameters::defaultDbSqlite3CacheSize()),
 	_journalMode(Parameters::defaultDbSqlite3JournalMode()),
 	_synchronous(Parameters::defaultDbSqlite3Synchronous()),
-	_tempStore(Parameters::defaultDbSqlite3TempStore())
+	_tempStore(Parameters::defaultDbSqlite3TempStore()),
+	_mmapSize(Parameters::defaultDbSqlite3MmapSize())
 {
 	ULOGGER_DEBUG("treadSafe=%d", sqlite3_threadsafe());
 	this->parseParameters(parameters);
@@ -79,6 +80,19 @@ void DBDriverSqlite3::parseParameters(const ParametersMap & parameters)
 	{
 		this->setTempStore(std::atoi((*iter).second.c_str()));
 	}
+	if((iter=parameters.find(Parameters::kDbSqlite3MmapSize())) != parameters.end())
+	{
+		int mmapSize = uStr2Int((*iter).second);
+		if(mmapSize >= 0)
+		{
+			this->setMmapSize(mmapSize);
+		}
+		else
+		{
+			UERROR("Wrong %s value (%s), it should be positive (MB) or 0 to disable. Keeping %d MB.",
+					Parameters::kDbSqlite3MmapSize().c_str(), (*iter).second.c_str(), (int)_mmapSize);
+		}
+	}
 	if((iter=parameters.find(Parameters::kDbSqlite3InMemory())) != parameters.end())
 	{
 		this->setDbInMemory(uStr2Bool((*iter).second.c_str()));
@@ -187,6 +201,16 @@ void DBDriverSqlite3::setTempStore(int tempStore)
 	}
 }
 
+void DBDriverSqlite3::setMmapSize(unsigned int mmapSize)
+{
+	_mmapSize = mmapSize;
+	if(this->isConnected() && !this->isInMemory())
+	{
+		std::string query = uFormat("PRAGMA mmap_size = %lld;", (long long)_mmapSize * 1024ll * 1024ll);
+		this->executeNoResultQuery(query.c_str());
+	}
+}
+
 void DBDriverSqlite3::setDbInMemory(bool dbInMemory)
 {
 	UDEBUG("dbInMemory=%d", dbInMemory?1:0);
@@ -405,6 +429,7 @@ bool DBDriverSqlite3::connectDatabaseQuery(const std::string & url, bool overwri
 	this->setJournalMode(_journalMode); // this will call the SQL
 	this->setSynchronous(_synchronous); // this will call the SQL
 	this->setTempStore(_tempStore); // this will call the SQL
+	this->setMmapSize(_mmapSize); // this will call the SQL
 
 	return true;
 }
@@ -33,6 +33,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UEventsManager.h>
+#include <rtabmap/utilite/UThread.h>
+#include <rtabmap/utilite/UMutex.h>
+#include <rtabmap/utilite/USemaphore.h>
 
 #include "rtabmap/core/CameraEvent.h"
 #include "rtabmap/core/RtabmapEvent.h"
@@ -40,8 +43,153 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/Compression.h"
 
+#include <algorithm>
+
 namespace rtabmap {
 
+/**
+ * Load the next nodes of the database in batches and decompress
+ * their data in parallel, ahead of DBReader::getNextData().
+ */
+class DBReaderPrefetcher : public UThread
+{
+public:
+	DBReaderPrefetcher(DBDriver * driver, const std::vector<int> & ids, int window) :
+		driver_(driver),
+		ids_(ids),
+		next_(0),
+		window_(window),
+		batchSize_(window>1?window/2:1),
+		slots_(window)
+	{
+		UASSERT(driver_ != 0 && window_ > 0);
+	}
+	virtual ~DBReaderPrefetcher()
+	{
+		join(true);
+		for(std::list<Node>::iterator iter=nodes_.begin(); iter!=nodes_.end(); ++iter)
+		{
+			delete iter->signature;
+		}
+	}
+
+	// Return false if there are no more nodes. Signature ownership is transferred.
+	bool take(Signature *& signature, std::multimap<int, Link> & links)
+	{
+		ready_.acquire();
+		mutex_.lock();
+		if(nodes_.empty())
+		{
+			mutex_.unlock();
+			ready_.release(); // for next calls
+			return false;
+		}
+		signature = nodes_.front().signature;
+		links = nodes_.front().links;
+		nodes_.pop_front();
+		mutex_.unlock();
+		slots_.release();
+		return true;
+	}
+
+private:
+	virtual void mainLoopBegin()
+	{
+		ULogger::registerCurrentThread("DBReaderPrefetch");
+	}
+	virtual void mainLoop()
+	{
+		if(next_ >= ids_.size())
+		{
+			// no more nodes
+			ready_.release();
+			this->kill();
+			return;
+		}
+
+		int batch = std::min(batchSize_, (int)(ids_.size()-next_));
+		slots_.acquire(batch);
+		if(this->isKilled())
+		{
+			return;
+		}
+
+		UTimer timer;
+		std::list<int> ids(ids_.begin()+next_, ids_.begin()+next_+batch);
+		next_ += batch;
+		std::list<Signature *> signatures;
+		driver_->loadSignatures(ids, signatures);
+		driver_->loadNodeData(signatures);
+		if((int)signatures.size() < batch)
+		{
+			UWARN("%d nodes not found in the database, they are skipped.", batch-(int)signatures.size());
+			slots_.release(batch-(int)signatures.size());
+		}
+
+		std::vector<Node> nodes(signatures.size());
+		int i=0;
+		for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter, ++i)
+		{
+			nodes[i].signature = *iter;
+			driver_->loadLinks((*iter)->id(), nodes[i].links);
+		}
+		double loadTime = timer.ticks();
+
+#ifdef _OPENMP
+		#pragma omp parallel for
+#endif
+		for(int j=0; j<(int)nodes.size(); ++j)
+		{
+			nodes[j].signature->sensorData().uncompressData();
+		}
+		UDEBUG("Prefetched %d nodes (load=%fs, decompression=%fs)", (int)nodes.size(), loadTime, timer.ticks());
+
+		mutex_.lock();
+		nodes_.insert(nodes_.end(), nodes.begin(), nodes.end());
+		mutex_.unlock();
+		if(!nodes.empty())
+		{
+			ready_.release((int)nodes.size());
+		}
+	}
+	virtual void mainLoopKill()
+	{
+		// unblock both threads
+		slots_.release(window_);
+		ready_.release();
+	}
+
+private:
+	struct Node
+	{
+		Node() : signature(0) {}
+		Signature * signature;
+		std::multimap<int, Link> links;
+	};
+	DBDriver * driver_;
+	std::vector<int> ids_;
+	unsigned int next_;
+	int window_;
+	int batchSize_;
+	UMutex mutex_;
+	USemaphore slots_;
+	USemaphore ready_;
+	std::list<Node> nodes_;
+};
+
+static std::multimap<int, Link> linksOfType(const std::multimap<int, Link> & links, Link::Type type)
+{
+	std::multimap<int, Link> output;
+	for(std::multimap<int, Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		if(iter->second.type() == type)
+		{
+			output.insert(*iter);
+		}
+	}
+	return output;
+}
+
 DBReader::DBReader(const std::string & databasePath,
 				   float frameRate,
 				   bool odometryIgnored,
@@ -64,7 +212,9 @@ DBReader::DBReader(const std::string & databasePath,
 	_previousStamp(0),
 	_previousMapID(0),
 	_calibrated(false),
-	_framesPublished(0)
+	_framesPublished(0),
+	_readAheadWindow(0),
+	_prefetcher(0)
 {
 }
 
@@ -90,12 +240,15 @@ DBReader::DBReader(const std::list<std::string> & databasePaths,
 	_previousStamp(0),
 	_previousMapID(0),
 	_calibrated(false),
-	_framesPublished(0)
+	_framesPublished(0),
+	_readAheadWindow(0),
+	_prefetcher(0)
 {
 }
 
 DBReader::~DBReader()
 {
+	delete _prefetcher;
 	if(_dbDriver)
 	{
 		_dbDriver->closeConnection();
@@ -107,6 +260,9 @@ bool DBReader::init(
 		const std::string & calibrationFolder,
 		const std::string & cameraName)
 {
+	// stop prefetching before closing the database
+	delete _prefetcher;
+	_prefetcher = 0;
 	if(_dbDriver)
 	{
 		_dbDriver->closeConnection();
@@ -202,6 +358,17 @@ bool DBReader::init(
 		_calibrated = true; // database is empty, make sure calibration warning is not shown.
 	}
 
+	if(_readAheadWindow > 0 && _currentId != _ids.end())
+	{
+		std::vector<int> ids(_currentId, _ids.end());
+		if(_maxFrames > 0 && (int)ids.size() > _maxFrames)
+		{
+			ids.resize(_maxFrames);
+		}
+		_prefetcher = new DBReaderPrefetcher(_dbDriver, ids, _readAheadWindow);
+		_prefetcher->start();
+	}
+
 	_timer.start();
 
 	return true;
@@ -217,6 +384,12 @@ std::string DBReader::getSerial() const
 	return "DBReader";
 }
 
+void DBReader::setReadAhead(int window)
+{
+	UASSERT(window >= 0);
+	_readAheadWindow = window;
+}
+
 SensorData DBReader::captureImage(CameraInfo * info)
 {
 	if(_maxFrames>0 && ++_framesPublished > _maxFrames)
@@ -327,16 +500,34 @@ SensorData DBReader::getNextData(CameraInfo * info)
 	{
 		if(_currentId != _ids.end())
 		{
-			std::list<int> signIds;
-			signIds.push_back(*_currentId);
-			std::list<Signature *> signatures;
-			_dbDriver->loadSignatures(signIds, signatures);
-			if(signatures.empty())
+			Signature * s = 0;
+			std::multimap<int, Link> allLinks;
+			bool uncompressed = false;
+			if(_prefetcher)
 			{
-				return data;
+				if(!_prefetcher->take(s, allLinks))
+				{
+					return data;
+				}
+				// missing nodes are skipped by the prefetcher
+				_currentId = _ids.find(s->id());
+				UASSERT(_currentId != _ids.end());
+				uncompressed = true;
+			}
+			else
+			{
+				std::list<int> signIds;
+				signIds.push_back(*_currentId);
+				std::list<Signature *> signatures;
+				_dbDriver->loadSignatures(signIds, signatures);
+				if(signatures.empty())
+				{
+					return data;
+				}
+				_dbDriver->loadNodeData(signatures);
+				s = signatures.front();
+				_dbDriver->loadLinks(*_currentId, allLinks);
 			}
-			_dbDriver->loadNodeData(signatures);
-			Signature * s  = signatures.front();
 			data = s->sensorData();
 
 			// info
@@ -344,8 +535,7 @@ SensorData DBReader::getNextData(CameraInfo * info)
 			Transform globalPose;
 			cv::Mat globalPoseCov;
 
-			std::multimap<int, Link> priorLinks;
-			_dbDriver->loadLinks(*_currentId, priorLinks, Link::kPosePrior);
+			std::multimap<int, Link> priorLinks = linksOfType(allLinks, Link::kPosePrior);
 			if( priorLinks.size() &&
 				!priorLinks.begin()->second.transform().isNull() &&
 				priorLinks.begin()->second.infMatrix().cols == 6 &&
@@ -364,8 +554,7 @@ SensorData DBReader::getNextData(CameraInfo * info)
 			}
 
 			Transform gravityTransform;
-			std::multimap<int, Link> gravityLinks;
-			_dbDriver->loadLinks(*_currentId, gravityLinks, Link::kGravity);
+			std::multimap<int, Link> gravityLinks = linksOfType(allLinks, Link::kGravity);
 			if( gravityLinks.size() &&
 				!gravityLinks.begin()->second.transform().isNull() &&
 				gravityLinks.begin()->second.infMatrix().cols == 6 &&
@@ -377,8 +566,7 @@ SensorData DBReader::getNextData(CameraInfo * info)
 			cv::Mat infMatrix = cv::Mat::eye(6,6,CV_64FC1);
 			if(!_odometryIgnored)
 			{
-				std::multimap<int, Link> links;
-				_dbDriver->loadLinks(*_currentId, links, Link::kNeighbor);
+				std::multimap<int, Link> links = linksOfType(allLinks, Link::kNeighbor);
 				if(links.size() && links.begin()->first < *_currentId)
 				{
 					// assume the first is the backward neighbor, take its variance
@@ -448,7 +636,10 @@ SensorData DBReader::getNextData(CameraInfo * info)
 				_previousMapID = s->mapId();
 			}
 
-			data.uncompressData();
+			if(!uncompressed)
+			{
+				data.uncompressData();
+			}
 			if(data.cameraModels().size() > 1 &&
 				_cameraIndex >= 0)
 			{
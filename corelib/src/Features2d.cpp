@@ -39,6 +39,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/core/version.hpp>
 #include <opencv2/opencv_modules.hpp>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef RTABMAP_ORB_OCTREE
 #include "opencv/ORBextractor.h"
@@ -337,7 +341,8 @@ Feature2D::Feature2D(const ParametersMap & parameters) :
 		_subPixIterations(Parameters::defaultKpSubPixIterations()),
 		_subPixEps(Parameters::defaultKpSubPixEps()),
 		gridRows_(Parameters::defaultKpGridRows()),
-		gridCols_(Parameters::defaultKpGridCols())
+		gridCols_(Parameters::defaultKpGridCols()),
+		parallelExtraction_(Parameters::defaultKpParallelExtraction())
 {
 	_stereo = new Stereo(parameters);
 	this->parseParameters(parameters);
@@ -358,6 +363,7 @@ void Feature2D::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kKpSubPixEps(), _subPixEps);
 	Parameters::parse(parameters, Parameters::kKpGridRows(), gridRows_);
 	Parameters::parse(parameters, Parameters::kKpGridCols(), gridCols_);
+	Parameters::parse(parameters, Parameters::kKpParallelExtraction(), parallelExtraction_);
 
 	UASSERT(gridRows_ >= 1 && gridCols_>=1);
 	if(maxFeatures_ > 0)
@@ -523,30 +529,45 @@ std::vector<cv::KeyPoint> Feature2D::generateKeypoints(const cv::Mat & image, co
 	{
 		if(maskIn.type()==CV_16UC1 || maskIn.type() == CV_32FC1)
 		{
-			mask = cv::Mat::zeros(maskIn.rows, maskIn.cols, CV_8UC1);
-			for(int i=0; i<(int)mask.total(); ++i)
+			// ORB uses 255 to handle pyramids
+			if(maskIn.type()==CV_16UC1)
 			{
-				float value = 0.0f;
-				if(maskIn.type()==CV_16UC1)
+				// Convert depth range in mm, 0 and max value are invalid
+				int minRaw = std::max(1, (int)std::min(_minDepth*1000.0f, 65535.0f));
+				while(float(minRaw)*0.001f <= _minDepth)
+				{
+					++minRaw;
+				}
+				while(minRaw > 1 && float(minRaw-1)*0.001f > _minDepth)
+				{
+					--minRaw;
+				}
+				int maxRaw = std::numeric_limits<unsigned short>::max()-1;
+				if(_maxDepth != 0.0f)
 				{
-					if(((unsigned short*)maskIn.data)[i] > 0 &&
-					   ((unsigned short*)maskIn.data)[i] < std::numeric_limits<unsigned short>::max())
+					maxRaw = std::min(maxRaw, (int)std::min(_maxDepth*1000.0f, 65535.0f)+1);
+					while(maxRaw >= minRaw && float(maxRaw)*0.001f > _maxDepth)
 					{
-						value = float(((unsigned short*)maskIn.data)[i])*0.001f;
+						--maxRaw;
 					}
 				}
-				else
+				if(minRaw <= maxRaw)
 				{
-					value = ((float*)maskIn.data)[i];
+					cv::inRange(maskIn, cv::Scalar(minRaw), cv::Scalar(maxRaw), mask);
 				}
-
-				if(value>_minDepth &&
-				   (_maxDepth == 0.0f || value <= _maxDepth) &&
-				   uIsFinite(value))
+				else
 				{
-					((unsigned char*)mask.data)[i] = 255; // ORB uses 255 to handle pyramids
+					mask = cv::Mat::zeros(maskIn.rows, maskIn.cols, CV_8UC1);
 				}
 			}
+			else
+			{
+				// NaN and +inf values are rejected by the comparisons
+				cv::compare(maskIn, _minDepth, mask, cv::CMP_GT);
+				cv::Mat maskMax;
+				cv::compare(maskIn, _maxDepth == 0.0f?std::numeric_limits<float>::max():_maxDepth, maskMax, cv::CMP_LE);
+				cv::bitwise_and(mask, maskMax, mask);
+			}
 		}
 		else if(maskIn.type()==CV_8UC1)
 		{
@@ -572,26 +593,36 @@ std::vector<cv::KeyPoint> Feature2D::generateKeypoints(const cv::Mat & image, co
 	// Get keypoints
 	int rowSize = globalRoi.height / gridRows_;
 	int colSize = globalRoi.width / gridCols_;
-	for (int i = 0; i<gridRows_; ++i)
+	int cells = gridRows_ * gridCols_;
+	// Keypoints of each cell are kept apart and merged in
+	// cell order, so the result doesn't depend on the threads.
+	std::vector<std::vector<cv::KeyPoint> > cellsKeypoints(cells);
+	bool parallel = parallelExtraction_ && cells > 1 && this->isKeypointsDetectionParallelizable();
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic, 1) if(parallel)
+#endif
+	for (int k = 0; k<cells; ++k)
 	{
-		for (int j = 0; j<gridCols_; ++j)
+		int i = k / gridCols_;
+		int j = k % gridCols_;
+		cv::Rect roi(globalRoi.x + j*colSize, globalRoi.y + i*rowSize, colSize, rowSize);
+		std::vector<cv::KeyPoint> & sub_keypoints = cellsKeypoints[k];
+		sub_keypoints = this->generateKeypointsImpl(image, roi, mask);
+		limitKeypoints(sub_keypoints, maxFeatures_);
+		if(roi.x || roi.y)
 		{
-			cv::Rect roi(globalRoi.x + j*colSize, globalRoi.y + i*rowSize, colSize, rowSize);
-			std::vector<cv::KeyPoint> sub_keypoints;
-			sub_keypoints = this->generateKeypointsImpl(image, roi, mask);
-			limitKeypoints(sub_keypoints, maxFeatures_);
-			if(roi.x || roi.y)
+			// Adjust keypoint position to raw image
+			for(std::vector<cv::KeyPoint>::iterator iter=sub_keypoints.begin(); iter!=sub_keypoints.end(); ++iter)
 			{
-				// Adjust keypoint position to raw image
-				for(std::vector<cv::KeyPoint>::iterator iter=sub_keypoints.begin(); iter!=sub_keypoints.end(); ++iter)
-				{
-					iter->pt.x += roi.x;
-					iter->pt.y += roi.y;
-				}
+				iter->pt.x += roi.x;
+				iter->pt.y += roi.y;
 			}
-			keypoints.insert( keypoints.end(), sub_keypoints.begin(), sub_keypoints.end() );
 		}
 	}
+	for (int k = 0; k<cells; ++k)
+	{
+		keypoints.insert( keypoints.end(), cellsKeypoints[k].begin(), cellsKeypoints[k].end() );
+	}
 	UDEBUG("Keypoints extraction time = %f s, keypoints extracted = %d (mask empty=%d)", timer.ticks(), keypoints.size(), mask.empty()?1:0);
 
 	if(keypoints.size() && _subPixWinSize > 0 && _subPixIterations > 0)
@@ -622,7 +653,55 @@ cv::Mat Feature2D::generateDescriptors(
 	{
 		UASSERT(!image.empty());
 		UASSERT(image.type() == CV_8UC1);
-		descriptors = generateDescriptorsImpl(image, keypoints);
+		int chunks = 1;
+#ifdef _OPENMP
+		if(parallelExtraction_ && this->isDescriptorsExtractionParallelizable())
+		{
+			// at least 128 keypoints per chunk
+			chunks = std::min(omp_get_max_threads(), (int)keypoints.size()/128);
+		}
+#endif
+		if(chunks > 1)
+		{
+			// The extractor can remove keypoints, chunks are merged back in order
+			std::vector<std::vector<cv::KeyPoint> > chunksKeypoints(chunks);
+			std::vector<cv::Mat> chunksDescriptors(chunks);
+			int chunkSize = ((int)keypoints.size() + chunks - 1) / chunks;
+			for(int i=0; i<chunks; ++i)
+			{
+				std::vector<cv::KeyPoint>::iterator first = keypoints.begin() + std::min(i*chunkSize, (int)keypoints.size());
+				std::vector<cv::KeyPoint>::iterator last = keypoints.begin() + std::min((i+1)*chunkSize, (int)keypoints.size());
+				chunksKeypoints[i] = std::vector<cv::KeyPoint>(first, last);
+			}
+#ifdef _OPENMP
+			#pragma omp parallel for schedule(static, 1)
+#endif
+			for(int i=0; i<chunks; ++i)
+			{
+				if(chunksKeypoints[i].size())
+				{
+					chunksDescriptors[i] = generateDescriptorsImpl(image, chunksKeypoints[i]);
+				}
+			}
+			keypoints.clear();
+			std::vector<cv::Mat> validDescriptors;
+			for(int i=0; i<chunks; ++i)
+			{
+				keypoints.insert(keypoints.end(), chunksKeypoints[i].begin(), chunksKeypoints[i].end());
+				if(!chunksDescriptors[i].empty())
+				{
+					validDescriptors.push_back(chunksDescriptors[i]);
+				}
+			}
+			if(validDescriptors.size())
+			{
+				cv::vconcat(validDescriptors, descriptors);
+			}
+		}
+		else
+		{
+			descriptors = generateDescriptorsImpl(image, keypoints);
+		}
 		UASSERT_MSG(descriptors.rows == (int)keypoints.size(), uFormat("descriptors=%d, keypoints=%d", descriptors.rows, (int)keypoints.size()).c_str());
 		UDEBUG("Descriptors extracted = %d, remaining kpts=%d", descriptors.rows, (int)keypoints.size());
 	}
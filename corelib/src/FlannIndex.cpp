@@ -30,6 +30,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtflann/flann.hpp"
 
+#include <cstring>
+
+#if defined(__AVX__) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace rtabmap {
 
 FlannIndex::FlannIndex():
@@ -539,4 +550,163 @@ void FlannIndex::radiusSearch(
 	}
 }
 
+static inline int popcount64(unsigned long long x)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	return (int)__popcnt64(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+int FlannIndex::hammingDistance(const unsigned char * a, const unsigned char * b, int size)
+{
+	int d = 0;
+	int i = 0;
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+	for(; i+64<=size; i+=64)
+	{
+		__m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void*)(a+i)), _mm512_loadu_si512((const void*)(b+i)));
+		d += (int)_mm512_reduce_add_epi64(_mm512_popcnt_epi64(x));
+	}
+#endif
+#ifdef __AVX2__
+	if(i+32<=size)
+	{
+		// popcount of each nibble with a lookup table, summed with SAD
+		const __m256i lookup = _mm256_setr_epi8(
+				0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+				0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+		const __m256i lowMask = _mm256_set1_epi8(0x0F);
+		__m256i acc = _mm256_setzero_si256();
+		for(; i+32<=size; i+=32)
+		{
+			__m256i x = _mm256_xor_si256(
+					_mm256_loadu_si256((const __m256i*)(a+i)),
+					_mm256_loadu_si256((const __m256i*)(b+i)));
+			__m256i cnt = _mm256_add_epi8(
+					_mm256_shuffle_epi8(lookup, _mm256_and_si256(x, lowMask)),
+					_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask)));
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+		}
+		__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		d += (int)(_mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1));
+	}
+#endif
+	for(; i+8<=size; i+=8)
+	{
+		unsigned long long x, y;
+		memcpy(&x, a+i, 8);
+		memcpy(&y, b+i, 8);
+		d += popcount64(x ^ y);
+	}
+	for(; i<size; ++i)
+	{
+		d += popcount64((unsigned long long)(a[i] ^ b[i]));
+	}
+	return d;
+}
+
+float FlannIndex::l2SqrDistance(const float * a, const float * b, int size)
+{
+	float d = 0.0f;
+	int i = 0;
+#if defined(__AVX__)
+	__m256 acc = _mm256_setzero_ps();
+	for(; i+8<=size; i+=8)
+	{
+		__m256 x = _mm256_sub_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i));
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(x, x));
+	}
+	float sum[8];
+	_mm256_storeu_ps(sum, acc);
+	d = ((sum[0]+sum[1]) + (sum[2]+sum[3])) + ((sum[4]+sum[5]) + (sum[6]+sum[7]));
+#elif defined(__SSE__) || defined(_M_X64)
+	__m128 acc = _mm_setzero_ps();
+	for(; i+4<=size; i+=4)
+	{
+		__m128 x = _mm_sub_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i));
+		acc = _mm_add_ps(acc, _mm_mul_ps(x, x));
+	}
+	float sum[4];
+	_mm_storeu_ps(sum, acc);
+	d = (sum[0]+sum[1]) + (sum[2]+sum[3]);
+#else
+	// independent sums so that the compiler can pipeline/vectorize them
+	float d0=0.0f, d1=0.0f, d2=0.0f, d3=0.0f;
+	for(; i+4<=size; i+=4)
+	{
+		float x0=a[i]-b[i], x1=a[i+1]-b[i+1], x2=a[i+2]-b[i+2], x3=a[i+3]-b[i+3];
+		d0 += x0*x0;
+		d1 += x1*x1;
+		d2 += x2*x2;
+		d3 += x3*x3;
+	}
+	d = (d0+d1) + (d2+d3);
+#endif
+	for(; i<size; ++i)
+	{
+		float x = a[i]-b[i];
+		d += x*x;
+	}
+	return d;
+}
+
+void FlannIndex::hammingKnnMatch(
+		const cv::Mat & query,
+		const cv::Mat & features,
+		std::vector<std::vector<cv::DMatch> > & matches,
+		int knn)
+{
+	UASSERT(knn >= 1);
+	UASSERT(query.empty() || query.type() == CV_8UC1);
+	UASSERT(features.empty() || features.type() == CV_8UC1);
+	UASSERT(query.empty() || features.empty() || query.cols == features.cols);
+
+	matches.clear();
+	matches.resize(query.rows);
+	if(query.empty() || features.empty())
+	{
+		return;
+	}
+
+	const int size = features.cols;
+	const int k = knn < features.rows?knn:features.rows;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+	for(int i=0; i<query.rows; ++i)
+	{
+		const unsigned char * q = query.ptr<unsigned char>(i);
+		// sorted k best, usually k=2 so a simple insertion is enough
+		std::vector<int> bestIndices(k, -1);
+		std::vector<int> bestDists(k, size*8+1);
+		for(int j=0; j<features.rows; ++j)
+		{
+			int d = hammingDistance(q, features.ptr<unsigned char>(j), size);
+			if(d < bestDists[k-1])
+			{
+				int l = k-1;
+				for(; l>0 && d < bestDists[l-1]; --l)
+				{
+					bestDists[l] = bestDists[l-1];
+					bestIndices[l] = bestIndices[l-1];
+				}
+				bestDists[l] = d;
+				bestIndices[l] = j;
+			}
+		}
+		matches[i].resize(k);
+		for(int l=0; l<k; ++l)
+		{
+			matches[i][l] = cv::DMatch(i, bestIndices[l], (float)bestDists[l]);
+		}
+	}
+}
+
 } /* namespace rtabmap */
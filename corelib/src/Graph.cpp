@@ -34,9 +34,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UFile.h>
 #include <rtabmap/core/GeodeticCoords.h>
 #include <rtabmap/core/Memory.h>
+#include <rtabmap/core/PathGraph.h>
+#include <rtabmap/core/PosesIndex.h>
 #include <rtabmap/core/util3d_filtering.h>
 #include <rtabmap/core/util3d_registration.h>
-#include <pcl/search/kdtree.h>
 #include <pcl/common/eigen.h>
 #include <pcl/common/common.h>
 #include <set>
@@ -1227,53 +1228,43 @@ std::map<int, Transform> radiusPosesFiltering(
 {
 	if(poses.size() > 2 && radius > 0.0f)
 	{
-		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-		cloud->resize(poses.size());
-		int i=0;
-		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter, ++i)
-		{
-			(*cloud)[i] = pcl::PointXYZ(iter->second.x(), iter->second.y(), iter->second.z());
-			UASSERT_MSG(pcl::isFinite((*cloud)[i]), uFormat("Invalid pose (%d) %s", iter->first, iter->second.prettyPrint().c_str()).c_str());
-		}
-
 		// radius filtering
 		std::vector<int> names = uKeys(poses);
 		std::vector<Transform> transforms = uValues(poses);
 
-		pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ> (false));
-		tree->setInputCloud(cloud);
+		PosesIndex index(radius);
+		index.update(poses);
 		std::set<int> indicesChecked;
 		std::set<int> indicesKept;
 
-		for(unsigned int i=0; i<cloud->size(); ++i)
+		for(unsigned int i=0; i<names.size(); ++i)
 		{
 			if(indicesChecked.find(i) == indicesChecked.end())
 			{
-				std::vector<int> kIndices;
-				std::vector<float> kDistances;
-				tree->radiusSearch(cloud->at(i), radius, kIndices, kDistances);
+				std::map<int, float> kIds = index.radiusSearch(transforms[i], radius);
 
 				std::set<int> cloudIndices;
 				const Transform & currentT = transforms.at(i);
 				Eigen::Vector3f vA = currentT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
-				for(unsigned int j=0; j<kIndices.size(); ++j)
+				for(std::map<int, float>::iterator iter=kIds.begin(); iter!=kIds.end(); ++iter)
 				{
-					if(indicesChecked.find(kIndices[j]) == indicesChecked.end())
+					int kIndex = std::lower_bound(names.begin(), names.end(), iter->first) - names.begin();
+					if(indicesChecked.find(kIndex) == indicesChecked.end())
 					{
 						if(angle > 0.0f)
 						{
-							const Transform & checkT = transforms.at(kIndices[j]);
+							const Transform & checkT = transforms.at(kIndex);
 							// same orientation?
 							Eigen::Vector3f vB = checkT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
 							double a = pcl::getAngle3D(Eigen::Vector4f(vA[0], vA[1], vA[2], 0), Eigen::Vector4f(vB[0], vB[1], vB[2], 0));
 							if(a <= angle)
 							{
-								cloudIndices.insert(kIndices[j]);
+								cloudIndices.insert(kIndex);
 							}
 						}
 						else
 						{
-							cloudIndices.insert(kIndices[j]);
+							cloudIndices.insert(kIndex);
 						}
 					}
 				}
@@ -1307,11 +1298,7 @@ std::map<int, Transform> radiusPosesFiltering(
 			}
 		}
 
-		//pcl::IndicesPtr indicesOut(new std::vector<int>);
-		//indicesOut->insert(indicesOut->end(), indicesKept.begin(), indicesKept.end());
-		UINFO("Cloud filtered In = %d, Out = %d", cloud->size(), indicesKept.size());
-		//pcl::io::savePCDFile("duplicateIn.pcd", *cloud);
-		//pcl::io::savePCDFile("duplicateOut.pcd", *cloud, *indicesOut);
+		UINFO("Cloud filtered In = %d, Out = %d", (int)poses.size(), (int)indicesKept.size());
 
 		std::map<int, Transform> keptPoses;
 		for(std::set<int>::iterator iter = indicesKept.begin(); iter!=indicesKept.end(); ++iter)
@@ -1336,51 +1323,33 @@ std::multimap<int, int> radiusPosesClustering(const std::map<int, Transform> & p
 	std::multimap<int, int> clusters;
 	if(poses.size() > 1 && radius > 0.0f)
 	{
-		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-		cloud->resize(poses.size());
-		int i=0;
-		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter, ++i)
-		{
-			(*cloud)[i] = pcl::PointXYZ(iter->second.x(), iter->second.y(), iter->second.z());
-			UASSERT_MSG(pcl::isFinite((*cloud)[i]), uFormat("Invalid pose (%d) %s", iter->first, iter->second.prettyPrint().c_str()).c_str());
-		}
-
 		// radius clustering (nearest neighbors)
-		std::vector<int> ids = uKeys(poses);
-		std::vector<Transform> transforms = uValues(poses);
+		PosesIndex index(radius);
+		index.update(poses);
 
-		pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ> (false));
-		tree->setInputCloud(cloud);
-
-		for(unsigned int i=0; i<cloud->size(); ++i)
+		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
 		{
-			std::vector<int> kIndices;
-			std::vector<float> kDistances;
-			tree->radiusSearch(cloud->at(i), radius, kIndices, kDistances);
+			std::map<int, float> kIds = index.radiusSearch(iter->second, radius, iter->first);
 
-			std::set<int> cloudIndices;
-			const Transform & currentT = transforms.at(i);
+			const Transform & currentT = iter->second;
 			Eigen::Vector3f vA = currentT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
-			for(unsigned int j=0; j<kIndices.size(); ++j)
+			for(std::map<int, float>::iterator jter=kIds.begin(); jter!=kIds.end(); ++jter)
 			{
-				if((int)i != kIndices[j])
+				if(angle > 0.0f)
 				{
-					if(angle > 0.0f)
-					{
-						const Transform & checkT = transforms.at(kIndices[j]);
-						// same orientation?
-						Eigen::Vector3f vB = checkT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
-						double a = pcl::getAngle3D(Eigen::Vector4f(vA[0], vA[1], vA[2], 0), Eigen::Vector4f(vB[0], vB[1], vB[2], 0));
-						if(a <= angle)
-						{
-							clusters.insert(std::make_pair(ids[i], ids[kIndices[j]]));
-						}
-					}
-					else
+					const Transform & checkT = poses.at(jter->first);
+					// same orientation?
+					Eigen::Vector3f vB = checkT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
+					double a = pcl::getAngle3D(Eigen::Vector4f(vA[0], vA[1], vA[2], 0), Eigen::Vector4f(vB[0], vB[1], vB[2], 0));
+					if(a <= angle)
 					{
-						clusters.insert(std::make_pair(ids[i], ids[kIndices[j]]));
+						clusters.insert(std::make_pair(iter->first, jter->first));
 					}
 				}
+				else
+				{
+					clusters.insert(std::make_pair(iter->first, jter->first));
+				}
 			}
 		}
 	}
@@ -1633,98 +1602,46 @@ std::list<std::pair<int, Transform> > computePath(
 {
 	std::list<std::pair<int, Transform> > path;
 
-	int startNode = from;
-	int endNode = to;
-	rtabmap::Transform endPose = poses.at(endNode);
-	std::map<int, Node> nodes;
-	nodes.insert(std::make_pair(startNode, Node(startNode, 0, poses.at(startNode))));
-	std::priority_queue<Pair, std::vector<Pair>, Order> pq;
-	std::multimap<float, int> pqmap;
-	if(updateNewCosts)
+	if(poses.find(from) == poses.end() || poses.find(to) == poses.end())
 	{
-		pqmap.insert(std::make_pair(0, startNode));
+		UERROR("Poses of nodes %d and %d should be found in poses!", from, to);
+		return path;
 	}
-	else
+
+	// Link costs are the distances between poses, so the
+	// euclidean distance to the end is used as heuristic.
+	PathGraph graph;
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
 	{
-		pq.push(Pair(startNode, 0));
+		graph.setPose(iter->first, iter->second);
 	}
-
-	while((updateNewCosts && pqmap.size()) || (!updateNewCosts && pq.size()))
+	int missing = 0;
+	for(std::multimap<int, int>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
 	{
-		Node * currentNode;
-		if(updateNewCosts)
+		if(iter->first == iter->second)
 		{
-			currentNode = &nodes.find(pqmap.begin()->second)->second;
-			pqmap.erase(pqmap.begin());
+			continue;
 		}
-		else
+		std::map<int, rtabmap::Transform>::const_iterator fromIter = poses.find(iter->first);
+		std::map<int, rtabmap::Transform>::const_iterator toIter = poses.find(iter->second);
+		if(fromIter == poses.end() || toIter == poses.end())
 		{
-			currentNode = &nodes.find(pq.top().first)->second;
-			pq.pop();
+			++missing;
 		}
-
-		currentNode->setClosed(true);
-
-		if(currentNode->id() == endNode)
+		else
 		{
-			while(currentNode->id()!=startNode)
-			{
-				path.push_front(std::make_pair(currentNode->id(), currentNode->pose()));
-				currentNode = &nodes.find(currentNode->fromId())->second;
-			}
-			path.push_front(std::make_pair(startNode, poses.at(startNode)));
-			break;
+			graph.addLink(iter->first, iter->second, fromIter->second.inverse() * toIter->second);
 		}
+	}
+	if(missing)
+	{
+		UERROR("%d links have nodes not found in poses! Ignoring them!", missing);
+	}
 
-		// lookup neighbors
-		for(std::multimap<int, int>::const_iterator iter = links.find(currentNode->id());
-			iter!=links.end() && iter->first == currentNode->id();
-			++iter)
-		{
-			std::map<int, Node>::iterator nodeIter = nodes.find(iter->second);
-			if(nodeIter == nodes.end())
-			{
-				std::map<int, rtabmap::Transform>::const_iterator poseIter = poses.find(iter->second);
-				if(poseIter == poses.end())
-				{
-					UERROR("Next pose %d (from %d) should be found in poses! Ignoring it!", iter->second, iter->first);
-				}
-				else
-				{
-					Node n(iter->second, currentNode->id(), poseIter->second);
-					n.setCostSoFar(currentNode->costSoFar() + currentNode->distFrom(poseIter->second));
-					n.setDistToEnd(n.distFrom(endPose));
-
-					nodes.insert(std::make_pair(iter->second, n));
-					if(updateNewCosts)
-					{
-						pqmap.insert(std::make_pair(n.totalCost(), n.id()));
-					}
-					else
-					{
-						pq.push(Pair(n.id(), n.totalCost()));
-					}
-				}
-			}
-			else if(updateNewCosts && nodeIter->second.isOpened())
-			{
-				float newCostSoFar = currentNode->costSoFar() + currentNode->distFrom(nodeIter->second.pose());
-				if(nodeIter->second.costSoFar() > newCostSoFar)
-				{
-					// update the cost in the priority queue
-					for(std::multimap<float, int>::iterator mapIter=pqmap.begin(); mapIter!=pqmap.end(); ++mapIter)
-					{
-						if(mapIter->second == nodeIter->first)
-						{
-							pqmap.erase(mapIter);
-							nodeIter->second.setCostSoFar(newCostSoFar);
-							pqmap.insert(std::make_pair(nodeIter->second.totalCost(), nodeIter->first));
-							break;
-						}
-					}
-				}
-			}
-		}
+	path = graph.computePath(from, to);
+	for(std::list<std::pair<int, Transform> >::iterator iter=path.begin(); iter!=path.end(); ++iter)
+	{
+		iter->second = poses.at(iter->first);
 	}
 	return path;
 }
@@ -1869,130 +1786,12 @@ std::list<std::pair<int, Transform> > computePath(
 		UINFO("getting all %d links time = %f s", (int)allLinks.size(), t.ticks());
 	}
 
-	//dijkstra
-	int startNode = fromId;
-	int endNode = toId;
-	std::map<int, Node> nodes;
-	nodes.insert(std::make_pair(startNode, Node(startNode, 0, Transform::getIdentity())));
-	std::priority_queue<Pair, std::vector<Pair>, Order> pq;
-	std::multimap<float, int> pqmap;
-	if(updateNewCosts)
-	{
-		pqmap.insert(std::make_pair(0, startNode));
-	}
-	else
-	{
-		pq.push(Pair(startNode, 0));
-	}
-
-	while((updateNewCosts && pqmap.size()) || (!updateNewCosts && pq.size()))
-	{
-		Node * currentNode;
-		if(updateNewCosts)
-		{
-			currentNode = &nodes.find(pqmap.begin()->second)->second;
-			pqmap.erase(pqmap.begin());
-		}
-		else
-		{
-			currentNode = &nodes.find(pq.top().first)->second;
-			pq.pop();
-		}
-
-		currentNode->setClosed(true);
-
-		if(currentNode->id() == endNode)
-		{
-			while(currentNode->id()!=startNode)
-			{
-				path.push_front(std::make_pair(currentNode->id(), currentNode->pose()));
-				currentNode = &nodes.find(currentNode->fromId())->second;
-			}
-			path.push_front(std::make_pair(startNode, currentNode->pose()));
-			break;
-		}
-
-		// lookup neighbors
-		std::multimap<int, Link> links;
-		if(allLinks.size() == 0)
-		{
-			links = memory->getLinks(currentNode->id(), lookInDatabase, true);
-		}
-		else
-		{
-			for(std::multimap<int, Link>::const_iterator iter = allLinks.lower_bound(currentNode->id());
-				iter!=allLinks.end() && iter->first == currentNode->id();
-				++iter)
-			{
-				links.insert(std::make_pair(iter->second.to(), iter->second));
-			}
-		}
-		for(std::multimap<int, Link>::const_iterator iter = links.begin(); iter!=links.end(); ++iter)
-		{
-			if(iter->second.from() != iter->second.to())
-			{
-				Transform nextPose = currentNode->pose()*iter->second.transform();
-				float cost = 0.0f;
-				if(linearVelocity <= 0.0f && angularVelocity <= 0.0f)
-				{
-					// use distance only
-					cost = iter->second.transform().getNorm();
-				}
-				else // use time
-				{
-					if(linearVelocity > 0.0f)
-					{
-						cost += iter->second.transform().getNorm()/linearVelocity;
-					}
-					if(angularVelocity > 0.0f)
-					{
-						Eigen::Vector4f v1 = Eigen::Vector4f(nextPose.x()-currentNode->pose().x(), nextPose.y()-currentNode->pose().y(), nextPose.z()-currentNode->pose().z(), 1.0f);
-						Eigen::Vector4f v2 = nextPose.rotation().toEigen4f()*Eigen::Vector4f(1,0,0,1);
-						float angle = pcl::getAngle3D(v1, v2);
-						cost += angle / angularVelocity;
-					}
-				}
-
-				std::map<int, Node>::iterator nodeIter = nodes.find(iter->first);
-				if(nodeIter == nodes.end())
-				{
-					Node n(iter->second.to(), currentNode->id(), nextPose);
-
-					n.setCostSoFar(currentNode->costSoFar() + cost);
-					nodes.insert(std::make_pair(iter->second.to(), n));
-					if(updateNewCosts)
-					{
-						pqmap.insert(std::make_pair(n.totalCost(), n.id()));
-					}
-					else
-					{
-						pq.push(Pair(n.id(), n.totalCost()));
-					}
-				}
-				else if(updateNewCosts && nodeIter->second.isOpened())
-				{
-					float newCostSoFar = currentNode->costSoFar() + cost;
-					if(nodeIter->second.costSoFar() > newCostSoFar)
-					{
-						// update pose with new link
-						nodeIter->second.setPose(nextPose);
-
-						// update the cost in the priority queue
-						for(std::multimap<float, int>::iterator mapIter=pqmap.begin(); mapIter!=pqmap.end(); ++mapIter)
-						{
-							if(mapIter->second == nodeIter->first)
-							{
-								pqmap.erase(mapIter);
-								nodeIter->second.setCostSoFar(newCostSoFar);
-								pqmap.insert(std::make_pair(nodeIter->second.totalCost(), nodeIter->first));
-								break;
-							}
-						}
-					}
-				}
-			}
-		}
-	}
+	// Only links of nodes in RAM are used if we don't look in database
+	UTimer t;
+	PathGraph graph;
+	graph.addLinks(lookInDatabase?allLinks:memory->getAllLinks(false, true, true));
+	path = graph.computePath(fromId, toId, linearVelocity, angularVelocity);
+	UDEBUG("path planning time = %f s (nodes=%d)", t.ticks(), graph.size());
 
 	// Debugging stuff
 	if(ULogger::level() == ULogger::kDebug)
@@ -2069,30 +1868,31 @@ std::vector<int> findNearestNodes(
 		const rtabmap::Transform & targetPose,
 		int k)
 {
+	// A single query: scanning the poses is cheaper than building a search tree
 	std::vector<int> nearestIds;
-	if(nodes.size() && !targetPose.isNull())
+	if(nodes.size() && !targetPose.isNull() && k > 0)
 	{
-		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-		cloud->resize(nodes.size());
-		std::vector<int> ids(nodes.size());
-		int oi = 0;
+		std::vector<std::pair<float, int> > best; // max-heap <sqrd distance, id>
+		best.reserve(k+1);
 		for(std::map<int, Transform>::const_iterator iter = nodes.begin(); iter!=nodes.end(); ++iter)
 		{
-			(*cloud)[oi] = pcl::PointXYZ(iter->second.x(), iter->second.y(), iter->second.z());
-			ids[oi++] = iter->first;
+			float d = iter->second.getDistanceSquared(targetPose);
+			if((int)best.size() < k || d < best.front().first)
+			{
+				best.push_back(std::make_pair(d, iter->first));
+				std::push_heap(best.begin(), best.end());
+				if((int)best.size() > k)
+				{
+					std::pop_heap(best.begin(), best.end());
+					best.pop_back();
+				}
+			}
 		}
-
-		pcl::search::KdTree<pcl::PointXYZ>::Ptr kdTree(new pcl::search::KdTree<pcl::PointXYZ>);
-		kdTree->setInputCloud(cloud);
-		std::vector<int> ind;
-		std::vector<float> dist;
-		pcl::PointXYZ pt(targetPose.x(), targetPose.y(), targetPose.z());
-		kdTree->nearestKSearch(pt, k, ind, dist);
-
-		nearestIds.resize(ind.size());
-		for(unsigned int i=0; i<ind.size(); ++i)
+		std::sort_heap(best.begin(), best.end());
+		nearestIds.resize(best.size());
+		for(unsigned int i=0; i<best.size(); ++i)
 		{
-			nearestIds[i] = ids[ind[i]];
+			nearestIds[i] = best[i].second;
 		}
 	}
 	return nearestIds;
@@ -2111,38 +1911,18 @@ std::map<int, float> getNodesInRadius(
 		return foundNodes;
 	}
 
-	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-	cloud->resize(nodes.size());
-	std::vector<int> ids(nodes.size());
-	int oi = 0;
+	const Transform & fromT = nodes.at(nodeId);
+	float radiusSqrd = radius*radius;
 	for(std::map<int, Transform>::const_iterator iter = nodes.begin(); iter!=nodes.end(); ++iter)
 	{
 		if(iter->first != nodeId)
 		{
-			(*cloud)[oi] = pcl::PointXYZ(iter->second.x(), iter->second.y(), iter->second.z());
-			UASSERT_MSG(pcl::isFinite((*cloud)[oi]), uFormat("Invalid pose (%d) %s", iter->first, iter->second.prettyPrint().c_str()).c_str());
-			ids[oi] = iter->first;
-			++oi;
-		}
-	}
-	cloud->resize(oi);
-	ids.resize(oi);
-
-	Transform fromT = nodes.at(nodeId);
-
-	if(cloud->size())
-	{
-		pcl::search::KdTree<pcl::PointXYZ>::Ptr kdTree(new pcl::search::KdTree<pcl::PointXYZ>);
-		kdTree->setInputCloud(cloud);
-		std::vector<int> ind;
-		std::vector<float> sqrdDist;
-		pcl::PointXYZ pt(fromT.x(), fromT.y(), fromT.z());
-		kdTree->radiusSearch(pt, radius, ind, sqrdDist, 0);
-		for(unsigned int i=0; i<ind.size(); ++i)
-		{
-			if(ind[i] >=0)
+			UASSERT_MSG(uIsFinite(iter->second.x()) && uIsFinite(iter->second.y()) && uIsFinite(iter->second.z()),
+					uFormat("Invalid pose (%d) %s", iter->first, iter->second.prettyPrint().c_str()).c_str());
+			float d = iter->second.getDistanceSquared(fromT);
+			if(d <= radiusSqrd)
 			{
-				foundNodes.insert(std::make_pair(ids[ind[i]], sqrdDist[i]));
+				foundNodes.insert(foundNodes.end(), std::make_pair(iter->first, d));
 			}
 		}
 	}
@@ -2157,64 +1937,32 @@ std::map<int, Transform> getPosesInRadius(
 		float radius,
 		float angle)
 {
-	UASSERT(uContains(nodes, nodeId));
+	std::map<int, float> foundIds = getNodesInRadius(nodeId, nodes, radius);
 	std::map<int, Transform> foundNodes;
-	if(nodes.size() <= 1)
+	if(foundIds.empty())
 	{
 		return foundNodes;
 	}
 
-	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-	cloud->resize(nodes.size());
-	std::vector<int> ids(nodes.size());
-	int oi = 0;
-	for(std::map<int, Transform>::const_iterator iter = nodes.begin(); iter!=nodes.end(); ++iter)
+	const Transform & fromT = nodes.at(nodeId);
+	Eigen::Vector3f vA = fromT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
+	for(std::map<int, float>::iterator iter=foundIds.begin(); iter!=foundIds.end(); ++iter)
 	{
-		if(iter->first != nodeId)
+		const Transform & checkT = nodes.at(iter->first);
+		if(angle > 0.0f)
 		{
-			(*cloud)[oi] = pcl::PointXYZ(iter->second.x(), iter->second.y(), iter->second.z());
-			UASSERT_MSG(pcl::isFinite((*cloud)[oi]), uFormat("Invalid pose (%d) %s", iter->first, iter->second.prettyPrint().c_str()).c_str());
-			ids[oi] = iter->first;
-			++oi;
-		}
-	}
-	cloud->resize(oi);
-	ids.resize(oi);
-
-	Transform fromT = nodes.at(nodeId);
-
-	if(cloud->size())
-	{
-		pcl::search::KdTree<pcl::PointXYZ>::Ptr kdTree(new pcl::search::KdTree<pcl::PointXYZ>);
-		kdTree->setInputCloud(cloud);
-		std::vector<int> ind;
-		std::vector<float> sqrdDist;
-		pcl::PointXYZ pt(fromT.x(), fromT.y(), fromT.z());
-		kdTree->radiusSearch(pt, radius, ind, sqrdDist, 0);
-
-		Eigen::Vector3f vA = fromT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
-
-		for(unsigned int i=0; i<ind.size(); ++i)
-		{
-			if(ind[i] >=0)
+			// same orientation?
+			Eigen::Vector3f vB = checkT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
+			double a = pcl::getAngle3D(Eigen::Vector4f(vA[0], vA[1], vA[2], 0), Eigen::Vector4f(vB[0], vB[1], vB[2], 0));
+			if(a <= angle)
 			{
-				if(angle > 0.0f)
-				{
-					const Transform & checkT = nodes.at(ids[ind[i]]);
-					// same orientation?
-					Eigen::Vector3f vB = checkT.toEigen3f().linear()*Eigen::Vector3f(1,0,0);
-					double a = pcl::getAngle3D(Eigen::Vector4f(vA[0], vA[1], vA[2], 0), Eigen::Vector4f(vB[0], vB[1], vB[2], 0));
-					if(a <= angle)
-					{
-						foundNodes.insert(std::make_pair(ids[ind[i]], nodes.at(ids[ind[i]])));
-					}
-				}
-				else
-				{
-					foundNodes.insert(std::make_pair(ids[ind[i]], nodes.at(ids[ind[i]])));
-				}
+				foundNodes.insert(foundNodes.end(), std::make_pair(iter->first, checkT));
 			}
 		}
+		else
+		{
+			foundNodes.insert(foundNodes.end(), std::make_pair(iter->first, checkT));
+		}
 	}
 	UDEBUG("found nodes=%d", (int)foundNodes.size());
 	return foundNodes;
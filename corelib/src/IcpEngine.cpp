@@ -0,0 +1,923 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <rtabmap/core/IcpEngine.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <pcl/common/transforms.h>
+#include <Eigen/Cholesky>
+#include <Eigen/SVD>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <cstdlib>
+
+#if __cplusplus >= 201103L
+#include <unordered_map>
+#else
+#include <map>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace rtabmap {
+
+struct IcpEngine::Cells
+{
+#if __cplusplus >= 201103L
+	typedef std::unordered_map<long long, std::pair<int, int> > Map;
+#else
+	typedef std::map<long long, std::pair<int, int> > Map;
+#endif
+	Map map; // first point and end of each cell
+};
+
+namespace {
+
+// Nearest of the points [begin,end) to (x,y,z), updated only if its squared
+// distance is under or equal to bestDistance (the last one on equality,
+// like a sequential scan).
+void nearestInCell(
+		const float * px,
+		const float * py,
+		const float * pz,
+		int begin,
+		int end,
+		float x,
+		float y,
+		float z,
+		float & bestDistance,
+		int & best)
+{
+	int n = begin;
+#if defined(__SSE2__) || defined(_M_X64)
+	const __m128 qx = _mm_set1_ps(x);
+	const __m128 qy = _mm_set1_ps(y);
+	const __m128 qz = _mm_set1_ps(z);
+	for(; n+4<=end; n+=4)
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(px+n), qx);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(py+n), qy);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(pz+n), qz);
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		if(_mm_movemask_ps(_mm_cmple_ps(d, _mm_set1_ps(bestDistance))))
+		{
+			float tmp[4];
+			_mm_storeu_ps(tmp, d);
+			for(int l=0; l<4; ++l)
+			{
+				if(tmp[l] <= bestDistance)
+				{
+					bestDistance = tmp[l];
+					best = n+l;
+				}
+			}
+		}
+	}
+#endif
+	for(; n<end; ++n)
+	{
+		float dx = px[n] - x;
+		float dy = py[n] - y;
+		float dz = pz[n] - z;
+		float d = dx*dx + dy*dy + dz*dz;
+		if(d <= bestDistance)
+		{
+			bestDistance = d;
+			best = n;
+		}
+	}
+}
+
+// Add the sums over k in [begin,end) of a[i][k]*a[j][k] (j>=i) to
+// ATA(i,j) and of a[i][k]*b[k] to ATb(i). Accumulated in double.
+void accumulateRow(
+		const float * const * a,
+		const float * b,
+		int i,
+		int dim,
+		int begin,
+		int end,
+		double * ATA,
+		double * ATb)
+{
+	const int n = dim-i;
+	const float * ai = a[i];
+	double sums[7] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0}; // a[i..dim-1], then b
+	int k = begin;
+#if defined(__AVX__)
+	__m256d acc[7];
+	for(int j=0; j<=n; ++j)
+	{
+		acc[j] = _mm256_setzero_pd();
+	}
+	for(; k+4<=end; k+=4)
+	{
+		__m256d vi = _mm256_cvtps_pd(_mm_loadu_ps(ai+k));
+		for(int j=0; j<n; ++j)
+		{
+			acc[j] = _mm256_add_pd(acc[j], _mm256_mul_pd(vi, _mm256_cvtps_pd(_mm_loadu_ps(a[i+j]+k))));
+		}
+		acc[n] = _mm256_add_pd(acc[n], _mm256_mul_pd(vi, _mm256_cvtps_pd(_mm_loadu_ps(b+k))));
+	}
+	for(int j=0; j<=n; ++j)
+	{
+		double tmp[4];
+		_mm256_storeu_pd(tmp, acc[j]);
+		sums[j] = (tmp[0]+tmp[1]) + (tmp[2]+tmp[3]);
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	__m128d acc[7];
+	for(int j=0; j<=n; ++j)
+	{
+		acc[j] = _mm_setzero_pd();
+	}
+	for(; k+2<=end; k+=2)
+	{
+		__m128d vi = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)(ai+k))));
+		for(int j=0; j<n; ++j)
+		{
+			acc[j] = _mm_add_pd(acc[j], _mm_mul_pd(vi, _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)(a[i+j]+k))))));
+		}
+		acc[n] = _mm_add_pd(acc[n], _mm_mul_pd(vi, _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)(b+k))))));
+	}
+	for(int j=0; j<=n; ++j)
+	{
+		double tmp[2];
+		_mm_storeu_pd(tmp, acc[j]);
+		sums[j] = tmp[0]+tmp[1];
+	}
+#endif
+	for(; k<end; ++k)
+	{
+		double vi = ai[k];
+		for(int j=0; j<n; ++j)
+		{
+			sums[j] += vi*a[i+j][k];
+		}
+		sums[n] += vi*b[k];
+	}
+	for(int j=0; j<n; ++j)
+	{
+		ATA[i*dim+i+j] += sums[j];
+	}
+	ATb[i] += sums[n];
+}
+
+// Normal equations ATA*x=ATb of the linear system a*x=b, a being
+// "dim" columns of "size" rows. Each thread sums a contiguous block
+// of rows, partial sums are then added in thread order.
+void computeNormalEquations(
+		const float * const * a,
+		const float * b,
+		int dim,
+		int size,
+		double * ATA,
+		double * ATb)
+{
+	memset(ATA, 0, dim*dim*sizeof(double));
+	memset(ATb, 0, dim*sizeof(double));
+#ifdef _OPENMP
+	#pragma omp parallel if(size > 4096)
+#endif
+	{
+		double partialATA[36] = {0};
+		double partialATb[6] = {0};
+		int begin = 0;
+		int end = size;
+#ifdef _OPENMP
+		int chunk = (size + omp_get_num_threads() - 1) / omp_get_num_threads();
+		begin = std::min(size, omp_get_thread_num()*chunk);
+		end = std::min(size, begin+chunk);
+#endif
+		for(int i=0; i<dim; ++i)
+		{
+			accumulateRow(a, b, i, dim, begin, end, partialATA, partialATb);
+		}
+#ifdef _OPENMP
+		#pragma omp for ordered schedule(static,1)
+		for(int t=0; t<omp_get_num_threads(); ++t)
+		{
+			#pragma omp ordered
+			{
+				for(int i=0; i<dim*dim; ++i)
+				{
+					ATA[i] += partialATA[i];
+				}
+				for(int i=0; i<dim; ++i)
+				{
+					ATb[i] += partialATb[i];
+				}
+			}
+		}
+#else
+		memcpy(ATA, partialATA, dim*dim*sizeof(double));
+		memcpy(ATb, partialATb, dim*sizeof(double));
+#endif
+	}
+	for(int i=0; i<dim; ++i)
+	{
+		for(int j=0; j<i; ++j)
+		{
+			ATA[i*dim+j] = ATA[j*dim+i];
+		}
+	}
+}
+
+// Same criteria than pcl::registration::DefaultConvergenceCriteria with
+// transformation epsilon = epsilon*epsilon (like util3d::icp()).
+bool hasConverged(
+		const Eigen::Affine3d & delta,
+		double mse,
+		double & previousMse,
+		float epsilon,
+		int maxIterations,
+		IcpEngine::Statistics & stats)
+{
+	if(stats.iterations >= maxIterations)
+	{
+		stats.maxIterationsReached = true;
+		return true;
+	}
+	double cosAngle = 0.5 * (delta.linear().trace() - 1.0);
+	if(cosAngle >= 0.99999 && delta.translation().squaredNorm() <= double(epsilon*epsilon))
+	{
+		return true;
+	}
+	if(fabs(mse - previousMse) < 1e-12 ||
+	   fabs(mse - previousMse) / previousMse < 1e-5)
+	{
+		return true;
+	}
+	previousMse = mse;
+	return false;
+}
+
+} // namespace
+
+IcpEngine::IcpEngine() :
+		maxCorrespondenceDistance_(0.0f),
+		cellSize_(0.0f),
+		flat_(false),
+		cells_(new Cells())
+{
+	clear();
+}
+
+IcpEngine::~IcpEngine()
+{
+	delete cells_;
+}
+
+long long IcpEngine::cellKey(int x, int y, int z) const
+{
+	if(x < minCell_[0] || x > maxCell_[0] ||
+	   y < minCell_[1] || y > maxCell_[1] ||
+	   z < minCell_[2] || z > maxCell_[2])
+	{
+		return -1;
+	}
+	// 21 bits per axis, relative to the bounds of the target
+	return ((long long)(x-minCell_[0]) << 42) | ((long long)(y-minCell_[1]) << 21) | (long long)(z-minCell_[2]);
+}
+
+template<typename PointT>
+void IcpEngine::indexPoints(const pcl::PointCloud<PointT> & cloud, float maxCorrespondenceDistance, std::vector<int> & order)
+{
+	UASSERT(maxCorrespondenceDistance > 0.0f);
+	clear();
+	maxCorrespondenceDistance_ = maxCorrespondenceDistance;
+	const int size = (int)cloud.size();
+	if(size == 0)
+	{
+		order.clear();
+		return;
+	}
+
+	Eigen::Vector3f minPt = cloud.at(0).getVector3fMap();
+	Eigen::Vector3f maxPt = minPt;
+	for(int i=1; i<size; ++i)
+	{
+		minPt = minPt.cwiseMin(cloud.at(i).getVector3fMap());
+		maxPt = maxPt.cwiseMax(cloud.at(i).getVector3fMap());
+	}
+
+	// Cells of the max correspondence distance, smaller for a dense target so that
+	// a cell contains about kPointsPerCell points (averaged over the bounding box
+	// or its area for a flat target), but not less than half the max correspondence
+	// distance to limit the number of cells searched when there is no correspondence.
+	const float kPointsPerCell = 8.0f;
+	Eigen::Vector3f extent = (maxPt - minPt).cwiseMax(Eigen::Vector3f::Constant(maxCorrespondenceDistance*0.01f));
+	float densityCellSize;
+	if(maxPt[2] - minPt[2] < maxCorrespondenceDistance)
+	{
+		densityCellSize = sqrt(extent[0]*extent[1]*kPointsPerCell/float(size));
+	}
+	else
+	{
+		densityCellSize = std::pow(extent[0]*extent[1]*extent[2]*kPointsPerCell/float(size), 1.0f/3.0f);
+	}
+	cellSize_ = std::max(maxCorrespondenceDistance*0.5f, std::min(maxCorrespondenceDistance, densityCellSize));
+
+	// Keys are relative to the bounds of the target, make the cells larger if they don't fit
+	bool fit = false;
+	while(!fit)
+	{
+		fit = true;
+		for(int k=0; k<3; ++k)
+		{
+			minCell_[k] = (int)std::floor(minPt[k]/cellSize_);
+			maxCell_[k] = (int)std::floor(maxPt[k]/cellSize_);
+			if((long long)maxCell_[k] - (long long)minCell_[k] >= (1<<21))
+			{
+				fit = false;
+			}
+		}
+		if(!fit)
+		{
+			cellSize_ *= 2.0f;
+			UDEBUG("Target too large for the cell keys, increasing cell size to %f m", cellSize_);
+		}
+	}
+	const float cellInv = 1.0f/cellSize_;
+
+	std::vector<std::pair<long long, int> > keys(size);
+	for(int i=0; i<size; ++i)
+	{
+		const PointT & pt = cloud.at(i);
+		keys[i].first = cellKey((int)std::floor(pt.x*cellInv), (int)std::floor(pt.y*cellInv), (int)std::floor(pt.z*cellInv));
+		UASSERT(keys[i].first >= 0);
+		keys[i].second = i;
+	}
+	std::sort(keys.begin(), keys.end());
+
+	x_.resize(size);
+	y_.resize(size);
+	z_.resize(size);
+	order.resize(size);
+	int start = 0;
+	for(int k=0; k<size; ++k)
+	{
+		const PointT & pt = cloud.at(keys[k].second);
+		x_[k] = pt.x;
+		y_[k] = pt.y;
+		z_[k] = pt.z;
+		order[k] = keys[k].second;
+		if(k+1 == size || keys[k+1].first != keys[k].first)
+		{
+			cells_->map.insert(std::make_pair(keys[k].first, std::make_pair(start, k+1)));
+			start = k+1;
+		}
+	}
+	flat_ = minCell_[2] == maxCell_[2];
+	UDEBUG("Indexed %d points in %d cells (cell=%f m, max correspondence distance=%f m, flat=%d)",
+			size, (int)cells_->map.size(), cellSize_, maxCorrespondenceDistance, flat_?1:0);
+}
+
+void IcpEngine::setTarget(const pcl::PointCloud<pcl::PointXYZ> & cloud, float maxCorrespondenceDistance)
+{
+	std::vector<int> order;
+	indexPoints(cloud, maxCorrespondenceDistance, order);
+}
+
+void IcpEngine::setTarget(const pcl::PointCloud<pcl::PointNormal> & cloud, float maxCorrespondenceDistance)
+{
+	std::vector<int> order;
+	indexPoints(cloud, maxCorrespondenceDistance, order);
+	nx_.resize(order.size());
+	ny_.resize(order.size());
+	nz_.resize(order.size());
+	for(unsigned int k=0; k<order.size(); ++k)
+	{
+		const pcl::PointNormal & pt = cloud.at(order[k]);
+		nx_[k] = pt.normal_x;
+		ny_[k] = pt.normal_y;
+		nz_[k] = pt.normal_z;
+	}
+}
+
+void IcpEngine::clear()
+{
+	x_.clear();
+	y_.clear();
+	z_.clear();
+	nx_.clear();
+	ny_.clear();
+	nz_.clear();
+	cells_->map.clear();
+	for(int k=0; k<3; ++k)
+	{
+		minCell_[k] = 0;
+		maxCell_[k] = -1;
+	}
+	flat_ = false;
+}
+
+int IcpEngine::nearestPoint(float x, float y, float z, float & sqrDistance) const
+{
+	const float maxDistance = maxCorrespondenceDistance_*maxCorrespondenceDistance_;
+	sqrDistance = maxDistance;
+	if(isEmpty())
+	{
+		return -1;
+	}
+
+	// Ignore query points too far from the target
+	const float q[3] = {x, y, z};
+	float outside = 0.0f;
+	for(int k=0; k<3; ++k)
+	{
+		float low = float(minCell_[k])*cellSize_;
+		float high = float(maxCell_[k]+1)*cellSize_;
+		float d = q[k]<low?low-q[k]:q[k]>high?q[k]-high:0.0f;
+		outside += d*d;
+	}
+	if(outside > maxDistance)
+	{
+		return -1;
+	}
+
+	const float cellInv = 1.0f/cellSize_;
+	int c[3];
+	for(int k=0; k<3; ++k)
+	{
+		c[k] = (int)std::floor(q[k]*cellInv);
+	}
+
+	// Search ring by ring (cells at the same Chebyshev distance of the query cell)
+	// until the points outside the searched cells cannot be closer than the best one.
+	int best = -1;
+	float bestDistance = maxDistance;
+	for(int r=0; ; ++r)
+	{
+		const int minK = std::max(minCell_[2], flat_?minCell_[2]:c[2]-r);
+		const int maxK = std::min(maxCell_[2], flat_?maxCell_[2]:c[2]+r);
+		const int minJ = std::max(minCell_[1], c[1]-r);
+		const int maxJ = std::min(maxCell_[1], c[1]+r);
+		for(int k=minK; k<=maxK; ++k)
+		{
+			const int dk = abs(k-c[2]);
+			if(dk > r)
+			{
+				continue;
+			}
+			for(int j=minJ; j<=maxJ; ++j)
+			{
+				if(dk == r || abs(j-c[1]) == r)
+				{
+					for(int i=std::max(minCell_[0], c[0]-r); i<=std::min(maxCell_[0], c[0]+r); ++i)
+					{
+						searchCell(i, j, k, x, y, z, bestDistance, best);
+					}
+				}
+				else
+				{
+					// only both ends of the row are on the ring
+					searchCell(c[0]-r, j, k, x, y, z, bestDistance, best);
+					searchCell(c[0]+r, j, k, x, y, z, bestDistance, best);
+				}
+			}
+		}
+
+		// distance to the closest cell not yet searched
+		float bound = FLT_MAX;
+		for(int k=0; k<(flat_?2:3); ++k)
+		{
+			bound = std::min(bound, std::min(q[k] - float(c[k]-r)*cellSize_, float(c[k]+r+1)*cellSize_ - q[k]));
+		}
+		if(bound*bound >= bestDistance)
+		{
+			break;
+		}
+	}
+	sqrDistance = bestDistance;
+	return best;
+}
+
+void IcpEngine::searchCell(int i, int j, int k, float x, float y, float z, float & bestDistance, int & best) const
+{
+	long long key = cellKey(i, j, k);
+	if(key >= 0)
+	{
+		Cells::Map::const_iterator iter = cells_->map.find(key);
+		if(iter != cells_->map.end())
+		{
+			nearestInCell(x_.data(), y_.data(), z_.data(), iter->second.first, iter->second.second, x, y, z, bestDistance, best);
+		}
+	}
+}
+
+Transform IcpEngine::icp(
+		const pcl::PointCloud<pcl::PointXYZ> & source,
+		const Transform & targetPose,
+		int maxIterations,
+		float epsilon,
+		bool force3DoF,
+		bool & hasConvergedOut,
+		pcl::PointCloud<pcl::PointXYZ> & registered,
+		Statistics * statsOut) const
+{
+	UASSERT(!targetPose.isNull());
+	hasConvergedOut = false;
+	Statistics stats;
+	Eigen::Affine3d finalTransform = Eigen::Affine3d::Identity();
+	const int size = (int)source.size();
+
+	if(size && !isEmpty() && maxIterations > 0)
+	{
+		const Eigen::Affine3d pose = targetPose.toEigen3d();
+		const Eigen::Affine3d poseInv = pose.inverse();
+		const Eigen::Matrix3f poseR = pose.linear().cast<float>();
+		const Eigen::Vector3f poseT = pose.translation().cast<float>();
+
+		// matched pairs in source frame: source (p) and target (q) points
+		std::vector<float> p[3];
+		std::vector<float> q[3];
+		for(int i=0; i<3; ++i)
+		{
+			p[i].resize(size);
+			q[i].resize(size);
+		}
+		std::vector<float> distances(size);
+		double previousMse = DBL_MAX;
+
+		while(true)
+		{
+			const Eigen::Matrix3f R = finalTransform.linear().cast<float>();
+			const Eigen::Vector3f t = finalTransform.translation().cast<float>();
+			const Eigen::Affine3f toTarget = (poseInv * finalTransform).cast<float>();
+#ifdef _OPENMP
+			#pragma omp parallel for schedule(static) if(size > 1024)
+#endif
+			for(int i=0; i<size; ++i)
+			{
+				const pcl::PointXYZ & pt = source.at(i);
+				Eigen::Vector3f ptT = toTarget * pt.getVector3fMap();
+				int n = nearestPoint(ptT[0], ptT[1], ptT[2], distances[i]);
+				if(n >= 0)
+				{
+					Eigen::Vector3f v = R * pt.getVector3fMap() + t;
+					Eigen::Vector3f w = poseR * Eigen::Vector3f(x_[n], y_[n], z_[n]) + poseT;
+					for(int k=0; k<3; ++k)
+					{
+						p[k][i] = v[k];
+						q[k][i] = w[k];
+					}
+				}
+				else
+				{
+					distances[i] = -1.0f;
+				}
+			}
+
+			// centroids and correlation
+			int correspondences = 0;
+			double mse = 0.0;
+			Eigen::Vector3d sumP = Eigen::Vector3d::Zero();
+			Eigen::Vector3d sumQ = Eigen::Vector3d::Zero();
+			Eigen::Matrix3d sumPQ = Eigen::Matrix3d::Zero();
+			for(int i=0; i<size; ++i)
+			{
+				if(distances[i] >= 0.0f)
+				{
+					Eigen::Vector3d vp(p[0][i], p[1][i], p[2][i]);
+					Eigen::Vector3d vq(q[0][i], q[1][i], q[2][i]);
+					sumP += vp;
+					sumQ += vq;
+					sumPQ += vp * vq.transpose();
+					mse += distances[i];
+					++correspondences;
+				}
+			}
+			stats.correspondences = correspondences;
+			if(correspondences < 3)
+			{
+				UDEBUG("Not enough correspondences (%d)", correspondences);
+				break;
+			}
+			mse /= double(correspondences);
+			stats.rmse = sqrt(mse);
+
+			Eigen::Vector3d centroidP = sumP / double(correspondences);
+			Eigen::Vector3d centroidQ = sumQ / double(correspondences);
+			Eigen::Matrix3d H = sumPQ - double(correspondences) * centroidP * centroidQ.transpose();
+			Eigen::Affine3d delta = Eigen::Affine3d::Identity();
+			if(force3DoF)
+			{
+				// like pcl::registration::TransformationEstimation2D, without z translation
+				double angle = atan2(H(0,1) - H(1,0), H(0,0) + H(1,1));
+				delta.linear() = Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+				Eigen::Vector3d tr = centroidQ - delta.linear() * centroidP;
+				delta.translation() = Eigen::Vector3d(tr[0], tr[1], 0.0);
+			}
+			else
+			{
+				// like pcl::registration::TransformationEstimationSVD
+				Eigen::JacobiSVD<Eigen::Matrix3d> svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
+				Eigen::Matrix3d u = svd.matrixU();
+				Eigen::Matrix3d v = svd.matrixV();
+				if(u.determinant() * v.determinant() < 0)
+				{
+					v.col(2) *= -1.0;
+				}
+				delta.linear() = v * u.transpose();
+				delta.translation() = centroidQ - delta.linear() * centroidP;
+			}
+			finalTransform = delta * finalTransform;
+			++stats.iterations;
+
+			if(hasConverged(delta, mse, previousMse, epsilon, maxIterations, stats))
+			{
+				stats.converged = true;
+				break;
+			}
+		}
+	}
+
+	hasConvergedOut = stats.converged;
+	UDEBUG("iterations=%d correspondences=%d rmse=%f converged=%d maxIterationsReached=%d",
+			stats.iterations, stats.correspondences, stats.rmse, stats.converged?1:0, stats.maxIterationsReached?1:0);
+	if(statsOut)
+	{
+		*statsOut = stats;
+	}
+	Transform output = Transform::fromEigen3d(finalTransform);
+	pcl::transformPointCloud(source, registered, output.toEigen4f());
+	return output;
+}
+
+Transform IcpEngine::icpPointToPlane(
+		const pcl::PointCloud<pcl::PointNormal> & source,
+		const Transform & targetPose,
+		int maxIterations,
+		float epsilon,
+		bool force3DoF,
+		bool & hasConvergedOut,
+		pcl::PointCloud<pcl::PointNormal> & registered,
+		Statistics * statsOut) const
+{
+	UASSERT(!targetPose.isNull());
+	UASSERT_MSG(isEmpty() || hasNormals(), "Target should be set with normals for point to plane ICP.");
+	hasConvergedOut = false;
+	Statistics stats;
+	Eigen::Affine3d finalTransform = Eigen::Affine3d::Identity();
+	const int size = (int)source.size();
+
+	if(size && !isEmpty() && maxIterations > 0)
+	{
+		const Eigen::Affine3d pose = targetPose.toEigen3d();
+		const Eigen::Affine3d poseInv = pose.inverse();
+		const Eigen::Matrix3f poseR = pose.linear().cast<float>();
+		const Eigen::Vector3f poseT = pose.translation().cast<float>();
+		const int dim = force3DoF?3:6;
+
+		// Rows of the linearized system (like pcl::registration::TransformationEstimationPointToPlaneLLS),
+		// unknowns are (roll, pitch, yaw, x, y, z) or (yaw, x, y) in 3DoF.
+		// Rows without correspondence are zeros.
+		std::vector<float> a[6];
+		for(int i=0; i<dim; ++i)
+		{
+			a[i].resize(size);
+		}
+		std::vector<float> b(size);
+		std::vector<float> distances(size);
+		double previousMse = DBL_MAX;
+
+		while(true)
+		{
+			const Eigen::Matrix3f R = finalTransform.linear().cast<float>();
+			const Eigen::Vector3f t = finalTransform.translation().cast<float>();
+			const Eigen::Affine3f toTarget = (poseInv * finalTransform).cast<float>();
+#ifdef _OPENMP
+			#pragma omp parallel for schedule(static) if(size > 1024)
+#endif
+			for(int i=0; i<size; ++i)
+			{
+				const pcl::PointNormal & pt = source.at(i);
+				Eigen::Vector3f ptT = toTarget * pt.getVector3fMap();
+				int n = nearestPoint(ptT[0], ptT[1], ptT[2], distances[i]);
+				if(n >= 0)
+				{
+					Eigen::Vector3f v = R * pt.getVector3fMap() + t;
+					Eigen::Vector3f w = poseR * Eigen::Vector3f(x_[n], y_[n], z_[n]) + poseT;
+					Eigen::Vector3f normal = poseR * Eigen::Vector3f(nx_[n], ny_[n], nz_[n]);
+					float c = normal[1]*v[0] - normal[0]*v[1];
+					if(force3DoF)
+					{
+						a[0][i] = c;
+						a[1][i] = normal[0];
+						a[2][i] = normal[1];
+					}
+					else
+					{
+						a[0][i] = normal[2]*v[1] - normal[1]*v[2];
+						a[1][i] = normal[0]*v[2] - normal[2]*v[0];
+						a[2][i] = c;
+						a[3][i] = normal[0];
+						a[4][i] = normal[1];
+						a[5][i] = normal[2];
+					}
+					b[i] = normal.dot(w - v);
+				}
+				else
+				{
+					for(int k=0; k<dim; ++k)
+					{
+						a[k][i] = 0.0f;
+					}
+					b[i] = 0.0f;
+					distances[i] = -1.0f;
+				}
+			}
+
+			int correspondences = 0;
+			double mse = 0.0;
+			for(int i=0; i<size; ++i)
+			{
+				if(distances[i] >= 0.0f)
+				{
+					mse += distances[i];
+					++correspondences;
+				}
+			}
+			stats.correspondences = correspondences;
+			if(correspondences < 3)
+			{
+				UDEBUG("Not enough correspondences (%d)", correspondences);
+				break;
+			}
+			mse /= double(correspondences);
+			stats.rmse = sqrt(mse);
+
+			const float * rows[6];
+			for(int k=0; k<dim; ++k)
+			{
+				rows[k] = a[k].data();
+			}
+			double ATAData[36];
+			double ATbData[6];
+			computeNormalEquations(rows, b.data(), dim, size, ATAData, ATbData);
+
+			Eigen::Affine3d delta = Eigen::Affine3d::Identity();
+			if(force3DoF)
+			{
+				Eigen::Matrix3d ATA = Eigen::Map<Eigen::Matrix3d>(ATAData); // symmetric
+				Eigen::Vector3d x = ATA.ldlt().solve(Eigen::Map<Eigen::Vector3d>(ATbData));
+				delta.linear() = Eigen::AngleAxisd(x[0], Eigen::Vector3d::UnitZ()).toRotationMatrix();
+				delta.translation() = Eigen::Vector3d(x[1], x[2], 0.0);
+			}
+			else
+			{
+				Eigen::Matrix<double, 6, 6> ATA = Eigen::Map<Eigen::Matrix<double, 6, 6> >(ATAData); // symmetric
+				Eigen::Matrix<double, 6, 1> x = ATA.ldlt().solve(Eigen::Map<Eigen::Matrix<double, 6, 1> >(ATbData));
+				delta.linear() = (Eigen::AngleAxisd(x[2], Eigen::Vector3d::UnitZ()) *
+						Eigen::AngleAxisd(x[1], Eigen::Vector3d::UnitY()) *
+						Eigen::AngleAxisd(x[0], Eigen::Vector3d::UnitX())).toRotationMatrix();
+				delta.translation() = Eigen::Vector3d(x[3], x[4], x[5]);
+			}
+			finalTransform = delta * finalTransform;
+			++stats.iterations;
+
+			if(hasConverged(delta, mse, previousMse, epsilon, maxIterations, stats))
+			{
+				stats.converged = true;
+				break;
+			}
+		}
+	}
+
+	hasConvergedOut = stats.converged;
+	UDEBUG("iterations=%d correspondences=%d rmse=%f converged=%d maxIterationsReached=%d",
+			stats.iterations, stats.correspondences, stats.rmse, stats.converged?1:0, stats.maxIterationsReached?1:0);
+	if(statsOut)
+	{
+		*statsOut = stats;
+	}
+	Transform output = Transform::fromEigen3d(finalTransform);
+	pcl::transformPointCloudWithNormals(source, registered, output.toEigen4f());
+	return output;
+}
+
+void IcpEngine::computeVarianceAndCorrespondences(
+		const pcl::PointCloud<pcl::PointXYZ> & source,
+		const Transform & targetPose,
+		double & variance,
+		int & correspondences) const
+{
+	UASSERT(!targetPose.isNull());
+	variance = 1;
+	correspondences = 0;
+	if(isEmpty())
+	{
+		return;
+	}
+	const Eigen::Affine3f toTarget = targetPose.inverse().toEigen3f();
+	const int size = (int)source.size();
+	std::vector<float> distances(size);
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static) if(size > 1024)
+#endif
+	for(int i=0; i<size; ++i)
+	{
+		Eigen::Vector3f pt = toTarget * source.at(i).getVector3fMap();
+		if(nearestPoint(pt[0], pt[1], pt[2], distances[i]) < 0)
+		{
+			distances[i] = -1.0f;
+		}
+	}
+	distances.erase(std::remove(distances.begin(), distances.end(), -1.0f), distances.end());
+	correspondences = (int)distances.size();
+	if(correspondences >= 3)
+	{
+		std::nth_element(distances.begin(), distances.begin() + (distances.size()>>1), distances.end());
+		variance = 2.1981 * distances[distances.size()>>1];
+	}
+}
+
+void IcpEngine::computeVarianceAndCorrespondences(
+		const pcl::PointCloud<pcl::PointNormal> & source,
+		const Transform & targetPose,
+		float maxCorrespondenceAngle,
+		double & variance,
+		int & correspondences) const
+{
+	UASSERT(!targetPose.isNull());
+	UASSERT_MSG(isEmpty() || hasNormals() || maxCorrespondenceAngle <= 0.0f, "Target should be set with normals to check correspondences angle.");
+	variance = 1;
+	correspondences = 0;
+	if(isEmpty())
+	{
+		return;
+	}
+	const Eigen::Affine3f toTarget = targetPose.inverse().toEigen3f();
+	const int size = (int)source.size();
+	std::vector<float> distances(size);
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static) if(size > 1024)
+#endif
+	for(int i=0; i<size; ++i)
+	{
+		const pcl::PointNormal & pt = source.at(i);
+		Eigen::Vector3f ptT = toTarget * pt.getVector3fMap();
+		int n = nearestPoint(ptT[0], ptT[1], ptT[2], distances[i]);
+		if(n < 0)
+		{
+			distances[i] = -1.0f;
+		}
+		else if(maxCorrespondenceAngle > 0.0f)
+		{
+			// angle between normals, in target frame
+			Eigen::Vector3f normal = toTarget.linear() * pt.getNormalVector3fMap();
+			Eigen::Vector3f normalTarget(nx_[n], ny_[n], nz_[n]);
+			float norm = normal.norm() * normalTarget.norm();
+			float cosAngle = norm>0.0f?normal.dot(normalTarget)/norm:1.0f;
+			float angle = acos(std::max(-1.0f, std::min(1.0f, cosAngle)));
+			if(!(angle < maxCorrespondenceAngle))
+			{
+				distances[i] = -1.0f;
+			}
+		}
+	}
+	distances.erase(std::remove(distances.begin(), distances.end(), -1.0f), distances.end());
+	correspondences = (int)distances.size();
+	if(correspondences)
+	{
+		std::nth_element(distances.begin(), distances.begin() + (distances.size()>>1), distances.end());
+		variance = 2.1981 * distances[distances.size()>>1];
+	}
+}
+
+} /* namespace rtabmap */
@@ -0,0 +1,317 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <rtabmap/core/LaserScanChannels.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace rtabmap {
+
+LaserScanChannels::LaserScanChannels() :
+	size_(0),
+	channels_(0),
+	step_(0),
+	is2d_(false),
+	offset_(0)
+{
+}
+
+LaserScanChannels::LaserScanChannels(const LaserScan & scan, bool normals, const std::vector<int> * indices) :
+	size_(indices?(int)indices->size():scan.size()),
+	channels_(normals && scan.hasNormals()?6:3),
+	step_(((size_+7)/8)*8),
+	is2d_(scan.is2d()),
+	offset_(0)
+{
+	UASSERT(scan.isEmpty() || scan.dataType() == CV_32FC(scan.channels()));
+	if(indices)
+	{
+		indices_ = *indices;
+	}
+	if(size_ == 0)
+	{
+		return;
+	}
+
+	// padding is zero, so kernels can process full channels
+	buffer_.resize(channels_*step_ + 8, 0.0f);
+	size_t address = (size_t)&buffer_[0];
+	offset_ = int((((address + 31) & ~(size_t)31) - address) / sizeof(float));
+	float * x = channel(0);
+	float * y = channel(1);
+	float * z = channel(2);
+	for(int i=0; i<size_; ++i)
+	{
+		UASSERT(index(i) >= 0 && index(i) < scan.size());
+		const float * ptr = scan.data().ptr<float>(0, index(i));
+		x[i] = ptr[0];
+		y[i] = ptr[1];
+		z[i] = is2d_?0.0f:ptr[2];
+	}
+	if(hasNormals())
+	{
+		int offset = scan.getNormalsOffset();
+		float * nx = channel(3);
+		float * ny = channel(4);
+		float * nz = channel(5);
+		for(int i=0; i<size_; ++i)
+		{
+			const float * ptr = scan.data().ptr<float>(0, index(i)) + offset;
+			nx[i] = ptr[0];
+			ny[i] = ptr[1];
+			nz[i] = ptr[2];
+		}
+	}
+}
+
+void LaserScanChannels::transform(const Transform & transform)
+{
+	if(size_ == 0 || transform.isNull() || transform.isIdentity())
+	{
+		return;
+	}
+
+	const float r[9] = {
+			transform.r11(), transform.r12(), transform.r13(),
+			transform.r21(), transform.r22(), transform.r23(),
+			transform.r31(), transform.r32(), transform.r33()};
+	const float t[3] = {transform.x(), transform.y(), transform.z()};
+
+	// points, then normals (rotation only)
+	for(int c=0; c<channels_; c+=3)
+	{
+		float * x = channel(c);
+		float * y = channel(c+1);
+		float * z = channel(c+2);
+		const float tx = c==0?t[0]:0.0f;
+		const float ty = c==0?t[1]:0.0f;
+		const float tz = c==0?t[2]:0.0f;
+		int i=0;
+#if defined(__AVX__)
+		const __m256 r00 = _mm256_set1_ps(r[0]), r01 = _mm256_set1_ps(r[1]), r02 = _mm256_set1_ps(r[2]);
+		const __m256 r10 = _mm256_set1_ps(r[3]), r11 = _mm256_set1_ps(r[4]), r12 = _mm256_set1_ps(r[5]);
+		const __m256 r20 = _mm256_set1_ps(r[6]), r21 = _mm256_set1_ps(r[7]), r22 = _mm256_set1_ps(r[8]);
+		const __m256 vtx = _mm256_set1_ps(tx), vty = _mm256_set1_ps(ty), vtz = _mm256_set1_ps(tz);
+		for(; i<step_; i+=8)
+		{
+			__m256 vx = _mm256_load_ps(x+i);
+			__m256 vy = _mm256_load_ps(y+i);
+			__m256 vz = _mm256_load_ps(z+i);
+			_mm256_store_ps(x+i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r00, vx), _mm256_mul_ps(r01, vy)), _mm256_add_ps(_mm256_mul_ps(r02, vz), vtx)));
+			_mm256_store_ps(y+i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r10, vx), _mm256_mul_ps(r11, vy)), _mm256_add_ps(_mm256_mul_ps(r12, vz), vty)));
+			_mm256_store_ps(z+i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r20, vx), _mm256_mul_ps(r21, vy)), _mm256_add_ps(_mm256_mul_ps(r22, vz), vtz)));
+		}
+#elif defined(__SSE2__) || defined(_M_X64)
+		const __m128 r00 = _mm_set1_ps(r[0]), r01 = _mm_set1_ps(r[1]), r02 = _mm_set1_ps(r[2]);
+		const __m128 r10 = _mm_set1_ps(r[3]), r11 = _mm_set1_ps(r[4]), r12 = _mm_set1_ps(r[5]);
+		const __m128 r20 = _mm_set1_ps(r[6]), r21 = _mm_set1_ps(r[7]), r22 = _mm_set1_ps(r[8]);
+		const __m128 vtx = _mm_set1_ps(tx), vty = _mm_set1_ps(ty), vtz = _mm_set1_ps(tz);
+		for(; i<step_; i+=4)
+		{
+			__m128 vx = _mm_load_ps(x+i);
+			__m128 vy = _mm_load_ps(y+i);
+			__m128 vz = _mm_load_ps(z+i);
+			_mm_store_ps(x+i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, vx), _mm_mul_ps(r01, vy)), _mm_add_ps(_mm_mul_ps(r02, vz), vtx)));
+			_mm_store_ps(y+i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r10, vx), _mm_mul_ps(r11, vy)), _mm_add_ps(_mm_mul_ps(r12, vz), vty)));
+			_mm_store_ps(z+i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r20, vx), _mm_mul_ps(r21, vy)), _mm_add_ps(_mm_mul_ps(r22, vz), vtz)));
+		}
+#endif
+		for(; i<size_; ++i)
+		{
+			float vx = x[i];
+			float vy = y[i];
+			float vz = z[i];
+			x[i] = r[0]*vx + r[1]*vy + r[2]*vz + tx;
+			y[i] = r[3]*vx + r[4]*vy + r[5]*vz + ty;
+			z[i] = r[6]*vx + r[7]*vy + r[8]*vz + tz;
+		}
+	}
+	if(is2d_)
+	{
+		// 2D scans stay in the xy plane
+		memset(channel(2), 0, step_*sizeof(float));
+	}
+}
+
+std::vector<int> LaserScanChannels::rangeFiltering(float rangeMin, float rangeMax) const
+{
+	std::vector<int> output;
+	if(size_ == 0)
+	{
+		return output;
+	}
+	output.reserve(size_);
+
+	// Points are rejected if r < min or r > max, so that NaN ranges are
+	// kept like before (comparisons with NaN are false).
+	const float rangeMinSqrd = rangeMin>0.0f?rangeMin*rangeMin:-1.0f;
+	const float rangeMaxSqrd = rangeMax>0.0f?rangeMax*rangeMax:FLT_MAX;
+	const float * x = channel(0);
+	const float * y = channel(1);
+	const float * z = channel(2);
+	int i=0;
+#if defined(__AVX__)
+	const __m256 vmin = _mm256_set1_ps(rangeMinSqrd);
+	const __m256 vmax = _mm256_set1_ps(rangeMaxSqrd);
+	for(; i<step_; i+=8)
+	{
+		__m256 vx = _mm256_load_ps(x+i);
+		__m256 vy = _mm256_load_ps(y+i);
+		__m256 vz = _mm256_load_ps(z+i);
+		__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+		int mask = _mm256_movemask_ps(_mm256_and_ps(
+				_mm256_cmp_ps(r, vmin, _CMP_NLT_UQ),
+				_mm256_cmp_ps(r, vmax, _CMP_NGT_UQ)));
+		for(int j=0; mask && j<8 && i+j<size_; ++j, mask>>=1)
+		{
+			if(mask & 1)
+			{
+				output.push_back(index(i+j));
+			}
+		}
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	const __m128 vmin = _mm_set1_ps(rangeMinSqrd);
+	const __m128 vmax = _mm_set1_ps(rangeMaxSqrd);
+	for(; i<step_; i+=4)
+	{
+		__m128 vx = _mm_load_ps(x+i);
+		__m128 vy = _mm_load_ps(y+i);
+		__m128 vz = _mm_load_ps(z+i);
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+		int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpnlt_ps(r, vmin), _mm_cmpngt_ps(r, vmax)));
+		for(int j=0; mask && j<4 && i+j<size_; ++j, mask>>=1)
+		{
+			if(mask & 1)
+			{
+				output.push_back(index(i+j));
+			}
+		}
+	}
+#endif
+	for(; i<size_; ++i)
+	{
+		float r = x[i]*x[i] + y[i]*y[i] + z[i]*z[i];
+		if(!(r < rangeMinSqrd) && !(r > rangeMaxSqrd))
+		{
+			output.push_back(index(i));
+		}
+	}
+	return output;
+}
+
+void LaserScanChannels::voxelCoordinates(float voxelSize, int * vx, int * vy, int * vz) const
+{
+	UASSERT(voxelSize > 0.0f);
+	const float inv = 1.0f/voxelSize;
+	int * out[3] = {vx, vy, vz};
+	for(int c=0; c<3; ++c)
+	{
+		const float * v = channel(c);
+		int * o = out[c];
+		int i=0;
+#if defined(__AVX__)
+		const __m256 vinv = _mm256_set1_ps(inv);
+		for(; i+8<=size_; i+=8)
+		{
+			__m256 f = _mm256_floor_ps(_mm256_mul_ps(_mm256_load_ps(v+i), vinv));
+			_mm256_storeu_si256((__m256i*)(o+i), _mm256_cvttps_epi32(f));
+		}
+#endif
+		for(; i<size_; ++i)
+		{
+			o[i] = (int)std::floor(v[i]*inv);
+		}
+	}
+}
+
+cv::Mat LaserScanChannels::data(const LaserScan & scan) const
+{
+	cv::Mat output = indices_.empty()?scan.data().clone():select(scan.data(), indices_);
+	if(size_ == 0)
+	{
+		return output;
+	}
+	UASSERT(output.cols == size_);
+
+	const float * x = channel(0);
+	const float * y = channel(1);
+	const float * z = channel(2);
+	for(int i=0; i<size_; ++i)
+	{
+		float * ptr = output.ptr<float>(0, i);
+		ptr[0] = x[i];
+		ptr[1] = y[i];
+		if(!is2d_)
+		{
+			ptr[2] = z[i];
+		}
+	}
+	if(hasNormals())
+	{
+		int offset = scan.getNormalsOffset();
+		const float * nx = channel(3);
+		const float * ny = channel(4);
+		const float * nz = channel(5);
+		for(int i=0; i<size_; ++i)
+		{
+			float * ptr = output.ptr<float>(0, i) + offset;
+			ptr[0] = nx[i];
+			ptr[1] = ny[i];
+			ptr[2] = nz[i];
+		}
+	}
+	return output;
+}
+
+cv::Mat LaserScanChannels::select(const cv::Mat & data, const std::vector<int> & indices)
+{
+	if(data.empty())
+	{
+		return cv::Mat();
+	}
+	UASSERT(data.rows == 1);
+	cv::Mat output(1, (int)indices.size(), data.type());
+	size_t elemSize = data.elemSize();
+	for(unsigned int i=0; i<indices.size(); ++i)
+	{
+		UASSERT(indices[i] >= 0 && indices[i] < data.cols);
+		memcpy(output.ptr(0, i), data.ptr(0, indices[i]), elemSize);
+	}
+	return output;
+}
+
+}
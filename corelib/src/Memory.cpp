@@ -63,6 +63,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/OccupancyGrid.h>
 #include <rtabmap/core/MarkerDetector.h>
 #include <opencv2/imgproc/types_c.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace rtabmap {
 
@@ -79,6 +83,7 @@ Memory::Memory(const ParametersMap & parameters) :
 	_notLinkedNodesKeptInDb(Parameters::defaultMemNotLinkedNodesKept()),
 	_saveIntermediateNodeData(Parameters::defaultMemIntermediateNodeDataKept()),
 	_rgbCompressionFormat(Parameters::defaultMemImageCompressionFormat()),
+	_depthCompressionFormat(Parameters::defaultMemDepthCompressionFormat()),
 	_incrementalMemory(Parameters::defaultMemIncrementalMemory()),
 	_reduceGraph(Parameters::defaultMemReduceGraph()),
 	_maxStMemSize(Parameters::defaultMemSTMSize()),
@@ -92,6 +97,8 @@ Memory::Memory(const ParametersMap & parameters) :
 	_imagePreDecimation(Parameters::defaultMemImagePreDecimation()),
 	_imagePostDecimation(Parameters::defaultMemImagePostDecimation()),
 	_compressionParallelized(Parameters::defaultMemCompressionParallelized()),
+	_compressionCodec(Parameters::defaultMemCompressionCodec()),
+	_compressionPngLevel(Parameters::defaultMemCompressionPngLevel()),
 	_laserScanDownsampleStepSize(Parameters::defaultMemLaserScanDownsampleStepSize()),
 	_laserScanVoxelSize(Parameters::defaultMemLaserScanVoxelSize()),
 	_laserScanNormalK(Parameters::defaultMemLaserScanNormalK()),
@@ -540,6 +547,7 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(params, Parameters::kMemNotLinkedNodesKept(), _notLinkedNodesKeptInDb);
 	Parameters::parse(params, Parameters::kMemIntermediateNodeDataKept(), _saveIntermediateNodeData);
 	Parameters::parse(params, Parameters::kMemImageCompressionFormat(), _rgbCompressionFormat);
+	Parameters::parse(params, Parameters::kMemDepthCompressionFormat(), _depthCompressionFormat);
 	Parameters::parse(params, Parameters::kMemRehearsalIdUpdatedToNewOne(), _idUpdatedToNewOneRehearsal);
 	Parameters::parse(params, Parameters::kMemGenerateIds(), _generateIds);
 	Parameters::parse(params, Parameters::kMemBadSignaturesIgnored(), _badSignaturesIgnored);
@@ -552,6 +560,8 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(params, Parameters::kMemImagePreDecimation(), _imagePreDecimation);
 	Parameters::parse(params, Parameters::kMemImagePostDecimation(), _imagePostDecimation);
 	Parameters::parse(params, Parameters::kMemCompressionParallelized(), _compressionParallelized);
+	Parameters::parse(params, Parameters::kMemCompressionCodec(), _compressionCodec);
+	Parameters::parse(params, Parameters::kMemCompressionPngLevel(), _compressionPngLevel);
 	Parameters::parse(params, Parameters::kMemLaserScanDownsampleStepSize(), _laserScanDownsampleStepSize);
 	Parameters::parse(params, Parameters::kMemLaserScanVoxelSize(), _laserScanVoxelSize);
 	Parameters::parse(params, Parameters::kMemLaserScanNormalK(), _laserScanNormalK);
@@ -881,6 +891,7 @@ void Memory::addSignatureToStm(Signature * signature, const cv::Mat & covariance
 	if(signature)
 	{
 		UDEBUG("adding %d", signature->id());
+		_linksModifiedIds.insert(signature->id()); // with its landmarks
 		// Update neighbors
 		if(_stMem.size())
 		{
@@ -961,6 +972,7 @@ void Memory::addSignatureToStm(Signature * signature, const cv::Mat & covariance
 					_signatures.at(*_stMem.rbegin())->addLink(Link(*_stMem.rbegin(), signature->id(), Link::kNeighbor, Transform()));
 					signature->addLink(Link(signature->id(), *_stMem.rbegin(), Link::kNeighbor, Transform()));
 				}
+				_linksModifiedIds.insert(*_stMem.rbegin());
 				UDEBUG("Min STM id = %d", *_stMem.begin());
 			}
 			else
@@ -1080,6 +1092,7 @@ void Memory::moveSignatureToWMFromSTM(int id, int * reducedTo)
 					Signature * sTo = this->_getSignature(iter->first);
 					UASSERT(sTo!=0);
 					sTo->removeLink(s->id());
+					_linksModifiedIds.insert(sTo->id());
 					if(iter->second.type() != Link::kNeighbor &&
 					   iter->second.type() != Link::kNeighborMerged &&
 					   iter->second.type() != Link::kUndef)
@@ -1097,6 +1110,7 @@ void Memory::moveSignatureToWMFromSTM(int id, int * reducedTo)
 								UASSERT(sB!=0);
 								UASSERT(!sB->hasLink(l.to()));
 								sB->addLink(l.inverse());
+								_linksModifiedIds.insert(sB->id());
 							}
 						}
 					}
@@ -1110,6 +1124,7 @@ void Memory::moveSignatureToWMFromSTM(int id, int * reducedTo)
 					   iter->second.type() == Link::kNeighborMerged)
 					{
 						s->removeLink(iter->first);
+						_linksModifiedIds.insert(s->id());
 						if(iter->second.type() == Link::kNeighbor)
 						{
 							if(_lastGlobalLoopClosureId == s->id())
@@ -1736,6 +1751,7 @@ void Memory::clear()
 	_idMapCount = kIdStart;
 	_memoryChanged = false;
 	_linksChanged = false;
+	_linksModifiedIds.clear();
 	_gpsOrigin = GPS();
 	_rectCameraModels.clear();
 	_rectStereoCameraModel = StereoCameraModel();
@@ -1744,6 +1760,7 @@ void Memory::clear()
 	_labels.clear();
 	_landmarksIndex.clear();
 	_landmarksInvertedIndex.clear();
+	_icpMultiAssembledScans.clear();
 	_allNodesInWM = true;
 
 	if(_dbDriver)
@@ -1831,52 +1848,107 @@ std::map<int, float> Memory::computeLikelihood(const Signature * signature, cons
 
 		const std::list<int> & wordIds = uUniqueKeys(signature->getWords());
 
-		float nwi; // nwi is the number of a specific word referenced by a place
-		float ni; // ni is the total of words referenced by a place
-		float nw; // nw is the number of places referenced by a specific word
 		float N; // N is the total number of places
 
-		float logNnw;
-		const VisualWord * vw;
-
 		N = this->getSignatures().size();
 
 		if(N)
 		{
 			UDEBUG("processing... ");
-			// Pour chaque mot dans la signature SURF
+
+			// Dense layout of the locations to compare: sorted ids
+			// (same order than the likelihood map) with their cached
+			// inverse number of words (1/ni), so that ni is looked up
+			// only once per location instead of once per reference.
+			std::vector<int> locationIds(likelihood.size());
+			std::vector<float> niInv(likelihood.size(), 0.0f);
+			int index = 0;
+			for(std::map<int, float>::iterator iter=likelihood.begin(); iter!=likelihood.end(); ++iter, ++index)
+			{
+				locationIds[index] = iter->first;
+				if(iter->first > 0)
+				{
+					int ni = this->getNi(iter->first); // ni is the total of words referenced by a place
+					if(ni != 0)
+					{
+						niInv[index] = 1.0f / float(ni);
+					}
+				}
+			}
+
+			// Inverted index: words of the signature with their idf weight log(N/nw)
+			std::vector<const VisualWord *> words;
+			std::vector<float> logNnws;
+			words.reserve(wordIds.size());
+			logNnws.reserve(wordIds.size());
 			for(std::list<int>::const_iterator i=wordIds.begin(); i!=wordIds.end(); ++i)
 			{
 				if(*i>0)
 				{
-					// "Inverted index" - Pour chaque endroit contenu dans chaque mot
-					vw = _vwd->getWord(*i);
+					const VisualWord * vw = _vwd->getWord(*i);
 					UASSERT_MSG(vw!=0, uFormat("Word %d not found in dictionary!?", *i).c_str());
 
-					const std::map<int, int> & refs = vw->getReferences();
-					nw = refs.size();
+					float nw = vw->getReferences().size(); // nw is the number of places referenced by a specific word
 					if(nw)
 					{
-						logNnw = log10(N/nw);
+						float logNnw = log10(N/nw);
 						if(logNnw)
 						{
-							for(std::map<int, int>::const_iterator j=refs.begin(); j!=refs.end(); ++j)
-							{
-								std::map<int, float>::iterator iter = likelihood.find(j->first);
-								if(iter != likelihood.end())
-								{
-									nwi = j->second;
-									ni = this->getNi(j->first);
-									if(ni != 0)
-									{
-										//UDEBUG("%d, %f %f %f %f", vw->id(), logNnw, nwi, ni, ( nwi  * logNnw ) / ni);
-										iter->second += ( nwi  * logNnw ) / ni;
-									}
-								}
-							}
+							words.push_back(vw);
+							logNnws.push_back(logNnw);
+						}
+					}
+				}
+			}
+
+			// Accumulate tf-idf scores. Each thread accumulates in its own
+			// partial score array, which are summed afterwards in thread order.
+			std::vector<float> scores(locationIds.size(), 0.0f);
+			int wordsSize = (int)words.size();
+#ifdef _OPENMP
+			#pragma omp parallel if(wordsSize > 256)
+#endif
+			{
+				std::vector<float> partialScores(locationIds.size(), 0.0f);
+#ifdef _OPENMP
+				#pragma omp for schedule(static)
+#endif
+				for(int i=0; i<wordsSize; ++i)
+				{
+					const std::map<int, int> & refs = words[i]->getReferences();
+					const float logNnw = logNnws[i];
+					std::vector<int>::const_iterator lowerBound = locationIds.begin();
+					// references and locations are both sorted by id
+					for(std::map<int, int>::const_iterator j=refs.begin(); j!=refs.end() && lowerBound!=locationIds.end(); ++j)
+					{
+						lowerBound = std::lower_bound(lowerBound, (std::vector<int>::const_iterator)locationIds.end(), j->first);
+						if(lowerBound != locationIds.end() && *lowerBound == j->first)
+						{
+							int k = lowerBound - locationIds.begin();
+							// nwi is the number of a specific word referenced by a place
+							partialScores[k] += ( float(j->second) * logNnw ) * niInv[k];
 						}
 					}
 				}
+#ifdef _OPENMP
+				#pragma omp for ordered schedule(static,1)
+				for(int t=0; t<omp_get_num_threads(); ++t)
+				{
+					#pragma omp ordered
+					for(unsigned int k=0; k<scores.size(); ++k)
+					{
+						scores[k] += partialScores[k];
+					}
+				}
+#else
+				scores.swap(partialScores);
+#endif
+			}
+
+			index = 0;
+			for(std::map<int, float>::iterator iter=likelihood.begin(); iter!=likelihood.end(); ++iter, ++index)
+			{
+				iter->second = scores[index];
 			}
 		}
 
@@ -2339,10 +2411,12 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 					}
 
 					sTo->removeLink(s->id());
+					_linksModifiedIds.insert(sTo->id());
 				}
 
 			}
 			s->removeLinks(true); // remove all links, but keep self referring link
+			_linksModifiedIds.insert(s->id());
 			s->removeLandmarks(); // remove all landmarks
 			s->setWeight(0);
 			s->setLabel(""); // reset label
@@ -2594,6 +2668,8 @@ void Memory::removeLink(int oldId, int newId)
 
 			oldS->removeLink(newS->id());
 			newS->removeLink(oldS->id());
+			_linksModifiedIds.insert(oldS->id());
+			_linksModifiedIds.insert(newS->id());
 
 			if(type!=Link::kVirtualClosure)
 			{
@@ -2686,36 +2762,144 @@ Transform Memory::computeTransform(
 		bool useKnownCorrespondencesIfPossible) const
 {
 	UDEBUG("");
-	Transform transform;
 
 	// make sure we have all data needed
-	// load binary data from database if not in RAM (if image is already here, scan and userData should be or they are null)
-	if(((_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired()) && fromS.sensorData().imageCompressed().empty()) ||
-	   (_registrationPipeline->isScanRequired() && fromS.sensorData().imageCompressed().empty() && fromS.sensorData().laserScanCompressed().isEmpty()) ||
-	   (_registrationPipeline->isUserDataRequired() && fromS.sensorData().imageCompressed().empty() && fromS.sensorData().userDataCompressed().empty()))
+	loadRegistrationData(fromS);
+	loadRegistrationData(toS);
+	uncompressRegistrationData(fromS);
+	uncompressRegistrationData(toS);
+
+	return computeTransformImpl(fromS, toS, guess, info, useKnownCorrespondencesIfPossible);
+}
+
+std::vector<Transform> Memory::computeTransforms(
+		const std::vector<std::pair<int, int> > & ids,
+		const std::vector<Transform> & guesses,
+		std::vector<RegistrationInfo> * infos,
+		bool useKnownCorrespondencesIfPossible)
+{
+	std::vector<std::pair<Signature*, Signature*> > signatures(ids.size());
+	std::vector<std::string> msgs(ids.size());
+	for(unsigned int i=0; i<ids.size(); ++i)
+	{
+		Signature * fromS = this->_getSignature(ids[i].first);
+		Signature * toS = this->_getSignature(ids[i].second);
+		if(fromS && toS)
+		{
+			signatures[i] = std::make_pair(fromS, toS);
+		}
+		else
+		{
+			msgs[i] = uFormat("Did not find nodes %d and/or %d", ids[i].first, ids[i].second);
+			UWARN(msgs[i].c_str());
+		}
+	}
+
+	std::vector<Transform> transforms = computeTransforms(signatures, guesses, infos, useKnownCorrespondencesIfPossible);
+	if(infos)
+	{
+		for(unsigned int i=0; i<msgs.size(); ++i)
+		{
+			if(!msgs[i].empty())
+			{
+				infos->at(i).rejectedMsg = msgs[i];
+			}
+		}
+	}
+	return transforms;
+}
+
+std::vector<Transform> Memory::computeTransforms(
+		const std::vector<std::pair<Signature*, Signature*> > & signatures,
+		const std::vector<Transform> & guesses,
+		std::vector<RegistrationInfo> * infos,
+		bool useKnownCorrespondencesIfPossible) const
+{
+	UASSERT(guesses.size() == signatures.size());
+	UDEBUG("registrations=%d", (int)signatures.size());
+
+	// Load data sequentially (database access), then uncompress each
+	// signature only once even if it is used by many registrations.
+	std::vector<Signature*> toUncompress;
+	std::set<Signature*> added;
+	for(unsigned int i=0; i<signatures.size(); ++i)
+	{
+		Signature * s[2] = {signatures[i].first, signatures[i].second};
+		for(int j=0; j<2; ++j)
+		{
+			if(s[j] && added.insert(s[j]).second)
+			{
+				loadRegistrationData(*s[j]);
+				toUncompress.push_back(s[j]);
+			}
+		}
+	}
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)toUncompress.size(); ++i)
+	{
+		uncompressRegistrationData(*toUncompress[i]);
+	}
+
+	// Registrations are independent, the registration pipeline can be used
+	// concurrently and the signatures are not modified anymore.
+	std::vector<Transform> transforms(signatures.size());
+	std::vector<RegistrationInfo> tmpInfos;
+	if(infos == 0)
+	{
+		infos = &tmpInfos;
+	}
+	infos->resize(signatures.size());
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)signatures.size(); ++i)
 	{
-		fromS.sensorData() = getNodeData(fromS.id());
+		if(signatures[i].first && signatures[i].second)
+		{
+			transforms[i] = computeTransformImpl(
+					*signatures[i].first,
+					*signatures[i].second,
+					guesses[i],
+					&infos->at(i),
+					useKnownCorrespondencesIfPossible);
+		}
 	}
-	if(((_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired()) && toS.sensorData().imageCompressed().empty()) ||
-	   (_registrationPipeline->isScanRequired() && toS.sensorData().imageCompressed().empty() && toS.sensorData().laserScanCompressed().isEmpty()) ||
-	   (_registrationPipeline->isUserDataRequired() && toS.sensorData().imageCompressed().empty() && toS.sensorData().userDataCompressed().empty()))
+	return transforms;
+}
+
+void Memory::loadRegistrationData(Signature & s) const
+{
+	// load binary data from database if not in RAM (if image is already here, scan and userData should be or they are null)
+	if(((_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired()) && s.sensorData().imageCompressed().empty()) ||
+	   (_registrationPipeline->isScanRequired() && s.sensorData().imageCompressed().empty() && s.sensorData().laserScanCompressed().isEmpty()) ||
+	   (_registrationPipeline->isUserDataRequired() && s.sensorData().imageCompressed().empty() && s.sensorData().userDataCompressed().empty()))
 	{
-		toS.sensorData() = getNodeData(toS.id());
+		s.sensorData() = getNodeData(s.id());
 	}
+}
+
+void Memory::uncompressRegistrationData(Signature & s) const
+{
 	// uncompress only what we need
 	cv::Mat imgBuf, depthBuf, userBuf;
 	LaserScan laserBuf;
-	fromS.sensorData().uncompressData(
-			(_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired())?&imgBuf:0,
-			(_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired())?&depthBuf:0,
-			_registrationPipeline->isScanRequired()?&laserBuf:0,
-			_registrationPipeline->isUserDataRequired()?&userBuf:0);
-	toS.sensorData().uncompressData(
+	s.sensorData().uncompressData(
 			(_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired())?&imgBuf:0,
 			(_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired())?&depthBuf:0,
 			_registrationPipeline->isScanRequired()?&laserBuf:0,
 			_registrationPipeline->isUserDataRequired()?&userBuf:0);
+}
 
+Transform Memory::computeTransformImpl(
+		const Signature & fromS,
+		const Signature & toS,
+		Transform guess,
+		RegistrationInfo * info,
+		bool useKnownCorrespondencesIfPossible) const
+{
+	Transform transform;
 
 	// compute transform fromId -> toId
 	std::vector<int> inliersV;
@@ -2994,6 +3178,61 @@ Transform Memory::computeIcpTransformMulti(
 		int toId,
 		const std::map<int, Transform> & poses,
 		RegistrationInfo * info)
+{
+	Transform t;
+	SensorData assembledData;
+	Transform guess;
+	if(assembleScansMulti(fromId, toId, poses, assembledData, guess))
+	{
+		t = _registrationIcpMulti->computeTransformation(_getSignature(fromId)->sensorData(), assembledData, guess, info);
+	}
+	return t;
+}
+
+std::vector<Transform> Memory::computeIcpTransformsMulti(
+		int fromId,
+		const std::vector<std::pair<int, std::map<int, Transform> > > & toIdsAndPoses,
+		std::vector<RegistrationInfo> * infos)
+{
+	UDEBUG("registrations=%d", (int)toIdsAndPoses.size());
+
+	// Scans are assembled sequentially (database access and cache of
+	// assembled scans), then registered in parallel.
+	std::vector<SensorData> assembledData(toIdsAndPoses.size());
+	std::vector<Transform> guesses(toIdsAndPoses.size());
+	std::vector<bool> assembled(toIdsAndPoses.size(), false);
+	for(unsigned int i=0; i<toIdsAndPoses.size(); ++i)
+	{
+		assembled[i] = assembleScansMulti(fromId, toIdsAndPoses[i].first, toIdsAndPoses[i].second, assembledData[i], guesses[i]);
+	}
+
+	const SensorData & fromData = _getSignature(fromId)->sensorData();
+	std::vector<Transform> transforms(toIdsAndPoses.size());
+	std::vector<RegistrationInfo> tmpInfos;
+	if(infos == 0)
+	{
+		infos = &tmpInfos;
+	}
+	infos->resize(toIdsAndPoses.size());
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int i=0; i<(int)toIdsAndPoses.size(); ++i)
+	{
+		if(assembled[i])
+		{
+			transforms[i] = _registrationIcpMulti->computeTransformation(fromData, assembledData[i], guesses[i], &infos->at(i));
+		}
+	}
+	return transforms;
+}
+
+bool Memory::assembleScansMulti(
+		int fromId,
+		int toId,
+		const std::map<int, Transform> & poses,
+		SensorData & assembledData,
+		Transform & guess)
 {
 	UASSERT(uContains(poses, fromId) && uContains(_signatures, fromId));
 	UASSERT(uContains(poses, toId) && uContains(_signatures, toId));
@@ -3038,113 +3277,174 @@ Transform Memory::computeIcpTransformMulti(
 	LaserScan toScan;
 	toS->sensorData().uncompressData(0, 0, &toScan);
 
-	Transform t;
 	if(!fromScan.isEmpty() && !toScan.isEmpty())
 	{
-		Transform guess = poses.at(fromId).inverse() * poses.at(toId);
+		guess = poses.at(fromId).inverse() * poses.at(toId);
 		float guessNorm = guess.getNorm();
 		if(fromScan.rangeMax() > 0.0f && toScan.rangeMax() > 0.0f &&
 			guessNorm > fromScan.rangeMax() + toScan.rangeMax())
 		{
 			// stop right known,it is impossible that scans overlay.
 			UINFO("Too far scans between %d and %d to compute transformation: guessNorm=%f, scan range from=%f to=%f", fromId, toId, guessNorm, fromScan.rangeMax(), toScan.rangeMax());
-			return t;
+			return false;
 		}
 
-		// Create a fake signature with all scans merged in oldId referential
-		SensorData assembledData;
 		Transform toPoseInv = poses.at(toId).inverse();
-		std::string msg;
-		int maxPoints = fromScan.size();
-		pcl::PointCloud<pcl::PointXYZ>::Ptr assembledToClouds(new pcl::PointCloud<pcl::PointXYZ>);
-		pcl::PointCloud<pcl::PointNormal>::Ptr assembledToNormalClouds(new pcl::PointCloud<pcl::PointNormal>);
-		pcl::PointCloud<pcl::PointXYZI>::Ptr assembledToIClouds(new pcl::PointCloud<pcl::PointXYZI>);
-		pcl::PointCloud<pcl::PointXYZINormal>::Ptr assembledToNormalIClouds(new pcl::PointCloud<pcl::PointXYZINormal>);
+		AssembledScans assembled;
+		assembled.toId = toId;
+		assembled.format = fromScan.format();
+		assembled.maxPoints = fromScan.maxPoints();
+		assembled.rangeMax = fromScan.rangeMax();
+		assembled.localTransform = fromScan.localTransform();
 		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
 		{
 			if(iter->first != fromId)
 			{
-				Signature * s = this->_getSignature(iter->first);
-				if(!s->sensorData().laserScanCompressed().isEmpty())
+				assembled.poses.push_back(std::make_pair(iter->first, toPoseInv * iter->second));
+				assembled.scans.push_back(this->_getSignature(iter->first)->sensorData().laserScanCompressed().data());
+			}
+		}
+		std::list<AssembledScans>::iterator cached = _icpMultiAssembledScans.begin();
+		for(; cached!=_icpMultiAssembledScans.end(); ++cached)
+		{
+			if(cached->isSame(assembled))
+			{
+				break;
+			}
+		}
+
+		if(cached != _icpMultiAssembledScans.end())
+		{
+			// Same scans than a previous call, the assembled scan is reused
+			// and so its prepared target in RegistrationIcp.
+			UDEBUG("Reusing assembled scans of %d nodes", (int)cached->poses.size());
+			assembledData = cached->data;
+			_icpMultiAssembledScans.splice(_icpMultiAssembledScans.begin(), _icpMultiAssembledScans, cached);
+		}
+		else
+		{
+			// Create a fake signature with all scans merged in oldId referential
+			std::string msg;
+			int maxPoints = fromScan.size();
+			pcl::PointCloud<pcl::PointXYZ>::Ptr assembledToClouds(new pcl::PointCloud<pcl::PointXYZ>);
+			pcl::PointCloud<pcl::PointNormal>::Ptr assembledToNormalClouds(new pcl::PointCloud<pcl::PointNormal>);
+			pcl::PointCloud<pcl::PointXYZI>::Ptr assembledToIClouds(new pcl::PointCloud<pcl::PointXYZI>);
+			pcl::PointCloud<pcl::PointXYZINormal>::Ptr assembledToNormalIClouds(new pcl::PointCloud<pcl::PointXYZINormal>);
+			for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+			{
+				if(iter->first != fromId)
 				{
-					LaserScan scan;
-					s->sensorData().uncompressData(0, 0, &scan);
-					if(!scan.isEmpty() && scan.format() == fromScan.format())
+					Signature * s = this->_getSignature(iter->first);
+					if(!s->sensorData().laserScanCompressed().isEmpty())
 					{
-						if(scan.hasIntensity())
+						LaserScan scan;
+						s->sensorData().uncompressData(0, 0, &scan);
+						if(!scan.isEmpty() && scan.format() == fromScan.format())
 						{
-							if(scan.hasNormals())
+							if(scan.hasIntensity())
 							{
-								*assembledToNormalIClouds += *util3d::laserScanToPointCloudINormal(scan,
-										toPoseInv * iter->second * scan.localTransform());
+								if(scan.hasNormals())
+								{
+									*assembledToNormalIClouds += *util3d::laserScanToPointCloudINormal(scan,
+											toPoseInv * iter->second * scan.localTransform());
+								}
+								else
+								{
+									*assembledToIClouds += *util3d::laserScanToPointCloudI(scan,
+											toPoseInv * iter->second * scan.localTransform());
+								}
 							}
 							else
 							{
-								*assembledToIClouds += *util3d::laserScanToPointCloudI(scan,
-										toPoseInv * iter->second * scan.localTransform());
-							}
-						}
-						else
-						{
-							if(scan.hasNormals())
-							{
-								*assembledToNormalClouds += *util3d::laserScanToPointCloudNormal(scan,
-										toPoseInv * iter->second * scan.localTransform());
+								if(scan.hasNormals())
+								{
+									*assembledToNormalClouds += *util3d::laserScanToPointCloudNormal(scan,
+											toPoseInv * iter->second * scan.localTransform());
+								}
+								else
+								{
+									*assembledToClouds += *util3d::laserScanToPointCloud(scan,
+											toPoseInv * iter->second * scan.localTransform());
+								}
 							}
-							else
+
+							if(scan.size() > maxPoints)
 							{
-								*assembledToClouds += *util3d::laserScanToPointCloud(scan,
-										toPoseInv * iter->second * scan.localTransform());
+								maxPoints = scan.size();
 							}
 						}
-
-						if(scan.size() > maxPoints)
+						else if(!scan.isEmpty())
 						{
-							maxPoints = scan.size();
+							UWARN("Incompatible scan format %d vs %d", (int)fromScan.format(), (int)scan.format());
 						}
 					}
-					else if(!scan.isEmpty())
+					else
 					{
-						UWARN("Incompatible scan format %d vs %d", (int)fromScan.format(), (int)scan.format());
+						UWARN("Depth2D not found for signature %d", iter->first);
 					}
 				}
-				else
-				{
-					UWARN("Depth2D not found for signature %d", iter->first);
-				}
 			}
-		}
 
-		cv::Mat assembledScan;
-		if(assembledToNormalClouds->size())
-		{
-			assembledScan = fromScan.is2d()?util3d::laserScan2dFromPointCloud(*assembledToNormalClouds):util3d::laserScanFromPointCloud(*assembledToNormalClouds);
-		}
-		else if(assembledToClouds->size())
-		{
-			assembledScan = fromScan.is2d()?util3d::laserScan2dFromPointCloud(*assembledToClouds):util3d::laserScanFromPointCloud(*assembledToClouds);
-		}
-		else if(assembledToNormalIClouds->size())
-		{
-			assembledScan = fromScan.is2d()?util3d::laserScan2dFromPointCloud(*assembledToNormalIClouds):util3d::laserScanFromPointCloud(*assembledToNormalIClouds);
-		}
-		else if(assembledToIClouds->size())
-		{
-			assembledScan = fromScan.is2d()?util3d::laserScan2dFromPointCloud(*assembledToIClouds):util3d::laserScanFromPointCloud(*assembledToIClouds);
-		}
+			cv::Mat assembledScan;
+			if(assembledToNormalClouds->size())
+			{
+				assembledScan = fromScan.is2d()?util3d::laserScan2dFromPointCloud(*assembledToNormalClouds):util3d::laserScanFromPointCloud(*assembledToNormalClouds);
+			}
+			else if(assembledToClouds->size())
+			{
+				assembledScan = fromScan.is2d()?util3d::laserScan2dFromPointCloud(*assembledToClouds):util3d::laserScanFromPointCloud(*assembledToClouds);
+			}
+			else if(assembledToNormalIClouds->size())
+			{
+				assembledScan = fromScan.is2d()?util3d::laserScan2dFromPointCloud(*assembledToNormalIClouds):util3d::laserScanFromPointCloud(*assembledToNormalIClouds);
+			}
+			else if(assembledToIClouds->size())
+			{
+				assembledScan = fromScan.is2d()?util3d::laserScan2dFromPointCloud(*assembledToIClouds):util3d::laserScanFromPointCloud(*assembledToIClouds);
+			}
 
-		// scans are in base frame but for 2d scans, set the height so that correspondences matching works
-		assembledData.setLaserScan(
-				LaserScan(assembledScan,
-					fromScan.maxPoints()?fromScan.maxPoints():maxPoints,
-					fromScan.rangeMax(),
-					fromScan.format(),
-					fromScan.is2d()?Transform(0,0,fromScan.localTransform().z(),0,0,0):Transform::getIdentity()));
+			// scans are in base frame but for 2d scans, set the height so that correspondences matching works
+			assembledData.setLaserScan(
+					LaserScan(assembledScan,
+						fromScan.maxPoints()?fromScan.maxPoints():maxPoints,
+						fromScan.rangeMax(),
+						fromScan.format(),
+						fromScan.is2d()?Transform(0,0,fromScan.localTransform().z(),0,0,0):Transform::getIdentity()));
 
-		t = _registrationIcpMulti->computeTransformation(fromS->sensorData(), assembledData, guess, info);
+			assembled.data = assembledData;
+			_icpMultiAssembledScans.push_front(assembled);
+			if(_icpMultiAssembledScans.size() > 5)
+			{
+				_icpMultiAssembledScans.pop_back();
+			}
+		}
+		return true;
 	}
 
-	return t;
+	return false;
+}
+
+bool Memory::AssembledScans::isSame(const AssembledScans & other) const
+{
+	if(toId != other.toId ||
+		format != other.format ||
+		maxPoints != other.maxPoints ||
+		rangeMax != other.rangeMax ||
+		localTransform != other.localTransform ||
+		poses.size() != other.poses.size())
+	{
+		return false;
+	}
+	for(unsigned int i=0; i<poses.size(); ++i)
+	{
+		if(poses[i].first != other.poses[i].first ||
+			poses[i].second != other.poses[i].second ||
+			scans[i].data != other.scans[i].data)
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
 bool Memory::addLink(const Link & link, bool addInDatabase)
@@ -3152,6 +3452,8 @@ bool Memory::addLink(const Link & link, bool addInDatabase)
 	UASSERT(link.type() > Link::kNeighbor && link.type() != Link::kUndef);
 
 	ULOGGER_INFO("to=%d, from=%d transform: %s var=%f", link.to(), link.from(), link.transform().prettyPrint().c_str(), link.transVariance());
+	_linksModifiedIds.insert(link.from());
+	_linksModifiedIds.insert(link.to());
 	Signature * toS = _getSignature(link.to());
 	Signature * fromS = _getSignature(link.from());
 	if(toS && fromS)
@@ -3234,6 +3536,8 @@ bool Memory::addLink(const Link & link, bool addInDatabase)
 
 void Memory::updateLink(const Link & link, bool updateInDatabase)
 {
+	_linksModifiedIds.insert(link.from());
+	_linksModifiedIds.insert(link.to());
 	Signature * fromS = this->_getSignature(link.from());
 	Signature * toS = this->_getSignature(link.to());
 
@@ -3297,7 +3601,12 @@ void Memory::removeAllVirtualLinks()
 	UDEBUG("");
 	for(std::map<int, Signature*>::iterator iter=_signatures.begin(); iter!=_signatures.end(); ++iter)
 	{
+		size_t links = iter->second->getLinks().size();
 		iter->second->removeVirtualLinks();
+		if(links != iter->second->getLinks().size())
+		{
+			_linksModifiedIds.insert(iter->first);
+		}
 	}
 }
 
@@ -3316,6 +3625,7 @@ void Memory::removeVirtualLinks(int signatureId)
 				if(sTo)
 				{
 					sTo->removeLink(s->id());
+					_linksModifiedIds.insert(sTo->id());
 				}
 				else
 				{
@@ -3324,6 +3634,7 @@ void Memory::removeVirtualLinks(int signatureId)
 			}
 		}
 		s->removeVirtualLinks();
+		_linksModifiedIds.insert(s->id());
 	}
 	else
 	{
@@ -3570,6 +3881,8 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 			Link newToOldLink = newS->getLinks().find(oldS->id())->second;
 			oldS->removeLink(newId);
 			newS->removeLink(oldId);
+			_linksModifiedIds.insert(oldId);
+			_linksModifiedIds.insert(newId);
 
 			if(_idUpdatedToNewOneRehearsal)
 			{
@@ -3589,6 +3902,7 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 							// modify neighbor "from"
 							s->removeLink(oldS->id());
 							s->addLink(mergedLink.inverse());
+							_linksModifiedIds.insert(s->id());
 
 							newS->addLink(mergedLink);
 						}
@@ -4878,10 +5192,10 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		cv::Mat compressedUserData;
 		if(_compressionParallelized)
 		{
-			rtabmap::CompressionThread ctImage(image, _rgbCompressionFormat);
-			rtabmap::CompressionThread ctDepth(depthOrRightImage, depthOrRightImage.type() == CV_32FC1 || depthOrRightImage.type() == CV_16UC1?std::string(".png"):_rgbCompressionFormat);
-			rtabmap::CompressionThread ctLaserScan(laserScan.data());
-			rtabmap::CompressionThread ctUserData(data.userDataRaw());
+			rtabmap::CompressionThread ctImage(image, _rgbCompressionFormat, 0, _compressionPngLevel);
+			rtabmap::CompressionThread ctDepth(depthOrRightImage, depthOrRightImage.type() == CV_32FC1 || depthOrRightImage.type() == CV_16UC1?_depthCompressionFormat:_rgbCompressionFormat, 0, _compressionPngLevel);
+			rtabmap::CompressionThread ctLaserScan(laserScan.data(), "", _compressionCodec);
+			rtabmap::CompressionThread ctUserData(data.userDataRaw(), "", _compressionCodec);
 			if(!image.empty())
 			{
 				ctImage.start();
@@ -4898,10 +5212,10 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 			{
 				ctUserData.start();
 			}
-			ctImage.join();
-			ctDepth.join();
-			ctLaserScan.join();
-			ctUserData.join();
+			ctImage.wait();
+			ctDepth.wait();
+			ctLaserScan.wait();
+			ctUserData.wait();
 
 			compressedImage = ctImage.getCompressedData();
 			compressedDepth = ctDepth.getCompressedData();
@@ -4910,10 +5224,10 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		}
 		else
 		{
-			compressedImage = compressImage2(image, _rgbCompressionFormat);
-			compressedDepth = compressImage2(depthOrRightImage, depthOrRightImage.type() == CV_32FC1 || depthOrRightImage.type() == CV_16UC1?std::string(".png"):_rgbCompressionFormat);
-			compressedScan = compressData2(laserScan.data());
-			compressedUserData = compressData2(data.userDataRaw());
+			compressedImage = compressImage2(image, _rgbCompressionFormat, _compressionPngLevel);
+			compressedDepth = compressImage2(depthOrRightImage, depthOrRightImage.type() == CV_32FC1 || depthOrRightImage.type() == CV_16UC1?_depthCompressionFormat:_rgbCompressionFormat, _compressionPngLevel);
+			compressedScan = compressData2(laserScan.data(), _compressionCodec);
+			compressedUserData = compressData2(data.userDataRaw(), _compressionCodec);
 		}
 
 		s = new Signature(id,
@@ -4978,8 +5292,8 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		cv::Mat compressedUserData;
 		if(_compressionParallelized)
 		{
-			rtabmap::CompressionThread ctUserData(data.userDataRaw());
-			rtabmap::CompressionThread ctLaserScan(laserScan.data());
+			rtabmap::CompressionThread ctUserData(data.userDataRaw(), "", _compressionCodec);
+			rtabmap::CompressionThread ctLaserScan(laserScan.data(), "", _compressionCodec);
 			if(!data.userDataRaw().empty() && !isIntermediateNode)
 			{
 				ctUserData.start();
@@ -4988,16 +5302,16 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 			{
 				ctLaserScan.start();
 			}
-			ctUserData.join();
-			ctLaserScan.join();
+			ctUserData.wait();
+			ctLaserScan.wait();
 
 			compressedScan = ctLaserScan.getCompressedData();
 			compressedUserData = ctUserData.getCompressedData();
 		}
 		else
 		{
-			compressedScan = compressData2(laserScan.data());
-			compressedUserData = compressData2(data.userDataRaw());
+			compressedScan = compressData2(laserScan.data(), _compressionCodec);
+			compressedUserData = compressData2(data.userDataRaw(), _compressionCodec);
 		}
 
 		s = new Signature(id,
@@ -5090,7 +5404,7 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 			cv::Point3f viewPoint(0,0,0);
 			_occupancy->createLocalMap(*s, ground, obstacles, empty, viewPoint);
 			cellSize = _occupancy->getCellSize();
-			s->sensorData().setOccupancyGrid(ground, obstacles, empty, cellSize, viewPoint);
+			s->sensorData().setOccupancyGrid(ground, obstacles, empty, cellSize, viewPoint, _compressionCodec);
 
 			t = timer.ticks();
 			if(stats) stats->addStatistic(Statistics::kTimingMemOccupancy_grid(), t*1000.0f);
@@ -5103,7 +5417,8 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 					data.gridObstacleCellsRaw(),
 					data.gridEmptyCellsRaw(),
 					data.gridCellSize(),
-					data.gridViewPoint());
+					data.gridViewPoint(),
+					_compressionCodec);
 		}
 	}
 
@@ -40,6 +40,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace rtabmap {
 
+// The global map grows by a multiple of this number of cells
+static const int kTileSize = 64;
+
+// Cells to add on a side of the map to cover the missing cells: whole tiles,
+// and at least half the current size so that the map is reallocated only
+// a logarithmic number of times while it grows (like std::vector).
+static int growthCells(int missing, int size)
+{
+	if(missing <= 0)
+	{
+		return 0;
+	}
+	int cells = std::max(missing, size/2);
+	return ((cells + kTileSize - 1) / kTileSize) * kTileSize;
+}
+
 OccupancyGrid::OccupancyGrid(const ParametersMap & parameters) :
 	parameters_(parameters),
 	cloudDecimation_(Parameters::defaultGridDepthDecimation()),
@@ -251,6 +267,7 @@ void OccupancyGrid::setMap(const cv::Mat & map, float xMin, float yMin, float ce
 		xMin_ = xMin;
 		yMin_ = yMin;
 		cellSize_ = cellSize;
+		dirtyRegion_ = cv::Rect(0, 0, map_.cols, map_.rows);
 		addedNodes_.insert(poses.lower_bound(1), poses.end());
 	}
 }
@@ -593,6 +610,7 @@ void OccupancyGrid::clear()
 	cache_.clear();
 	map_ = cv::Mat();
 	mapInfo_ = cv::Mat();
+	dirtyRegion_ = cv::Rect();
 	cellCount_.clear();
 	xMin_ = 0.0f;
 	yMin_ = 0.0f;
@@ -603,22 +621,38 @@ void OccupancyGrid::clear()
 
 cv::Mat OccupancyGrid::getMap(float & xMin, float & yMin) const
 {
-	xMin = xMin_;
-	yMin = yMin_;
+	return getMap(xMin, yMin, cv::Rect(0, 0, map_.cols, map_.rows));
+}
+
+cv::Mat OccupancyGrid::getMap(float & xMin, float & yMin, const cv::Rect & regionIn) const
+{
+	cv::Rect region = regionIn & cv::Rect(0, 0, map_.cols, map_.rows);
+	xMin = xMin_ + float(region.x)*cellSize_;
+	yMin = yMin_ + float(region.y)*cellSize_;
+	if(region.area() == 0)
+	{
+		return cv::Mat();
+	}
 
-	cv::Mat map = map_;
+	// with erosion, neighbor cells are required around the region
+	cv::Rect roi = region;
+	if(erode_)
+	{
+		roi = cv::Rect(region.x-1, region.y-1, region.width+2, region.height+2) & cv::Rect(0, 0, map_.cols, map_.rows);
+	}
+	cv::Mat map = map_(roi);
 
 	UTimer t;
-	if(occupancyThr_ != 0.0f && !map.empty())
+	if(occupancyThr_ != 0.0f)
 	{
 		float occThr = logodds(occupancyThr_);
-		map = cv::Mat(map.size(), map.type());
-		UASSERT(mapInfo_.cols == map.cols && mapInfo_.rows == map.rows);
+		map = cv::Mat(roi.size(), map_.type());
+		UASSERT(mapInfo_.cols == map_.cols && mapInfo_.rows == map_.rows);
 		for(int i=0; i<map.rows; ++i)
 		{
 			for(int j=0; j<map.cols; ++j)
 			{
-				const float * info = mapInfo_.ptr<float>(i, j);
+				const float * info = mapInfo_.ptr<float>(roi.y+i, roi.x+j);
 				if(info[3] == 0.0f)
 				{
 					map.at<char>(i, j) = -1; // unknown
@@ -636,28 +670,38 @@ cv::Mat OccupancyGrid::getMap(float & xMin, float & yMin) const
 		UDEBUG("Converting map from probabilities (thr=%f) = %fs", occupancyThr_, t.ticks());
 	}
 
-	if(erode_ && !map.empty())
+	if(erode_)
 	{
-		map = util3d::erodeMap(map);
+		map = util3d::erodeMap(map.isContinuous()?map:map.clone());
 		UDEBUG("Eroding map = %fs", t.ticks());
 	}
+	if(roi != region)
+	{
+		map = map(cv::Rect(region.x-roi.x, region.y-roi.y, region.width, region.height)).clone();
+	}
 	return map;
 }
 
 cv::Mat OccupancyGrid::getProbMap(float & xMin, float & yMin) const
 {
-	xMin = xMin_;
-	yMin = yMin_;
+	return getProbMap(xMin, yMin, cv::Rect(0, 0, mapInfo_.cols, mapInfo_.rows));
+}
+
+cv::Mat OccupancyGrid::getProbMap(float & xMin, float & yMin, const cv::Rect & regionIn) const
+{
+	cv::Rect region = regionIn & cv::Rect(0, 0, mapInfo_.cols, mapInfo_.rows);
+	xMin = xMin_ + float(region.x)*cellSize_;
+	yMin = yMin_ + float(region.y)*cellSize_;
 
 	cv::Mat map;
-	if(!mapInfo_.empty())
+	if(region.area())
 	{
-		map = cv::Mat(mapInfo_.size(), map_.type());
+		map = cv::Mat(region.size(), map_.type());
 		for(int i=0; i<map.rows; ++i)
 		{
 			for(int j=0; j<map.cols; ++j)
 			{
-				const float * info = mapInfo_.ptr<float>(i, j);
+				const float * info = mapInfo_.ptr<float>(region.y+i, region.x+j);
 				if(info[3] == 0.0f)
 				{
 					map.at<char>(i, j) = -1; // unknown
@@ -1094,6 +1138,7 @@ bool OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 			{
 				UDEBUG("map min=(%f, %f) odlMin(%f,%f) max=(%f,%f)", xMin, yMin, xMin_, yMin_, xMax, yMax);
 				cv::Size newMapSize((xMax - xMin) / cellSize_+0.5f, (yMax - yMin) / cellSize_+0.5f);
+				bool reallocated = true;
 				if(map_.empty())
 				{
 					UDEBUG("Map empty!");
@@ -1102,50 +1147,53 @@ bool OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 				}
 				else
 				{
-					if(xMin == xMin_ && yMin == yMin_ &&
-							newMapSize.width == map_.cols &&
-							newMapSize.height == map_.rows)
+					UASSERT_MSG(xMin <= xMin_+cellSize_/2, uFormat("xMin=%f, xMin_=%f, cellSize_=%f", xMin, xMin_, cellSize_).c_str());
+					UASSERT_MSG(yMin <= yMin_+cellSize_/2, uFormat("yMin=%f, yMin_=%f, cellSize_=%f", yMin, yMin_, cellSize_).c_str());
+					UASSERT_MSG(xMax >= xMin_+float(map_.cols)*cellSize_ - cellSize_/2, uFormat("xMin=%f, xMin_=%f, cols=%d cellSize_=%f", xMin, xMin_, map_.cols, cellSize_).c_str());
+					UASSERT_MSG(yMax >= yMin_+float(map_.rows)*cellSize_ - cellSize_/2, uFormat("yMin=%f, yMin_=%f, cols=%d cellSize_=%f", yMin, yMin_, map_.rows, cellSize_).c_str());
+
+					// The map grows geometrically by whole tiles, so that it is not reallocated
+					// and copied each time the robot goes a little further than the borders.
+					int deltaX = 0;
+					if(xMin < xMin_ - cellSize_/2)
+					{
+						deltaX = growthCells(int((xMin_ - xMin) / cellSize_ + 1.0f), map_.cols);
+					}
+					int deltaY = 0;
+					if(yMin < yMin_ - cellSize_/2)
+					{
+						deltaY = growthCells(int((yMin_ - yMin) / cellSize_ + 1.0f), map_.rows);
+					}
+					xMin = xMin_-float(deltaX)*cellSize_;
+					yMin = yMin_-float(deltaY)*cellSize_;
+					int extraX = growthCells(int((xMax - xMin) / cellSize_+0.5f) - (map_.cols + deltaX), map_.cols);
+					int extraY = growthCells(int((yMax - yMin) / cellSize_+0.5f) - (map_.rows + deltaY), map_.rows);
+
+					if(deltaX == 0 && deltaY == 0 && extraX == 0 && extraY == 0)
 					{
 						// same map size and origin, don't do anything
 						UDEBUG("Map same size!");
 						map = map_;
 						mapInfo = mapInfo_;
+						reallocated = false;
 					}
 					else
 					{
-						UASSERT_MSG(xMin <= xMin_+cellSize_/2, uFormat("xMin=%f, xMin_=%f, cellSize_=%f", xMin, xMin_, cellSize_).c_str());
-						UASSERT_MSG(yMin <= yMin_+cellSize_/2, uFormat("yMin=%f, yMin_=%f, cellSize_=%f", yMin, yMin_, cellSize_).c_str());
-						UASSERT_MSG(xMax >= xMin_+float(map_.cols)*cellSize_ - cellSize_/2, uFormat("xMin=%f, xMin_=%f, cols=%d cellSize_=%f", xMin, xMin_, map_.cols, cellSize_).c_str());
-						UASSERT_MSG(yMax >= yMin_+float(map_.rows)*cellSize_ - cellSize_/2, uFormat("yMin=%f, yMin_=%f, cols=%d cellSize_=%f", yMin, yMin_, map_.rows, cellSize_).c_str());
-
 						UDEBUG("Copy map");
 						// copy the old map in the new map
-						// make sure the translation is cellSize
-						int deltaX = 0;
-						if(xMin < xMin_)
-						{
-							deltaX = (xMin_ - xMin) / cellSize_ + 1.0f;
-							xMin = xMin_-float(deltaX)*cellSize_;
-						}
-						int deltaY = 0;
-						if(yMin < yMin_)
-						{
-							deltaY = (yMin_ - yMin) / cellSize_ + 1.0f;
-							yMin = yMin_-float(deltaY)*cellSize_;
-						}
+						newMapSize.width = map_.cols + deltaX + extraX;
+						newMapSize.height = map_.rows + deltaY + extraY;
 						UDEBUG("deltaX=%d, deltaY=%d", deltaX, deltaY);
-						newMapSize.width = (xMax - xMin) / cellSize_+0.5f;
-						newMapSize.height = (yMax - yMin) / cellSize_+0.5f;
 						UDEBUG("%d/%d -> %d/%d", map_.cols, map_.rows, newMapSize.width, newMapSize.height);
-						UASSERT(newMapSize.width >= map_.cols && newMapSize.height >= map_.rows);
-						UASSERT(newMapSize.width >= map_.cols+deltaX && newMapSize.height >= map_.rows+deltaY);
-						UASSERT(deltaX>=0 && deltaY>=0);
 						map = cv::Mat::ones(newMapSize, CV_8S)*-1;
 						mapInfo = cv::Mat::zeros(newMapSize, mapInfo_.type());
 						map_.copyTo(map(cv::Rect(deltaX, deltaY, map_.cols, map_.rows)));
 						mapInfo_.copyTo(mapInfo(cv::Rect(deltaX, deltaY, map_.cols, map_.rows)));
 					}
 				}
+				// cells modified by this update
+				cv::Point2i dirtyMin(map.cols, map.rows);
+				cv::Point2i dirtyMax(-1, -1);
 				UASSERT(map.cols == mapInfo.cols && map.rows == mapInfo.rows);
 				UDEBUG("map %d %d", map.cols, map.rows);
 				if(poses.size())
@@ -1174,6 +1222,8 @@ bool OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 							UASSERT_MSG(pt.y >=0 && pt.y < map.rows && pt.x >= 0 && pt.x < map.cols,
 									uFormat("%d: pt=(%d,%d) map=%dx%d rawPt=(%f,%f) xMin=%f yMin=%f channels=%dvs%d (graph modified=%d)",
 											kter->first, pt.x, pt.y, map.cols, map.rows, ptf[0], ptf[1], xMin, yMin, iter->second.channels(), mapInfo.channels()-1, (graphOptimized || graphChanged)?1:0).c_str());
+							dirtyMin.x = std::min(dirtyMin.x, pt.x); dirtyMin.y = std::min(dirtyMin.y, pt.y);
+							dirtyMax.x = std::max(dirtyMax.x, pt.x); dirtyMax.y = std::max(dirtyMax.y, pt.y);
 							char & value = map.at<char>(pt.y, pt.x);
 							if(value != -2 && (!incrementalGraphUpdate || value==-1))
 							{
@@ -1244,6 +1294,8 @@ bool OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 							ptBegin.y = 0;
 						if(ptEnd.y >= map.rows)
 							ptEnd.y = map.rows-1;
+						dirtyMin.x = std::min(dirtyMin.x, ptBegin.x); dirtyMin.y = std::min(dirtyMin.y, ptBegin.y);
+						dirtyMax.x = std::max(dirtyMax.x, ptEnd.x); dirtyMax.y = std::max(dirtyMax.y, ptEnd.y);
 						for(int i=ptBegin.x; i<ptEnd.x; ++i)
 						{
 							for(int j=ptBegin.y; j<ptEnd.y; ++j)
@@ -1298,6 +1350,8 @@ bool OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 							UASSERT_MSG(pt.y>=0 && pt.y < map.rows && pt.x>=0 && pt.x < map.cols,
 										uFormat("%d: pt=(%d,%d) map=%dx%d rawPt=(%f,%f) xMin=%f yMin=%f channels=%dvs%d (graph modified=%d)",
 												kter->first, pt.x, pt.y, map.cols, map.rows, ptf[0], ptf[1], xMin, yMin, jter->second.channels(), mapInfo.channels()-1, (graphOptimized || graphChanged)?1:0).c_str());
+							dirtyMin.x = std::min(dirtyMin.x, pt.x); dirtyMin.y = std::min(dirtyMin.y, pt.y);
+							dirtyMax.x = std::max(dirtyMax.x, pt.x); dirtyMax.y = std::max(dirtyMax.y, pt.y);
 							char & value = map.at<char>(pt.y, pt.x);
 							if(value != -2)
 							{
@@ -1474,6 +1528,21 @@ bool OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 				xMin_ = xMin;
 				yMin_ = yMin;
 
+				if(reallocated || incrementalGraphUpdate)
+				{
+					dirtyRegion_ = cv::Rect(0, 0, map_.cols, map_.rows);
+				}
+				else if(dirtyMax.x >= dirtyMin.x && dirtyMax.y >= dirtyMin.y)
+				{
+					cv::Rect dirty(dirtyMin.x, dirtyMin.y, dirtyMax.x-dirtyMin.x+1, dirtyMax.y-dirtyMin.y+1);
+					if(erode_)
+					{
+						// eroded cells depend on their neighbors
+						dirty = cv::Rect(dirty.x-1, dirty.y-1, dirty.width+2, dirty.height+2) & cv::Rect(0, 0, map_.cols, map_.rows);
+					}
+					dirtyRegion_ = dirtyRegion_.area()?dirtyRegion_ | dirty:dirty;
+				}
+
 				// clean cellCount_
 				for(std::map<int, std::pair<int, int> >::iterator iter= cellCount_.begin(); iter!=cellCount_.end();)
 				{
@@ -34,6 +34,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d_mapping.h>
 #include <pcl/common/transforms.h>
 
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace rtabmap {
 
 //////////////////////////////////////
@@ -60,10 +66,17 @@ const RtabmapColorOcTreeNode* RtabmapColorOcTreeNode::getChild(unsigned int i) c
 //octomap <1.8
 bool RtabmapColorOcTreeNode::pruneNode() {
 #ifdef OCTOMAP_PRE_18
-	// checks for equal occupancy only, color ignored
+	// checks for equal occupancy, node reference and type only, color ignored
 	if (!this->collapsible()) return false;
+	for (unsigned int i=0;i<8;i++) {
+		if (getChild(i)->getNodeRefId() != getChild(0)->getNodeRefId() ||
+			getChild(i)->getOccupancyType() != getChild(0)->getOccupancyType() ||
+			getChild(i)->getOccupancyType() > 0) return false;
+	}
 	// set occupancy value
 	setLogOdds(getChild(0)->getLogOdds());
+	nodeRefId_ = getChild(0)->getNodeRefId();
+	type_ = getChild(0)->getOccupancyType();
 	// set color to average color
 	if (isColorSet()) color = getAverageChildColor();
 	// delete children
@@ -86,6 +99,8 @@ void RtabmapColorOcTreeNode::expandNode() {
 		createChild(k);
 		children[k]->setValue(value);
 		getChild(k)->setColor(color);
+		getChild(k)->setNodeRefId(nodeRefId_);
+		getChild(k)->setOccupancyType(type_);
 	}
 #else
 	UFATAL("This function should not be used with octomap >= 1.8");
@@ -105,7 +120,8 @@ bool RtabmapColorOcTreeNode::createChild(unsigned int i) {
 }
 
 RtabmapColorOcTree::RtabmapColorOcTree(double resolution)
-	: OccupancyOcTreeBase<RtabmapColorOcTreeNode>(resolution) {
+	: OccupancyOcTreeBase<RtabmapColorOcTreeNode>(resolution),
+	  pruneByNodeRef_(false) {
 	RtabmapColorOcTreeMemberInit.ensureLinking();
 };
 
@@ -156,10 +172,20 @@ bool RtabmapColorOcTree::isNodeCollapsible(const RtabmapColorOcTreeNode* node) c
 	if (nodeHasChildren(firstChild))
 		return false;
 
+	// Ground and obstacle cells keep their own point reference. Cells are
+	// also tracked by node reference, which is kept when a pruned node
+	// is expanded again (see OctoMap::update()).
+	if (pruneByNodeRef_ && firstChild->getOccupancyType() > 0)
+		return false;
+
 	for (unsigned int i = 1; i<8; i++) {
 		// compare nodes only using their occupancy, ignoring color for pruning
 		if (!nodeChildExists(node, i) || nodeHasChildren(getNodeChild(node, i)) || !(getNodeChild(node, i)->getValue() == firstChild->getValue()))
 			return false;
+		if (pruneByNodeRef_ &&
+			(getNodeChild(node, i)->getNodeRefId() != firstChild->getNodeRefId() ||
+			 getNodeChild(node, i)->getOccupancyType() != firstChild->getOccupancyType()))
+			return false;
 	}
 
 	return true;
@@ -267,6 +293,85 @@ RtabmapColorOcTree::StaticMemberInitializer RtabmapColorOcTree::RtabmapColorOcTr
 // OctoMap
 //////////////////////////////////////
 
+namespace {
+
+// Interleave bits of the keys (Morton order), so that consecutive
+// keys share most of their path in the octree.
+inline unsigned long long mortonSpread(unsigned long long x)
+{
+	x = (x | (x << 32)) & 0x1f00000000ffffULL;
+	x = (x | (x << 16)) & 0x1f0000ff0000ffULL;
+	x = (x | (x << 8)) & 0x100f00f00f00f00fULL;
+	x = (x | (x << 4)) & 0x10c30c30c30c30c3ULL;
+	x = (x | (x << 2)) & 0x1249249249249249ULL;
+	return x;
+}
+inline unsigned long long mortonCode(const octomap::OcTreeKey & key)
+{
+	return (mortonSpread(key[0]) << 2) | (mortonSpread(key[1]) << 1) | mortonSpread(key[2]);
+}
+struct MortonLess
+{
+	bool operator()(const octomap::OcTreeKey & a, const octomap::OcTreeKey & b) const
+	{
+		return mortonCode(a) < mortonCode(b);
+	}
+};
+void sortUniqueKeys(std::vector<octomap::OcTreeKey> & keys)
+{
+	std::sort(keys.begin(), keys.end(), MortonLess());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+/**
+ * Keys of all cells traversed by the rays from origin (end points excluded),
+ * without duplicates and sorted in Morton order. Rays are traced in parallel
+ * and each thread deduplicates its keys before they are merged.
+ */
+void computeRayKeys(
+		const RtabmapColorOcTree & octree,
+		const octomap::point3d & origin,
+		const std::vector<octomap::point3d> & ends,
+		std::vector<octomap::OcTreeKey> & keys)
+{
+	keys.clear();
+	const int size = (int)ends.size();
+#ifdef _OPENMP
+	#pragma omp parallel if(size > 256)
+#endif
+	{
+		std::vector<octomap::OcTreeKey> threadKeys;
+		octomap::KeyRay keyRay;
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic, 64) nowait
+#endif
+		for(int i=0; i<size; ++i)
+		{
+			if(octree.computeRayKeys(origin, ends[i], keyRay))
+			{
+				threadKeys.insert(threadKeys.end(), keyRay.begin(), keyRay.end());
+				if(threadKeys.size() > (1<<20))
+				{
+					// limit memory used by duplicated keys
+					sortUniqueKeys(threadKeys);
+				}
+			}
+		}
+		sortUniqueKeys(threadKeys);
+#ifdef _OPENMP
+		#pragma omp critical
+#endif
+		{
+			std::vector<octomap::OcTreeKey> merged(keys.size() + threadKeys.size());
+			std::merge(keys.begin(), keys.end(), threadKeys.begin(), threadKeys.end(), merged.begin(), MortonLess());
+			merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+			keys.swap(merged);
+		}
+	}
+}
+
+}
+
 OctoMap::OctoMap(const ParametersMap & parameters) :
 		hasColor_(false),
 		fullUpdate_(Parameters::defaultGridGlobalFullUpdate()),
@@ -306,6 +411,8 @@ OctoMap::OctoMap(const ParametersMap & parameters) :
 	octree_->setClampingThresMin(clampingMin);
 	octree_->setClampingThresMax(clampingMax);
 	Parameters::parse(parameters, Parameters::kGridGlobalFullUpdate(), fullUpdate_);
+	// cells are moved in place on graph optimization only without full update
+	octree_->setPruneByNodeRef(!fullUpdate_);
 	Parameters::parse(parameters, Parameters::kGridGlobalUpdateError(), updateError_);
 	Parameters::parse(parameters, Parameters::kGridRangeMax(), rangeMax_);
 	Parameters::parse(parameters, Parameters::kGridRayTracing(), rayTracing_);
@@ -323,6 +430,7 @@ OctoMap::OctoMap(float cellSize, float occupancyThr, bool fullUpdate, float upda
 	maxValues_[0] = maxValues_[1] = maxValues_[2] = 0.0;
 
 	octree_->setOccupancyThres(occupancyThr);
+	octree_->setPruneByNodeRef(!fullUpdate_);
 	UASSERT(cellSize>0.0f);
 }
 
@@ -335,6 +443,8 @@ OctoMap::~OctoMap()
 void OctoMap::clear()
 {
 	octree_->clear();
+	nodeCells_.clear();
+	temporaryCells_.clear();
 	cache_.clear();
 	cacheClouds_.clear();
 	cacheViewPoints_.clear();
@@ -421,98 +531,134 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 			UINFO("Graph optimized!");
 		}
 
-		minValues_[0] = minValues_[1] = minValues_[2] = 0.0;
-		maxValues_[0] = maxValues_[1] = maxValues_[2] = 0.0;
-
 		if(fullUpdate_ || graphChanged)
 		{
 			// clear all but keep cache
 			octree_->clear();
+			nodeCells_.clear();
+			temporaryCells_.clear();
 			addedNodes_.clear();
 			hasColor_ = false;
+			minValues_[0] = minValues_[1] = minValues_[2] = 0.0;
+			maxValues_[0] = maxValues_[1] = maxValues_[2] = 0.0;
 		}
 		else
 		{
-			RtabmapColorOcTree * newOcTree = new RtabmapColorOcTree(octree_->getResolution());
-			int copied=0;
-			int count=0;
+			// Move in place only the cells of the nodes that have moved. Cells
+			// of nodes not in the graph anymore and cells of temporary clouds are removed.
+			struct MovedCell
+			{
+				int nodeRefId;
+				octomap::point3d point;
+				float logOdds;
+				int type;
+				RtabmapColorOcTreeNode::Color color;
+			};
+			std::vector<MovedCell> movedCells;
+			int removed=0;
 			UTimer t;
-			for (RtabmapColorOcTree::iterator it = octree_->begin(); it != octree_->end(); ++it, ++count)
+			for(octomap::KeySet::iterator it=temporaryCells_.begin(); it!=temporaryCells_.end(); ++it)
 			{
-				RtabmapColorOcTreeNode & nOld = *it;
-				if(nOld.getNodeRefId() > 0)
+				RtabmapColorOcTreeNode * n = octree_->search(*it);
+				if(n && n->getNodeRefId() == 0 && octree_->deleteNode(*it))
 				{
-					std::map<int, Transform>::iterator jter = transforms.find(nOld.getNodeRefId());
-					if(jter != transforms.end())
+					++removed;
+				}
+			}
+			temporaryCells_.clear();
+			for(std::map<int, std::vector<octomap::OcTreeKey> >::iterator iter=nodeCells_.begin(); iter!=nodeCells_.end();)
+			{
+				std::map<int, Transform>::iterator jter = transforms.find(iter->first);
+				bool moved = jter != transforms.end() && !jter->second.isIdentity();
+				if(jter != transforms.end() && !moved)
+				{
+					++iter;
+					continue;
+				}
+				for(unsigned int i=0; i<iter->second.size(); ++i)
+				{
+					const octomap::OcTreeKey & key = iter->second[i];
+					RtabmapColorOcTreeNode * n = octree_->search(key);
+					// cells overwritten by other nodes are ignored. If the cell has been
+					// pruned, its parent has the same reference and deleteNode() expands it
+					// with that reference, so the siblings are handled with their own keys.
+					if(n && n->getNodeRefId() == iter->first)
 					{
-						octomap::point3d pt;
-						std::map<int, Transform>::iterator pter = addedNodes_.find(nOld.getNodeRefId());
-						UASSERT(pter != addedNodes_.end());
-
-						if(nOld.getOccupancyType() > 0)
-						{
-							pt = nOld.getPointRef();
-						}
-						else
+						if(moved)
 						{
-							pt = octree_->keyToCoord(it.getKey());
+							MovedCell cell;
+							cell.nodeRefId = iter->first;
+							cell.point = n->getOccupancyType() > 0?n->getPointRef():octree_->keyToCoord(key);
+							cell.logOdds = n->getLogOdds();
+							cell.type = n->getOccupancyType();
+							cell.color = n->getColor();
+							movedCells.push_back(cell);
 						}
+						octree_->deleteNode(key);
+						++removed;
+					}
+				}
+				if(moved)
+				{
+					iter->second.clear();
+					++iter;
+				}
+				else
+				{
+					nodeCells_.erase(iter++);
+				}
+			}
 
-						cv::Point3f cvPt(pt.x(), pt.y(), pt.z());
-						cvPt = util3d::transformPoint(cvPt, jter->second);
-						octomap::point3d ptTransformed(cvPt.x, cvPt.y, cvPt.z);
+			int copied=0;
+			for(unsigned int i=0; i<movedCells.size(); ++i)
+			{
+				const MovedCell & cell = movedCells[i];
+				cv::Point3f cvPt(cell.point.x(), cell.point.y(), cell.point.z());
+				cvPt = util3d::transformPoint(cvPt, transforms.at(cell.nodeRefId));
+				octomap::point3d ptTransformed(cvPt.x, cvPt.y, cvPt.z);
 
-						octomap::OcTreeKey key;
-						if(newOcTree->coordToKeyChecked(ptTransformed, key))
+				octomap::OcTreeKey key;
+				if(octree_->coordToKeyChecked(ptTransformed, key))
+				{
+					RtabmapColorOcTreeNode * n = octree_->search(key);
+					if(n)
+					{
+						if(n->getNodeRefId() > cell.nodeRefId)
 						{
-							RtabmapColorOcTreeNode * n = newOcTree->search(key);
-							if(n)
-							{
-								if(n->getNodeRefId() > nOld.getNodeRefId())
-								{
-									// The cell has been updated from more recent node, don't update the cell
-									continue;
-								}
-								else if(nOld.getOccupancyType() <= 0 && n->getOccupancyType() > 0)
-								{
-									// empty cells cannot overwrite ground/obstacle cells
-									continue;
-								}
-							}
-
-							RtabmapColorOcTreeNode * nNew = newOcTree->updateNode(key, nOld.getLogOdds());
-							if(nNew)
-							{
-								++copied;
-								updateMinMax(ptTransformed);
-								nNew->setNodeRefId(nOld.getNodeRefId());
-								if(nOld.getOccupancyType() > 0)
-								{
-									nNew->setPointRef(pt);
-								}
-								nNew->setOccupancyType(nOld.getOccupancyType());
-								nNew->setColor(nOld.getColor());
-							}
-							else
-							{
-								UERROR("Could not update node at (%f,%f,%f)", cvPt.x, cvPt.y, cvPt.z);
-							}
+							// The cell has been updated from more recent node, don't update the cell
+							continue;
 						}
-						else
+						else if(cell.type <= 0 && n->getOccupancyType() > 0)
 						{
-							UERROR("Could not find key for (%f,%f,%f)", cvPt.x, cvPt.y, cvPt.z);
+							// empty cells cannot overwrite ground/obstacle cells
+							continue;
 						}
 					}
-					else if(jter == transforms.end())
+
+					RtabmapColorOcTreeNode * nNew = octree_->updateNode(key, cell.logOdds);
+					if(nNew)
 					{
-						// Note: normal if old nodes were transfered to LTM
-						//UWARN("Could not find a transform for point linked to node %d (transforms=%d)", iter->second.nodeRefId_, (int)transforms.size());
+						++copied;
+						updateMinMax(ptTransformed);
+						setCellNodeRef(nNew, key, cell.nodeRefId);
+						if(cell.type > 0)
+						{
+							nNew->setPointRef(cell.point);
+						}
+						nNew->setOccupancyType(cell.type);
+						nNew->setColor(cell.color);
 					}
+					else
+					{
+						UERROR("Could not update node at (%f,%f,%f)", cvPt.x, cvPt.y, cvPt.z);
+					}
+				}
+				else
+				{
+					UERROR("Could not find key for (%f,%f,%f)", cvPt.x, cvPt.y, cvPt.z);
 				}
 			}
-			UINFO("Graph optimization detected, moved %d/%d in %fs", copied, count, t.ticks());
-			delete octree_;
-			octree_ = newOcTree;
+			UINFO("Graph optimization detected, moved %d/%d cells (removed %d) in %fs", copied, (int)movedCells.size(), removed, t.ticks());
 
 			//update added poses
 			addedNodes_ = updatedAddedNodes;
@@ -576,7 +722,7 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 				bool computeRays = rayTracing_ && (occupancyIter == cache_.end() || occupancyIter->second.second.empty());
 
 				// instead of direct scan insertion, compute update to filter ground:
-				octomap::KeySet free_cells;
+				std::vector<octomap::point3d> rayEnds;
 				// insert ground points only as free:
 				unsigned int maxGroundPts = occupancyIter != cache_.end()?occupancyIter->second.first.first.cols:cloudIter->second.first->size();
 				UDEBUG("%d: compute free cells (from %d ground points)", iter->first, (int)maxGroundPts);
@@ -640,9 +786,9 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 									hasColor_ = true;
 								}
 								octree_->averageNodeColor(key, pt.r, pt.g, pt.b);
+								setCellNodeRef(n, key, iter->first);
 								if(iter->first > 0)
 								{
-									n->setNodeRefId(iter->first);
 									n->setPointRef(point);
 								}
 								n->setOccupancyType(RtabmapColorOcTreeNode::kTypeGround);
@@ -651,15 +797,12 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 					}
 
 					// only clear space (ground points)
-					octomap::KeyRay keyRay;
-					if (computeRays &&
-						(iter->first < 0 || iter->first>lastId) &&
-						octree_->computeRayKeys(sensorOrigin, point, keyRay))
+					if (computeRays && (iter->first < 0 || iter->first>lastId))
 					{
-						free_cells.insert(keyRay.begin(), keyRay.end());
+						rayEnds.push_back(point);
 					}
 				}
-				UDEBUG("%d: ground cells=%d free cells=%d", iter->first, (int)maxGroundPts, (int)free_cells.size());
+				UDEBUG("%d: ground cells=%d rays=%d", iter->first, (int)maxGroundPts, (int)rayEnds.size());
 
 				// all other points: free on ray, occupied on endpoint:
 				unsigned int maxObstaclePts = occupancyIter != cache_.end()?occupancyIter->second.first.second.cols:cloudIter->second.second->size();
@@ -725,9 +868,9 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 									hasColor_ = true;
 								}
 								octree_->averageNodeColor(key, pt.r, pt.g, pt.b);
+								setCellNodeRef(n, key, iter->first);
 								if(iter->first > 0)
 								{
-									n->setNodeRefId(iter->first);
 									n->setPointRef(point);
 								}
 								n->setOccupancyType(RtabmapColorOcTreeNode::kTypeObstacle);
@@ -736,19 +879,19 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 					}
 
 					// free cells
-					octomap::KeyRay keyRay;
-					if (computeRays &&
-						(iter->first < 0 || iter->first>lastId) &&
-						octree_->computeRayKeys(sensorOrigin, point, keyRay))
+					if (computeRays && (iter->first < 0 || iter->first>lastId))
 					{
-						free_cells.insert(keyRay.begin(), keyRay.end());
+						rayEnds.push_back(point);
 					}
 				}
-				UDEBUG("%d: occupied cells=%d free cells=%d", iter->first, (int)maxObstaclePts, (int)free_cells.size());
+				UDEBUG("%d: occupied cells=%d rays=%d", iter->first, (int)maxObstaclePts, (int)rayEnds.size());
 
+				std::vector<octomap::OcTreeKey> free_cells;
+				computeRayKeys(*octree_, sensorOrigin, rayEnds, free_cells);
+				UDEBUG("%d: free cells=%d", iter->first, (int)free_cells.size());
 
 				// mark free cells only if not seen occupied in this cloud
-				for(octomap::KeySet::iterator it = free_cells.begin(), end=free_cells.end(); it!= end; ++it)
+				for(std::vector<octomap::OcTreeKey>::iterator it = free_cells.begin(), end=free_cells.end(); it!= end; ++it)
 				{
 					if(iter->first > 0)
 					{
@@ -764,10 +907,7 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 					if(n && n->getOccupancyType() == RtabmapColorOcTreeNode::kTypeUnknown)
 					{
 						n->setOccupancyType(RtabmapColorOcTreeNode::kTypeEmpty);
-						if(iter->first > 0)
-						{
-							n->setNodeRefId(iter->first);
-						}
+						setCellNodeRef(n, *it, iter->first);
 					}
 				}
 
@@ -818,10 +958,7 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 								if(n && n->getOccupancyType() == RtabmapColorOcTreeNode::kTypeUnknown)
 								{
 									n->setOccupancyType(RtabmapColorOcTreeNode::kTypeEmpty);
-									if(iter->first > 0)
-									{
-										n->setNodeRefId(iter->first);
-									}
+									setCellNodeRef(n, key, iter->first);
 								}
 							}
 						}
@@ -858,6 +995,25 @@ bool OctoMap::update(const std::map<int, Transform> & poses)
 	return !orderedPoses.empty() || graphOptimized || graphChanged;
 }
 
+void OctoMap::setCellNodeRef(RtabmapColorOcTreeNode * n, const octomap::OcTreeKey & key, int nodeId)
+{
+	if(nodeId > 0)
+	{
+		if(n->getNodeRefId() != nodeId)
+		{
+			n->setNodeRefId(nodeId);
+			if(!fullUpdate_)
+			{
+				nodeCells_[nodeId].push_back(key);
+			}
+		}
+	}
+	else if(!fullUpdate_ && n->getNodeRefId() == 0)
+	{
+		temporaryCells_.insert(key);
+	}
+}
+
 void OctoMap::updateMinMax(const octomap::point3d & point)
 {
 	if(point.x() < minValues_[0])
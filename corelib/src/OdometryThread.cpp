@@ -31,7 +31,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/OdometryInfo.h"
 #include "rtabmap/core/CameraEvent.h"
 #include "rtabmap/core/OdometryEvent.h"
+#include "rtabmap/core/IMU.h"
 #include "rtabmap/utilite/ULogger.h"
+#include "rtabmap/utilite/UEventsManager.h"
 
 namespace rtabmap {
 
@@ -44,6 +46,9 @@ OdometryThread::OdometryThread(Odometry * odometry, unsigned int dataBufferMaxSi
 	_imuEstimatedDelay(0.0)
 {
 	UASSERT(_odometry != 0);
+	UEventsManager::subscribe<CameraEvent>(this);
+	UEventsManager::subscribe<IMUEvent>(this);
+	UEventsManager::subscribe<OdometryResetEvent>(this);
 }
 
 OdometryThread::~OdometryThread()
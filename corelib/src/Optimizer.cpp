@@ -316,7 +316,9 @@ Optimizer::Optimizer(int iterations, bool slam2d, bool covarianceIgnored, double
 		robust_(robust),
 		priorsIgnored_(priorsIgnored),
 		landmarksIgnored_(landmarksIgnored),
-		gravitySigma_(gravitySigma)
+		gravitySigma_(gravitySigma),
+		incremental_(Parameters::defaultOptimizerIncremental()),
+		incRootId_(0)
 {
 }
 
@@ -328,7 +330,9 @@ Optimizer::Optimizer(const ParametersMap & parameters) :
 		robust_(Parameters::defaultOptimizerRobust()),
 		priorsIgnored_(Parameters::defaultOptimizerPriorsIgnored()),
 		landmarksIgnored_(Parameters::defaultOptimizerLandmarksIgnored()),
-		gravitySigma_(Parameters::defaultOptimizerGravitySigma())
+		gravitySigma_(Parameters::defaultOptimizerGravitySigma()),
+		incremental_(Parameters::defaultOptimizerIncremental()),
+		incRootId_(0)
 {
 	parseParameters(parameters);
 }
@@ -343,6 +347,272 @@ void Optimizer::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kOptimizerPriorsIgnored(), priorsIgnored_);
 	Parameters::parse(parameters, Parameters::kOptimizerLandmarksIgnored(), landmarksIgnored_);
 	Parameters::parse(parameters, Parameters::kOptimizerGravitySigma(), gravitySigma_);
+	bool incremental = incremental_;
+	Parameters::parse(parameters, Parameters::kOptimizerIncremental(), incremental_);
+	if(incremental != incremental_)
+	{
+		resetIncremental();
+	}
+}
+
+static bool sameLink(const Link & a, const Link & b)
+{
+	if(a.to() != b.to() || a.type() != b.type() || a.transform() != b.transform())
+	{
+		return false;
+	}
+	const cv::Mat & infA = a.infMatrix();
+	const cv::Mat & infB = b.infMatrix();
+	if(infA.size() != infB.size() || infA.type() != infB.type())
+	{
+		return false;
+	}
+	return infA.empty() || cv::norm(infA, infB, cv::NORM_INF) == 0.0;
+}
+
+bool Optimizer::getIncrementalDelta(
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & constraints,
+		std::map<int, Transform> & newPoses,
+		std::multimap<int, Link> & newConstraints,
+		std::set<int> & removedPoses,
+		std::multimap<int, Link> & removedConstraints) const
+{
+	newPoses.clear();
+	newConstraints.clear();
+	removedPoses.clear();
+	removedConstraints.clear();
+
+	std::map<int, Transform>::const_iterator iter = poses.begin();
+	for(std::map<int, Transform>::const_iterator jter=incPoses_.begin(); jter!=incPoses_.end(); ++jter)
+	{
+		for(; iter!=poses.end() && iter->first < jter->first; ++iter)
+		{
+			newPoses.insert(newPoses.end(), *iter);
+		}
+		if(iter == poses.end() || iter->first != jter->first)
+		{
+			removedPoses.insert(removedPoses.end(), jter->first);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+	for(; iter!=poses.end(); ++iter)
+	{
+		newPoses.insert(newPoses.end(), *iter);
+	}
+
+	std::set<const Link *> matched;
+	for(std::multimap<int, Link>::const_iterator iter=constraints.begin(); iter!=constraints.end(); ++iter)
+	{
+		bool found = false;
+		for(std::multimap<int, Link>::const_iterator jter=incConstraints_.lower_bound(iter->first);
+			jter!=incConstraints_.end() && jter->first == iter->first;
+			++jter)
+		{
+			if(jter->second.to() == iter->second.to() && jter->second.type() == iter->second.type())
+			{
+				if(sameLink(jter->second, iter->second))
+				{
+					matched.insert(&jter->second);
+					found = true;
+				}
+				break;
+			}
+		}
+		if(!found)
+		{
+			newConstraints.insert(newConstraints.end(), *iter);
+		}
+	}
+	if(matched.size() != incConstraints_.size())
+	{
+		for(std::multimap<int, Link>::const_iterator jter=incConstraints_.begin(); jter!=incConstraints_.end(); ++jter)
+		{
+			if(matched.find(&jter->second) == matched.end())
+			{
+				removedConstraints.insert(removedConstraints.end(), *jter);
+			}
+		}
+	}
+	if(!removedPoses.empty() || !removedConstraints.empty())
+	{
+		UDEBUG("%d poses and %d links have been removed or modified", (int)removedPoses.size(), (int)removedConstraints.size());
+		return false;
+	}
+	return true;
+}
+
+void Optimizer::addConstraints(
+		const std::map<int, Transform> & newPoses,
+		const std::multimap<int, Link> & newConstraints)
+{
+	for(std::map<int, Transform>::const_iterator iter=newPoses.begin(); iter!=newPoses.end(); ++iter)
+	{
+		UASSERT(!iter->second.isNull());
+		if(incPoses_.find(iter->first) == incPoses_.end())
+		{
+			incNewPoses_.insert(*iter);
+		}
+	}
+	incNewConstraints_.insert(newConstraints.begin(), newConstraints.end());
+}
+
+void Optimizer::removeConstraints(
+		const std::set<int> & removedPoses,
+		const std::multimap<int, Link> & removedConstraints)
+{
+	for(std::set<int>::const_iterator iter=removedPoses.begin(); iter!=removedPoses.end(); ++iter)
+	{
+		if(incPoses_.erase(*iter))
+		{
+			incRemovedPoses_.insert(*iter);
+		}
+		incNewPoses_.erase(*iter);
+	}
+	for(std::multimap<int, Link>::const_iterator iter=removedConstraints.begin(); iter!=removedConstraints.end(); ++iter)
+	{
+		for(std::multimap<int, Link>::iterator jter=incConstraints_.lower_bound(iter->first);
+			jter!=incConstraints_.end() && jter->first == iter->first;
+			++jter)
+		{
+			if(jter->second.to() == iter->second.to() && jter->second.type() == iter->second.type())
+			{
+				incRemovedConstraints_.insert(*jter);
+				incConstraints_.erase(jter);
+				break;
+			}
+		}
+	}
+}
+
+std::map<int, Transform> Optimizer::update(
+		int rootId,
+		cv::Mat & outputCovariance,
+		double * finalError,
+		int * iterationsDone)
+{
+	if(incNewPoses_.empty() && incNewConstraints_.empty() &&
+	   incRemovedPoses_.empty() && incRemovedConstraints_.empty() &&
+	   !incPoses_.empty() && rootId == incRootId_)
+	{
+		UDEBUG("Nothing new in the graph, returning last solution");
+		outputCovariance = incCovariance_.clone();
+		if(finalError)
+		{
+			*finalError = 0.0;
+		}
+		if(iterationsDone)
+		{
+			*iterationsDone = 0;
+		}
+		return incPoses_;
+	}
+
+	// Initialize new poses from their links to poses already optimized (warm start),
+	// the input poses are kept for those not linked.
+	std::map<int, Transform> poses = incPoses_;
+	std::map<int, Transform> guesses = incNewPoses_;
+	std::set<int> initialized;
+	bool added = !poses.empty();
+	while(added)
+	{
+		added = false;
+		for(std::multimap<int, Link>::const_iterator iter=incNewConstraints_.begin(); iter!=incNewConstraints_.end(); ++iter)
+		{
+			int from = iter->second.from();
+			int to = iter->second.to();
+			if(from == to)
+			{
+				continue;
+			}
+			bool fromKnown = poses.find(from) != poses.end() || initialized.find(from) != initialized.end();
+			bool toKnown = poses.find(to) != poses.end() || initialized.find(to) != initialized.end();
+			if(fromKnown && !toKnown && guesses.find(to) != guesses.end())
+			{
+				const Transform & fromPose = poses.find(from)!=poses.end()?poses.at(from):guesses.at(from);
+				guesses.at(to) = fromPose * iter->second.transform();
+				initialized.insert(to);
+				added = true;
+			}
+			else if(toKnown && !fromKnown && guesses.find(from) != guesses.end())
+			{
+				const Transform & toPose = poses.find(to)!=poses.end()?poses.at(to):guesses.at(to);
+				guesses.at(from) = toPose * iter->second.transform().inverse();
+				initialized.insert(from);
+				added = true;
+			}
+		}
+	}
+	UDEBUG("New poses=%d (%d initialized from links), new links=%d, removed poses=%d links=%d, graph poses=%d links=%d",
+			(int)incNewPoses_.size(), (int)initialized.size(), (int)incNewConstraints_.size(),
+			(int)incRemovedPoses_.size(), (int)incRemovedConstraints_.size(),
+			(int)incPoses_.size(), (int)incConstraints_.size());
+	poses.insert(guesses.begin(), guesses.end());
+	incConstraints_.insert(incNewConstraints_.begin(), incNewConstraints_.end());
+
+	std::map<int, Transform> optimizedPoses = updateIncremental(
+			rootId,
+			poses,
+			incConstraints_,
+			guesses,
+			incNewConstraints_,
+			incRemovedPoses_,
+			incRemovedConstraints_,
+			outputCovariance,
+			finalError,
+			iterationsDone);
+
+	incNewPoses_.clear();
+	incNewConstraints_.clear();
+	incRemovedPoses_.clear();
+	incRemovedConstraints_.clear();
+	if(optimizedPoses.empty())
+	{
+		UWARN("Incremental optimization failed, the graph is reset.");
+		resetIncremental();
+	}
+	else
+	{
+		// Keep also poses not optimized (e.g., ignored landmarks) to detect them as not new next time
+		incPoses_ = poses;
+		for(std::map<int, Transform>::iterator iter=optimizedPoses.begin(); iter!=optimizedPoses.end(); ++iter)
+		{
+			incPoses_[iter->first] = iter->second;
+		}
+		incRootId_ = rootId;
+		incCovariance_ = outputCovariance.clone();
+	}
+	return optimizedPoses;
+}
+
+void Optimizer::resetIncremental()
+{
+	incPoses_.clear();
+	incConstraints_.clear();
+	incNewPoses_.clear();
+	incNewConstraints_.clear();
+	incRemovedPoses_.clear();
+	incRemovedConstraints_.clear();
+	incRootId_ = 0;
+	incCovariance_ = cv::Mat();
+}
+
+std::map<int, Transform> Optimizer::updateIncremental(
+		int rootId,
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & constraints,
+		const std::map<int, Transform> &,
+		const std::multimap<int, Link> &,
+		const std::set<int> &,
+		const std::multimap<int, Link> &,
+		cv::Mat & outputCovariance,
+		double * finalError,
+		int * iterationsDone)
+{
+	return optimize(rootId, poses, constraints, outputCovariance, 0, finalError, iterationsDone);
 }
 
 std::map<int, Transform> Optimizer::optimizeIncremental(
@@ -0,0 +1,921 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap/core/PathGraph.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <pcl/common/common.h>
+#include <algorithm>
+#include <limits>
+
+namespace rtabmap {
+
+PathGraph::PathGraph() :
+	posesMissing_(0),
+	poseScale_(0.0f),
+	poseScaleValid_(false),
+	newEdgesCount_(0),
+	removedCount_(0),
+	referenceNodes_(0),
+	referenceCount_(0),
+	referenceDistancesValid_(false),
+	heuristicScale_(0.0f)
+{
+	offsets_.push_back(0);
+}
+
+void PathGraph::clear()
+{
+	idToIndex_.clear();
+	ids_.clear();
+	poses_.clear();
+	posesMissing_ = 0;
+	poseScale_ = 0.0f;
+	poseScaleValid_ = false;
+	offsets_.clear();
+	offsets_.push_back(0);
+	edges_.clear();
+	newEdges_.clear();
+	newEdgesCount_ = 0;
+	removedCount_ = 0;
+	referenceCount_ = 0;
+	referenceDistancesValid_ = false;
+	referenceDistances_.clear();
+	costs_.clear();
+	keys_.clear();
+	heuristics_.clear();
+	parents_.clear();
+	heapIndex_.clear();
+	heap_.clear();
+	visited_.clear();
+	chainedPoses_.clear();
+}
+
+int PathGraph::addNode(int id)
+{
+	std::map<int, int>::iterator iter = idToIndex_.find(id);
+	if(iter != idToIndex_.end())
+	{
+		return iter->second;
+	}
+	UASSERT(id != 0);
+	// Indices of removed nodes are not reused before compact(), so
+	// that edges still pointing to them can be detected.
+	int index = (int)ids_.size();
+	idToIndex_.insert(std::make_pair(id, index));
+	ids_.push_back(id);
+	poses_.push_back(Transform());
+	++posesMissing_;
+	newEdges_.push_back(std::vector<Edge>());
+	// not reachable from the reference nodes until linked
+	referenceDistances_.resize(ids_.size()*referenceCount_, std::numeric_limits<float>::max());
+	return index;
+}
+
+PathGraph::Edge * PathGraph::findEdge(int from, int to)
+{
+	if(from+1 < (int)offsets_.size())
+	{
+		for(int i=offsets_[from]; i<offsets_[from+1]; ++i)
+		{
+			if(edges_[i].to == to)
+			{
+				return &edges_[i];
+			}
+		}
+	}
+	std::vector<Edge> & edges = newEdges_[from];
+	for(unsigned int i=0; i<edges.size(); ++i)
+	{
+		if(edges[i].to == to)
+		{
+			return &edges[i];
+		}
+	}
+	return 0;
+}
+
+bool PathGraph::setEdge(int from, int to, const Transform & transform)
+{
+	UASSERT(!transform.isNull());
+	int fromIndex = addNode(from);
+	int toIndex = addNode(to);
+	Edge * edge = findEdge(fromIndex, toIndex);
+	if(edge)
+	{
+		if(edge->transform == transform)
+		{
+			return false;
+		}
+		float previousCost = edge->cost;
+		*edge = Edge(toIndex, transform);
+		if(edge->cost > previousCost)
+		{
+			// distances may increase
+			referenceDistancesValid_ = false;
+		}
+		else
+		{
+			edgeAdded(fromIndex, toIndex, edge->cost);
+		}
+	}
+	else
+	{
+		newEdges_[fromIndex].push_back(Edge(toIndex, transform));
+		++newEdgesCount_;
+		edgeAdded(fromIndex, toIndex, newEdges_[fromIndex].back().cost);
+	}
+	return true;
+}
+
+void PathGraph::edgeAdded(int from, int to, float cost)
+{
+	// A removed or more expensive link keeps the pose scale
+	// admissible, only new or cheaper links are checked.
+	if(poseScaleValid_ && !poses_[from].isNull() && !poses_[to].isNull())
+	{
+		float distance = poses_[from].getDistance(poses_[to]);
+		if(distance > 0.0f && cost/distance < poseScale_)
+		{
+			poseScale_ = cost/distance;
+		}
+	}
+	if(referenceDistancesValid_)
+	{
+		for(int l=0; l<referenceCount_; ++l)
+		{
+			float d = referenceDistances_[from*referenceCount_+l];
+			if(d != std::numeric_limits<float>::max() && d + cost < referenceDistances_[to*referenceCount_+l])
+			{
+				updateReferenceDistances(l, to, d + cost);
+			}
+		}
+	}
+}
+
+void PathGraph::addLink(int from, int to, const Transform & transform)
+{
+	setEdge(from, to, transform);
+}
+
+void PathGraph::addLinks(const std::multimap<int, Link> & links)
+{
+	for(std::multimap<int, Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		if(iter->second.from() != iter->second.to() && !iter->second.transform().isNull())
+		{
+			addLink(iter->second.from(), iter->second.to(), iter->second.transform());
+			if(iter->second.to() < 0)
+			{
+				// landmark
+				addLink(iter->second.to(), iter->second.from(), iter->second.transform().inverse());
+			}
+		}
+	}
+}
+
+bool PathGraph::setLinks(int from, const std::multimap<int, Link> & links)
+{
+	std::map<int, Transform> newLinks;
+	for(std::multimap<int, Link>::const_iterator jter=links.begin(); jter!=links.end(); ++jter)
+	{
+		UASSERT(jter->second.from() == from);
+		if(jter->second.from() != jter->second.to() && !jter->second.transform().isNull())
+		{
+			newLinks[jter->second.to()] = jter->second.transform();
+		}
+	}
+
+	// Only links removed or changed are updated, so that
+	// the reference distances stay valid if links are only added.
+	bool changed = false;
+	std::map<int, int>::iterator iter = idToIndex_.find(from);
+	if(iter != idToIndex_.end())
+	{
+		int index = iter->second;
+		std::vector<int> removed;
+		if(index+1 < (int)offsets_.size())
+		{
+			for(int i=offsets_[index]; i<offsets_[index+1]; ++i)
+			{
+				if(edges_[i].to >= 0 && ids_[edges_[i].to] != 0 && newLinks.find(ids_[edges_[i].to]) == newLinks.end())
+				{
+					removed.push_back(ids_[edges_[i].to]);
+				}
+			}
+		}
+		for(unsigned int i=0; i<newEdges_[index].size(); ++i)
+		{
+			if(newEdges_[index][i].to >= 0 && ids_[newEdges_[index][i].to] != 0 && newLinks.find(ids_[newEdges_[index][i].to]) == newLinks.end())
+			{
+				removed.push_back(ids_[newEdges_[index][i].to]);
+			}
+		}
+		for(unsigned int i=0; i<removed.size(); ++i)
+		{
+			removeLink(from, removed[i]);
+			if(removed[i] < 0)
+			{
+				// inverse link from landmark
+				removeLink(removed[i], from);
+			}
+			changed = true;
+		}
+	}
+
+	for(std::map<int, Transform>::iterator jter=newLinks.begin(); jter!=newLinks.end(); ++jter)
+	{
+		if(setEdge(from, jter->first, jter->second))
+		{
+			changed = true;
+		}
+		if(jter->first < 0 && setEdge(jter->first, from, jter->second.inverse()))
+		{
+			// landmark
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+void PathGraph::removeEdges(int from)
+{
+	if(from+1 < (int)offsets_.size())
+	{
+		for(int i=offsets_[from]; i<offsets_[from+1]; ++i)
+		{
+			if(edges_[i].to >= 0)
+			{
+				edges_[i].to = -1;
+				++removedCount_;
+				referenceDistancesValid_ = false;
+			}
+		}
+	}
+	if(newEdges_[from].size())
+	{
+		removedCount_ += (int)newEdges_[from].size();
+		newEdges_[from].clear();
+		referenceDistancesValid_ = false;
+	}
+}
+
+void PathGraph::removeLink(int from, int to)
+{
+	std::map<int, int>::iterator iter = idToIndex_.find(from);
+	std::map<int, int>::iterator jter = idToIndex_.find(to);
+	if(iter != idToIndex_.end() && jter != idToIndex_.end())
+	{
+		Edge * edge = findEdge(iter->second, jter->second);
+		if(edge)
+		{
+			edge->to = -1;
+			++removedCount_;
+			referenceDistancesValid_ = false;
+		}
+	}
+}
+
+void PathGraph::removeNode(int id)
+{
+	std::map<int, int>::iterator iter = idToIndex_.find(id);
+	if(iter != idToIndex_.end())
+	{
+		int index = iter->second;
+		// Remove inverse links of neighbors, other links
+		// to this node are ignored until compact().
+		std::vector<int> neighbors;
+		if(index+1 < (int)offsets_.size())
+		{
+			for(int i=offsets_[index]; i<offsets_[index+1]; ++i)
+			{
+				if(edges_[i].to >= 0)
+				{
+					neighbors.push_back(edges_[i].to);
+				}
+			}
+		}
+		for(unsigned int i=0; i<newEdges_[index].size(); ++i)
+		{
+			if(newEdges_[index][i].to >= 0)
+			{
+				neighbors.push_back(newEdges_[index][i].to);
+			}
+		}
+		for(unsigned int i=0; i<neighbors.size(); ++i)
+		{
+			Edge * edge = findEdge(neighbors[i], index);
+			if(edge)
+			{
+				edge->to = -1;
+				++removedCount_;
+				referenceDistancesValid_ = false;
+			}
+		}
+		removeEdges(index);
+		ids_[index] = 0;
+		if(poses_[index].isNull())
+		{
+			--posesMissing_;
+		}
+		poses_[index] = Transform();
+		idToIndex_.erase(iter);
+		++removedCount_;
+	}
+}
+
+void PathGraph::setPose(int id, const Transform & pose)
+{
+	int index = addNode(id);
+	if(pose == poses_[index])
+	{
+		return;
+	}
+	if(poses_[index].isNull())
+	{
+		--posesMissing_;
+	}
+	else if(pose.isNull())
+	{
+		++posesMissing_;
+	}
+	poses_[index] = pose;
+	poseScaleValid_ = false;
+}
+
+void PathGraph::setReferenceNodes(int count)
+{
+	if(count != referenceNodes_)
+	{
+		referenceNodes_ = count>0?count:0;
+		referenceCount_ = 0;
+		referenceDistancesValid_ = false;
+		referenceDistances_.clear();
+	}
+}
+
+void PathGraph::compact()
+{
+	UDEBUG("nodes=%d edges=%d new=%d removed=%d", (int)idToIndex_.size(), (int)edges_.size(), newEdgesCount_, removedCount_);
+	std::vector<int> newIndices(ids_.size(), -1);
+	int count = 0;
+	for(unsigned int i=0; i<ids_.size(); ++i)
+	{
+		if(ids_[i] != 0)
+		{
+			newIndices[i] = count++;
+		}
+	}
+
+	std::vector<int> ids(count);
+	std::vector<Transform> poses(count);
+	std::vector<float> referenceDistances(count*referenceCount_);
+	std::vector<int> offsets(count+1, 0);
+	std::vector<Edge> edges;
+	edges.reserve(edges_.size() + newEdgesCount_);
+	for(unsigned int i=0; i<ids_.size(); ++i)
+	{
+		int index = newIndices[i];
+		if(index < 0)
+		{
+			continue;
+		}
+		ids[index] = ids_[i];
+		poses[index] = poses_[i];
+		for(int l=0; l<referenceCount_; ++l)
+		{
+			referenceDistances[index*referenceCount_+l] = referenceDistances_[i*referenceCount_+l];
+		}
+		offsets[index] = (int)edges.size();
+		if(i+1 < offsets_.size())
+		{
+			for(int j=offsets_[i]; j<offsets_[i+1]; ++j)
+			{
+				if(edges_[j].to >= 0 && newIndices[edges_[j].to] >= 0)
+				{
+					edges.push_back(edges_[j]);
+					edges.back().to = newIndices[edges_[j].to];
+				}
+			}
+		}
+		for(unsigned int j=0; j<newEdges_[i].size(); ++j)
+		{
+			if(newEdges_[i][j].to >= 0 && newIndices[newEdges_[i][j].to] >= 0)
+			{
+				edges.push_back(newEdges_[i][j]);
+				edges.back().to = newIndices[newEdges_[i][j].to];
+			}
+		}
+	}
+	offsets[count] = (int)edges.size();
+
+	for(std::map<int, int>::iterator iter=idToIndex_.begin(); iter!=idToIndex_.end(); ++iter)
+	{
+		iter->second = newIndices[iter->second];
+	}
+	ids_.swap(ids);
+	poses_.swap(poses);
+	referenceDistances_.swap(referenceDistances);
+	offsets_.swap(offsets);
+	edges_.swap(edges);
+	newEdges_.clear();
+	newEdges_.resize(count);
+	newEdgesCount_ = 0;
+	removedCount_ = 0;
+
+	// search buffers are indexed by the old indices
+	heapIndex_.clear();
+	visited_.clear();
+	heap_.clear();
+}
+
+float PathGraph::heuristic(int index, int goal) const
+{
+	if(heuristicScale_ <= 0.0f)
+	{
+		return 0.0f;
+	}
+	float h = 0.0f;
+	if(posesMissing_ == 0 && poseScaleValid_)
+	{
+		h = poseScale_ * poses_[index].getDistance(poses_[goal]);
+	}
+	if(referenceDistancesValid_)
+	{
+		const float * di = &referenceDistances_[index*referenceCount_];
+		const float * dg = &referenceDistances_[goal*referenceCount_];
+		for(int l=0; l<referenceCount_; ++l)
+		{
+			if(di[l] != std::numeric_limits<float>::max() && dg[l] != std::numeric_limits<float>::max())
+			{
+				float dl = dg[l]>di[l]?dg[l]-di[l]:di[l]-dg[l];
+				if(dl > h)
+				{
+					h = dl;
+				}
+			}
+		}
+	}
+	return h * heuristicScale_;
+}
+
+void PathGraph::heapPush(int index)
+{
+	heapIndex_[index] = (int)heap_.size();
+	heap_.push_back(index);
+	heapUpdate(index);
+}
+
+void PathGraph::heapUpdate(int index)
+{
+	// keys only decrease, sift up
+	int i = heapIndex_[index];
+	while(i > 0)
+	{
+		int parent = (i-1)/2;
+		if(keys_[heap_[parent]] <= keys_[index])
+		{
+			break;
+		}
+		heap_[i] = heap_[parent];
+		heapIndex_[heap_[i]] = i;
+		i = parent;
+	}
+	heap_[i] = index;
+	heapIndex_[index] = i;
+}
+
+int PathGraph::heapPop()
+{
+	int top = heap_[0];
+	int last = heap_.back();
+	heap_.pop_back();
+	if(!heap_.empty())
+	{
+		// sift down
+		int size = (int)heap_.size();
+		int i = 0;
+		while(true)
+		{
+			int child = 2*i+1;
+			if(child >= size)
+			{
+				break;
+			}
+			if(child+1 < size && keys_[heap_[child+1]] < keys_[heap_[child]])
+			{
+				++child;
+			}
+			if(keys_[last] <= keys_[heap_[child]])
+			{
+				break;
+			}
+			heap_[i] = heap_[child];
+			heapIndex_[heap_[i]] = i;
+			i = child;
+		}
+		heap_[i] = last;
+		heapIndex_[last] = i;
+	}
+	heapIndex_[top] = -2;
+	return top;
+}
+
+void PathGraph::resetSearch()
+{
+	if(heapIndex_.size() < ids_.size())
+	{
+		heapIndex_.resize(ids_.size(), -1);
+		costs_.resize(ids_.size());
+		keys_.resize(ids_.size());
+		heuristics_.resize(ids_.size());
+		parents_.resize(ids_.size());
+	}
+	for(unsigned int i=0; i<visited_.size(); ++i)
+	{
+		heapIndex_[visited_[i]] = -1;
+	}
+	visited_.clear();
+	heap_.clear();
+}
+
+void PathGraph::dijkstra(int source, float * distances)
+{
+	// Plain Dijkstra on link costs (distances), used for reference nodes
+	resetSearch();
+	costs_[source] = 0.0f;
+	keys_[source] = 0.0f;
+	visited_.push_back(source);
+	heapPush(source);
+	while(!heap_.empty())
+	{
+		int u = heapPop();
+		distances[u] = costs_[u];
+		int ranges[2][2] = {{0,0},{0,(int)newEdges_[u].size()}};
+		if(u+1 < (int)offsets_.size())
+		{
+			ranges[0][0] = offsets_[u];
+			ranges[0][1] = offsets_[u+1];
+		}
+		for(int r=0; r<2; ++r)
+		{
+			for(int i=ranges[r][0]; i<ranges[r][1]; ++i)
+			{
+				const Edge & e = r==0?edges_[i]:newEdges_[u][i];
+				if(e.to < 0 || ids_[e.to] == 0 || heapIndex_[e.to] == -2)
+				{
+					continue;
+				}
+				float cost = costs_[u] + e.cost;
+				if(heapIndex_[e.to] == -1)
+				{
+					visited_.push_back(e.to);
+					costs_[e.to] = keys_[e.to] = cost;
+					heapPush(e.to);
+				}
+				else if(cost < costs_[e.to])
+				{
+					costs_[e.to] = keys_[e.to] = cost;
+					heapUpdate(e.to);
+				}
+			}
+		}
+	}
+	resetSearch();
+}
+
+void PathGraph::computePoseScale()
+{
+	// For any path, the sum of the link costs is at least the smallest
+	// cost/distance ratio times the euclidean distance between its ends.
+	poseScale_ = std::numeric_limits<float>::max();
+	for(unsigned int u=0; u<ids_.size(); ++u)
+	{
+		if(ids_[u] == 0)
+		{
+			continue;
+		}
+		int ranges[2][2] = {{0,0},{0,(int)newEdges_[u].size()}};
+		if(u+1 < offsets_.size())
+		{
+			ranges[0][0] = offsets_[u];
+			ranges[0][1] = offsets_[u+1];
+		}
+		for(int r=0; r<2; ++r)
+		{
+			for(int i=ranges[r][0]; i<ranges[r][1]; ++i)
+			{
+				const Edge & e = r==0?edges_[i]:newEdges_[u][i];
+				if(e.to < 0 || ids_[e.to] == 0)
+				{
+					continue;
+				}
+				float distance = poses_[u].getDistance(poses_[e.to]);
+				if(distance > 0.0f && e.cost/distance < poseScale_)
+				{
+					poseScale_ = e.cost/distance;
+				}
+			}
+		}
+	}
+	if(poseScale_ == std::numeric_limits<float>::max())
+	{
+		poseScale_ = 0.0f;
+	}
+	UDEBUG("poseScale=%f", poseScale_);
+	poseScaleValid_ = true;
+}
+
+void PathGraph::updateReferenceDistances(int reference, int to, float distance)
+{
+	// Dijkstra from the node whose distance decreased, only
+	// nodes getting a shorter distance are visited.
+	resetSearch();
+	costs_[to] = keys_[to] = distance;
+	visited_.push_back(to);
+	heapPush(to);
+	while(!heap_.empty())
+	{
+		int u = heapPop();
+		referenceDistances_[u*referenceCount_+reference] = costs_[u];
+		int ranges[2][2] = {{0,0},{0,(int)newEdges_[u].size()}};
+		if(u+1 < (int)offsets_.size())
+		{
+			ranges[0][0] = offsets_[u];
+			ranges[0][1] = offsets_[u+1];
+		}
+		for(int r=0; r<2; ++r)
+		{
+			for(int i=ranges[r][0]; i<ranges[r][1]; ++i)
+			{
+				const Edge & e = r==0?edges_[i]:newEdges_[u][i];
+				if(e.to < 0 || ids_[e.to] == 0 || heapIndex_[e.to] == -2)
+				{
+					continue;
+				}
+				float cost = costs_[u] + e.cost;
+				if(cost >= referenceDistances_[e.to*referenceCount_+reference])
+				{
+					continue;
+				}
+				if(heapIndex_[e.to] == -1)
+				{
+					visited_.push_back(e.to);
+					costs_[e.to] = keys_[e.to] = cost;
+					heapPush(e.to);
+				}
+				else if(cost < costs_[e.to])
+				{
+					costs_[e.to] = keys_[e.to] = cost;
+					heapUpdate(e.to);
+				}
+			}
+		}
+	}
+	resetSearch();
+}
+
+void PathGraph::computeReferenceDistances()
+{
+	UDEBUG("Computing %d reference nodes", referenceNodes_);
+	int n = (int)ids_.size();
+	int count = std::min(referenceNodes_, (int)idToIndex_.size());
+	std::vector<std::vector<float> > distances;
+	if(count)
+	{
+		// Farthest nodes selection: the first reference is the farthest
+		// node from an arbitrary node, the next ones are the farthest
+		// from the references already selected.
+		std::vector<float> minDistances(n, std::numeric_limits<float>::max());
+		dijkstra(idToIndex_.begin()->second, &minDistances[0]);
+		for(int l=0; l<count; ++l)
+		{
+			int reference = -1;
+			float maxDistance = -1.0f;
+			for(int i=0; i<n; ++i)
+			{
+				if(ids_[i] != 0 && minDistances[i] != std::numeric_limits<float>::max() && minDistances[i] > maxDistance)
+				{
+					maxDistance = minDistances[i];
+					reference = i;
+				}
+			}
+			if(reference < 0 || (l > 0 && maxDistance == 0.0f))
+			{
+				break;
+			}
+			distances.push_back(std::vector<float>(n, std::numeric_limits<float>::max()));
+			dijkstra(reference, &distances.back()[0]);
+			if(l == 0)
+			{
+				minDistances = distances.back();
+			}
+			else
+			{
+				for(int i=0; i<n; ++i)
+				{
+					minDistances[i] = std::min(minDistances[i], distances.back()[i]);
+				}
+			}
+		}
+	}
+	// interleaved by node, so that nodes can be added
+	referenceCount_ = (int)distances.size();
+	referenceDistances_.resize(n*referenceCount_);
+	for(int i=0; i<n; ++i)
+	{
+		for(int l=0; l<referenceCount_; ++l)
+		{
+			referenceDistances_[i*referenceCount_+l] = distances[l][i];
+		}
+	}
+	referenceDistancesValid_ = true;
+}
+
+std::list<std::pair<int, Transform> > PathGraph::computePath(
+		int from,
+		int to,
+		float linearVelocity,
+		float angularVelocity)
+{
+	std::list<std::pair<int, Transform> > path;
+	if(from == to)
+	{
+		path.push_back(std::make_pair(from, Transform::getIdentity()));
+		return path;
+	}
+	std::map<int, int>::iterator iter = idToIndex_.find(from);
+	std::map<int, int>::iterator jter = idToIndex_.find(to);
+	if(iter == idToIndex_.end() || jter == idToIndex_.end())
+	{
+		return path;
+	}
+
+	if(newEdgesCount_ + removedCount_ > std::max(1024, (int)edges_.size()/4))
+	{
+		compact();
+		iter = idToIndex_.find(from);
+		jter = idToIndex_.find(to);
+	}
+	int start = iter->second;
+	int goal = jter->second;
+
+	// Costs are distances scaled by the linear velocity, the
+	// heuristic cannot be used with rotation only.
+	heuristicScale_ = 1.0f;
+	if(linearVelocity > 0.0f)
+	{
+		heuristicScale_ = 1.0f/linearVelocity;
+	}
+	else if(angularVelocity > 0.0f)
+	{
+		heuristicScale_ = 0.0f;
+	}
+	if(referenceNodes_ > 0 && !referenceDistancesValid_ && heuristicScale_ > 0.0f)
+	{
+		computeReferenceDistances();
+	}
+	if(posesMissing_ == 0 && !poseScaleValid_ && heuristicScale_ > 0.0f)
+	{
+		computePoseScale();
+	}
+
+	resetSearch();
+	if(angularVelocity > 0.0f && chainedPoses_.size() < ids_.size())
+	{
+		chainedPoses_.resize(ids_.size());
+	}
+	costs_[start] = 0.0f;
+	heuristics_[start] = heuristic(start, goal);
+	keys_[start] = heuristics_[start];
+	parents_[start] = -1;
+	if(angularVelocity > 0.0f)
+	{
+		chainedPoses_[start] = Transform::getIdentity();
+	}
+	visited_.push_back(start);
+	heapPush(start);
+	while(!heap_.empty())
+	{
+		int u = heapPop();
+		if(u == goal)
+		{
+			break;
+		}
+		int ranges[2][2] = {{0,0},{0,(int)newEdges_[u].size()}};
+		if(u+1 < (int)offsets_.size())
+		{
+			ranges[0][0] = offsets_[u];
+			ranges[0][1] = offsets_[u+1];
+		}
+		for(int r=0; r<2; ++r)
+		{
+			for(int i=ranges[r][0]; i<ranges[r][1]; ++i)
+			{
+				const Edge & e = r==0?edges_[i]:newEdges_[u][i];
+				if(e.to < 0 || ids_[e.to] == 0 || heapIndex_[e.to] == -2)
+				{
+					continue;
+				}
+				float cost = 0.0f;
+				Transform nextPose;
+				if(linearVelocity <= 0.0f && angularVelocity <= 0.0f)
+				{
+					// use distance only
+					cost = e.cost;
+				}
+				else // use time
+				{
+					if(linearVelocity > 0.0f)
+					{
+						cost += e.cost/linearVelocity;
+					}
+					if(angularVelocity > 0.0f)
+					{
+						const Transform & pose = chainedPoses_[u];
+						nextPose = pose*e.transform;
+						Eigen::Vector4f v1 = Eigen::Vector4f(nextPose.x()-pose.x(), nextPose.y()-pose.y(), nextPose.z()-pose.z(), 1.0f);
+						Eigen::Vector4f v2 = nextPose.rotation().toEigen4f()*Eigen::Vector4f(1,0,0,1);
+						float angle = pcl::getAngle3D(v1, v2);
+						cost += angle / angularVelocity;
+					}
+				}
+				cost += costs_[u];
+
+				if(heapIndex_[e.to] == -1)
+				{
+					visited_.push_back(e.to);
+					costs_[e.to] = cost;
+					heuristics_[e.to] = heuristic(e.to, goal);
+					keys_[e.to] = cost + heuristics_[e.to];
+					parents_[e.to] = u;
+					if(angularVelocity > 0.0f)
+					{
+						chainedPoses_[e.to] = nextPose;
+					}
+					heapPush(e.to);
+				}
+				else if(cost < costs_[e.to])
+				{
+					costs_[e.to] = cost;
+					keys_[e.to] = cost + heuristics_[e.to];
+					parents_[e.to] = u;
+					if(angularVelocity > 0.0f)
+					{
+						chainedPoses_[e.to] = nextPose;
+					}
+					heapUpdate(e.to);
+				}
+			}
+		}
+	}
+
+	if(heapIndex_[goal] == -2)
+	{
+		std::list<int> indices;
+		for(int i=goal; i>=0; i=parents_[i])
+		{
+			indices.push_front(i);
+		}
+		Transform pose = Transform::getIdentity();
+		int previous = -1;
+		for(std::list<int>::iterator kter=indices.begin(); kter!=indices.end(); ++kter)
+		{
+			if(previous >= 0)
+			{
+				Edge * edge = findEdge(previous, *kter);
+				UASSERT(edge != 0);
+				pose *= edge->transform;
+			}
+			path.push_back(std::make_pair(ids_[*kter], pose));
+			previous = *kter;
+		}
+	}
+	resetSearch();
+	return path;
+}
+
+} /* namespace rtabmap */
@@ -0,0 +1,416 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap/core/PosesIndex.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UMath.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#if __cplusplus >= 201103L
+#include <unordered_map>
+#endif
+
+namespace rtabmap {
+
+struct PosesIndex::Cells
+{
+#if __cplusplus >= 201103L
+	typedef std::unordered_map<long long, std::vector<Point> > Map;
+#else
+	typedef std::map<long long, std::vector<Point> > Map;
+#endif
+	Map map;
+};
+
+PosesIndex::PosesIndex(float cellSize) :
+	cellSize_(cellSize),
+	cells_(new Cells())
+{
+	UASSERT(cellSize_ > 0.0f);
+	clear();
+}
+
+PosesIndex::~PosesIndex()
+{
+	delete cells_;
+}
+
+void PosesIndex::clear()
+{
+	entries_.clear();
+	cells_->map.clear();
+	for(int i=0; i<3; ++i)
+	{
+		minCell_[i] = std::numeric_limits<int>::max();
+		maxCell_[i] = std::numeric_limits<int>::min();
+	}
+}
+
+void PosesIndex::setCellSize(float cellSize)
+{
+	UASSERT(cellSize > 0.0f);
+	if(cellSize != cellSize_)
+	{
+		cellSize_ = cellSize;
+		std::map<int, Entry> entries;
+		entries.swap(entries_);
+		clear();
+		for(std::map<int, Entry>::iterator iter=entries.begin(); iter!=entries.end(); ++iter)
+		{
+			Entry & entry = entries_.insert(entries_.end(), *iter)->second;
+			insertInCell(iter->first, entry);
+		}
+	}
+}
+
+void PosesIndex::cellOf(float x, float y, float z, int & cx, int & cy, int & cz) const
+{
+	cx = (int)std::floor(x/cellSize_);
+	cy = (int)std::floor(y/cellSize_);
+	cz = (int)std::floor(z/cellSize_);
+}
+
+long long PosesIndex::cellKey(int cx, int cy, int cz)
+{
+	// 21 bits per axis
+	const long long mask = (1<<21)-1;
+	return (((long long)cx & mask) << 42) | (((long long)cy & mask) << 21) | ((long long)cz & mask);
+}
+
+void PosesIndex::insertInCell(int id, Entry & entry)
+{
+	int c[3];
+	cellOf(entry.x, entry.y, entry.z, c[0], c[1], c[2]);
+	entry.key = cellKey(c[0], c[1], c[2]);
+	Point pt;
+	pt.id = id;
+	pt.x = entry.x;
+	pt.y = entry.y;
+	pt.z = entry.z;
+	cells_->map[entry.key].push_back(pt);
+	for(int i=0; i<3; ++i)
+	{
+		minCell_[i] = std::min(minCell_[i], c[i]);
+		maxCell_[i] = std::max(maxCell_[i], c[i]);
+	}
+}
+
+void PosesIndex::removeFromCell(int id, const Entry & entry)
+{
+	Cells::Map::iterator iter = cells_->map.find(entry.key);
+	UASSERT(iter != cells_->map.end());
+	std::vector<Point> & points = iter->second;
+	unsigned int i=0;
+	for(; i<points.size() && points[i].id != id; ++i);
+	UASSERT(i < points.size());
+	points[i] = points.back();
+	points.pop_back();
+	if(points.empty())
+	{
+		cells_->map.erase(iter);
+	}
+}
+
+void PosesIndex::add(int id, const Transform & pose)
+{
+	UASSERT_MSG(!pose.isNull() && uIsFinite(pose.x()) && uIsFinite(pose.y()) && uIsFinite(pose.z()),
+			uFormat("Invalid pose (%d) %s", id, pose.prettyPrint().c_str()).c_str());
+	std::map<int, Entry>::iterator iter = entries_.find(id);
+	if(iter != entries_.end())
+	{
+		removeFromCell(id, iter->second);
+	}
+	else
+	{
+		iter = entries_.insert(std::make_pair(id, Entry())).first;
+	}
+	iter->second.x = pose.x();
+	iter->second.y = pose.y();
+	iter->second.z = pose.z();
+	insertInCell(id, iter->second);
+}
+
+void PosesIndex::remove(int id)
+{
+	std::map<int, Entry>::iterator iter = entries_.find(id);
+	if(iter != entries_.end())
+	{
+		removeFromCell(id, iter->second);
+		entries_.erase(iter);
+	}
+}
+
+int PosesIndex::update(const std::map<int, Transform> & poses)
+{
+	// Both maps are sorted by id, walk them together
+	int changes = 0;
+	std::map<int, Entry>::iterator iter = entries_.begin();
+	for(std::map<int, Transform>::const_iterator jter=poses.begin(); jter!=poses.end(); ++jter)
+	{
+		while(iter != entries_.end() && iter->first < jter->first)
+		{
+			removeFromCell(iter->first, iter->second);
+			entries_.erase(iter++);
+			++changes;
+		}
+		if(iter != entries_.end() && iter->first == jter->first)
+		{
+			if(iter->second.x != jter->second.x() ||
+			   iter->second.y != jter->second.y() ||
+			   iter->second.z != jter->second.z())
+			{
+				add(jter->first, jter->second);
+				++changes;
+			}
+			++iter;
+		}
+		else
+		{
+			add(jter->first, jter->second);
+			++changes;
+		}
+	}
+	while(iter != entries_.end())
+	{
+		removeFromCell(iter->first, iter->second);
+		entries_.erase(iter++);
+		++changes;
+	}
+	UDEBUG("poses=%d changes=%d cells=%d", (int)entries_.size(), changes, (int)cells_->map.size());
+	return changes;
+}
+
+std::map<int, float> PosesIndex::radiusSearch(const Transform & pose, float radius, int excludedId) const
+{
+	std::map<int, float> found;
+	if(entries_.empty() || pose.isNull() || radius < 0.0f)
+	{
+		return found;
+	}
+	float x = pose.x();
+	float y = pose.y();
+	float z = pose.z();
+	float radiusSqrd = radius*radius;
+	int minC[3], maxC[3];
+	cellOf(x-radius, y-radius, z-radius, minC[0], minC[1], minC[2]);
+	cellOf(x+radius, y+radius, z+radius, maxC[0], maxC[1], maxC[2]);
+	double cellsCount = 1.0;
+	for(int i=0; i<3; ++i)
+	{
+		minC[i] = std::max(minC[i], minCell_[i]);
+		maxC[i] = std::min(maxC[i], maxCell_[i]);
+		cellsCount *= maxC[i]>=minC[i]?double(maxC[i]-minC[i]+1):0.0;
+	}
+	if(cellsCount > (double)entries_.size())
+	{
+		// faster to check all poses
+		for(std::map<int, Entry>::const_iterator iter=entries_.begin(); iter!=entries_.end(); ++iter)
+		{
+			float dx = iter->second.x-x, dy = iter->second.y-y, dz = iter->second.z-z;
+			float d = dx*dx + dy*dy + dz*dz;
+			if(d <= radiusSqrd && iter->first != excludedId)
+			{
+				found.insert(found.end(), std::make_pair(iter->first, d));
+			}
+		}
+		return found;
+	}
+	for(int cx=minC[0]; cx<=maxC[0]; ++cx)
+	{
+		for(int cy=minC[1]; cy<=maxC[1]; ++cy)
+		{
+			for(int cz=minC[2]; cz<=maxC[2]; ++cz)
+			{
+				Cells::Map::const_iterator iter = cells_->map.find(cellKey(cx, cy, cz));
+				if(iter == cells_->map.end())
+				{
+					continue;
+				}
+				for(unsigned int i=0; i<iter->second.size(); ++i)
+				{
+					const Point & p = iter->second[i];
+					float dx = p.x-x, dy = p.y-y, dz = p.z-z;
+					float d = dx*dx + dy*dy + dz*dz;
+					if(d <= radiusSqrd && p.id != excludedId)
+					{
+						found.insert(std::make_pair(p.id, d));
+					}
+				}
+			}
+		}
+	}
+	return found;
+}
+
+std::vector<int> PosesIndex::knnSearch(const Transform & pose, int k, bool ignoreLandmarks) const
+{
+	std::vector<int> nearest;
+	if(entries_.empty() || pose.isNull() || k <= 0)
+	{
+		return nearest;
+	}
+	float x = pose.x();
+	float y = pose.y();
+	float z = pose.z();
+	int c[3];
+	cellOf(x, y, z, c[0], c[1], c[2]);
+	// max ring to cover all cells
+	int maxRing = 0;
+	for(int i=0; i<3; ++i)
+	{
+		maxRing = std::max(maxRing, std::max(c[i]-minCell_[i], maxCell_[i]-c[i]));
+	}
+
+	// <squared distance, id>, max-heap of the k nearest
+	std::vector<std::pair<float, int> > best;
+	best.reserve(k+1);
+	double cellsChecked = 0.0;
+	for(int ring=0; ring<=maxRing; ++ring)
+	{
+		int minC[3], maxC[3];
+		double cellsCount = 1.0;
+		for(int i=0; i<3; ++i)
+		{
+			minC[i] = std::max(c[i]-ring, minCell_[i]);
+			maxC[i] = std::min(c[i]+ring, maxCell_[i]);
+			cellsCount *= maxC[i]>=minC[i]?double(maxC[i]-minC[i]+1):0.0;
+		}
+		if(cellsCount - cellsChecked > (double)entries_.size())
+		{
+			// Sparse cells around the query, faster to check all poses
+			best.clear();
+			for(std::map<int, Entry>::const_iterator iter=entries_.begin(); iter!=entries_.end(); ++iter)
+			{
+				if(ignoreLandmarks && iter->first < 0)
+				{
+					continue;
+				}
+				float dx = iter->second.x-x, dy = iter->second.y-y, dz = iter->second.z-z;
+				best.push_back(std::make_pair(dx*dx + dy*dy + dz*dz, iter->first));
+				std::push_heap(best.begin(), best.end());
+				if((int)best.size() > k)
+				{
+					std::pop_heap(best.begin(), best.end());
+					best.pop_back();
+				}
+			}
+			break;
+		}
+		cellsChecked = cellsCount;
+
+		for(int cx=minC[0]; cx<=maxC[0]; ++cx)
+		{
+			for(int cy=minC[1]; cy<=maxC[1]; ++cy)
+			{
+				for(int cz=minC[2]; cz<=maxC[2]; ++cz)
+				{
+					if(std::abs(cx-c[0]) != ring && std::abs(cy-c[1]) != ring && std::abs(cz-c[2]) != ring)
+					{
+						// inner cells already checked
+						continue;
+					}
+					Cells::Map::const_iterator iter = cells_->map.find(cellKey(cx, cy, cz));
+					if(iter == cells_->map.end())
+					{
+						continue;
+					}
+					for(unsigned int i=0; i<iter->second.size(); ++i)
+					{
+						const Point & p = iter->second[i];
+						if(ignoreLandmarks && p.id < 0)
+						{
+							continue;
+						}
+						float dx = p.x-x, dy = p.y-y, dz = p.z-z;
+						best.push_back(std::make_pair(dx*dx + dy*dy + dz*dz, p.id));
+						std::push_heap(best.begin(), best.end());
+						if((int)best.size() > k)
+						{
+							std::pop_heap(best.begin(), best.end());
+							best.pop_back();
+						}
+					}
+				}
+			}
+		}
+		// Poses in next rings are at least ring*cellSize far
+		float minDistance = float(ring)*cellSize_;
+		if((int)best.size() == k && best.front().first <= minDistance*minDistance)
+		{
+			break;
+		}
+	}
+
+	std::sort_heap(best.begin(), best.end());
+	nearest.resize(best.size());
+	for(unsigned int i=0; i<best.size(); ++i)
+	{
+		nearest[i] = best[i].second;
+	}
+	return nearest;
+}
+
+std::map<int, float> PosesIndex::frustumSearch(
+		const Transform & pose,
+		float horizontalFOV,
+		float verticalFOV,
+		float nearDistance,
+		float farDistance,
+		int excludedId) const
+{
+	std::map<int, float> found = radiusSearch(pose, farDistance, excludedId);
+	if(found.empty())
+	{
+		return found;
+	}
+	Transform poseInv = pose.inverse();
+	float tanH = std::tan(horizontalFOV/2.0f);
+	float tanV = std::tan(verticalFOV/2.0f);
+	for(std::map<int, float>::iterator iter=found.begin(); iter!=found.end();)
+	{
+		const Entry & e = entries_.at(iter->first);
+		// in pose frame
+		float x = poseInv.r11()*e.x + poseInv.r12()*e.y + poseInv.r13()*e.z + poseInv.o14();
+		float y = poseInv.r21()*e.x + poseInv.r22()*e.y + poseInv.r23()*e.z + poseInv.o24();
+		float z = poseInv.r31()*e.x + poseInv.r32()*e.y + poseInv.r33()*e.z + poseInv.o34();
+		if(x >= nearDistance &&
+		   (horizontalFOV >= float(M_PI) || std::fabs(y) <= x*tanH) &&
+		   (verticalFOV >= float(M_PI) || std::fabs(z) <= x*tanV))
+		{
+			++iter;
+		}
+		else
+		{
+			found.erase(iter++);
+		}
+	}
+	return found;
+}
+
+} /* namespace rtabmap */
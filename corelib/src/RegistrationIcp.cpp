@@ -27,6 +27,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include <rtabmap/core/RegistrationIcp.h>
+#include <rtabmap/core/IcpEngine.h>
 #include <rtabmap/core/util3d_registration.h>
 #include <rtabmap/core/util3d_surface.h>
 #include <rtabmap/core/util3d.h>
@@ -382,17 +383,15 @@ RegistrationIcp::RegistrationIcp(const ParametersMap & parameters, Registration
 	_libpointmatcherConfig(Parameters::defaultIcpPMConfig()),
 	_libpointmatcherKnn(Parameters::defaultIcpPMMatcherKnn()),
 	_libpointmatcherEpsilon(Parameters::defaultIcpPMMatcherEpsilon()),
-	_libpointmatcherOutlierRatio(Parameters::defaultIcpPMOutlierRatio()),
-	_libpointmatcherICP(0)
+	_libpointmatcherOutlierRatio(Parameters::defaultIcpPMOutlierRatio())
 {
 	this->parseParameters(parameters);
 }
 
 RegistrationIcp::~RegistrationIcp()
 {
-#ifdef RTABMAP_POINTMATCHER
-	delete (PM::ICP*)_libpointmatcherICP;
-#endif
+	clearLibpointmatcherICPs();
+	clearPreparedTargets();
 }
 
 void RegistrationIcp::parseParameters(const ParametersMap & parameters)
@@ -428,110 +427,362 @@ void RegistrationIcp::parseParameters(const ParametersMap & parameters)
 		_libpointmatcher = false;
 	}
 #else
+	clearLibpointmatcherICPs();
 	if(_libpointmatcher)
 	{
 		UINFO("libpointmatcher enabled! config=\"%s\"", _libpointmatcherConfig.c_str());
-		if(_libpointmatcherICP!=0)
-		{
-			delete (PM::ICP*)_libpointmatcherICP;
-			_libpointmatcherICP = 0;
-		}
+		// create the first instance now to report configuration errors
+		releaseLibpointmatcherICP(acquireLibpointmatcherICP());
+	}
+#endif
+
+	UASSERT_MSG(_voxelSize >= 0, uFormat("value=%d", _voxelSize).c_str());
+	UASSERT_MSG(_downsamplingStep >= 0, uFormat("value=%d", _downsamplingStep).c_str());
+	UASSERT_MSG(_maxCorrespondenceDistance > 0.0f, uFormat("value=%f", _maxCorrespondenceDistance).c_str());
+	UASSERT_MSG(_maxIterations > 0, uFormat("value=%d", _maxIterations).c_str());
+	UASSERT(_epsilon >= 0.0f);
+	UASSERT_MSG(_correspondenceRatio >=0.0f && _correspondenceRatio <=1.0f, uFormat("value=%f", _correspondenceRatio).c_str());
+	UASSERT_MSG(!_pointToPlane || (_pointToPlane && (_pointToPlaneK > 0 || _pointToPlaneRadius > 0.0f)), uFormat("_pointToPlaneK=%d _pointToPlaneRadius=%f", _pointToPlaneK, _pointToPlaneRadius).c_str());
 
-		_libpointmatcherICP = new PM::ICP();
+	clearPreparedTargets();
+}
 
-		PM::ICP * icp = (PM::ICP*)_libpointmatcherICP;
+void * RegistrationIcp::acquireLibpointmatcherICP() const
+{
+#ifdef RTABMAP_POINTMATCHER
+	UScopeMutex lock(_libpointmatcherICPsMutex);
+	if(!_libpointmatcherICPs.empty())
+	{
+		void * icp = _libpointmatcherICPs.front();
+		_libpointmatcherICPs.pop_front();
+		return icp;
+	}
+
+	PM::ICP * icp = new PM::ICP();
 
-		bool useDefaults = true;
-		if(!_libpointmatcherConfig.empty())
+	bool useDefaults = true;
+	if(!_libpointmatcherConfig.empty())
+	{
+		// load YAML config
+		std::ifstream ifs(_libpointmatcherConfig.c_str());
+		if (ifs.good())
 		{
-			// load YAML config
-			std::ifstream ifs(_libpointmatcherConfig.c_str());
-			if (ifs.good())
-			{
-				icp->loadFromYaml(ifs);
-				useDefaults = false;
-			}
-			else
-			{
-				UERROR("Cannot open libpointmatcher config file \"%s\", using default values instead.", _libpointmatcherConfig.c_str());
-			}
+			icp->loadFromYaml(ifs);
+			useDefaults = false;
 		}
-		if(useDefaults)
+		else
 		{
-			// Create the default ICP algorithm
-			// See the implementation of setDefault() to create a custom ICP algorithm
-			icp->setDefault();
+			UERROR("Cannot open libpointmatcher config file \"%s\", using default values instead.", _libpointmatcherConfig.c_str());
+		}
+	}
+	if(useDefaults)
+	{
+		// Create the default ICP algorithm
+		// See the implementation of setDefault() to create a custom ICP algorithm
+		icp->setDefault();
 
-			icp->readingDataPointsFilters.clear();
-			icp->readingDataPointsFilters.push_back(PM::get().DataPointsFilterRegistrar.create("IdentityDataPointsFilter"));
+		icp->readingDataPointsFilters.clear();
+		icp->readingDataPointsFilters.push_back(PM::get().DataPointsFilterRegistrar.create("IdentityDataPointsFilter"));
 
-			icp->referenceDataPointsFilters.clear();
-			icp->referenceDataPointsFilters.push_back(PM::get().DataPointsFilterRegistrar.create("IdentityDataPointsFilter"));
+		icp->referenceDataPointsFilters.clear();
+		icp->referenceDataPointsFilters.push_back(PM::get().DataPointsFilterRegistrar.create("IdentityDataPointsFilter"));
 
-			PM::Parameters params;
-			params["maxDist"] = uNumber2Str(_maxCorrespondenceDistance);
-			params["knn"] = uNumber2Str(_libpointmatcherKnn);
-			params["epsilon"] = uNumber2Str(_libpointmatcherEpsilon);
+		PM::Parameters params;
+		params["maxDist"] = uNumber2Str(_maxCorrespondenceDistance);
+		params["knn"] = uNumber2Str(_libpointmatcherKnn);
+		params["epsilon"] = uNumber2Str(_libpointmatcherEpsilon);
 #if POINTMATCHER_VERSION_INT >= 10300
-			icp->matcher = PM::get().MatcherRegistrar.create("KDTreeMatcher", params);
+		icp->matcher = PM::get().MatcherRegistrar.create("KDTreeMatcher", params);
 #else
-			icp->matcher.reset(PM::get().MatcherRegistrar.create("KDTreeMatcher", params));
+		icp->matcher.reset(PM::get().MatcherRegistrar.create("KDTreeMatcher", params));
 #endif
-			params.clear();
+		params.clear();
 
-			params["ratio"] = uNumber2Str(_libpointmatcherOutlierRatio);
-			icp->outlierFilters.clear();
-			icp->outlierFilters.push_back(PM::get().OutlierFilterRegistrar.create("TrimmedDistOutlierFilter", params));
+		params["ratio"] = uNumber2Str(_libpointmatcherOutlierRatio);
+		icp->outlierFilters.clear();
+		icp->outlierFilters.push_back(PM::get().OutlierFilterRegistrar.create("TrimmedDistOutlierFilter", params));
+		params.clear();
+		if(_pointToPlane)
+		{
+			params["maxAngle"] = uNumber2Str(_maxRotation<=0.0f?M_PI:_maxRotation);
+			icp->outlierFilters.push_back(PM::get().OutlierFilterRegistrar.create("SurfaceNormalOutlierFilter", params));
 			params.clear();
-			if(_pointToPlane)
-			{
-				params["maxAngle"] = uNumber2Str(_maxRotation<=0.0f?M_PI:_maxRotation);
-				icp->outlierFilters.push_back(PM::get().OutlierFilterRegistrar.create("SurfaceNormalOutlierFilter", params));
-				params.clear();
 
-				params["force2D"] = force3DoF()?"1":"0";
+			params["force2D"] = force3DoF()?"1":"0";
 #if POINTMATCHER_VERSION_INT >= 10300
-				icp->errorMinimizer = PM::get().ErrorMinimizerRegistrar.create("PointToPlaneErrorMinimizer", params);
+			icp->errorMinimizer = PM::get().ErrorMinimizerRegistrar.create("PointToPlaneErrorMinimizer", params);
 #else
-				icp->errorMinimizer.reset(PM::get().ErrorMinimizerRegistrar.create("PointToPlaneErrorMinimizer", params));
+			icp->errorMinimizer.reset(PM::get().ErrorMinimizerRegistrar.create("PointToPlaneErrorMinimizer", params));
 #endif
-				params.clear();
-			}
-			else
-			{
+			params.clear();
+		}
+		else
+		{
 #if POINTMATCHER_VERSION_INT >= 10300
-				icp->errorMinimizer = PM::get().ErrorMinimizerRegistrar.create("PointToPointErrorMinimizer");
+			icp->errorMinimizer = PM::get().ErrorMinimizerRegistrar.create("PointToPointErrorMinimizer");
+#else
+			icp->errorMinimizer.reset(PM::get().ErrorMinimizerRegistrar.create("PointToPointErrorMinimizer"));
+#endif
+		}
+
+		icp->transformationCheckers.clear();
+		params["maxIterationCount"] = uNumber2Str(_maxIterations);
+		icp->transformationCheckers.push_back(PM::get().TransformationCheckerRegistrar.create("CounterTransformationChecker", params));
+		params.clear();
+
+		params["minDiffRotErr"] =   uNumber2Str(_epsilon*_epsilon*100.0f);
+		params["minDiffTransErr"] = uNumber2Str(_epsilon*_epsilon);
+		params["smoothLength"] =    uNumber2Str(4);
+		icp->transformationCheckers.push_back(PM::get().TransformationCheckerRegistrar.create("DifferentialTransformationChecker", params));
+		params.clear();
+
+		params["maxRotationNorm"] = uNumber2Str(_maxRotation<=0.0f?M_PI:_maxRotation);
+		params["maxTranslationNorm"] =    uNumber2Str(_maxTranslation<=0.0f?std::numeric_limits<float>::max():_maxTranslation);
+		icp->transformationCheckers.push_back(PM::get().TransformationCheckerRegistrar.create("BoundTransformationChecker", params));
+		params.clear();
+	}
+	return icp;
 #else
-				icp->errorMinimizer.reset(PM::get().ErrorMinimizerRegistrar.create("PointToPointErrorMinimizer"));
+	return 0;
+#endif
+}
+
+void RegistrationIcp::releaseLibpointmatcherICP(void * icp) const
+{
+	UScopeMutex lock(_libpointmatcherICPsMutex);
+	_libpointmatcherICPs.push_back(icp);
+}
+
+void RegistrationIcp::clearLibpointmatcherICPs()
+{
+	UScopeMutex lock(_libpointmatcherICPsMutex);
+#ifdef RTABMAP_POINTMATCHER
+	for(std::list<void*>::iterator iter=_libpointmatcherICPs.begin(); iter!=_libpointmatcherICPs.end(); ++iter)
+	{
+		delete (PM::ICP*)*iter;
+	}
 #endif
+	_libpointmatcherICPs.clear();
+}
+
+// Target scan ready for registration: filtered, with normals if
+// required, converted in its base frame and indexed. As the target
+// doesn't depend on the guess, it is shared between all registrations
+// with the same input scan (e.g., same assembled scans in
+// Memory::computeIcpTransformMulti()).
+class RegistrationIcp::PreparedTarget
+{
+public:
+	PreparedTarget(const LaserScan & input, bool normalsInScan, bool pointToPlane) :
+		input(input),
+		normalsInScan(normalsInScan),
+		pointToPlane(pointToPlane),
+		maxPoints(input.maxPoints()),
+		complexity(1.0),
+		references(1),
+		cached(false)
+	{}
+
+	bool isSame(const LaserScan & scan, bool normalsInScanIn, bool pointToPlaneIn) const
+	{
+		return scan.data().data == input.data().data &&
+				scan.data().cols == input.data().cols &&
+				scan.data().rows == input.data().rows &&
+				scan.format() == input.format() &&
+				scan.maxPoints() == input.maxPoints() &&
+				scan.rangeMax() == input.rangeMax() &&
+				scan.localTransform() == input.localTransform() &&
+				normalsInScanIn == normalsInScan &&
+				pointToPlaneIn == pointToPlane;
+	}
+
+	LaserScan input; // keep a reference on input data, so that it cannot be reused by another scan
+	bool normalsInScan; // normals of the scan are used without voxel filtering
+	bool pointToPlane;  // normals are computed after voxel filtering
+
+	LaserScan filtered;    // after downsampling and range filtering
+	LaserScan scan;        // after voxel filtering (if normalsInScan is false)
+	LaserScan scanNormals; // after voxel filtering with computed normals (if pointToPlane is true)
+	int maxPoints;         // adjusted with voxel filtering ratio
+	double complexity;
+	cv::Mat complexityVectors;
+
+	IcpEngine engine;        // indexed points
+	IcpEngine engineNormals; // indexed points with normals (if normalsInScan or pointToPlane are true)
+
+	// guarded by _preparedTargetsMutex
+	int references; // registrations using the target
+	bool cached;    // in _preparedTargets
+};
+
+const RegistrationIcp::PreparedTarget * RegistrationIcp::acquirePreparedTarget(
+		const LaserScan & input,
+		bool normalsInScan,
+		bool pointToPlane) const
+{
+	{
+		UScopeMutex lock(_preparedTargetsMutex);
+		for(std::list<PreparedTarget*>::iterator iter=_preparedTargets.begin(); iter!=_preparedTargets.end(); ++iter)
+		{
+			if((*iter)->isSame(input, normalsInScan, pointToPlane))
+			{
+				PreparedTarget * target = *iter;
+				++target->references;
+				_preparedTargets.erase(iter);
+				_preparedTargets.push_front(target);
+				UDEBUG("Reusing prepared target (%d points)", target->engine.size());
+				return target;
 			}
+		}
+	}
 
-			icp->transformationCheckers.clear();
-			params["maxIterationCount"] = uNumber2Str(_maxIterations);
-			icp->transformationCheckers.push_back(PM::get().TransformationCheckerRegistrar.create("CounterTransformationChecker", params));
-			params.clear();
+	UTimer timer;
+	PreparedTarget * target = new PreparedTarget(input, normalsInScan, pointToPlane);
+	target->filtered = input;
+	if(_downsamplingStep>1 || _rangeMin >0.0f || _rangeMax > 0.0f)
+	{
+		target->filtered = util3d::commonFiltering(input, _downsamplingStep, _rangeMin, _rangeMax);
+	}
+	const LaserScan & toScan = target->filtered;
+	if(toScan.size())
+	{
+		const Transform & localTransform = toScan.localTransform();
+		if(normalsInScan)
+		{
+			target->complexity = util3d::computeNormalsComplexity(toScan, &target->complexityVectors);
+			pcl::PointCloud<pcl::PointNormal>::Ptr toCloudNormals = util3d::laserScanToPointCloudNormal(toScan, localTransform);
+			toCloudNormals = util3d::removeNaNNormalsFromPointCloud(toCloudNormals);
+			target->engineNormals.setTarget(*toCloudNormals, _maxCorrespondenceDistance);
+		}
 
-			params["minDiffRotErr"] =   uNumber2Str(_epsilon*_epsilon*100.0f);
-			params["minDiffTransErr"] = uNumber2Str(_epsilon*_epsilon);
-			params["smoothLength"] =    uNumber2Str(4);
-			icp->transformationCheckers.push_back(PM::get().TransformationCheckerRegistrar.create("DifferentialTransformationChecker", params));
-			params.clear();
+		pcl::PointCloud<pcl::PointXYZ>::Ptr toCloudFiltered = util3d::laserScanToPointCloud(toScan, localTransform);
+		if(_voxelSize > 0.0f)
+		{
+			float pointsBeforeFiltering = (float)toCloudFiltered->size();
+			toCloudFiltered = util3d::voxelize(toCloudFiltered, _voxelSize);
+			float ratioTo = float(toCloudFiltered->size()) / pointsBeforeFiltering;
+			target->maxPoints = int(float(target->maxPoints) * ratioTo);
+		}
+		target->engine.setTarget(*toCloudFiltered, _maxCorrespondenceDistance);
 
-			params["maxRotationNorm"] = uNumber2Str(_maxRotation<=0.0f?M_PI:_maxRotation);
-			params["maxTranslationNorm"] =    uNumber2Str(_maxTranslation<=0.0f?std::numeric_limits<float>::max():_maxTranslation);
-			icp->transformationCheckers.push_back(PM::get().TransformationCheckerRegistrar.create("BoundTransformationChecker", params));
-			params.clear();
+		if(!normalsInScan)
+		{
+			if(toScan.is2d())
+			{
+				target->scan = LaserScan(
+						util3d::laserScan2dFromPointCloud(*toCloudFiltered, localTransform.inverse()),
+						target->maxPoints,
+						toScan.rangeMax(),
+						LaserScan::kXY,
+						localTransform);
+			}
+			else
+			{
+				target->scan = LaserScan(
+						util3d::laserScanFromPointCloud(*toCloudFiltered, localTransform.inverse()),
+						target->maxPoints,
+						toScan.rangeMax(),
+						LaserScan::kXYZ,
+						localTransform);
+			}
+		}
+
+		if(pointToPlane)
+		{
+			Eigen::Vector3f viewpointTo(localTransform.x(), localTransform.y(), localTransform.z());
+			pcl::PointCloud<pcl::Normal>::Ptr normalsTo;
+			if(toScan.is2d())
+			{
+				if(_voxelSize > 0.0f)
+				{
+					normalsTo = util3d::computeNormals2D(
+							toCloudFiltered,
+							_pointToPlaneK,
+							_pointToPlaneRadius,
+							viewpointTo);
+				}
+				else
+				{
+					normalsTo = util3d::computeFastOrganizedNormals2D(
+							toCloudFiltered,
+							_pointToPlaneK,
+							_pointToPlaneRadius,
+							viewpointTo);
+				}
+			}
+			else
+			{
+				normalsTo = util3d::computeNormals(toCloudFiltered, _pointToPlaneK, _pointToPlaneRadius, viewpointTo);
+			}
+			target->complexity = util3d::computeNormalsComplexity(*normalsTo, toScan.is2d(), &target->complexityVectors);
+
+			pcl::PointCloud<pcl::PointNormal>::Ptr toCloudNormals(new pcl::PointCloud<pcl::PointNormal>);
+			pcl::concatenateFields(*toCloudFiltered, *normalsTo, *toCloudNormals);
+			toCloudNormals = util3d::removeNaNNormalsFromPointCloud(toCloudNormals);
+			target->engineNormals.setTarget(*toCloudNormals, _maxCorrespondenceDistance);
+
+			if(toScan.is2d())
+			{
+				target->scanNormals = LaserScan(
+						util3d::laserScan2dFromPointCloud(*toCloudNormals, localTransform.inverse()),
+						target->maxPoints,
+						toScan.rangeMax(),
+						LaserScan::kXYNormal,
+						localTransform);
+			}
+			else
+			{
+				target->scanNormals = LaserScan(
+						util3d::laserScanFromPointCloud(*toCloudNormals, localTransform.inverse()),
+						target->maxPoints,
+						toScan.rangeMax(),
+						LaserScan::kXYZNormal,
+						localTransform);
+			}
 		}
 	}
-#endif
+	UDEBUG("Prepared target (%d points, normals=%d, voxel=%f) time = %f s", target->engine.size(), target->engineNormals.size(), _voxelSize, timer.ticks());
 
-	UASSERT_MSG(_voxelSize >= 0, uFormat("value=%d", _voxelSize).c_str());
-	UASSERT_MSG(_downsamplingStep >= 0, uFormat("value=%d", _downsamplingStep).c_str());
-	UASSERT_MSG(_maxCorrespondenceDistance > 0.0f, uFormat("value=%f", _maxCorrespondenceDistance).c_str());
-	UASSERT_MSG(_maxIterations > 0, uFormat("value=%d", _maxIterations).c_str());
-	UASSERT(_epsilon >= 0.0f);
-	UASSERT_MSG(_correspondenceRatio >=0.0f && _correspondenceRatio <=1.0f, uFormat("value=%f", _correspondenceRatio).c_str());
-	UASSERT_MSG(!_pointToPlane || (_pointToPlane && (_pointToPlaneK > 0 || _pointToPlaneRadius > 0.0f)), uFormat("_pointToPlaneK=%d _pointToPlaneRadius=%f", _pointToPlaneK, _pointToPlaneRadius).c_str());
+	UScopeMutex lock(_preparedTargetsMutex);
+	target->cached = true;
+	_preparedTargets.push_front(target);
+	if(_preparedTargets.size() > 5)
+	{
+		PreparedTarget * oldest = _preparedTargets.back();
+		_preparedTargets.pop_back();
+		oldest->cached = false;
+		if(oldest->references == 0)
+		{
+			delete oldest;
+		}
+	}
+	return target;
+}
+
+void RegistrationIcp::releasePreparedTarget(const PreparedTarget * target) const
+{
+	UScopeMutex lock(_preparedTargetsMutex);
+	PreparedTarget * t = const_cast<PreparedTarget*>(target);
+	UASSERT(t->references > 0);
+	if(--t->references == 0 && !t->cached)
+	{
+		delete t;
+	}
+}
+
+void RegistrationIcp::clearPreparedTargets()
+{
+	UScopeMutex lock(_preparedTargetsMutex);
+	for(std::list<PreparedTarget*>::iterator iter=_preparedTargets.begin(); iter!=_preparedTargets.end(); ++iter)
+	{
+		// targets still used are deleted when released
+		(*iter)->cached = false;
+		if((*iter)->references == 0)
+		{
+			delete *iter;
+		}
+	}
+	_preparedTargets.clear();
 }
 
 Transform RegistrationIcp::computeTransformationImpl(
@@ -572,14 +823,24 @@ Transform RegistrationIcp::computeTransformationImpl(
 	{
 		// ICP with guess transform
 		LaserScan fromScan = dataFrom.laserScanRaw();
-		LaserScan toScan = dataTo.laserScanRaw();
 		if(_downsamplingStep>1 || _rangeMin >0.0f || _rangeMax > 0.0f)
 		{
 			fromScan = util3d::commonFiltering(fromScan, _downsamplingStep, _rangeMin, _rangeMax);
-			toScan = util3d::commonFiltering(toScan, _downsamplingStep, _rangeMin, _rangeMax);
 			UDEBUG("Downsampling and/or range filtering time (step=%d, min=%fm, max=%fm) = %f s", _downsamplingStep, _rangeMin, _rangeMax,  timer.ticks());
 		}
 
+		// The target is prepared in its own frame (independently of the guess), so
+		// that it can be reused. The guess is the pose of the target in "from" frame.
+		const LaserScan & toScanRaw = dataTo.laserScanRaw();
+		bool pointToPlaneSupported = _pointToPlane && !((fromScan.is2d() || toScanRaw.is2d()) && !_libpointmatcher); // PCL crashes if 2D
+		bool normalsInScan = pointToPlaneSupported &&
+				_voxelSize == 0.0f &&
+				fromScan.hasNormals() &&
+				toScanRaw.hasNormals();
+		const PreparedTarget * target = acquirePreparedTarget(toScanRaw, normalsInScan, pointToPlaneSupported && !normalsInScan);
+		LaserScan toScan = target->filtered;
+		UDEBUG("Target preparation time = %f s", timer.ticks());
+
 		if(fromScan.size() && toScan.size())
 		{
 			Transform icpT;
@@ -590,34 +851,27 @@ Transform RegistrationIcp::computeTransformationImpl(
 			bool transformComputed = false;
 			bool tooLowComplexityForPlaneToPlane = false;
 			cv::Mat complexityVectors;
+			IcpEngine::Statistics stats;
 
-			if( _pointToPlane &&
-				_voxelSize == 0.0f &&
-				fromScan.hasNormals() &&
-				toScan.hasNormals() &&
-				!((fromScan.is2d() || toScan.is2d()) && !_libpointmatcher)) // PCL crashes if 2D)
+			if(normalsInScan)
 			{
 				//special case if we have already normals computed and there is no filtering
 
-				cv::Mat complexityVectorsFrom, complexityVectorsTo;
+				cv::Mat complexityVectorsFrom;
 				double fromComplexity = util3d::computeNormalsComplexity(fromScan, &complexityVectorsFrom);
-				double toComplexity = util3d::computeNormalsComplexity(toScan, &complexityVectorsTo);
+				double toComplexity = target->complexity;
 				float complexity = fromComplexity<toComplexity?fromComplexity:toComplexity;
 				info.icpStructuralComplexity = complexity;
 				if(complexity < _pointToPlaneMinComplexity)
 				{
 					tooLowComplexityForPlaneToPlane = true;
-					complexityVectors = fromComplexity<toComplexity?complexityVectorsFrom:complexityVectorsTo;
+					complexityVectors = fromComplexity<toComplexity?complexityVectorsFrom:target->complexityVectors;
 					UWARN("ICP PointToPlane ignored as structural complexity is too low (corridor-like environment): %f < %f (%s). PointToPoint is done instead, orientation is still optimized but translation will be limited to direction of normals.", complexity, _pointToPlaneMinComplexity, Parameters::kIcpPointToPlaneMinComplexity().c_str());
 				}
 				else
 				{
 					pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormals = util3d::laserScanToPointCloudNormal(fromScan, fromScan.localTransform());
-					pcl::PointCloud<pcl::PointNormal>::Ptr toCloudNormals = util3d::laserScanToPointCloudNormal(toScan, guess * toScan.localTransform());
-
 					fromCloudNormals = util3d::removeNaNNormalsFromPointCloud(fromCloudNormals);
-					toCloudNormals = util3d::removeNaNNormalsFromPointCloud(toCloudNormals);
-
 
 					UDEBUG("Conversion time = %f s", timer.ticks());
 					pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormalsRegistered(new pcl::PointCloud<pcl::PointNormal>());
@@ -630,10 +884,11 @@ Transform RegistrationIcp::computeTransformationImpl(
 
 						// Compute the transformation to express data in ref
 						PM::TransformationParameters T;
+						PM::ICP * icpPtr = (PM::ICP*)acquireLibpointmatcherICP();
+						UASSERT(icpPtr != 0);
 						try
 						{
-							UASSERT(_libpointmatcherICP != 0);
-							PM::ICP & icp = *((PM::ICP*)_libpointmatcherICP);
+							PM::ICP & icp = *icpPtr;
 							UDEBUG("libpointmatcher icp... (if there is a seg fault here, make sure all third party libraries are built with same Eigen version.)");
 							T = icp(data, ref);
 							icpT = Transform::fromEigen3d(Eigen::Affine3d(Eigen::Matrix4d(eigenMatrixToDim<double>(T.template cast<double>(), 4))));
@@ -652,27 +907,27 @@ Transform RegistrationIcp::computeTransformationImpl(
 						{
 							msg = uFormat("libpointmatcher has failed: %s", e.what());
 						}
+						releaseLibpointmatcherICP(icpPtr);
 					}
 					else
 #endif
 					{
-						icpT = util3d::icpPointToPlane(
-								fromCloudNormals,
-								toCloudNormals,
-							   _maxCorrespondenceDistance,
-							   _maxIterations,
-							   hasConverged,
-							   *fromCloudNormalsRegistered,
-							   _epsilon,
-							   this->force3DoF());
+						icpT = target->engineNormals.icpPointToPlane(
+								*fromCloudNormals,
+								guess,
+								_maxIterations,
+								_epsilon,
+								this->force3DoF(),
+								hasConverged,
+								*fromCloudNormalsRegistered,
+								&stats);
 					}
 
 					if(!icpT.isNull() && hasConverged)
 					{
-						util3d::computeVarianceAndCorrespondences(
-								fromCloudNormalsRegistered,
-								toCloudNormals,
-								_maxCorrespondenceDistance,
+						target->engineNormals.computeVarianceAndCorrespondences(
+								*fromCloudNormalsRegistered,
+								guess,
 								_maxRotation,
 								variance,
 								correspondences);
@@ -682,15 +937,13 @@ Transform RegistrationIcp::computeTransformationImpl(
 			}
 
 			int maxLaserScansFrom = fromScan.maxPoints();
-			int maxLaserScansTo = toScan.maxPoints();
+			int maxLaserScansTo = target->maxPoints;
 			if(!transformComputed)
 			{
 				pcl::PointCloud<pcl::PointXYZ>::Ptr fromCloud = util3d::laserScanToPointCloud(fromScan, fromScan.localTransform());
-				pcl::PointCloud<pcl::PointXYZ>::Ptr toCloud = util3d::laserScanToPointCloud(toScan, guess * toScan.localTransform());
 				UDEBUG("Conversion time = %f s", timer.ticks());
 
 				pcl::PointCloud<pcl::PointXYZ>::Ptr fromCloudFiltered = fromCloud;
-				pcl::PointCloud<pcl::PointXYZ>::Ptr toCloudFiltered = toCloud;
 				if(_voxelSize > 0.0f)
 				{
 					float pointsBeforeFiltering = (float)fromCloudFiltered->size();
@@ -698,26 +951,19 @@ Transform RegistrationIcp::computeTransformationImpl(
 					float ratioFrom = float(fromCloudFiltered->size()) / pointsBeforeFiltering;
 					maxLaserScansFrom = int(float(maxLaserScansFrom) * ratioFrom);
 
-					pointsBeforeFiltering = (float)toCloudFiltered->size();
-					toCloudFiltered = util3d::voxelize(toCloudFiltered, _voxelSize);
-					float ratioTo = float(toCloudFiltered->size()) / pointsBeforeFiltering;
-					maxLaserScansTo = int(float(maxLaserScansTo) * ratioTo);
-
-					UDEBUG("Voxel filtering time (voxel=%f m, ratioFrom=%f->%d/%d ratioTo=%f->%d/%d) = %f s",
+					UDEBUG("Voxel filtering time (voxel=%f m, ratioFrom=%f->%d/%d to=%d/%d) = %f s",
 							_voxelSize,
 							ratioFrom,
 							(int)fromCloudFiltered->size(),
 							maxLaserScansFrom,
-							ratioTo,
-							(int)toCloudFiltered->size(),
+							target->engine.size(),
 							maxLaserScansTo,
 							timer.ticks());
 				}
 
 				pcl::PointCloud<pcl::PointXYZ>::Ptr fromCloudRegistered(new pcl::PointCloud<pcl::PointXYZ>());
-				if(_pointToPlane && // ICP Point To Plane
-					!tooLowComplexityForPlaneToPlane && // if previously rejected above
-					!((fromScan.is2d()|| toScan.is2d()) && !_libpointmatcher)) // PCL crashes if 2D
+				if(target->pointToPlane && // ICP Point To Plane
+					!tooLowComplexityForPlaneToPlane) // if previously rejected above
 				{
 					Eigen::Vector3f viewpointFrom(fromScan.localTransform().x(), fromScan.localTransform().y(), fromScan.localTransform().z());
 					pcl::PointCloud<pcl::Normal>::Ptr normalsFrom;
@@ -745,42 +991,15 @@ Transform RegistrationIcp::computeTransformationImpl(
 						normalsFrom = util3d::computeNormals(fromCloudFiltered, _pointToPlaneK, _pointToPlaneRadius, viewpointFrom);
 					}
 
-					Transform toT = guess * toScan.localTransform();
-					Eigen::Vector3f viewpointTo(toT.x(), toT.y(), toT.z());
-					pcl::PointCloud<pcl::Normal>::Ptr normalsTo;
-					if(toScan.is2d())
-					{
-						if(_voxelSize > 0.0f)
-						{
-							normalsTo = util3d::computeNormals2D(
-									toCloudFiltered,
-									_pointToPlaneK,
-									_pointToPlaneRadius,
-									viewpointTo);
-						}
-						else
-						{
-							normalsTo = util3d::computeFastOrganizedNormals2D(
-									toCloudFiltered,
-									_pointToPlaneK,
-									_pointToPlaneRadius,
-									viewpointTo);
-						}
-					}
-					else
-					{
-						normalsTo = util3d::computeNormals(toCloudFiltered, _pointToPlaneK, _pointToPlaneRadius, viewpointTo);
-					}
-
-					cv::Mat complexityVectorsFrom, complexityVectorsTo;
+					cv::Mat complexityVectorsFrom;
 					double fromComplexity = util3d::computeNormalsComplexity(*normalsFrom, fromScan.is2d(), &complexityVectorsFrom);
-					double toComplexity = util3d::computeNormalsComplexity(*normalsTo, toScan.is2d(), &complexityVectorsTo);
+					double toComplexity = target->complexity;
 					float complexity = fromComplexity<toComplexity?fromComplexity:toComplexity;
 					info.icpStructuralComplexity = complexity;
 					if(complexity < _pointToPlaneMinComplexity)
 					{
 						tooLowComplexityForPlaneToPlane = true;
-						complexityVectors = fromComplexity<toComplexity?complexityVectorsFrom:complexityVectorsTo;
+						complexityVectors = fromComplexity<toComplexity?complexityVectorsFrom:target->complexityVectors;
 						UWARN("ICP PointToPlane ignored as structural complexity is too low (corridor-like environment): %f < %f (%s). PointToPoint is done instead, orientation is still optimized but translation will be limited to direction of normals.", complexity, _pointToPlaneMinComplexity, Parameters::kIcpPointToPlaneMinComplexity().c_str());
 					}
 					else
@@ -788,11 +1007,6 @@ Transform RegistrationIcp::computeTransformationImpl(
 						pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormals(new pcl::PointCloud<pcl::PointNormal>);
 						pcl::concatenateFields(*fromCloudFiltered, *normalsFrom, *fromCloudNormals);
 
-						pcl::PointCloud<pcl::PointNormal>::Ptr toCloudNormals(new pcl::PointCloud<pcl::PointNormal>);
-						pcl::concatenateFields(*toCloudFiltered, *normalsTo, *toCloudNormals);
-
-						std::vector<int> indices;
-						toCloudNormals = util3d::removeNaNNormalsFromPointCloud(toCloudNormals);
 						fromCloudNormals = util3d::removeNaNNormalsFromPointCloud(fromCloudNormals);
 
 						// update output scans
@@ -816,31 +1030,12 @@ Transform RegistrationIcp::computeTransformationImpl(
 											LaserScan::kXYZNormal,
 											fromScan.localTransform()));
 						}
-						if(toScan.is2d())
-						{
-							toSignature.sensorData().setLaserScan(
-									LaserScan(
-											util3d::laserScan2dFromPointCloud(*toCloudNormals, (guess*toScan.localTransform()).inverse()),
-											maxLaserScansTo,
-											toScan.rangeMax(),
-											LaserScan::kXYNormal,
-											toScan.localTransform()));
-						}
-						else
-						{
-							toSignature.sensorData().setLaserScan(
-									LaserScan(
-											util3d::laserScanFromPointCloud(*toCloudNormals, (guess*toScan.localTransform()).inverse()),
-											maxLaserScansTo,
-											toScan.rangeMax(),
-											LaserScan::kXYZNormal,
-											toScan.localTransform()));
-						}
-						UDEBUG("Compute normals (%d,%d) time = %f s", (int)fromCloudNormals->size(), (int)toCloudNormals->size(), timer.ticks());
+						toSignature.sensorData().setLaserScan(target->scanNormals);
+						UDEBUG("Compute normals (%d,%d) time = %f s", (int)fromCloudNormals->size(), target->engineNormals.size(), timer.ticks());
 						fromScan = fromSignature.sensorData().laserScanRaw();
 						toScan = toSignature.sensorData().laserScanRaw();
 
-						if(toCloudNormals->size() && fromCloudNormals->size())
+						if(!target->engineNormals.isEmpty() && fromCloudNormals->size())
 						{
 							pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormalsRegistered(new pcl::PointCloud<pcl::PointNormal>());
 
@@ -853,10 +1048,11 @@ Transform RegistrationIcp::computeTransformationImpl(
 
 								// Compute the transformation to express data in ref
 								PM::TransformationParameters T;
+								PM::ICP * icpPtr = (PM::ICP*)acquireLibpointmatcherICP();
+								UASSERT(icpPtr != 0);
 								try
 								{
-									UASSERT(_libpointmatcherICP != 0);
-									PM::ICP & icp = *((PM::ICP*)_libpointmatcherICP);
+									PM::ICP & icp = *icpPtr;
 									UDEBUG("libpointmatcher icp... (if there is a seg fault here, make sure all third party libraries are built with same Eigen version.)");
 									T = icp(data, ref);
 									UDEBUG("libpointmatcher icp...done!");
@@ -875,27 +1071,27 @@ Transform RegistrationIcp::computeTransformationImpl(
 								{
 									msg = uFormat("libpointmatcher has failed: %s", e.what());
 								}
+								releaseLibpointmatcherICP(icpPtr);
 							}
 							else
 #endif
 							{
-								icpT = util3d::icpPointToPlane(
-										fromCloudNormals,
-										toCloudNormals,
-									   _maxCorrespondenceDistance,
-									   _maxIterations,
-									   hasConverged,
-									   *fromCloudNormalsRegistered,
-									   _epsilon,
-									   this->force3DoF());
+								icpT = target->engineNormals.icpPointToPlane(
+										*fromCloudNormals,
+										guess,
+										_maxIterations,
+										_epsilon,
+										this->force3DoF(),
+										hasConverged,
+										*fromCloudNormalsRegistered,
+										&stats);
 							}
 
 							if(!icpT.isNull() && hasConverged)
 							{
-								util3d::computeVarianceAndCorrespondences(
-										fromCloudNormalsRegistered,
-										toCloudNormals,
-										_maxCorrespondenceDistance,
+								target->engineNormals.computeVarianceAndCorrespondences(
+										*fromCloudNormalsRegistered,
+										guess,
 										_maxRotation,
 										variance,
 										correspondences);
@@ -907,7 +1103,7 @@ Transform RegistrationIcp::computeTransformationImpl(
 
 				if(!transformComputed) // ICP Point to Point
 				{
-					if(_pointToPlane && !tooLowComplexityForPlaneToPlane && ((fromScan.is2d() || toScan.is2d()) && !_libpointmatcher))
+					if(_pointToPlane && !tooLowComplexityForPlaneToPlane && !pointToPlaneSupported)
 					{
 						UWARN("ICP PointToPlane ignored for 2d scans with PCL registration (some crash issues). Use libpointmatcher (%s) or disable %s to avoid this warning.", Parameters::kIcpPM().c_str(), Parameters::kIcpPointToPlane().c_str());
 					}
@@ -935,25 +1131,9 @@ Transform RegistrationIcp::computeTransformationImpl(
 											LaserScan::kXYZ,
 											fromScan.localTransform()));
 						}
-						if(toScan.is2d())
-						{
-							toSignature.sensorData().setLaserScan(
-									LaserScan(
-											util3d::laserScan2dFromPointCloud(*toCloudFiltered, (guess*toScan.localTransform()).inverse()),
-											maxLaserScansTo,
-											toScan.rangeMax(),
-											LaserScan::kXY,
-											toScan.localTransform()));
-						}
-						else
+						if(!target->scan.isEmpty())
 						{
-							toSignature.sensorData().setLaserScan(
-									LaserScan(
-											util3d::laserScanFromPointCloud(*toCloudFiltered, (guess*toScan.localTransform()).inverse()),
-											maxLaserScansTo,
-											toScan.rangeMax(),
-											LaserScan::kXYZ,
-											toScan.localTransform()));
+							toSignature.sensorData().setLaserScan(target->scan);
 						}
 						fromScan = fromSignature.sensorData().laserScanRaw();
 						toScan = toSignature.sensorData().laserScanRaw();
@@ -968,15 +1148,17 @@ Transform RegistrationIcp::computeTransformationImpl(
 
 						// Compute the transformation to express data in ref
 						PM::TransformationParameters T;
+						PM::ICP * icpPtr = (PM::ICP*)acquireLibpointmatcherICP();
+						UASSERT(icpPtr != 0);
 						try
 						{
-							UASSERT(_libpointmatcherICP != 0);
-							PM::ICP & icp = *((PM::ICP*)_libpointmatcherICP);
+							PM::ICP & icp = *icpPtr;
 							UDEBUG("libpointmatcher icp... (if there is a seg fault here, make sure all third party libraries are built with same Eigen version.)");
+							float matchRatio = 0.0f;
 							if(_pointToPlane)
 							{
-								// temporary set PointToPointErrorMinimizer
-								PM::ICP & icpTmp = icp;
+								// temporary set PointToPointErrorMinimizer on a copy, the pooled instance is kept unchanged
+								PM::ICP icpTmp = icp;
 #if POINTMATCHER_VERSION_INT >= 10300
 								icpTmp.errorMinimizer = PM::get().ErrorMinimizerRegistrar.create("PointToPointErrorMinimizer");
 #else
@@ -995,15 +1177,16 @@ Transform RegistrationIcp::computeTransformationImpl(
 								}
 
 								T = icpTmp(data, ref);
+								matchRatio = icpTmp.errorMinimizer->getWeightedPointUsedRatio();
 							}
 							else
 							{
 								T = icp(data, ref);
+								matchRatio = icp.errorMinimizer->getWeightedPointUsedRatio();
 							}
 							UDEBUG("libpointmatcher icp...done!");
 							icpT = Transform::fromEigen3d(Eigen::Affine3d(Eigen::Matrix4d(eigenMatrixToDim<double>(T.template cast<double>(), 4))));
 
-							float matchRatio = icp.errorMinimizer->getWeightedPointUsedRatio();
 							UDEBUG("match ratio: %f", matchRatio);
 
 							if(!icpT.isNull())
@@ -1016,19 +1199,20 @@ Transform RegistrationIcp::computeTransformationImpl(
 						{
 							msg = uFormat("libpointmatcher has failed: %s", e.what());
 						}
+						releaseLibpointmatcherICP(icpPtr);
 					}
 					else
 #endif
 					{
-						icpT = util3d::icp(
-								fromCloudFiltered,
-								toCloudFiltered,
-							   _maxCorrespondenceDistance,
-							   _maxIterations,
-							   hasConverged,
-							   *fromCloudRegistered,
-							   _epsilon,
-							   this->force3DoF()); // icp2D
+						icpT = target->engine.icp(
+								*fromCloudFiltered,
+								guess,
+								_maxIterations,
+								_epsilon,
+								this->force3DoF(),
+								hasConverged,
+								*fromCloudRegistered,
+								&stats);
 					}
 
 					if(!icpT.isNull() && hasConverged)
@@ -1065,43 +1249,42 @@ Transform RegistrationIcp::computeTransformationImpl(
 							t = Transform(v[0], v[1], v[2], roll, pitch, yaw);
 							icpT = guess * t.inverse() * guessInv;
 
-							if(fromScan.hasNormals() && toScan.hasNormals())
+							if(fromScan.hasNormals() && toScan.hasNormals() && target->engineNormals.hasNormals())
 							{
 								// we were using normals, so compute correspondences using normals
 								pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormalsRegistered = util3d::laserScanToPointCloudNormal(fromScan, icpT * fromScan.localTransform());
-								pcl::PointCloud<pcl::PointNormal>::Ptr toCloudNormals = util3d::laserScanToPointCloudNormal(toScan, guess * toScan.localTransform());
 
-								util3d::computeVarianceAndCorrespondences(
-										fromCloudNormalsRegistered,
-										toCloudNormals,
-										_maxCorrespondenceDistance,
+								target->engineNormals.computeVarianceAndCorrespondences(
+										*fromCloudNormalsRegistered,
+										guess,
 										_maxRotation,
 										variance,
 										correspondences);
 							}
 							else
 							{
-								util3d::computeVarianceAndCorrespondences(
-										fromCloudRegistered,
-										toCloudFiltered,
-										_maxCorrespondenceDistance,
+								target->engine.computeVarianceAndCorrespondences(
+										*fromCloudRegistered,
+										guess,
 										variance,
 										correspondences);
 							}
 						}
 						else
 						{
-							util3d::computeVarianceAndCorrespondences(
-									fromCloudRegistered,
-									toCloudFiltered,
-									_maxCorrespondenceDistance,
+							target->engine.computeVarianceAndCorrespondences(
+									*fromCloudRegistered,
+									guess,
 									variance,
 									correspondences);
 						}
 					}
 				}
 			}
-			UDEBUG("ICP (iterations=%d) time = %f s", _maxIterations, timer.ticks());
+			info.icpIterations = stats.iterations;
+			info.icpRMS = stats.rmse;
+			UDEBUG("ICP (iterations=%d/%d, correspondences=%d, rmse=%f, converged=%d) time = %f s",
+					stats.iterations, _maxIterations, stats.correspondences, stats.rmse, stats.converged?1:0, timer.ticks());
 
 			if(!icpT.isNull() && hasConverged)
 			{
@@ -1195,6 +1378,7 @@ Transform RegistrationIcp::computeTransformationImpl(
 			msg = "Laser scans empty ?!?";
 			UWARN(msg.c_str());
 		}
+		releasePreparedTarget(target);
 	}
 	else if(dataTo.isValid())
 	{
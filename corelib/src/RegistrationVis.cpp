@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/VisualWord.h>
 #include <rtabmap/core/Optimizer.h>
 #include <rtabmap/core/util3d_transforms.h>
+#include <rtabmap/core/VisualMatcher.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UStl.h>
@@ -44,8 +45,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UMath.h>
 #include <opencv2/core/core_c.h>
 
-#include <rtflann/flann.hpp>
-
 namespace rtabmap {
 
 RegistrationVis::RegistrationVis(const ParametersMap & parameters, Registration * child) :
@@ -185,6 +184,10 @@ void RegistrationVis::parseParameters(const ParametersMap & parameters)
 
 RegistrationVis::~RegistrationVis()
 {
+	for(std::list<VisualMatcher*>::iterator iter=_matchers.begin(); iter!=_matchers.end(); ++iter)
+	{
+		delete *iter;
+	}
 }
 
 Feature2D * RegistrationVis::createFeatureDetector() const
@@ -192,6 +195,24 @@ Feature2D * RegistrationVis::createFeatureDetector() const
 	return Feature2D::create(_featureParameters);
 }
 
+VisualMatcher * RegistrationVis::acquireMatcher() const
+{
+	UScopeMutex lock(_matchersMutex);
+	if(_matchers.empty())
+	{
+		return new VisualMatcher();
+	}
+	VisualMatcher * matcher = _matchers.front();
+	_matchers.pop_front();
+	return matcher;
+}
+
+void RegistrationVis::releaseMatcher(VisualMatcher * matcher) const
+{
+	UScopeMutex lock(_matchersMutex);
+	_matchers.push_back(matcher);
+}
+
 Transform RegistrationVis::computeTransformationImpl(
 			Signature & fromSignature,
 			Signature & toSignature,
@@ -740,6 +761,7 @@ Transform RegistrationVis::computeTransformationImpl(
 			// We have all data we need here, so match!
 			if(descriptorsFrom.rows > 0 && descriptorsTo.rows > 0)
 			{
+				MatcherGuard matcher(*this);
 				cv::Size imageSize = imageTo.size();
 				bool isCalibrated = false; // multiple cameras not supported.
 				if(imageSize.height == 0 || imageSize.width == 0)
@@ -806,64 +828,38 @@ Transform RegistrationVis::computeTransformationImpl(
 						if(_guessMatchToProjection)
 						{
 							// match frame to projected
-							// Create kd-tree for projected keypoints
-							rtflann::Matrix<float> cornersProjectedMat((float*)cornersProjected.data(), cornersProjected.size(), 2);
-							rtflann::Index<rtflann::L2_Simple<float> > index(cornersProjectedMat, rtflann::KDTreeIndexParams());
-							index.buildIndex();
-
-							std::vector< std::vector<size_t> > indices;
-							std::vector<std::vector<float> > dists;
+							// Index projected keypoints in a grid
 							float radius = (float)_guessWinSize; // pixels
+							matcher->setPoints(cornersProjected, radius);
 							std::vector<cv::Point2f> pointsTo;
 							cv::KeyPoint::convert(kptsTo, pointsTo);
-							rtflann::Matrix<float> pointsToMat((float*)pointsTo.data(), pointsTo.size(), 2);
-							index.radiusSearch(pointsToMat, indices, dists, radius*radius, rtflann::SearchParams());
 
-							UASSERT(indices.size() == pointsToMat.rows);
 							UASSERT(descriptorsFrom.cols == descriptorsTo.cols);
 							UASSERT(descriptorsFrom.rows == (int)kptsFrom.size());
-							UASSERT((int)pointsToMat.rows == descriptorsTo.rows);
-							UASSERT(pointsToMat.rows == kptsTo.size());
-							UDEBUG("radius search done for guess");
+							UASSERT((int)pointsTo.size() == descriptorsTo.rows);
 
 							// Process results (Nearest Neighbor Distance Ratio)
 							int newToId = orignalWordsFromIds.size()?orignalWordsFromIds.back():descriptorsFrom.rows;
 							std::map<int,int> addedWordsFrom; //<id, index>
 							std::map<int, int> duplicates; //<fromId, toId>
 							int newWords = 0;
-							cv::Mat descriptors(10, descriptorsTo.cols, descriptorsTo.type());
-							for(unsigned int i = 0; i < pointsToMat.rows; ++i)
+							std::vector<int> descriptorsIndices;
+							for(unsigned int i = 0; i < pointsTo.size(); ++i)
 							{
 								int matchedIndex = -1;
-								if(indices[i].size() >= 2)
+								const std::vector<int> & indices = matcher->radiusSearch(pointsTo[i]);
+								if(indices.size())
 								{
-									std::vector<int> descriptorsIndices(indices[i].size());
-									int oi=0;
-									if((int)indices[i].size() > descriptors.rows)
+									descriptorsIndices.resize(indices.size());
+									for(unsigned int j=0; j<indices.size(); ++j)
 									{
-										descriptors.resize(indices[i].size());
+										descriptorsIndices[j] = projectedIndexToDescIndex[indices[j]];
 									}
-									for(unsigned int j=0; j<indices[i].size(); ++j)
+									int match = matcher->matchNNDR(descriptorsTo.row(i), descriptorsFrom, descriptorsIndices, _nndr);
+									if(match >= 0)
 									{
-										descriptorsFrom.row(projectedIndexToDescIndex[indices[i].at(j)]).copyTo(descriptors.row(oi));
-										descriptorsIndices[oi++] = indices[i].at(j);
+										matchedIndex = indices[match];
 									}
-									descriptorsIndices.resize(oi);
-									UASSERT(oi >=2);
-
-									std::vector<std::vector<cv::DMatch> > matches;
-									cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-									matcher.knnMatch(descriptorsTo.row(i), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
-									UASSERT(matches.size() == 1);
-									UASSERT(matches[0].size() == 2);
-									if(matches[0].at(0).distance < _nndr * matches[0].at(1).distance)
-									{
-										matchedIndex = descriptorsIndices.at(matches[0].at(0).trainIdx);
-									}
-								}
-								else if(indices[i].size() == 1)
-								{
-									matchedIndex = indices[i].at(0);
 								}
 
 								if(matchedIndex >= 0)
@@ -932,37 +928,27 @@ Transform RegistrationVis::computeTransformationImpl(
 						else
 						{
 							// match projected to frame
+							// Index frame keypoints in a grid
+							float radius = (float)_guessWinSize; // pixels
 							std::vector<cv::Point2f> pointsTo;
 							cv::KeyPoint::convert(kptsTo, pointsTo);
-							rtflann::Matrix<float> pointsToMat((float*)pointsTo.data(), pointsTo.size(), 2);
-							rtflann::Index<rtflann::L2_Simple<float> > index(pointsToMat, rtflann::KDTreeIndexParams());
-							index.buildIndex();
+							matcher->setPoints(pointsTo, radius);
 
-							std::vector< std::vector<size_t> > indices;
-							std::vector<std::vector<float> > dists;
-							float radius = (float)_guessWinSize; // pixels
-							rtflann::Matrix<float> cornersProjectedMat((float*)cornersProjected.data(), cornersProjected.size(), 2);
-							index.radiusSearch(cornersProjectedMat, indices, dists, radius*radius, rtflann::SearchParams());
-
-							UASSERT(indices.size() == cornersProjectedMat.rows);
 							UASSERT(descriptorsFrom.cols == descriptorsTo.cols);
 							UASSERT(descriptorsFrom.rows == (int)kptsFrom.size());
-							UASSERT((int)pointsToMat.rows == descriptorsTo.rows);
-							UASSERT(pointsToMat.rows == kptsTo.size());
-							UDEBUG("radius search done for guess");
+							UASSERT((int)pointsTo.size() == descriptorsTo.rows);
 
 							// Process results (Nearest Neighbor Distance Ratio)
 							std::set<int> addedWordsTo;
 							std::set<int> addedWordsFrom;
 							double bruteForceTotalTime = 0.0;
-							double bruteForceDescCopy = 0.0;
 							UTimer bruteForceTimer;
-							cv::Mat descriptors(10, descriptorsTo.cols, descriptorsTo.type());
-							for(unsigned int i = 0; i < cornersProjectedMat.rows; ++i)
+							for(unsigned int i = 0; i < cornersProjected.size(); ++i)
 							{
 								int matchedIndexFrom = projectedIndexToDescIndex[i];
+								const std::vector<int> & indices = matcher->radiusSearch(cornersProjected[i]);
 
-								if(indices[i].size())
+								if(indices.size())
 								{
 									info.projectedIDs.push_back(orignalWordsFromIds.size()?orignalWordsFromIds[matchedIndexFrom]:matchedIndexFrom);
 								}
@@ -970,38 +956,16 @@ Transform RegistrationVis::computeTransformationImpl(
 								if(util3d::isFinite(kptsFrom3D[matchedIndexFrom]))
 								{
 									int matchedIndexTo = -1;
-									if(indices[i].size() >= 2)
+									if(indices.size())
 									{
 										bruteForceTimer.restart();
-										std::vector<int> descriptorsIndices(indices[i].size());
-										int oi=0;
-										if((int)indices[i].size() > descriptors.rows)
-										{
-											descriptors.resize(indices[i].size());
-										}
-										for(unsigned int j=0; j<indices[i].size(); ++j)
-										{
-											descriptorsTo.row(indices[i].at(j)).copyTo(descriptors.row(oi));
-											descriptorsIndices[oi++] = indices[i].at(j);
-										}
-										bruteForceDescCopy += bruteForceTimer.ticks();
-										UASSERT(oi >=2);
-
-										std::vector<std::vector<cv::DMatch> > matches;
-										cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-										matcher.knnMatch(descriptorsFrom.row(matchedIndexFrom), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
-										UASSERT(matches.size() == 1);
-										UASSERT(matches[0].size() == 2);
+										int match = matcher->matchNNDR(descriptorsFrom.row(matchedIndexFrom), descriptorsTo, indices, _nndr);
 										bruteForceTotalTime+=bruteForceTimer.elapsed();
-										if(matches[0].at(0).distance < _nndr * matches[0].at(1).distance)
+										if(match >= 0)
 										{
-											matchedIndexTo = descriptorsIndices.at(matches[0].at(0).trainIdx);
+											matchedIndexTo = indices[match];
 										}
 									}
-									else if(indices[i].size() == 1)
-									{
-										matchedIndexTo = indices[i].at(0);
-									}
 
 									int id = orignalWordsFromIds.size()?orignalWordsFromIds[matchedIndexFrom]:matchedIndexFrom;
 									addedWordsFrom.insert(addedWordsFrom.end(), matchedIndexFrom);
@@ -1027,7 +991,7 @@ Transform RegistrationVis::computeTransformationImpl(
 									}
 								}
 							}
-							UDEBUG("bruteForceDescCopy=%fs, bruteForceTotalTime=%fs", bruteForceDescCopy, bruteForceTotalTime);
+							UDEBUG("bruteForceTotalTime=%fs", bruteForceTotalTime);
 
 							// create fake ids for not matched words from "from"
 							for(unsigned int i=0; i<kptsFrom3D.size(); ++i)
@@ -1084,29 +1048,50 @@ Transform RegistrationVis::computeTransformationImpl(
 
 					UDEBUG("");
 					// match between all descriptors
-					VWDictionary dictionary(_featureParameters);
 					std::list<int> fromWordIds;
-					if(orignalWordsFromIds.empty())
-					{
-						fromWordIds = dictionary.addNewWords(descriptorsFrom, 1);
-					}
-					else
+					std::list<int> toWordIds;
+					int nnStrategy = Parameters::defaultKpNNStrategy();
+					Parameters::parse(_featureParameters, Parameters::kKpNNStrategy(), nnStrategy);
+					if(nnStrategy != VWDictionary::kNNFlannNaive &&
+					   nnStrategy != VWDictionary::kNNBruteForce &&
+					   nnStrategy != VWDictionary::kNNBruteForceHamming)
 					{
-						for (int i = 0; i < descriptorsFrom.rows; ++i)
+						// approximate (kd-tree, LSH) or GPU search as configured
+						VWDictionary dictionary(_featureParameters);
+						if(orignalWordsFromIds.empty())
 						{
-							int id = orignalWordsFromIds[i];
-							dictionary.addWord(new VisualWord(id, descriptorsFrom.row(i), 1));
-							fromWordIds.push_back(id);
+							fromWordIds = dictionary.addNewWords(descriptorsFrom, 1);
+						}
+						else
+						{
+							for (int i = 0; i < descriptorsFrom.rows; ++i)
+							{
+								int id = orignalWordsFromIds[i];
+								dictionary.addWord(new VisualWord(id, descriptorsFrom.row(i), 1));
+								fromWordIds.push_back(id);
+							}
 						}
-					}
 
-					std::list<int> toWordIds;
-					if(descriptorsTo.rows)
+						if(descriptorsTo.rows)
+						{
+							dictionary.update();
+							toWordIds = dictionary.addNewWords(descriptorsTo, 2);
+						}
+						dictionary.clear(false);
+					}
+					else
 					{
-						dictionary.update();
-						toWordIds = dictionary.addNewWords(descriptorsTo, 2);
+						// Exact search: same ids than with the dictionary above, without
+						// creating visual words and a FLANN index for a single matching.
+						float nndr = Parameters::defaultKpNndrRatio();
+						bool newWordsComparedTogether = Parameters::defaultKpNewWordsComparedTogether();
+						Parameters::parse(_featureParameters, Parameters::kKpNndrRatio(), nndr);
+						Parameters::parse(_featureParameters, Parameters::kKpNewWordsComparedTogether(), newWordsComparedTogether);
+						std::vector<int> fromIds, toIds;
+						matcher->matchGlobal(descriptorsFrom, orignalWordsFromIds, descriptorsTo, nndr, newWordsComparedTogether, fromIds, toIds);
+						fromWordIds.assign(fromIds.begin(), fromIds.end());
+						toWordIds.assign(toIds.begin(), toIds.end());
 					}
-					dictionary.clear(false);
 
 					std::multiset<int> fromWordIdsSet(fromWordIds.begin(), fromWordIds.end());
 					std::multiset<int> toWordIdsSet(toWordIds.begin(), toWordIds.end());
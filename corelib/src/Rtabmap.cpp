@@ -30,6 +30,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Features2d.h"
 #include "rtabmap/core/Optimizer.h"
 #include "rtabmap/core/Graph.h"
+#include "rtabmap/core/PathGraph.h"
+#include "rtabmap/core/PosesIndex.h"
 #include "rtabmap/core/Signature.h"
 
 #include "rtabmap/core/EpipolarGeometry.h"
@@ -47,8 +49,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UMath.h>
 #include <rtabmap/utilite/UProcessInfo.h>
 
-#include <pcl/search/kdtree.h>
-#include <pcl/filters/crop_box.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/common/common.h>
 #include <pcl/TextureMesh.h>
@@ -56,6 +56,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <set>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #define LOG_F "LogF.txt"
 #define LOG_I "LogI.txt"
 
@@ -75,6 +79,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap
 {
 
+// Number of registrations done in parallel by a batch of Memory::computeTransforms()
+// or Memory::computeIcpTransformsMulti(), when the next registrations depend on the results
+static unsigned int registrationBatchSize()
+{
+#ifdef _OPENMP
+	return (unsigned int)std::max(1, omp_get_max_threads());
+#else
+	return 1;
+#endif
+}
+
 Rtabmap::Rtabmap() :
 	_publishStats(Parameters::defaultRtabmapPublishStats()),
 	_publishLastSignatureData(Parameters::defaultRtabmapPublishLastSignature()),
@@ -123,6 +138,7 @@ Rtabmap::Rtabmap() :
 	_pathStuckIterations(Parameters::defaultRGBDPlanStuckIterations()),
 	_pathLinearVelocity(Parameters::defaultRGBDPlanLinearVelocity()),
 	_pathAngularVelocity(Parameters::defaultRGBDPlanAngularVelocity()),
+	_pathReferenceNodes(Parameters::defaultRGBDPlanReferenceNodes()),
 	_savedLocalizationIgnored(Parameters::defaultRGBDSavedLocalizationIgnored()),
 	_loopCovLimited(Parameters::defaultRGBDLoopCovLimited()),
 	_loopGPS(Parameters::defaultRtabmapLoopGPS()),
@@ -139,6 +155,7 @@ Rtabmap::Rtabmap() :
 	_foutFloat(0),
 	_foutInt(0),
 	_wDir(""),
+	_optimizedPosesIndex(new PosesIndex(Parameters::defaultRGBDLocalRadius())),
 	_mapCorrection(Transform::getIdentity()),
 	_lastLocalizationNodeId(0),
 	_currentSessionHasGPS(false),
@@ -147,13 +164,15 @@ Rtabmap::Rtabmap() :
 	_pathGoalIndex(0),
 	_pathTransformToGoal(Transform::getIdentity()),
 	_pathStuckCount(0),
-	_pathStuckDistance(0.0f)
+	_pathStuckDistance(0.0f),
+	_pathGraph(0)
 {
 }
 
 Rtabmap::~Rtabmap() {
 	UDEBUG("");
 	this->close();
+	delete _optimizedPosesIndex;
 }
 
 void Rtabmap::setupLogFiles(bool overwrite)
@@ -318,6 +337,7 @@ void Rtabmap::init(const ParametersMap & parameters, const std::string & databas
 
 	Transform lastPose;
 	_optimizedPoses = _memory->loadOptimizedPoses(&lastPose);
+	_optimizedPosesIndex->update(_optimizedPoses);
 	UINFO("Loaded optimizedPoses=%d lastPose=%s", _optimizedPoses.size(), lastPose.prettyPrint().c_str());
 	if(!_optimizedPoses.empty())
 	{
@@ -367,6 +387,7 @@ void Rtabmap::close(bool databaseSaved, const std::string & ouputDatabasePath)
 	_odomCacheConstraints.clear();
 	_distanceTravelled = 0.0f;
 	this->clearPath(0);
+	this->clearPathGraph();
 	_gpsGeocentricCache.clear();
 	_currentSessionHasGPS = false;
 
@@ -398,6 +419,7 @@ void Rtabmap::close(bool databaseSaved, const std::string & ouputDatabasePath)
 		_memory = 0;
 	}
 	_optimizedPoses.clear();
+	_optimizedPosesIndex->clear();
 	_lastLocalizationPose.setNull();
 
 	if(_bayesFilter)
@@ -458,6 +480,11 @@ void Rtabmap::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kRGBDProximityBySpace(), _proximityBySpace);
 	Parameters::parse(parameters, Parameters::kRGBDScanMatchingIdsSavedInLinks(), _scanMatchingIdsSavedInLinks);
 	Parameters::parse(parameters, Parameters::kRGBDLocalRadius(), _localRadius);
+	if(_localRadius > 0.0f)
+	{
+		// most queries on the optimized poses are done in the local radius
+		_optimizedPosesIndex->setCellSize(_localRadius);
+	}
 	Parameters::parse(parameters, Parameters::kRGBDLocalImmunizationRatio(), _localImmunizationRatio);
 	Parameters::parse(parameters, Parameters::kRGBDProximityMaxGraphDepth(), _proximityMaxGraphDepth);
 	Parameters::parse(parameters, Parameters::kRGBDProximityMaxPaths(), _proximityMaxPaths);
@@ -484,6 +511,11 @@ void Rtabmap::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kRGBDPlanStuckIterations(), _pathStuckIterations);
 	Parameters::parse(parameters, Parameters::kRGBDPlanLinearVelocity(), _pathLinearVelocity);
 	Parameters::parse(parameters, Parameters::kRGBDPlanAngularVelocity(), _pathAngularVelocity);
+	Parameters::parse(parameters, Parameters::kRGBDPlanReferenceNodes(), _pathReferenceNodes);
+	if(_pathGraph)
+	{
+		_pathGraph->setReferenceNodes(_pathReferenceNodes);
+	}
 	Parameters::parse(parameters, Parameters::kRGBDSavedLocalizationIgnored(), _savedLocalizationIgnored);
 	Parameters::parse(parameters, Parameters::kRGBDLoopCovLimited(), _loopCovLimited);
 	Parameters::parse(parameters, Parameters::kRtabmapLoopGPS(), _loopGPS);
@@ -698,6 +730,7 @@ void Rtabmap::setInitialPose(const Transform & initialPose)
 			{
 				cv::Mat covariance;
 				this->optimizeCurrentMap(_memory->getLastWorkingSignature()->id(), false, _optimizedPoses, covariance, &_constraints);
+				_optimizedPosesIndex->update(_optimizedPoses);
 			}
 		}
 		else
@@ -723,6 +756,7 @@ int Rtabmap::triggerNewMap()
 		mapId = _memory->incrementMapId(&reducedIds);
 		UINFO("New map triggered, new map = %d", mapId);
 		_optimizedPoses.clear();
+		_optimizedPosesIndex->clear();
 		_constraints.clear();
 		_lastLocalizationNodeId = 0;
 		_odomCachePoses.clear();
@@ -869,6 +903,7 @@ void Rtabmap::resetMemory()
 	_lastProcessTime = 0.0;
 	_someNodesHaveBeenTransferred = false;
 	_optimizedPoses.clear();
+	_optimizedPosesIndex->clear();
 	_constraints.clear();
 	_mapCorrection.setIdentity();
 	_mapCorrectionBackup.setNull();
@@ -878,6 +913,11 @@ void Rtabmap::resetMemory()
 	_odomCacheConstraints.clear();
 	_distanceTravelled = 0.0f;
 	this->clearPath(0);
+	this->clearPathGraph();
+	if(_graphOptimizer)
+	{
+		_graphOptimizer->resetIncremental();
+	}
 
 	if(_memory)
 	{
@@ -886,6 +926,7 @@ void Rtabmap::resetMemory()
 		{
 			cv::Mat covariance;
 			optimizeCurrentMap(_memory->getLastWorkingSignature()->id(), false, _optimizedPoses, covariance, &_constraints);
+			_optimizedPosesIndex->update(_optimizedPoses);
 		}
 		if(_bayesFilter)
 		{
@@ -1049,8 +1090,8 @@ bool Rtabmap::process(
 				{
 					//set map->odom so that odom is moved back to last saved localization
 					_mapCorrection = _lastLocalizationPose * odomPose.inverse();
-					std::map<int, Transform> nodesOnly(_optimizedPoses.lower_bound(1), _optimizedPoses.end());
-					_lastLocalizationNodeId = graph::findNearestNode(nodesOnly, _lastLocalizationPose);
+					std::vector<int> nearestIds = getOptimizedPosesIndex().knnSearch(_lastLocalizationPose, 1, true);
+					_lastLocalizationNodeId = nearestIds.empty()?0:nearestIds[0];
 					UWARN("Update map correction based on last localization saved in database! correction = %s, nearest id = %d of last pose = %s, odom = %s",
 							_mapCorrection.prettyPrint().c_str(),
 							_lastLocalizationNodeId,
@@ -1065,6 +1106,7 @@ bool Rtabmap::process(
 					{
 						iter->second = mapCorrectionInv * iter->second;
 					}
+					_optimizedPosesIndex->update(_optimizedPoses);
 				}
 			}
 		}
@@ -1166,6 +1208,7 @@ bool Rtabmap::process(
 		if(rehearsedId > 0)
 		{
 			_optimizedPoses.erase(rehearsedId);
+			_optimizedPosesIndex->remove(rehearsedId);
 		}
 		else if(signature->getWeight() >= 0)
 		{
@@ -1269,6 +1312,7 @@ bool Rtabmap::process(
 							{
 								iter->second = mapCorrectionInv * up * iter->second;
 							}
+							_optimizedPosesIndex->update(_optimizedPoses);
 						}
 					}
 					else
@@ -1319,6 +1363,7 @@ bool Rtabmap::process(
 		UDEBUG("Added pose %s (odom=%s)", newPose.prettyPrint().c_str(), signature->getPose().prettyPrint().c_str());
 		// Update Poses and Constraints
 		_optimizedPoses.insert(std::make_pair(signature->id(), newPose));
+		_optimizedPosesIndex->add(signature->id(), newPose);
 		if(_memory->isIncremental() && signature->getWeight() >= 0)
 		{
 			for(std::map<int, Link>::const_iterator iter = signature->getLandmarks().begin(); iter!=signature->getLandmarks().end(); ++iter)
@@ -1326,6 +1371,7 @@ bool Rtabmap::process(
 				if(_optimizedPoses.find(iter->first) == _optimizedPoses.end())
 				{
 					_optimizedPoses.insert(std::make_pair(iter->first, newPose*iter->second.transform()));
+					_optimizedPosesIndex->add(iter->first, newPose*iter->second.transform());
 				}
 				_constraints.insert(std::make_pair(iter->first, iter->second.inverse()));
 			}
@@ -1351,6 +1397,7 @@ bool Rtabmap::process(
 				{
 					tmp = _constraints.rbegin()->second.merge(tmp, tmp.type());
 					_optimizedPoses.erase(s->id());
+					_optimizedPosesIndex->remove(s->id());
 					_constraints.erase(--_constraints.end());
 				}
 			}
@@ -1413,6 +1460,7 @@ bool Rtabmap::process(
 				++iter)
 			{
 				int erased = (int)_optimizedPoses.erase(iter->first);
+				_optimizedPosesIndex->remove(iter->first);
 				if(erased)
 				{
 					for(std::multimap<int, Link>::iterator jter = _constraints.begin(); jter!=_constraints.end();)
@@ -1523,7 +1571,7 @@ bool Rtabmap::process(
 					if(_optimizedPoses.size() && _memory->isIncremental())
 					{
 						//Search for latest node having GPS linked to current signature not too far.
-						std::map<int, float> nearestIds = graph::getNodesInRadius(signature->id(), _optimizedPoses, _localRadius);
+						std::map<int, float> nearestIds = getOptimizedPosesIndex().radiusSearch(_optimizedPoses.at(signature->id()), _localRadius, signature->id());
 						for(std::map<int, float>::reverse_iterator iter=nearestIds.rbegin(); iter!=nearestIds.rend() && iter->first>0; ++iter)
 						{
 							const Signature * s = _memory->getSignature(iter->first);
@@ -1733,9 +1781,10 @@ bool Rtabmap::process(
 	}
 
 	//============================================================
-	// Before retrieval, make sure the trash has finished
+	// The trash may still be emptying: it is saved by batches and
+	// the database looks in the trash first, so retrieval
+	// can be done while the trash is emptying.
 	//============================================================
-	_memory->joinTrashThread();
 	timeEmptyingTrash = _memory->getDbSavingTime();
 	timeJoiningTrash = timer.ticks();
 	ULOGGER_INFO("Time emptying memory trash = %fs,  joining (actual overhead) = %fs", timeEmptyingTrash, timeJoiningTrash);
@@ -2019,7 +2068,7 @@ bool Rtabmap::process(
 
 			// retrieval based on the nodes close the the nearest pose in WM
 			// immunize closest nodes
-			std::map<int, float> nearNodes = graph::getNodesInRadius(signature->id(), _optimizedPoses, _localRadius);
+			std::map<int, float> nearNodes = getOptimizedPosesIndex().radiusSearch(_optimizedPoses.at(signature->id()), _localRadius, signature->id());
 			// sort by distance
 			std::multimap<float, int> nearNodesByDist;
 			for(std::map<int, float>::iterator iter=nearNodes.lower_bound(1); iter!=nearNodes.end(); ++iter)
@@ -2245,7 +2294,7 @@ bool Rtabmap::process(
 				}
 				else
 				{
-					nearestIds = graph::getNodesInRadius(signature->id(), _optimizedPoses, _localRadius);
+					nearestIds = getOptimizedPosesIndex().radiusSearch(_optimizedPoses.at(signature->id()), _localRadius, signature->id());
 				}
 				UDEBUG("nearestIds=%d/%d", (int)nearestIds.size(), (int)_optimizedPoses.size());
 				std::map<int, Transform> nearestPoses;
@@ -2284,10 +2333,10 @@ bool Rtabmap::process(
 				{
 					proximityFilteringRadius = _maxLoopClosureDistance;
 				}
+				std::vector<std::pair<int, int> > visualCandidates;
 				for(std::map<NearestPathKey, std::map<int, Transform> >::const_reverse_iterator iter=nearestPaths.rbegin();
 					iter!=nearestPaths.rend() &&
-					(_memory->isIncremental() || lastProximitySpaceClosureId == 0) &&
-					(_proximityMaxPaths <= 0 || localVisualPathsChecked < _proximityMaxPaths);
+					(_proximityMaxPaths <= 0 || (int)visualCandidates.size() < _proximityMaxPaths);
 					++iter)
 				{
 					std::map<int, Transform> path = iter->second;
@@ -2315,49 +2364,78 @@ bool Rtabmap::process(
 							(proximityFilteringRadius <= 0.0f ||
 							 _optimizedPoses.at(signature->id()).getDistanceSquared(_optimizedPoses.at(nearestId)) < proximityFilteringRadius*proximityFilteringRadius))
 						{
-							++localVisualPathsChecked;
-							RegistrationInfo info;
-							// guess is null to make sure visual correspondences are globally computed
-							Transform transform = _memory->computeTransform(nearestId, signature->id(), Transform(), &info);
-							if(!transform.isNull())
+							visualCandidates.push_back(std::make_pair(nearestId, signature->id()));
+						}
+					}
+				}
+
+				// Registrations with the nearest paths are independent, they are
+				// computed in parallel then links are added in the same order as
+				// the paths (by highest likelihood). In localization mode, only the
+				// first accepted link is added: the registrations are done by
+				// batches to stop as soon as one is accepted.
+				const unsigned int visualBatchSize = _memory->isIncremental()?(unsigned int)visualCandidates.size():registrationBatchSize();
+				for(unsigned int batch=0;
+					batch<visualCandidates.size() &&
+					(_memory->isIncremental() || lastProximitySpaceClosureId == 0);
+					batch+=visualBatchSize)
+				{
+					std::vector<std::pair<int, int> > batchCandidates(
+							visualCandidates.begin()+batch,
+							visualCandidates.begin()+std::min((unsigned int)visualCandidates.size(), batch+visualBatchSize));
+					std::vector<RegistrationInfo> visualInfos;
+					// guess is null to make sure visual correspondences are globally computed
+					std::vector<Transform> visualTransforms = _memory->computeTransforms(
+							batchCandidates,
+							std::vector<Transform>(batchCandidates.size()),
+							&visualInfos);
+					for(unsigned int i=0;
+						i<batchCandidates.size() &&
+						(_memory->isIncremental() || lastProximitySpaceClosureId == 0);
+						++i)
+					{
+						++localVisualPathsChecked;
+						int nearestId = batchCandidates[i].first;
+						const RegistrationInfo & info = visualInfos[i];
+						Transform transform = visualTransforms[i];
+						if(!transform.isNull())
+						{
+							transform = transform.inverse();
+							if(proximityFilteringRadius <= 0 || transform.getNormSquared() <= proximityFilteringRadius*proximityFilteringRadius)
 							{
-								transform = transform.inverse();
-								if(proximityFilteringRadius <= 0 || transform.getNormSquared() <= proximityFilteringRadius*proximityFilteringRadius)
+								UINFO("[Visual] Add local loop closure in SPACE (%d->%d) %s",
+										signature->id(),
+										nearestId,
+										transform.prettyPrint().c_str());
+								UASSERT(info.covariance.at<double>(0,0) > 0.0 && info.covariance.at<double>(5,5) > 0.0);
+								cv::Mat information = getInformation(info.covariance);
+								_memory->addLink(Link(signature->id(), nearestId, Link::kGlobalClosure, transform, information));
+								loopClosureLinksAdded.push_back(std::make_pair(signature->id(), nearestId));
+
+								if(_loopClosureHypothesis.first == 0)
 								{
-									UINFO("[Visual] Add local loop closure in SPACE (%d->%d) %s",
-											signature->id(),
-											nearestId,
-											transform.prettyPrint().c_str());
-									UASSERT(info.covariance.at<double>(0,0) > 0.0 && info.covariance.at<double>(5,5) > 0.0);
-									cv::Mat information = getInformation(info.covariance);
-									_memory->addLink(Link(signature->id(), nearestId, Link::kGlobalClosure, transform, information));
-									loopClosureLinksAdded.push_back(std::make_pair(signature->id(), nearestId));
-
-									if(_loopClosureHypothesis.first == 0)
+									if(proximityDetectionsAddedVisually == 0)
 									{
-										if(proximityDetectionsAddedVisually == 0)
-										{
-											loopClosureVisualInliersMeanDist = info.inliersMeanDistance;
-											loopClosureVisualInliersDistribution = info.inliersDistribution;
-										}
+										loopClosureVisualInliersMeanDist = info.inliersMeanDistance;
+										loopClosureVisualInliersDistribution = info.inliersDistribution;
+									}
 
-										++proximityDetectionsAddedVisually;
-										lastProximitySpaceClosureId = nearestId;
+									++proximityDetectionsAddedVisually;
+									lastProximitySpaceClosureId = nearestId;
 
-										loopClosureVisualInliers = info.inliers;
-										loopClosureVisualMatches = info.matches;
+									loopClosureVisualInliers = info.inliers;
+									loopClosureVisualMatches = info.matches;
 
-										loopClosureLinearVariance = 1.0/information.at<double>(0,0);
-										loopClosureAngularVariance = 1.0/information.at<double>(5,5);
-									}
-								}
-								else
-								{
-									UWARN("Ignoring local loop closure with %d because resulting "
-										  "transform is too large!? (%fm > %fm)",
-											nearestId, transform.getNorm(), proximityFilteringRadius);
+									loopClosureLinearVariance = 1.0/information.at<double>(0,0);
+									loopClosureAngularVariance = 1.0/information.at<double>(5,5);
 								}
 							}
+							else
+							{
+								UWARN("Ignoring local loop closure with %d because resulting "
+									  "transform is too large!? (%fm > %fm)",
+										nearestId, transform.getNorm(), proximityFilteringRadius);
+							}
 						}
 					}
 				}
@@ -2381,10 +2459,11 @@ bool Rtabmap::process(
 					// local visual closure above.
 
 					proximitySpacePaths = (int)nearestPaths.size();
+					std::vector<std::pair<int, std::map<int, Transform> > > scanCandidates;
+					std::vector<std::map<int, Transform> > scanCandidatesLocalPath;
 					for(std::map<NearestPathKey, std::map<int, Transform> >::const_reverse_iterator iter=nearestPaths.rbegin();
 							iter!=nearestPaths.rend() &&
-							(_memory->isIncremental() || lastProximitySpaceClosureId == 0) &&
-							(_proximityMaxPaths <= 0 || localScanPathsChecked < _proximityMaxPaths);
+							(_proximityMaxPaths <= 0 || (int)scanCandidates.size() < _proximityMaxPaths);
 							++iter)
 					{
 						std::map<int, Transform> path = iter->second; // should contain only nodes (no landmarks)
@@ -2460,57 +2539,84 @@ bool Rtabmap::process(
 								//The nearest will be the reference for a loop closure transform
 								if(signature->getLinks().find(nearestId) == signature->getLinks().end())
 								{
-									++localScanPathsChecked;
-									RegistrationInfo info;
-									Transform transform = _memory->computeIcpTransformMulti(signature->id(), nearestId, filteredPath, &info);
-									if(!transform.isNull())
-									{
-										UINFO("[Scan matching] Add local loop closure in SPACE (%d->%d) %s",
-												signature->id(),
-												nearestId,
-												transform.prettyPrint().c_str());
+									scanCandidates.push_back(std::make_pair(nearestId, filteredPath));
+									scanCandidatesLocalPath.push_back(optimizedLocalPath);
+								}
+							}
+						}
+						else
+						{
+							//UDEBUG("Path %d ignored", nearestId);
+						}
+					}
+
+					// Assembled scans of each path are registered in parallel, then
+					// links are added in the same order as the paths (by batches in
+					// localization mode, see visual proximity detection above).
+					const unsigned int scanBatchSize = _memory->isIncremental()?(unsigned int)scanCandidates.size():registrationBatchSize();
+					for(unsigned int batch=0;
+						batch<scanCandidates.size() &&
+						(_memory->isIncremental() || lastProximitySpaceClosureId == 0);
+						batch+=scanBatchSize)
+					{
+						unsigned int batchEnd = std::min((unsigned int)scanCandidates.size(), batch+scanBatchSize);
+						std::vector<RegistrationInfo> scanInfos;
+						std::vector<Transform> scanTransforms = _memory->computeIcpTransformsMulti(
+								signature->id(),
+								std::vector<std::pair<int, std::map<int, Transform> > >(scanCandidates.begin()+batch, scanCandidates.begin()+batchEnd),
+								&scanInfos);
+						for(unsigned int i=0;
+							i<batchEnd-batch &&
+							(_memory->isIncremental() || lastProximitySpaceClosureId == 0);
+							++i)
+						{
+							++localScanPathsChecked;
+							int nearestId = scanCandidates[batch+i].first;
+							const std::map<int, Transform> & optimizedLocalPath = scanCandidatesLocalPath[batch+i];
+							const RegistrationInfo & info = scanInfos[i];
+							Transform transform = scanTransforms[i];
+							if(!transform.isNull())
+							{
+								UINFO("[Scan matching] Add local loop closure in SPACE (%d->%d) %s",
+										signature->id(),
+										nearestId,
+										transform.prettyPrint().c_str());
 
-										cv::Mat scanMatchingIds;
-										if(_scanMatchingIdsSavedInLinks)
+								cv::Mat scanMatchingIds;
+								if(_scanMatchingIdsSavedInLinks)
+								{
+									std::stringstream stream;
+									stream << "SCANS:";
+									for(std::map<int, Transform>::const_iterator iter=optimizedLocalPath.begin(); iter!=optimizedLocalPath.end(); ++iter)
+									{
+										if(iter != optimizedLocalPath.begin())
 										{
-											std::stringstream stream;
-											stream << "SCANS:";
-											for(std::map<int, Transform>::iterator iter=optimizedLocalPath.begin(); iter!=optimizedLocalPath.end(); ++iter)
-											{
-												if(iter != optimizedLocalPath.begin())
-												{
-													stream << ";";
-												}
-												stream << uNumber2Str(iter->first);
-											}
-											std::string scansStr = stream.str();
-											scanMatchingIds = cv::Mat(1, int(scansStr.size()+1), CV_8SC1, (void *)scansStr.c_str());
-											scanMatchingIds = compressData2(scanMatchingIds); // compressed
+											stream << ";";
 										}
+										stream << uNumber2Str(iter->first);
+									}
+									std::string scansStr = stream.str();
+									scanMatchingIds = cv::Mat(1, int(scansStr.size()+1), CV_8SC1, (void *)scansStr.c_str());
+									scanMatchingIds = compressData2(scanMatchingIds); // compressed
+								}
 
-										// set Identify covariance for laser scan matching only
-										UASSERT(info.covariance.at<double>(0,0) > 0.0 && info.covariance.at<double>(5,5) > 0.0);
-										_memory->addLink(Link(signature->id(), nearestId, Link::kLocalSpaceClosure, transform, getInformation(info.covariance)/100.0, scanMatchingIds));
-										loopClosureLinksAdded.push_back(std::make_pair(signature->id(), nearestId));
+								// set Identify covariance for laser scan matching only
+								UASSERT(info.covariance.at<double>(0,0) > 0.0 && info.covariance.at<double>(5,5) > 0.0);
+								_memory->addLink(Link(signature->id(), nearestId, Link::kLocalSpaceClosure, transform, getInformation(info.covariance)/100.0, scanMatchingIds));
+								loopClosureLinksAdded.push_back(std::make_pair(signature->id(), nearestId));
 
-										++proximityDetectionsAddedByICPOnly;
+								++proximityDetectionsAddedByICPOnly;
 
-										// no local loop closure added visually
-										if(proximityDetectionsAddedVisually == 0 && _loopClosureHypothesis.first == 0)
-										{
-											lastProximitySpaceClosureId = nearestId;
-										}
-									}
-									else
-									{
-										UINFO("Local scan matching rejected: %s", info.rejectedMsg.c_str());
-									}
+								// no local loop closure added visually
+								if(proximityDetectionsAddedVisually == 0 && _loopClosureHypothesis.first == 0)
+								{
+									lastProximitySpaceClosureId = nearestId;
 								}
 							}
-						}
-						else
-						{
-							//UDEBUG("Path %d ignored", nearestId);
+							else
+							{
+								UINFO("Local scan matching rejected: %s", info.rejectedMsg.c_str());
+							}
 						}
 					}
 				}
@@ -2761,6 +2867,7 @@ bool Rtabmap::process(
 						iter->second = mapCorrectionInv * up * iter->second;
 					}
 					_optimizedPoses.at(signature->id()) = signature->getPose();
+					_optimizedPosesIndex->update(_optimizedPoses);
 				}
 				else
 				{
@@ -2808,6 +2915,7 @@ bool Rtabmap::process(
 						}
 					}
 					_optimizedPoses.at(signature->id()) = newPose;
+					_optimizedPosesIndex->add(signature->id(), newPose);
 				}
 				localizationCovariance = localizationLinks.begin()->second.infMatrix().inv();
 
@@ -2963,6 +3071,7 @@ bool Rtabmap::process(
 			{
 				UINFO("Updated local map (old size=%d, new size=%d)", (int)_optimizedPoses.size(), (int)poses.size());
 				_optimizedPoses = poses;
+				_optimizedPosesIndex->update(_optimizedPoses);
 				_constraints = constraints;
 				localizationCovariance = covariance;
 			}
@@ -3287,6 +3396,17 @@ bool Rtabmap::process(
 		_gpsGeocentricCache.erase(*iter);
 	}
 
+	// nodes not in RAM anymore (transferred or deleted) should be reloaded in the path graph
+	if(_pathGraph)
+	{
+		_pathGraphStaleIds.insert(signaturesRemoved.begin(), signaturesRemoved.end());
+	}
+	else
+	{
+		// the path graph will be created from all links
+		_memory->clearLinksModifiedIds();
+	}
+
 	//Remove optimized poses from signatures transferred
 	if(signaturesRemoved.size() && (_optimizedPoses.size() || _constraints.size()))
 	{
@@ -3336,6 +3456,7 @@ bool Rtabmap::process(
 				UDEBUG("Detected that only last signature has been removed");
 				int lastId = signaturesRemoved.front();
 				_optimizedPoses.erase(lastId);
+				_optimizedPosesIndex->remove(lastId);
 				for(std::multimap<int, Link>::iterator iter=_constraints.find(lastId); iter!=_constraints.end() && iter->first==lastId;++iter)
 				{
 					iter->second.to();
@@ -3357,6 +3478,7 @@ bool Rtabmap::process(
 					{
 						UDEBUG("Removed %d from local map", iter->first);
 						UASSERT(iter->first != _lastLocalizationNodeId);
+						_optimizedPosesIndex->remove(iter->first);
 						_optimizedPoses.erase(iter++);
 					}
 					else
@@ -3380,6 +3502,7 @@ bool Rtabmap::process(
 		else
 		{
 			_optimizedPoses.clear();
+			_optimizedPosesIndex->clear();
 			_constraints.clear();
 		}
 	}
@@ -3721,6 +3844,7 @@ void Rtabmap::rejectLastLoopClosure()
 				{
 					UINFO("Updated local map (old size=%d, new size=%d)", (int)_optimizedPoses.size(), (int)poses.size());
 					_optimizedPoses = poses;
+					_optimizedPosesIndex->update(_optimizedPoses);
 					_constraints = constraints;
 					_mapCorrection = _optimizedPoses.at(_memory->getLastWorkingSignature()->id()) * _memory->getLastWorkingSignature()->getPose().inverse();
 				}
@@ -3740,6 +3864,7 @@ void Rtabmap::deleteLastLocation()
 		{
 			UINFO("Update graph");
 			_optimizedPoses.erase(lastId);
+			_optimizedPosesIndex->remove(lastId);
 			std::map<int, Transform> poses = _optimizedPoses;
 			//remove all constraints with last localization id
 			for(std::multimap<int, Link>::iterator iter=_constraints.begin(); iter!=_constraints.end();)
@@ -3771,6 +3896,7 @@ void Rtabmap::deleteLastLocation()
 				else
 				{
 					_optimizedPoses = poses;
+					_optimizedPosesIndex->update(_optimizedPoses);
 					_constraints = constraints;
 					_mapCorrection = _optimizedPoses.at(_memory->getLastWorkingSignature()->id()) * _memory->getLastWorkingSignature()->getPose().inverse();
 				}
@@ -3782,6 +3908,7 @@ void Rtabmap::deleteLastLocation()
 void Rtabmap::setOptimizedPoses(const std::map<int, Transform> & poses)
 {
 	_optimizedPoses = poses;
+	_optimizedPosesIndex->update(_optimizedPoses);
 }
 
 void Rtabmap::dumpData() const
@@ -3817,10 +3944,6 @@ std::map<int, Transform> Rtabmap::getForwardWMPoses(
 		UASSERT(fromS != 0);
 		UASSERT(_optimizedPoses.find(fromId) != _optimizedPoses.end());
 
-		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-		cloud->resize(_optimizedPoses.size());
-		std::vector<int> ids(_optimizedPoses.size());
-		int oi = 0;
 		const std::set<int> & stm = _memory->getStMem();
 		//get distances
 		std::map<int, float> foundIds;
@@ -3830,90 +3953,41 @@ std::map<int, Transform> Rtabmap::getForwardWMPoses(
 		}
 		else
 		{
-			foundIds = graph::getNodesInRadius(fromId, _optimizedPoses, radius);
+			foundIds = getOptimizedPosesIndex().radiusSearch(_optimizedPoses.at(fromId), radius, fromId);
 		}
 
+		Transform fromT = _optimizedPoses.at(fromId);
+		Transform fromTInv = fromT.inverse();
+
+		//filter poses in front of the fromId, sorted by distance
 		float radiusSqrd = radius * radius;
-		for(std::map<int, Transform>::const_iterator iter = _optimizedPoses.begin(); iter!=_optimizedPoses.end(); ++iter)
+		std::multimap<float, int> inFront;
+		for(std::map<int, float>::const_iterator iter = foundIds.begin(); iter!=foundIds.end(); ++iter)
 		{
-			if(iter->first != fromId)
+			if(iter->first != fromId &&
+			   stm.find(iter->first) == stm.end() &&
+			   iter->second <= radiusSqrd)
 			{
-				if(stm.find(iter->first) == stm.end() &&
-				   uContains(foundIds, iter->first) &&
-				   (radiusSqrd==0 || foundIds.at(iter->first) <= radiusSqrd))
+				std::map<int, Transform>::const_iterator jter = _optimizedPoses.find(iter->first);
+				if(jter != _optimizedPoses.end())
 				{
-					(*cloud)[oi] = pcl::PointXYZ(iter->second.x(), iter->second.y(), iter->second.z());
-					ids[oi++] = iter->first;
-				}
-			}
-		}
-
-		cloud->resize(oi);
-		ids.resize(oi);
-
-		Transform fromT = _optimizedPoses.at(fromId);
-
-		if(cloud->size())
-		{
-			//if(cloud->size())
-			//{
-			//	pcl::io::savePCDFile("radiusPoses.pcd", *cloud);
-			//	UWARN("Saved radiusPoses.pcd");
-			//}
-
-			//filter poses in front of the fromId
-			float x,y,z, roll,pitch,yaw;
-			fromT.getTranslationAndEulerAngles(x,y,z, roll,pitch,yaw);
-
-			pcl::CropBox<pcl::PointXYZ> cropbox;
-			cropbox.setInputCloud(cloud);
-			cropbox.setMin(Eigen::Vector4f(-1, -radius, -999999, 0));
-			cropbox.setMax(Eigen::Vector4f(radius, radius, 999999, 0));
-			cropbox.setRotation(Eigen::Vector3f(roll, pitch, yaw));
-			cropbox.setTranslation(Eigen::Vector3f(x, y, z));
-			cropbox.setRotation(Eigen::Vector3f(roll,pitch,yaw));
-			pcl::IndicesPtr indices(new std::vector<int>());
-			cropbox.filter(*indices);
-
-			//if(indices->size())
-			//{
-			//	pcl::io::savePCDFile("radiusCrop.pcd", *cloud, *indices);
-			//	UWARN("Saved radiusCrop.pcd");
-			//}
-
-			if(indices->size())
-			{
-				pcl::search::KdTree<pcl::PointXYZ>::Ptr kdTree(new pcl::search::KdTree<pcl::PointXYZ>);
-				kdTree->setInputCloud(cloud, indices);
-				std::vector<int> ind;
-				std::vector<float> dist;
-				pcl::PointXYZ pt(fromT.x(), fromT.y(), fromT.z());
-				kdTree->radiusSearch(pt, radius, ind, dist, maxNearestNeighbors);
-				//pcl::PointCloud<pcl::PointXYZ> inliers;
-				for(unsigned int i=0; i<ind.size(); ++i)
-				{
-					if(ind[i] >=0)
+					Transform t = fromTInv * jter->second;
+					if(t.x() >= -1.0f && t.x() <= radius && t.y() >= -radius && t.y() <= radius)
 					{
-						Transform tmp = _optimizedPoses.find(ids[ind[i]])->second;
-						//inliers.push_back(pcl::PointXYZ(tmp.x(), tmp.y(), tmp.z()));
-						UDEBUG("Inlier %d: %s", ids[ind[i]], tmp.prettyPrint().c_str());
-						poses.insert(std::make_pair(ids[ind[i]], tmp));
+						inFront.insert(std::make_pair(iter->second, iter->first));
 					}
 				}
-
-				//if(inliers.size())
-				//{
-				//	pcl::io::savePCDFile("radiusInliers.pcd", inliers);
-				//}
-				//if(nearestId >0)
-				//{
-				//	pcl::PointCloud<pcl::PointXYZ> c;
-				//	Transform ct = _optimizedPoses.find(nearestId)->second;
-				//	c.push_back(pcl::PointXYZ(ct.x(), ct.y(), ct.z()));
-				//	pcl::io::savePCDFile("radiusNearestPt.pcd", c);
-				//}
 			}
 		}
+
+		for(std::multimap<float, int>::iterator iter=inFront.begin();
+			iter!=inFront.end() && (maxNearestNeighbors <= 0 || (int)poses.size() < maxNearestNeighbors);
+			++iter)
+		{
+			const Transform & tmp = _optimizedPoses.at(iter->second);
+			UDEBUG("Inlier %d: %s", iter->second, tmp.prettyPrint().c_str());
+			poses.insert(std::make_pair(iter->second, tmp));
+		}
 	}
 	return poses;
 }
@@ -4007,7 +4081,7 @@ void Rtabmap::optimizeCurrentMap(
 		cv::Mat & covariance,
 		std::multimap<int, Link> * constraints,
 		double * error,
-		int * iterationsDone) const
+		int * iterationsDone)
 {
 	//Optimize the map
 	UINFO("Optimize map: around location %d", id);
@@ -4021,7 +4095,9 @@ void Rtabmap::optimizeCurrentMap(
 		}
 		UINFO("get %d ids time %f s", (int)ids.size(), timer.ticks());
 
-		std::map<int, Transform> poses = Rtabmap::optimizeGraph(id, uKeysSet(ids), optimizedPoses, lookInDatabase, covariance, constraints, error, iterationsDone);
+		// The incremental graph of the optimizer is the current map in WM
+		bool incremental = !lookInDatabase && _graphOptimizer->isIncremental();
+		std::map<int, Transform> poses = Rtabmap::optimizeGraph(id, uKeysSet(ids), optimizedPoses, lookInDatabase, covariance, constraints, error, iterationsDone, incremental);
 		UINFO("optimize time %f s", timer.ticks());
 
 		if(poses.size())
@@ -4054,7 +4130,8 @@ std::map<int, Transform> Rtabmap::optimizeGraph(
 		cv::Mat & covariance,
 		std::multimap<int, Link> * constraints,
 		double * error,
-		int * iterationsDone) const
+		int * iterationsDone,
+		bool incremental)
 {
 	UTimer timer;
 	std::map<int, Transform> optimizedPoses;
@@ -4091,7 +4168,30 @@ std::map<int, Transform> Rtabmap::optimizeGraph(
 	else
 	{
 		bool hasLandmarks = edgeConstraints.begin()->first < 0;
-		if(poses.size() != guessPoses.size() || hasLandmarks)
+		if(incremental)
+		{
+			std::map<int, Transform> posesOut;
+			std::multimap<int, Link> edgeConstraintsOut;
+			_graphOptimizer->getConnectedGraph(fromId, poses, edgeConstraints, posesOut, edgeConstraintsOut);
+
+			// Nodes transferred to LTM and modified links are removed from the
+			// incremental graph, the optimizer is not restarted
+			std::map<int, Transform> newPoses;
+			std::multimap<int, Link> newConstraints;
+			std::set<int> removedPoses;
+			std::multimap<int, Link> removedConstraints;
+			_graphOptimizer->getIncrementalDelta(posesOut, edgeConstraintsOut, newPoses, newConstraints, removedPoses, removedConstraints);
+			UDEBUG("incremental optimization: new poses=%d new links=%d removed poses=%d removed links=%d",
+					(int)newPoses.size(), (int)newConstraints.size(), (int)removedPoses.size(), (int)removedConstraints.size());
+			_graphOptimizer->removeConstraints(removedPoses, removedConstraints);
+			_graphOptimizer->addConstraints(newPoses, newConstraints);
+			optimizedPoses = _graphOptimizer->update(fromId, covariance, error, iterationsDone);
+			if(constraints)
+			{
+				*constraints = edgeConstraintsOut;
+			}
+		}
+		else if(poses.size() != guessPoses.size() || hasLandmarks)
 		{
 			UDEBUG("recompute poses using only links (robust to multi-session)");
 			std::map<int, Transform> posesOut;
@@ -4259,7 +4359,7 @@ void Rtabmap::get3DMap(
 		std::map<int, Transform> & poses,
 		std::multimap<int, Link> & constraints,
 		bool optimized,
-		bool global) const
+		bool global)
 {
 	UDEBUG("");
 	if(_memory && _memory->getLastWorkingSignature())
@@ -4459,6 +4559,7 @@ int Rtabmap::detectMoreLoopClosures(
 
 	std::list<Link> loopClosuresAdded;
 	std::multimap<int, int> checkedLoopClosures;
+	std::map<std::pair<int, int>, std::pair<Transform, RegistrationInfo> > registrations;
 
 	std::map<int, Transform> posesToCheckLoopClosures;
 	std::map<int, Transform> poses;
@@ -4492,6 +4593,13 @@ int Rtabmap::detectMoreLoopClosures(
 
 		UINFO("Looking for more loop closures, clustering poses... found %d clusters.", (int)clusters.size());
 
+		// Registrations of the clusters are independent, they are computed in
+		// parallel by batches in the order of the clusters. As only one link per
+		// node is added per iteration, a pair is registered only if none of its
+		// nodes has a link added by the previous batches. Registrations of the
+		// pairs not added in this iteration are kept for the next iterations.
+		const unsigned int batchSize = registrationBatchSize();
+		std::multimap<int, int>::iterator batchEnd = clusters.begin();
 		int i=0;
 		std::set<int> addedLinks;
 		for(std::multimap<int, int>::iterator iter=clusters.begin(); iter!= clusters.end(); ++iter, ++i)
@@ -4502,6 +4610,41 @@ int Rtabmap::detectMoreLoopClosures(
 				break;
 			}
 
+			if(iter == batchEnd)
+			{
+				std::vector<std::pair<int, int> > pairs;
+				std::vector<std::pair<Signature*, Signature*> > pairSignatures;
+				for(; batchEnd!=clusters.end() && pairs.size() < batchSize; ++batchEnd)
+				{
+					int from = std::max(batchEnd->first, batchEnd->second);
+					int to = std::min(batchEnd->first, batchEnd->second);
+					int mapIdFrom = uValue(mapIds, from, 0);
+					int mapIdTo = uValue(mapIds, to, 0);
+					if(((interSession && mapIdFrom != mapIdTo) ||
+						(intraSession && mapIdFrom == mapIdTo)) &&
+					   addedLinks.find(from) == addedLinks.end() &&
+					   addedLinks.find(to) == addedLinks.end() &&
+					   rtabmap::graph::findLink(checkedLoopClosures, from, to) == checkedLoopClosures.end() &&
+					   rtabmap::graph::findLink(links, from, to) == links.end() &&
+					   registrations.find(std::make_pair(from, to)) == registrations.end())
+					{
+						UASSERT(signatures.find(from) != signatures.end());
+						UASSERT(signatures.find(to) != signatures.end());
+						registrations.insert(std::make_pair(std::make_pair(from, to), std::make_pair(Transform(), RegistrationInfo())));
+						pairs.push_back(std::make_pair(from, to));
+						// use signatures instead of IDs because some signatures may not be in WM
+						pairSignatures.push_back(std::make_pair(&signatures.at(from), &signatures.at(to)));
+					}
+				}
+				UDEBUG("Looking for more loop closures, computing %d registrations (cluster %d/%d)...", (int)pairs.size(), i+1, (int)clusters.size());
+				std::vector<RegistrationInfo> infos;
+				std::vector<Transform> transforms = _memory->computeTransforms(pairSignatures, std::vector<Transform>(pairs.size()), &infos);
+				for(unsigned int j=0; j<pairs.size(); ++j)
+				{
+					registrations.at(pairs[j]) = std::make_pair(transforms[j], infos[j]);
+				}
+			}
+
 			int from = iter->first;
 			int to = iter->second;
 			if(iter->first < iter->second)
@@ -4526,12 +4669,9 @@ int Rtabmap::detectMoreLoopClosures(
 					{
 						checkedLoopClosures.insert(std::make_pair(from, to));
 
-						UASSERT(signatures.find(from) != signatures.end());
-						UASSERT(signatures.find(to) != signatures.end());
-
-						RegistrationInfo info;
-						// use signatures instead of IDs because some signatures may not be in WM
-						Transform t = _memory->computeTransform(signatures.at(from), signatures.at(to), Transform(), &info);
+						UASSERT(registrations.find(std::make_pair(from, to)) != registrations.end());
+						const RegistrationInfo & info = registrations.at(std::make_pair(from, to)).second;
+						Transform t = registrations.at(std::make_pair(from, to)).first;
 
 						if(!t.isNull())
 						{
@@ -4707,6 +4847,7 @@ int Rtabmap::detectMoreLoopClosures(
 				iter->second = jter->second;
 			}
 		}
+		_optimizedPosesIndex->update(_optimizedPoses);
 		std::map<int, Transform> tmp;
 		// Update also the links if some have been added in WM
 		_memory->getMetricConstraints(uKeysSet(_optimizedPoses), tmp, _constraints, false);
@@ -4758,6 +4899,7 @@ int Rtabmap::refineLinks()
 		{
 			_memory->updateLink(*iter, true);
 		}
+		this->clearPathGraph();
 	}
 	return (int)linksRefined.size();
 }
@@ -4799,6 +4941,72 @@ void Rtabmap::clearPath(int status)
 	}
 }
 
+const PosesIndex & Rtabmap::getOptimizedPosesIndex() const
+{
+	// The index is updated where _optimizedPoses is modified
+	UASSERT(_optimizedPosesIndex->size() == (int)_optimizedPoses.size());
+	return *_optimizedPosesIndex;
+}
+
+void Rtabmap::clearPathGraph()
+{
+	delete _pathGraph;
+	_pathGraph = 0;
+	_pathGraphStaleIds.clear();
+}
+
+void Rtabmap::updatePathGraph()
+{
+	UASSERT(_memory);
+	UTimer timer;
+	if(_pathGraph == 0)
+	{
+		_pathGraph = new PathGraph();
+		_pathGraph->setReferenceNodes(_pathReferenceNodes);
+		// Faster to load all links in one query
+		_pathGraph->addLinks(_memory->getAllLinks(true, true, true));
+		_pathGraphStaleIds.clear();
+		_memory->clearLinksModifiedIds();
+		UINFO("Path graph created with %d nodes (%fs)", _pathGraph->size(), timer.ticks());
+	}
+	else
+	{
+		// Only nodes with links modified, transferred or deleted since last update
+		_pathGraphStaleIds.insert(_memory->getLinksModifiedIds().begin(), _memory->getLinksModifiedIds().end());
+		_memory->clearLinksModifiedIds();
+		int updatedNodes = 0;
+		for(std::set<int>::iterator iter=_pathGraphStaleIds.begin(); iter!=_pathGraphStaleIds.end(); ++iter)
+		{
+			std::multimap<int, Link> links = _memory->getLinks(*iter, true, true);
+			if(links.empty())
+			{
+				if(_pathGraph->contains(*iter))
+				{
+					_pathGraph->removeNode(*iter);
+					++updatedNodes;
+				}
+			}
+			else if(_pathGraph->setLinks(*iter, links))
+			{
+				++updatedNodes;
+			}
+		}
+		UDEBUG("Path graph updated: %d nodes, %d stale, %d updated (%fs)",
+				_pathGraph->size(), (int)_pathGraphStaleIds.size(), updatedNodes, timer.ticks());
+		_pathGraphStaleIds.clear();
+	}
+
+	// Euclidean heuristic, nodes not in the local
+	// optimized graph keep their previous pose.
+	for(std::map<int, Transform>::iterator iter=_optimizedPoses.begin(); iter!=_optimizedPoses.end(); ++iter)
+	{
+		if(_pathGraph->contains(iter->first))
+		{
+			_pathGraph->setPose(iter->first, iter->second);
+		}
+	}
+}
+
 // return true if path is updated
 bool Rtabmap::computePath(int targetNode, bool global)
 {
@@ -4855,14 +5063,30 @@ bool Rtabmap::computePath(int targetNode, bool global)
 		}
 		if(currentNode && targetNode)
 		{
-			std::list<std::pair<int, Transform> > path = graph::computePath(
-					currentNode,
-					targetNode,
-					_memory,
-					global,
-					false,
-					_pathLinearVelocity,
-					_pathAngularVelocity);
+			std::list<std::pair<int, Transform> > path;
+			if(global)
+			{
+				// Don't reload all links from the database on each request
+				this->updatePathGraph();
+				timer.restart();
+				path = _pathGraph->computePath(
+						currentNode,
+						targetNode,
+						_pathLinearVelocity,
+						_pathAngularVelocity);
+				UDEBUG("Path planning time = %fs", timer.ticks());
+			}
+			else
+			{
+				path = graph::computePath(
+						currentNode,
+						targetNode,
+						_memory,
+						false,
+						false,
+						_pathLinearVelocity,
+						_pathAngularVelocity);
+			}
 
 			//transform in current referential
 			Transform t = uValue(_optimizedPoses, currentNode, Transform::getIdentity());
@@ -55,6 +55,12 @@ RtabmapThread::RtabmapThread(Rtabmap * rtabmap) :
 
 {
 	UASSERT(rtabmap != 0);
+	// IMU events are not handled, don't receive them
+	UEventsManager::subscribe<CameraEvent>(this);
+	UEventsManager::subscribe<OdometryEvent>(this);
+	UEventsManager::subscribe<UserDataEvent>(this);
+	UEventsManager::subscribe<RtabmapEventCmd>(this);
+	UEventsManager::subscribe<ParamEvent>(this);
 }
 
 RtabmapThread::~RtabmapThread()
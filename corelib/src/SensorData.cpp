@@ -402,7 +402,8 @@ void SensorData::setOccupancyGrid(
 			const cv::Mat & obstacles,
 			const cv::Mat & empty,
 			float cellSize,
-			const cv::Point3f & viewPoint)
+			const cv::Point3f & viewPoint,
+			int codec)
 {
 	UDEBUG("ground=%d obstacles=%d empty=%d", ground.cols, obstacles.cols, empty.cols);
 	if((!ground.empty() && (!_groundCellsCompressed.empty() || !_groundCellsRaw.empty())) ||
@@ -421,9 +422,9 @@ void SensorData::setOccupancyGrid(
 	_emptyCellsRaw = cv::Mat();
 	_emptyCellsCompressed = cv::Mat();
 
-	CompressionThread ctGround(ground);
-	CompressionThread ctObstacles(obstacles);
-	CompressionThread ctEmpty(empty);
+	CompressionThread ctGround(ground, "", codec);
+	CompressionThread ctObstacles(obstacles, "", codec);
+	CompressionThread ctEmpty(empty, "", codec);
 
 	if(!ground.empty())
 	{
@@ -461,9 +462,9 @@ void SensorData::setOccupancyGrid(
 			_emptyCellsCompressed = empty;
 		}
 	}
-	ctGround.join();
-	ctObstacles.join();
-	ctEmpty.join();
+	ctGround.wait();
+	ctObstacles.wait();
+	ctEmpty.wait();
 	if(!_groundCellsRaw.empty())
 	{
 		_groundCellsCompressed = ctGround.getCompressedData();
@@ -663,13 +664,13 @@ void SensorData::uncompressDataConst(
 			UASSERT(_emptyCellsCompressed.type() == CV_8UC1);
 			ctEmptyCells.start();
 		}
-		ctImage.join();
-		ctDepth.join();
-		ctLaserScan.join();
-		ctUserData.join();
-		ctGroundCells.join();
-		ctObstacleCells.join();
-		ctEmptyCells.join();
+		ctImage.wait();
+		ctDepth.wait();
+		ctLaserScan.wait();
+		ctUserData.wait();
+		ctGroundCells.wait();
+		ctObstacleCells.wait();
+		ctEmptyCells.wait();
 
 		if(imageRaw && imageRaw->empty())
 		{
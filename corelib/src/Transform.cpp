@@ -38,8 +38,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace rtabmap {
 
-Transform::Transform() : data_(cv::Mat::zeros(3,4,CV_32FC1))
+Transform::Transform()
 {
+	memset(data_, 0, 12*sizeof(float));
 }
 
 // rotation matrix r## and origin o##
@@ -48,10 +49,9 @@ Transform::Transform(
 		float r21, float r22, float r23, float o24,
 		float r31, float r32, float r33, float o34)
 {
-	data_ = (cv::Mat_<float>(3,4) <<
-			r11, r12, r13, o14,
-			r21, r22, r23, o24,
-			r31, r32, r33, o34);
+	data_[0] = r11; data_[1] = r12; data_[2] = r13; data_[3] = o14;
+	data_[4] = r21; data_[5] = r22; data_[6] = r23; data_[7] = o24;
+	data_[8] = r31; data_[9] = r32; data_[10] = r33; data_[11] = o34;
 }
 
 Transform::Transform(const cv::Mat & transformationMatrix)
@@ -59,14 +59,8 @@ Transform::Transform(const cv::Mat & transformationMatrix)
 	UASSERT(transformationMatrix.cols == 4 &&
 			transformationMatrix.rows == 3 &&
 			(transformationMatrix.type() == CV_32FC1 || transformationMatrix.type() == CV_64FC1));
-	if(transformationMatrix.type() == CV_32FC1)
-	{
-		data_ = transformationMatrix;
-	}
-	else
-	{
-		transformationMatrix.convertTo(data_, CV_32F);
-	}
+	cv::Mat data(3, 4, CV_32FC1, data_);
+	transformationMatrix.convertTo(data, CV_32F);
 }
 
 Transform::Transform(float x, float y, float z, float roll, float pitch, float yaw)
@@ -75,8 +69,7 @@ Transform::Transform(float x, float y, float z, float roll, float pitch, float y
 	*this = fromEigen3f(t);
 }
 
-Transform::Transform(float x, float y, float z, float qx, float qy, float qz, float qw) :
-		data_(cv::Mat::zeros(3,4,CV_32FC1))
+Transform::Transform(float x, float y, float z, float qx, float qy, float qz, float qw)
 {
 	Eigen::Matrix3f rotation = Eigen::Quaternionf(qw, qx, qy, qz).normalized().toRotationMatrix();
 	data()[0] = rotation(0,0);
@@ -101,13 +94,12 @@ Transform::Transform(float x, float y, float theta)
 
 Transform Transform::clone() const
 {
-	return Transform(data_.clone());
+	return *this;
 }
 
 bool Transform::isNull() const
 {
-	return (data_.empty() ||
-			(data()[0] == 0.0f &&
+	return ((data()[0] == 0.0f &&
 			data()[1] == 0.0f &&
 			data()[2] == 0.0f &&
 			data()[3] == 0.0f &&
@@ -168,7 +160,18 @@ float Transform::theta() const
 
 Transform Transform::inverse() const
 {
-	return fromEigen4f(toEigen4f().inverse());
+	Eigen::Matrix4f m = toEigen4f();
+	if(m.topLeftCorner<3,3>().isUnitary(1e-5f))
+	{
+		// rigid transform: R^T, -R^T*t
+		Eigen::Matrix3f rt = m.topLeftCorner<3,3>().transpose();
+		Eigen::Vector3f t = -rt * m.topRightCorner<3,1>();
+		return Transform(
+				rt(0,0), rt(0,1), rt(0,2), t[0],
+				rt(1,0), rt(1,1), rt(1,2), t[1],
+				rt(2,0), rt(2,1), rt(2,2), t[2]);
+	}
+	return fromEigen4f(m.inverse());
 }
 
 Transform Transform::rotation() const
@@ -195,12 +198,12 @@ Transform Transform::to3DoF() const
 
 cv::Mat Transform::rotationMatrix() const
 {
-	return data_.colRange(0, 3).clone();
+	return dataMatrix().colRange(0, 3).clone();
 }
 
 cv::Mat Transform::translationMatrix() const
 {
-	return data_.col(3).clone();
+	return dataMatrix().col(3).clone();
 }
 
 void Transform::getTranslationAndEulerAngles(float & x, float & y, float & z, float & roll, float & pitch, float & yaw) const
@@ -287,10 +290,18 @@ std::string Transform::prettyPrint() const
 
 Transform Transform::operator*(const Transform & t) const
 {
-	Eigen::Affine3f m = Eigen::Affine3f(toEigen4f()*t.toEigen4f());
+	// compose directly on the 3x4 matrices (implicit last row 0 0 0 1)
+	typedef Eigen::Map<const Eigen::Matrix<float, 3, 4, Eigen::RowMajor> > ConstMap34f;
+	ConstMap34f a(data_);
+	ConstMap34f b(t.data_);
+	Eigen::Matrix3f r = a.leftCols<3>() * b.leftCols<3>();
+	Eigen::Vector3f o = a.leftCols<3>() * b.col(3) + a.col(3);
 	// make sure rotation is always normalized!
-	m.linear() = Eigen::Quaternionf(m.linear()).normalized().toRotationMatrix();
-	return fromEigen3f(m);
+	r = Eigen::Quaternionf(r).normalized().toRotationMatrix();
+	return Transform(
+			r(0,0), r(0,1), r(0,2), o[0],
+			r(1,0), r(1,1), r(1,2), o[1],
+			r(2,0), r(2,1), r(2,2), o[2]);
 }
 
 Transform & Transform::operator*=(const Transform & t)
@@ -301,7 +312,7 @@ Transform & Transform::operator*=(const Transform & t)
 
 bool Transform::operator==(const Transform & t) const
 {
-	return memcmp(data_.data, t.data_.data, data_.total() * sizeof(float)) == 0;
+	return memcmp(data_, t.data_, 12 * sizeof(float)) == 0;
 }
 
 bool Transform::operator!=(const Transform & t) const
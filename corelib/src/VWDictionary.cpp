@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/FlannIndex.h"
 
 #include "rtabmap/utilite/UtiLite.h"
+#include "rtabmap/utilite/UThreadPool.h"
 
 #include <opencv2/opencv_modules.hpp>
 
@@ -53,6 +54,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define KDTREE_SIZE 4
 #define KNN_CHECKS 32
+#define DESCRIPTORS_BLOCK_SIZE 1024
 
 namespace rtabmap
 {
@@ -60,18 +62,80 @@ namespace rtabmap
 const int VWDictionary::ID_START = 1;
 const int VWDictionary::ID_INVALID = 0;
 
+// Build a FLANN index of a snapshot of the dictionary in a worker thread
+class FlannIndexBuildTask : public UTask
+{
+public:
+	FlannIndexBuildTask(
+			VWDictionary::NNStrategy strategy,
+			const cv::Mat & features,
+			const std::vector<int> & wordIds,
+			bool useDistanceL1) :
+		strategy_(strategy),
+		features_(features),
+		wordIds_(wordIds),
+		useDistanceL1_(useDistanceL1),
+		index_(new FlannIndex())
+	{
+		UASSERT(features_.rows == (int)wordIds_.size());
+	}
+	virtual ~FlannIndexBuildTask()
+	{
+		this->wait();
+		delete index_;
+	}
+	// index -> word id
+	const std::vector<int> & wordIds() const {return wordIds_;}
+	FlannIndex * takeIndex() {FlannIndex * index = index_; index_ = 0; return index;}
+
+protected:
+	virtual void run()
+	{
+		UTimer timer;
+		// rebalancing is done by VWDictionary, not in FlannIndex::addPoints()
+		switch(strategy_)
+		{
+		case VWDictionary::kNNFlannNaive:
+			index_->buildLinearIndex(features_, useDistanceL1_, 0.0f);
+			break;
+		case VWDictionary::kNNFlannKdTree:
+			index_->buildKDTreeIndex(features_, KDTREE_SIZE, useDistanceL1_, 0.0f);
+			break;
+		case VWDictionary::kNNFlannLSH:
+			index_->buildLSHIndex(features_, 12, 20, 2, 0.0f);
+			break;
+		default:
+			UFATAL("Not supposed to be here!");
+			break;
+		}
+		UDEBUG("Built FLANN index of %d words in background (%fs)", features_.rows, timer.ticks());
+	}
+
+private:
+	VWDictionary::NNStrategy strategy_;
+	cv::Mat features_;
+	std::vector<int> wordIds_;
+	bool useDistanceL1_;
+	FlannIndex * index_;
+};
+
 VWDictionary::VWDictionary(const ParametersMap & parameters) :
 	_totalActiveReferences(0),
 	_incrementalDictionary(Parameters::defaultKpIncrementalDictionary()),
 	_incrementalFlann(Parameters::defaultKpIncrementalFlann()),
 	_rebalancingFactor(Parameters::defaultKpFlannRebalancingFactor()),
+	_rebalancingAsync(Parameters::defaultKpFlannRebalancingAsync()),
 	_nndrRatio(Parameters::defaultKpNndrRatio()),
 	_newDictionaryPath(Parameters::defaultKpDictionaryPath()),
 	_newWordsComparedTogether(Parameters::defaultKpNewWordsComparedTogether()),
 	_lastWordId(0),
 	useDistanceL1_(false),
 	_flannIndex(new FlannIndex()),
-	_strategy(kNNBruteForce)
+	_strategy(kNNBruteForce),
+	_flannSizeAtBuild(0),
+	_flannPointsAdded(0),
+	_flannBuildTask(0),
+	_descriptorsCount(0)
 {
 	this->setNNStrategy((NNStrategy)Parameters::defaultKpNNStrategy());
 	this->parseParameters(parameters);
@@ -90,6 +154,7 @@ void VWDictionary::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kKpNewWordsComparedTogether(), _newWordsComparedTogether);
 	Parameters::parse(parameters, Parameters::kKpIncrementalFlann(), _incrementalFlann);
 	Parameters::parse(parameters, Parameters::kKpFlannRebalancingFactor(), _rebalancingFactor);
+	Parameters::parse(parameters, Parameters::kKpFlannRebalancingAsync(), _rebalancingAsync);
 
 	UASSERT_MSG(_nndrRatio > 0.0f, uFormat("String=%s value=%f", uContains(parameters, Parameters::kKpNndrRatio())?parameters.at(Parameters::kKpNndrRatio()).c_str():"", _nndrRatio).c_str());
 
@@ -220,6 +285,7 @@ void VWDictionary::setFixedDictionary(const std::string & dictionaryPath)
 
 								VisualWord * vw = new VisualWord(id, descriptor, 0);
 								vw->setSaved(true);
+								this->storeDescriptor(vw);
 								_visualWords.insert(_visualWords.end(), std::pair<int, VisualWord*>(id, vw));
 								_notIndexedWords.insert(_notIndexedWords.end(), id);
 								_unusedWords.insert(_unusedWords.end(), std::pair<int, VisualWord*>(id, vw));
@@ -315,6 +381,7 @@ void VWDictionary::setNNStrategy(NNStrategy strategy)
 		_strategy = strategy;
 		if(update)
 		{
+			this->cancelFlannRebuild();
 			_dataTree = cv::Mat();
 			_notIndexedWords = uKeysSet(_visualWords);
 			_removedIndexedWords.clear();
@@ -423,6 +490,11 @@ void VWDictionary::update()
 		   _strategy < kNNBruteForce &&
 		   _visualWords.size())
 		{
+			if(_flannBuildTask && _flannBuildTask->isDone())
+			{
+				this->finishFlannRebuild();
+			}
+
 			ULOGGER_DEBUG("Incremental FLANN: Removing %d words...", (int)_removedIndexedWords.size());
 			for(std::set<int>::iterator iter=_removedIndexedWords.begin(); iter!=_removedIndexedWords.end(); ++iter)
 			{
@@ -431,6 +503,10 @@ void VWDictionary::update()
 				_flannIndex->removePoint(_mapIdIndex.at(*iter));
 				_mapIndexId.erase(_mapIdIndex.at(*iter));
 				_mapIdIndex.erase(*iter);
+				if(_flannBuildTask && _flannBuildAddedWords.erase(*iter) == 0)
+				{
+					_flannBuildRemovedWords.insert(*iter);
+				}
 			}
 			ULOGGER_DEBUG("Incremental FLANN: Removing %d words... done!", (int)_removedIndexedWords.size());
 
@@ -464,23 +540,27 @@ void VWDictionary::update()
 					if(!_flannIndex->isBuilt())
 					{
 						UDEBUG("Building FLANN index...");
+						// with async rebalancing, the index should not be rebuilt in addPoints()
+						float rebalancingFactor = _rebalancingAsync?0.0f:_rebalancingFactor;
 						switch(_strategy)
 						{
 						case kNNFlannNaive:
-							_flannIndex->buildLinearIndex(descriptor, useDistanceL1_, _rebalancingFactor);
+							_flannIndex->buildLinearIndex(descriptor, useDistanceL1_, rebalancingFactor);
 							break;
 						case kNNFlannKdTree:
 							UASSERT_MSG(descriptor.type() == CV_32F, "To use KdTree dictionary, float descriptors are required!");
-							_flannIndex->buildKDTreeIndex(descriptor, KDTREE_SIZE, useDistanceL1_, _rebalancingFactor);
+							_flannIndex->buildKDTreeIndex(descriptor, KDTREE_SIZE, useDistanceL1_, rebalancingFactor);
 							break;
 						case kNNFlannLSH:
 							UASSERT_MSG(descriptor.type() == CV_8U, "To use LSH dictionary, binary descriptors are required!");
-							_flannIndex->buildLSHIndex(descriptor, 12, 20, 2, _rebalancingFactor);
+							_flannIndex->buildLSHIndex(descriptor, 12, 20, 2, rebalancingFactor);
 							break;
 						default:
 							UFATAL("Not supposed to be here!");
 							break;
 						}
+						_flannSizeAtBuild = descriptor.rows;
+						_flannPointsAdded = 0;
 						UDEBUG("Building FLANN index... done!");
 					}
 					else
@@ -488,6 +568,11 @@ void VWDictionary::update()
 						UASSERT(descriptor.cols == _flannIndex->featuresDim());
 						UASSERT(descriptor.type() == _flannIndex->featuresType());
 						index = _flannIndex->addPoints(descriptor);
+						_flannPointsAdded += descriptor.rows;
+						if(_flannBuildTask)
+						{
+							_flannBuildAddedWords.insert(w->id());
+						}
 					}
 					std::pair<std::map<int, int>::iterator, bool> inserted;
 					inserted = _mapIndexId.insert(std::pair<int, int>(index, w->id()));
@@ -497,6 +582,15 @@ void VWDictionary::update()
 				}
 				ULOGGER_DEBUG("Incremental FLANN: Inserting %d words... done!", (int)_notIndexedWords.size());
 			}
+
+			if(_rebalancingAsync &&
+			   _rebalancingFactor > 1.0f &&
+			   _flannBuildTask == 0 &&
+			   _flannIndex->isBuilt() &&
+			   float(_flannSizeAtBuild) * _rebalancingFactor < float(_flannSizeAtBuild + _flannPointsAdded))
+			{
+				this->startFlannRebuild();
+			}
 		}
 		else if(_strategy >= kNNBruteForce &&
 				_notIndexedWords.size() &&
@@ -522,6 +616,7 @@ void VWDictionary::update()
 		}
 		else
 		{
+			this->cancelFlannRebuild();
 			_mapIndexId.clear();
 			_mapIdIndex.clear();
 			_dataTree = cv::Mat();
@@ -588,22 +683,25 @@ void VWDictionary::update()
 				ULOGGER_DEBUG("_mapIndexId.size() = %d, words.size()=%d, _dim=%d",_mapIndexId.size(), _visualWords.size(), dim);
 				ULOGGER_DEBUG("copying data = %f s", timer.ticks());
 
+				float rebalancingFactor = _rebalancingAsync?0.0f:_rebalancingFactor;
 				switch(_strategy)
 				{
 				case kNNFlannNaive:
-					_flannIndex->buildLinearIndex(_dataTree, useDistanceL1_, _rebalancingFactor);
+					_flannIndex->buildLinearIndex(_dataTree, useDistanceL1_, rebalancingFactor);
 					break;
 				case kNNFlannKdTree:
 					UASSERT_MSG(type == CV_32F, "To use KdTree dictionary, float descriptors are required!");
-					_flannIndex->buildKDTreeIndex(_dataTree, KDTREE_SIZE, useDistanceL1_, _rebalancingFactor);
+					_flannIndex->buildKDTreeIndex(_dataTree, KDTREE_SIZE, useDistanceL1_, rebalancingFactor);
 					break;
 				case kNNFlannLSH:
 					UASSERT_MSG(type == CV_8U, "To use LSH dictionary, binary descriptors are required!");
-					_flannIndex->buildLSHIndex(_dataTree, 12, 20, 2, _rebalancingFactor);
+					_flannIndex->buildLSHIndex(_dataTree, 12, 20, 2, rebalancingFactor);
 					break;
 				default:
 					break;
 				}
+				_flannSizeAtBuild = _dataTree.rows;
+				_flannPointsAdded = 0;
 
 				ULOGGER_DEBUG("Time to create kd tree = %f s", timer.ticks());
 			}
@@ -617,9 +715,146 @@ void VWDictionary::update()
 	}
 	_notIndexedWords.clear();
 	_removedIndexedWords.clear();
+
+	// removed words are not referenced anymore by the search index, their rows can be reused
+	_freeDescriptorIndices.insert(_freeDescriptorIndices.end(), _pendingFreeDescriptorIndices.begin(), _pendingFreeDescriptorIndices.end());
+	_pendingFreeDescriptorIndices.clear();
 	UDEBUG("");
 }
 
+void VWDictionary::storeDescriptor(VisualWord * vw)
+{
+	const cv::Mat & descriptor = vw->getDescriptor();
+	if(vw->getDescriptorIndex() >= 0 ||
+	   descriptor.rows != 1 ||
+	   (_descriptorBlocks.size() &&
+		(descriptor.cols != _descriptorBlocks[0].cols || descriptor.type() != _descriptorBlocks[0].type())))
+	{
+		// Keep its own descriptor, it will be rejected by the dictionary anyway if not the same size/type
+		return;
+	}
+
+	int index;
+	if(_freeDescriptorIndices.size())
+	{
+		index = _freeDescriptorIndices.back();
+		_freeDescriptorIndices.pop_back();
+	}
+	else
+	{
+		index = _descriptorsCount++;
+		if(index / DESCRIPTORS_BLOCK_SIZE >= (int)_descriptorBlocks.size())
+		{
+			_descriptorBlocks.push_back(cv::Mat(DESCRIPTORS_BLOCK_SIZE, descriptor.cols, descriptor.type()));
+		}
+	}
+	cv::Mat row = _descriptorBlocks[index / DESCRIPTORS_BLOCK_SIZE].row(index % DESCRIPTORS_BLOCK_SIZE);
+	descriptor.copyTo(row);
+	vw->setDescriptor(row, index);
+}
+
+void VWDictionary::releaseDescriptor(VisualWord * vw, bool keepDescriptor)
+{
+	if(vw->getDescriptorIndex() >= 0)
+	{
+		UASSERT(vw->getDescriptorIndex() < _descriptorsCount);
+		_pendingFreeDescriptorIndices.push_back(vw->getDescriptorIndex());
+		vw->setDescriptor(keepDescriptor?vw->getDescriptor().clone():cv::Mat());
+	}
+}
+
+void VWDictionary::startFlannRebuild()
+{
+	UASSERT(_flannBuildTask == 0);
+	UTimer timer;
+
+	// Copy descriptors of the indexed words, words may be deleted while the index is built
+	cv::Mat features(_mapIdIndex.size(), _flannIndex->featuresDim(), _flannIndex->featuresType());
+	std::vector<int> wordIds(_mapIdIndex.size());
+	int i=0;
+	for(std::map<int, int>::iterator iter=_mapIdIndex.begin(); iter!=_mapIdIndex.end(); ++iter, ++i)
+	{
+		VisualWord* w = uValue(_visualWords, iter->first, (VisualWord*)0);
+		UASSERT(w);
+		if(w->getDescriptor().type() == CV_8U && _strategy == kNNFlannKdTree)
+		{
+			convertBinTo32F(w->getDescriptor()).copyTo(features.row(i));
+		}
+		else
+		{
+			w->getDescriptor().copyTo(features.row(i));
+		}
+		wordIds[i] = iter->first;
+	}
+
+	UDEBUG("Rebuilding FLANN index in background: %d -> %d (copying data = %fs)",
+			(int)_flannSizeAtBuild, (int)(_flannSizeAtBuild + _flannPointsAdded), timer.ticks());
+	_flannBuildTask = new FlannIndexBuildTask(_strategy, features, wordIds, useDistanceL1_);
+	_flannBuildTask->start();
+}
+
+void VWDictionary::finishFlannRebuild()
+{
+	UASSERT(_flannBuildTask != 0);
+	UTimer timer;
+	_flannBuildTask->wait();
+
+	// Swap indexes
+	FlannIndex * index = _flannBuildTask->takeIndex();
+	const std::vector<int> & wordIds = _flannBuildTask->wordIds();
+	_mapIndexId.clear();
+	_mapIdIndex.clear();
+	for(unsigned int i=0; i<wordIds.size(); ++i)
+	{
+		_mapIndexId.insert(_mapIndexId.end(), std::pair<int, int>(i, wordIds[i]));
+		_mapIdIndex.insert(_mapIdIndex.end(), std::pair<int, int>(wordIds[i], i));
+	}
+	_flannSizeAtBuild = wordIds.size();
+	_flannPointsAdded = 0;
+	delete _flannBuildTask;
+	_flannBuildTask = 0;
+	delete _flannIndex;
+	_flannIndex = index;
+
+	// Apply changes done to previous index since the build started
+	for(std::set<int>::iterator iter=_flannBuildRemovedWords.begin(); iter!=_flannBuildRemovedWords.end(); ++iter)
+	{
+		UASSERT(uContains(_mapIdIndex, *iter));
+		_flannIndex->removePoint(_mapIdIndex.at(*iter));
+		_mapIndexId.erase(_mapIdIndex.at(*iter));
+		_mapIdIndex.erase(*iter);
+	}
+	for(std::set<int>::iterator iter=_flannBuildAddedWords.begin(); iter!=_flannBuildAddedWords.end(); ++iter)
+	{
+		VisualWord* w = uValue(_visualWords, *iter, (VisualWord*)0);
+		UASSERT(w);
+		cv::Mat descriptor = w->getDescriptor();
+		if(descriptor.type() == CV_8U && _strategy == kNNFlannKdTree)
+		{
+			descriptor = convertBinTo32F(descriptor);
+		}
+		int index = _flannIndex->addPoints(descriptor);
+		_flannPointsAdded += descriptor.rows;
+		std::pair<std::map<int, int>::iterator, bool> inserted;
+		inserted = _mapIndexId.insert(std::pair<int, int>(index, w->id()));
+		UASSERT(inserted.second);
+		inserted = _mapIdIndex.insert(std::pair<int, int>(w->id(), index));
+		UASSERT(inserted.second);
+	}
+	UDEBUG("Swapped FLANN index (size=%d, removed=%d, added=%d, %fs)",
+			(int)_mapIdIndex.size(), (int)_flannBuildRemovedWords.size(), (int)_flannBuildAddedWords.size(), timer.ticks());
+	_flannBuildAddedWords.clear();
+	_flannBuildRemovedWords.clear();
+}
+
+void VWDictionary::cancelFlannRebuild()
+{
+	delete _flannBuildTask;
+	_flannBuildTask = 0;
+	_flannBuildAddedWords.clear();
+	_flannBuildRemovedWords.clear();
+}
+
 void VWDictionary::clear(bool printWarningsIfNotEmpty)
 {
 	ULOGGER_DEBUG("");
@@ -647,7 +882,14 @@ void VWDictionary::clear(bool printWarningsIfNotEmpty)
 	_mapIndexId.clear();
 	_mapIdIndex.clear();
 	_unusedWords.clear();
+	this->cancelFlannRebuild();
 	_flannIndex->release();
+	_flannSizeAtBuild = 0;
+	_flannPointsAdded = 0;
+	_descriptorBlocks.clear();
+	_freeDescriptorIndices.clear();
+	_pendingFreeDescriptorIndices.clear();
+	_descriptorsCount = 0;
 	useDistanceL1_ = false;
 }
 
@@ -790,11 +1032,18 @@ std::list<int> VWDictionary::addNewWords(
 		{
 			_flannIndex->knnSearch(descriptors, results, dists, k, KNN_CHECKS);
 		}
-		else if(_strategy == kNNBruteForce)
+		else if(_strategy == kNNBruteForce || _strategy == kNNBruteForceHamming)
 		{
 			bruteForce = true;
-			cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-			matcher.knnMatch(descriptors, _dataTree, matches, k);
+			if(_strategy == kNNBruteForceHamming && descriptors.type()==CV_8U)
+			{
+				FlannIndex::hammingKnnMatch(descriptors, _dataTree, matches, k);
+			}
+			else
+			{
+				cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
+				matcher.knnMatch(descriptors, _dataTree, matches, k);
+			}
 		}
 		else if(_strategy == kNNBruteForceGPU)
 		{
@@ -948,6 +1197,7 @@ std::list<int> VWDictionary::addNewWords(
 			{
 				// use original descriptor
 				VisualWord * vw = new VisualWord(getNextId(), descriptorsIn.row(i), signatureId);
+				this->storeDescriptor(vw);
 				_visualWords.insert(_visualWords.end(), std::pair<int, VisualWord *>(vw->id(), vw));
 				_notIndexedWords.insert(_notIndexedWords.end(), vw->id());
 				newWords.push_back(descriptors.row(i));
@@ -1109,11 +1359,18 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 			{
 				_flannIndex->knnSearch(query, results, dists, k, KNN_CHECKS);
 			}
-			else if(_strategy == kNNBruteForce)
+			else if(_strategy == kNNBruteForce || _strategy == kNNBruteForceHamming)
 			{
 				bruteForce = true;
-				cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-				matcher.knnMatch(query, _dataTree, matches, k);
+				if(_strategy == kNNBruteForceHamming && query.type()==CV_8U)
+				{
+					FlannIndex::hammingKnnMatch(query, _dataTree, matches, k);
+				}
+				else
+				{
+					cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
+					matcher.knnMatch(query, _dataTree, matches, k);
+				}
 			}
 			else if(_strategy == kNNBruteForceGPU)
 			{
@@ -1309,6 +1566,7 @@ void VWDictionary::addWord(VisualWord * vw)
 {
 	if(vw)
 	{
+		this->storeDescriptor(vw);
 		_visualWords.insert(std::pair<int, VisualWord *>(vw->id(), vw));
 		_notIndexedWords.insert(vw->id());
 		if(vw->getReferences().size())
@@ -1351,6 +1609,8 @@ void VWDictionary::removeWords(const std::vector<VisualWord*> & words)
 	//UDEBUG("Removing %d words from dictionary (current size=%d)", (int)words.size(), (int)_visualWords.size());
 	for(unsigned int i=0; i<words.size(); ++i)
 	{
+		// the caller owns the word now, so it should own its descriptor too
+		this->releaseDescriptor(words[i]);
 		_visualWords.erase(words[i]->id());
 		_unusedWords.erase(words[i]->id());
 		if(_notIndexedWords.erase(words[i]->id()) == 0)
@@ -1363,6 +1623,10 @@ void VWDictionary::removeWords(const std::vector<VisualWord*> & words)
 void VWDictionary::deleteUnusedWords()
 {
 	std::vector<VisualWord*> unusedWords = uValues(_unusedWords);
+	for(unsigned int i=0; i<unusedWords.size(); ++i)
+	{
+		this->releaseDescriptor(unusedWords[i], false);
+	}
 	removeWords(unusedWords);
 	for(unsigned int i=0; i<unusedWords.size(); ++i)
 	{
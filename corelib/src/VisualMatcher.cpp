@@ -0,0 +1,353 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap/core/VisualMatcher.h"
+#include "rtabmap/core/FlannIndex.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UMath.h>
+#include <algorithm>
+#include <cmath>
+
+namespace rtabmap {
+
+static inline float descriptorDistance(const unsigned char * a, const unsigned char * b, bool binary, int cols)
+{
+	return binary?
+			(float)FlannIndex::hammingDistance(a, b, cols):
+			FlannIndex::l2SqrDistance((const float*)a, (const float*)b, cols);
+}
+
+// Keep the 2 best, like cv::BFMatcher::knnMatch() the first one is kept on equal distances
+static inline void insertBest(float d, int index, int best[2], float bestDist[2])
+{
+	if(best[0] < 0 || d < bestDist[0])
+	{
+		best[1] = best[0];
+		bestDist[1] = bestDist[0];
+		best[0] = index;
+		bestDist[0] = d;
+	}
+	else if(best[1] < 0 || d < bestDist[1])
+	{
+		best[1] = index;
+		bestDist[1] = d;
+	}
+}
+
+// cell coordinate clamped to [-1, cells]
+static inline int cellCoord(float v, float minV, float cellSize, int cells)
+{
+	float c = std::floor((v - minV) / cellSize);
+	return c<0.0f?-1:c>=float(cells)?cells:(int)c;
+}
+
+VisualMatcher::VisualMatcher() :
+		radius_(0.0f),
+		cellSize_(0.0f),
+		minX_(0.0f),
+		minY_(0.0f),
+		gridCols_(0),
+		gridRows_(0)
+{
+}
+
+void VisualMatcher::matchGlobal(
+		const cv::Mat & descriptorsFrom,
+		const std::vector<int> & fromIds,
+		const cv::Mat & descriptorsTo,
+		float nndr,
+		bool newWordsComparedTogether,
+		std::vector<int> & fromWordIds,
+		std::vector<int> & toWordIds)
+{
+	UASSERT(descriptorsFrom.empty() || descriptorsFrom.type() == CV_8UC1 || descriptorsFrom.type() == CV_32FC1);
+	UASSERT(descriptorsFrom.empty() || descriptorsTo.empty() ||
+			(descriptorsFrom.type() == descriptorsTo.type() && descriptorsFrom.cols == descriptorsTo.cols));
+	UASSERT(fromIds.empty() || (int)fromIds.size() == descriptorsFrom.rows);
+
+	fromWordIds.clear();
+	toWordIds.clear();
+	wordRows_.clear();
+	wordIds_.clear();
+	int lastId = 0;
+	if(fromIds.size())
+	{
+		fromWordIds = fromIds;
+		wordIds_ = fromIds;
+		wordRows_.resize(fromIds.size());
+		for(unsigned int i=0; i<fromIds.size(); ++i)
+		{
+			wordRows_[i] = i;
+			if(lastId < fromIds[i])
+			{
+				lastId = fromIds[i];
+			}
+		}
+	}
+	else if(descriptorsFrom.rows)
+	{
+		addNewWords(descriptorsFrom, descriptorsFrom, nndr, newWordsComparedTogether, lastId, fromWordIds);
+
+		// only descriptors that created a word are in the dictionary
+		wordRows_ = newRows_;
+		wordIds_.resize(wordRows_.size());
+		for(unsigned int i=0; i<wordRows_.size(); ++i)
+		{
+			wordIds_[i] = fromWordIds[wordRows_[i]];
+		}
+	}
+
+	if(descriptorsTo.rows)
+	{
+		addNewWords(descriptorsFrom, descriptorsTo, nndr, newWordsComparedTogether, lastId, toWordIds);
+	}
+}
+
+void VisualMatcher::addNewWords(
+		const cv::Mat & words,
+		const cv::Mat & query,
+		float nndr,
+		bool newWordsComparedTogether,
+		int & lastId,
+		std::vector<int> & queryIds)
+{
+	const int n = query.rows;
+	const int dictSize = (int)wordRows_.size();
+	const bool binary = query.type() == CV_8UC1;
+	const int cols = query.cols;
+	queryIds.resize(n);
+	newRows_.clear();
+
+	// Nearest words in the dictionary, independent for each descriptor
+	knnIndices_.assign(n*2, -1);
+	knnDists_.assign(n*2, 0.0f);
+	if(dictSize)
+	{
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(dynamic, 16) if(n*dictSize > 16384)
+#endif
+		for(int i=0; i<n; ++i)
+		{
+			const unsigned char * q = query.ptr<unsigned char>(i);
+			int * best = &knnIndices_[i*2];
+			float * bestDist = &knnDists_[i*2];
+			for(int j=0; j<dictSize; ++j)
+			{
+				insertBest(descriptorDistance(q, words.ptr<unsigned char>(wordRows_[j]), binary, cols), j, best, bestDist);
+			}
+		}
+	}
+
+	// Words created from previous descriptors depend on the
+	// results of the previous ones, so this is done in order.
+	for(int i=0; i<n; ++i)
+	{
+		int bestIds[2] = {-1, -1};
+		float bestDist[2] = {0.0f, 0.0f};
+		for(int j=0; j<2 && knnIndices_[i*2+j] >= 0; ++j)
+		{
+			bestIds[j] = wordIds_[knnIndices_[i*2+j]];
+			bestDist[j] = knnDists_[i*2+j];
+		}
+
+		if(newWordsComparedTogether && newRows_.size())
+		{
+			const unsigned char * q = query.ptr<unsigned char>(i);
+			int bestNew[2] = {-1, -1};
+			float bestNewDist[2] = {0.0f, 0.0f};
+			for(unsigned int j=0; j<newRows_.size(); ++j)
+			{
+				insertBest(descriptorDistance(q, query.ptr<unsigned char>(newRows_[j]), binary, cols), j, bestNew, bestNewDist);
+			}
+			// merged after the dictionary results
+			for(int j=0; j<2 && bestNew[j] >= 0; ++j)
+			{
+				insertBest(bestNewDist[j], queryIds[newRows_[bestNew[j]]], bestIds, bestDist);
+			}
+		}
+
+		if(bestIds[1] >= 0 && bestDist[0] <= nndr * bestDist[1])
+		{
+			queryIds[i] = bestIds[0];
+		}
+		else
+		{
+			queryIds[i] = ++lastId;
+			newRows_.push_back(i);
+		}
+	}
+}
+
+void VisualMatcher::setPoints(const std::vector<cv::Point2f> & points, float radius)
+{
+	UASSERT(radius > 0.0f);
+	points_ = points;
+	radius_ = radius;
+	gridCols_ = 0;
+	gridRows_ = 0;
+	pointCells_.assign(points_.size(), -1);
+	cellStart_.assign(1, 0);
+	cellPoints_.clear();
+
+	float maxX=0.0f, maxY=0.0f;
+	bool first = true;
+	for(unsigned int i=0; i<points_.size(); ++i)
+	{
+		const cv::Point2f & pt = points_[i];
+		if(uIsFinite(pt.x) && uIsFinite(pt.y))
+		{
+			if(first)
+			{
+				minX_ = maxX = pt.x;
+				minY_ = maxY = pt.y;
+				first = false;
+			}
+			else
+			{
+				minX_ = std::min(minX_, pt.x);
+				minY_ = std::min(minY_, pt.y);
+				maxX = std::max(maxX, pt.x);
+				maxY = std::max(maxY, pt.y);
+			}
+		}
+	}
+	if(first)
+	{
+		return;
+	}
+
+	// cells of radius size, bigger if points are very sparse
+	cellSize_ = radius_;
+	double maxCells = std::max(1024.0, 4.0*double(points_.size()));
+	while((double((maxX-minX_)/cellSize_)+1.0) * (double((maxY-minY_)/cellSize_)+1.0) > maxCells)
+	{
+		cellSize_ *= 2.0f;
+	}
+	gridCols_ = int((maxX-minX_)/cellSize_)+1;
+	gridRows_ = int((maxY-minY_)/cellSize_)+1;
+	int cells = gridCols_*gridRows_;
+
+	// count points per cell, then fill cells in points order
+	cellStart_.assign(cells+1, 0);
+	for(unsigned int i=0; i<points_.size(); ++i)
+	{
+		const cv::Point2f & pt = points_[i];
+		if(uIsFinite(pt.x) && uIsFinite(pt.y))
+		{
+			int x = std::min(cellCoord(pt.x, minX_, cellSize_, gridCols_), gridCols_-1);
+			int y = std::min(cellCoord(pt.y, minY_, cellSize_, gridRows_), gridRows_-1);
+			pointCells_[i] = x + y*gridCols_;
+			++cellStart_[pointCells_[i]+1];
+		}
+	}
+	for(int i=0; i<cells; ++i)
+	{
+		cellStart_[i+1] += cellStart_[i];
+	}
+	cellPoints_.resize(cellStart_[cells]);
+	for(unsigned int i=0; i<points_.size(); ++i)
+	{
+		if(pointCells_[i] >= 0)
+		{
+			cellPoints_[cellStart_[pointCells_[i]]++] = i;
+		}
+	}
+	// cellStart_[i] is now the end of cell i, shift back
+	for(int i=cells; i>0; --i)
+	{
+		cellStart_[i] = cellStart_[i-1];
+	}
+	cellStart_[0] = 0;
+}
+
+const std::vector<int> & VisualMatcher::radiusSearch(const cv::Point2f & pt)
+{
+	neighbors_.clear();
+	neighborIndices_.clear();
+	if(gridCols_ == 0 || !uIsFinite(pt.x) || !uIsFinite(pt.y))
+	{
+		return neighborIndices_;
+	}
+
+	int x0 = std::max(0, cellCoord(pt.x-radius_, minX_, cellSize_, gridCols_));
+	int x1 = std::min(gridCols_-1, cellCoord(pt.x+radius_, minX_, cellSize_, gridCols_));
+	int y0 = std::max(0, cellCoord(pt.y-radius_, minY_, cellSize_, gridRows_));
+	int y1 = std::min(gridRows_-1, cellCoord(pt.y+radius_, minY_, cellSize_, gridRows_));
+	float radiusSqr = radius_*radius_;
+	for(int y=y0; y<=y1; ++y)
+	{
+		for(int x=x0; x<=x1; ++x)
+		{
+			int cell = x + y*gridCols_;
+			for(int k=cellStart_[cell]; k<cellStart_[cell+1]; ++k)
+			{
+				const cv::Point2f & p = points_[cellPoints_[k]];
+				float dx = p.x - pt.x;
+				float dy = p.y - pt.y;
+				float d = dx*dx + dy*dy;
+				if(d < radiusSqr)
+				{
+					neighbors_.push_back(std::make_pair(d, cellPoints_[k]));
+				}
+			}
+		}
+	}
+	std::sort(neighbors_.begin(), neighbors_.end());
+	neighborIndices_.resize(neighbors_.size());
+	for(unsigned int i=0; i<neighbors_.size(); ++i)
+	{
+		neighborIndices_[i] = neighbors_[i].second;
+	}
+	return neighborIndices_;
+}
+
+int VisualMatcher::matchNNDR(
+		const cv::Mat & query,
+		const cv::Mat & descriptors,
+		const std::vector<int> & candidates,
+		float nndr) const
+{
+	UASSERT(query.rows == 1);
+	UASSERT(query.type() == descriptors.type() && query.cols == descriptors.cols);
+	UASSERT(query.type() == CV_8UC1 || query.type() == CV_32FC1);
+	if(candidates.size() < 2)
+	{
+		return candidates.size()?0:-1;
+	}
+
+	const bool binary = query.type() == CV_8UC1;
+	const unsigned char * q = query.ptr<unsigned char>(0);
+	int best[2] = {-1, -1};
+	float bestDist[2] = {0.0f, 0.0f};
+	for(unsigned int i=0; i<candidates.size(); ++i)
+	{
+		insertBest(descriptorDistance(q, descriptors.ptr<unsigned char>(candidates[i]), binary, query.cols), i, best, bestDist);
+	}
+	return bestDist[0] < nndr * bestDist[1]?best[0]:-1;
+}
+
+} /* namespace rtabmap */
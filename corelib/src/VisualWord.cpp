@@ -35,6 +35,7 @@ namespace rtabmap
 VisualWord::VisualWord(int id, const cv::Mat & descriptor, int signatureId) :
 	_id(id),
 	_descriptor(descriptor),
+	_descriptorIndex(-1),
 	_saved(false),
 	_totalReferences(0)
 {
@@ -48,6 +48,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <gtsam/nonlinear/DoglegOptimizer.h>
 #include <gtsam/nonlinear/LevenbergMarquardtOptimizer.h>
 #include <gtsam/nonlinear/NonlinearOptimizer.h>
+#include <gtsam/nonlinear/ISAM2.h>
 #include <gtsam/nonlinear/Marginals.h>
 #include <gtsam/nonlinear/Values.h>
 #include "gtsam/GravityFactor.h"
@@ -64,405 +65,588 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace rtabmap {
 
-bool OptimizerGTSAM::available()
-{
 #ifdef RTABMAP_GTSAM
-	return true;
-#else
-	return false;
-#endif
-}
+namespace {
 
-void OptimizerGTSAM::parseParameters(const ParametersMap & parameters)
+// detect if there is a global pose prior set, if so remove rootId
+void checkPriors(
+		const OptimizerGTSAM & opt,
+		const std::multimap<int, Link> & edgeConstraints,
+		int & rootId,
+		bool & gpsPriorOnly)
 {
-	Optimizer::parseParameters(parameters);
-	Parameters::parse(parameters, Parameters::kGTSAMOptimizer(), optimizer_);
+	gpsPriorOnly = false;
+	if(!opt.priorsIgnored())
+	{
+		for(std::multimap<int, Link>::const_iterator iter=edgeConstraints.begin(); iter!=edgeConstraints.end(); ++iter)
+		{
+			if(iter->second.from() == iter->second.to() && iter->second.type() == Link::kPosePrior)
+			{
+				if ((opt.isSlam2d() && 1 / static_cast<double>(iter->second.infMatrix().at<double>(5,5)) < 9999) ||
+					(1 / static_cast<double>(iter->second.infMatrix().at<double>(3,3)) < 9999.0 &&
+					 1 / static_cast<double>(iter->second.infMatrix().at<double>(4,4)) < 9999.0 &&
+					 1 / static_cast<double>(iter->second.infMatrix().at<double>(5,5)) < 9999.0))
+				{
+					// orientation is set, don't set root prior
+					gpsPriorOnly = false;
+					rootId = 0;
+					break;
+				}
+				else if(opt.gravitySigma()<=0)
+				{
+					gpsPriorOnly = true;
+				}
+			}
+		}
+	}
 }
 
-std::map<int, Transform> OptimizerGTSAM::optimize(
+//prior first pose
+void addRootPrior(
+		const OptimizerGTSAM & opt,
 		int rootId,
+		bool gpsPriorOnly,
 		const std::map<int, Transform> & poses,
-		const std::multimap<int, Link> & edgeConstraints,
-		cv::Mat & outputCovariance,
-		std::list<std::map<int, Transform> > * intermediateGraphes,
-		double * finalError,
-		int * iterationsDone)
+		gtsam::NonlinearFactorGraph & graph)
 {
-	outputCovariance = cv::Mat::eye(6,6,CV_64FC1);
-	std::map<int, Transform> optimizedPoses;
-#ifdef RTABMAP_GTSAM
-
-#ifndef RTABMAP_VERTIGO
-	if(this->isRobust())
+	if(rootId != 0)
 	{
-		UWARN("Vertigo robust optimization is not available! Robust optimization is now disabled.");
-		setRobust(false);
+		UASSERT(uContains(poses, rootId));
+		const Transform & initialPose = poses.at(rootId);
+		if(opt.isSlam2d())
+		{
+			gtsam::noiseModel::Diagonal::shared_ptr priorNoise = gtsam::noiseModel::Diagonal::Variances(gtsam::Vector3(0.01, 0.01, 0.01));
+			graph.add(gtsam::PriorFactor<gtsam::Pose2>(rootId, gtsam::Pose2(initialPose.x(), initialPose.y(), initialPose.theta()), priorNoise));
+		}
+		else
+		{
+			gtsam::noiseModel::Diagonal::shared_ptr priorNoise = gtsam::noiseModel::Diagonal::Variances(
+					(gtsam::Vector(6) <<
+							(gpsPriorOnly?2:1e-2), gpsPriorOnly?2:1e-2, gpsPriorOnly?2:1e-2,
+							1e-2, 1e-2, 1e-2
+							).finished());
+			graph.add(gtsam::PriorFactor<gtsam::Pose3>(rootId, gtsam::Pose3(initialPose.toEigen4d()), priorNoise));
+		}
 	}
-#endif
+}
 
-	UDEBUG("Optimizing graph...");
-	if(edgeConstraints.size()>=1 && poses.size()>=2 && iterations() > 0)
+void addPoses(
+		const OptimizerGTSAM & opt,
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & edgeConstraints,
+		gtsam::Values & initialEstimate,
+		std::map<int, bool> & isLandmarkWithRotation)
+{
+	for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
 	{
-		gtsam::NonlinearFactorGraph graph;
-
-		// detect if there is a global pose prior set, if so remove rootId
-		bool gpsPriorOnly = false;
-		if(!priorsIgnored())
+		UASSERT(!iter->second.isNull());
+		if(opt.isSlam2d())
 		{
-			for(std::multimap<int, Link>::const_iterator iter=edgeConstraints.begin(); iter!=edgeConstraints.end(); ++iter)
+			if(iter->first > 0)
 			{
-				if(iter->second.from() == iter->second.to() && iter->second.type() == Link::kPosePrior)
+				initialEstimate.insert(iter->first, gtsam::Pose2(iter->second.x(), iter->second.y(), iter->second.theta()));
+			}
+			else if(!opt.landmarksIgnored())
+			{
+				// check if it is SE2 or only PointXY
+				std::multimap<int, Link>::const_iterator jter=edgeConstraints.find(iter->first);
+				UASSERT_MSG(jter != edgeConstraints.end(), uFormat("Not found landmark %d in edges!", iter->first).c_str());
+
+				if (1 / static_cast<double>(jter->second.infMatrix().at<double>(5,5)) >= 9999.0)
 				{
-					if ((isSlam2d() && 1 / static_cast<double>(iter->second.infMatrix().at<double>(5,5)) < 9999) ||
-						(1 / static_cast<double>(iter->second.infMatrix().at<double>(3,3)) < 9999.0 &&
-						 1 / static_cast<double>(iter->second.infMatrix().at<double>(4,4)) < 9999.0 &&
-						 1 / static_cast<double>(iter->second.infMatrix().at<double>(5,5)) < 9999.0))
-					{
-						// orientation is set, don't set root prior
-						gpsPriorOnly = false;
-						rootId = 0;
-						break;
-					}
-					else if(gravitySigma()<=0)
-					{
-						gpsPriorOnly = true;
-					}
+					initialEstimate.insert(iter->first, gtsam::Point2(iter->second.x(), iter->second.y()));
+					isLandmarkWithRotation.insert(std::make_pair(iter->first, false));
+				}
+				else
+				{
+					initialEstimate.insert(iter->first, gtsam::Pose2(iter->second.x(), iter->second.y(), iter->second.theta()));
+					isLandmarkWithRotation.insert(std::make_pair(iter->first, true));
 				}
 			}
-		}
 
-		//prior first pose
-		if(rootId != 0)
+		}
+		else
 		{
-			UASSERT(uContains(poses, rootId));
-			const Transform & initialPose = poses.at(rootId);
-			if(isSlam2d())
+			if(iter->first > 0)
 			{
-				gtsam::noiseModel::Diagonal::shared_ptr priorNoise = gtsam::noiseModel::Diagonal::Variances(gtsam::Vector3(0.01, 0.01, 0.01));
-				graph.add(gtsam::PriorFactor<gtsam::Pose2>(rootId, gtsam::Pose2(initialPose.x(), initialPose.y(), initialPose.theta()), priorNoise));
+				initialEstimate.insert(iter->first, gtsam::Pose3(iter->second.toEigen4d()));
 			}
-			else
+			else if(!opt.landmarksIgnored())
 			{
-				gtsam::noiseModel::Diagonal::shared_ptr priorNoise = gtsam::noiseModel::Diagonal::Variances(
-						(gtsam::Vector(6) <<
-								(gpsPriorOnly?2:1e-2), gpsPriorOnly?2:1e-2, gpsPriorOnly?2:1e-2,
-								1e-2, 1e-2, 1e-2
-								).finished());
-				graph.add(gtsam::PriorFactor<gtsam::Pose3>(rootId, gtsam::Pose3(initialPose.toEigen4d()), priorNoise));
+				// check if it is SE3 or only PointXYZ
+				std::multimap<int, Link>::const_iterator jter=edgeConstraints.find(iter->first);
+				UASSERT_MSG(jter != edgeConstraints.end(), uFormat("Not found landmark %d in edges!", iter->first).c_str());
+
+				if (1 / static_cast<double>(jter->second.infMatrix().at<double>(3,3)) >= 9999.0 ||
+					1 / static_cast<double>(jter->second.infMatrix().at<double>(4,4)) >= 9999.0 ||
+					1 / static_cast<double>(jter->second.infMatrix().at<double>(5,5)) >= 9999.0)
+				{
+					initialEstimate.insert(iter->first, gtsam::Point3(iter->second.x(), iter->second.y(), iter->second.z()));
+					isLandmarkWithRotation.insert(std::make_pair(iter->first, false));
+				}
+				else
+				{
+					initialEstimate.insert(iter->first, gtsam::Pose3(iter->second.toEigen4d()));
+					isLandmarkWithRotation.insert(std::make_pair(iter->first, true));
+				}
 			}
 		}
+	}
+}
 
-		UDEBUG("fill poses to gtsam... rootId=%d", rootId);
-		gtsam::Values initialEstimate;
-		std::map<int, bool> isLandmarkWithRotation;
-		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+void addFactors(
+		const OptimizerGTSAM & opt,
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & edgeConstraints,
+		const std::map<int, bool> & isLandmarkWithRotation,
+		gtsam::NonlinearFactorGraph & graph,
+		gtsam::Values & initialEstimate,
+		int & switchCounter,
+		std::vector<const Link *> * factorLinks = 0) // link of each factor of the graph, 0 for other factors
+{
+	for(std::multimap<int, Link>::const_iterator iter=edgeConstraints.begin(); iter!=edgeConstraints.end(); ++iter)
+	{
+		size_t graphSize = graph.size();
+		int id1 = iter->second.from();
+		int id2 = iter->second.to();
+		UASSERT(!iter->second.transform().isNull());
+		if(id1 == id2)
 		{
-			UASSERT(!iter->second.isNull());
-			if(isSlam2d())
+			if(iter->second.type() == Link::kPosePrior && !opt.priorsIgnored())
 			{
-				if(iter->first > 0)
-				{
-					initialEstimate.insert(iter->first, gtsam::Pose2(iter->second.x(), iter->second.y(), iter->second.theta()));
-				}
-				else if(!landmarksIgnored())
+				if(opt.isSlam2d())
 				{
-					// check if it is SE2 or only PointXY
-					std::multimap<int, Link>::const_iterator jter=edgeConstraints.find(iter->first);
-					UASSERT_MSG(jter != edgeConstraints.end(), uFormat("Not found landmark %d in edges!", iter->first).c_str());
-
-					if (1 / static_cast<double>(jter->second.infMatrix().at<double>(5,5)) >= 9999.0)
+					if (1 / static_cast<double>(iter->second.infMatrix().at<double>(5,5)) >= 9999.0)
 					{
-						initialEstimate.insert(iter->first, gtsam::Point2(iter->second.x(), iter->second.y()));
-						isLandmarkWithRotation.insert(std::make_pair(iter->first, false));
+						noiseModel::Diagonal::shared_ptr model = noiseModel::Diagonal::Variances(Vector2(
+								1/iter->second.infMatrix().at<double>(0,0),
+								1/iter->second.infMatrix().at<double>(1,1)));
+						graph.add(GPSPose2XYFactor(id1, gtsam::Point2(iter->second.transform().x(), iter->second.transform().y()), model));
 					}
 					else
 					{
-						initialEstimate.insert(iter->first, gtsam::Pose2(iter->second.x(), iter->second.y(), iter->second.theta()));
-						isLandmarkWithRotation.insert(std::make_pair(iter->first, true));
-					}
-				}
+						Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
+						if(!opt.isCovarianceIgnored())
+						{
+							information(0,0) = iter->second.infMatrix().at<double>(0,0); // x-x
+							information(0,1) = iter->second.infMatrix().at<double>(0,1); // x-y
+							information(0,2) = iter->second.infMatrix().at<double>(0,5); // x-theta
+							information(1,0) = iter->second.infMatrix().at<double>(1,0); // y-x
+							information(1,1) = iter->second.infMatrix().at<double>(1,1); // y-y
+							information(1,2) = iter->second.infMatrix().at<double>(1,5); // y-theta
+							information(2,0) = iter->second.infMatrix().at<double>(5,0); // theta-x
+							information(2,1) = iter->second.infMatrix().at<double>(5,1); // theta-y
+							information(2,2) = iter->second.infMatrix().at<double>(5,5); // theta-theta
+						}
 
-			}
-			else
-			{
-				if(iter->first > 0)
-				{
-					initialEstimate.insert(iter->first, gtsam::Pose3(iter->second.toEigen4d()));
+						gtsam::noiseModel::Gaussian::shared_ptr model = gtsam::noiseModel::Gaussian::Information(information);
+						graph.add(gtsam::PriorFactor<gtsam::Pose2>(id1, gtsam::Pose2(iter->second.transform().x(), iter->second.transform().y(), iter->second.transform().theta()), model));
+					}
 				}
-				else if(!landmarksIgnored())
+				else
 				{
-					// check if it is SE3 or only PointXYZ
-					std::multimap<int, Link>::const_iterator jter=edgeConstraints.find(iter->first);
-					UASSERT_MSG(jter != edgeConstraints.end(), uFormat("Not found landmark %d in edges!", iter->first).c_str());
-
-					if (1 / static_cast<double>(jter->second.infMatrix().at<double>(3,3)) >= 9999.0 ||
-						1 / static_cast<double>(jter->second.infMatrix().at<double>(4,4)) >= 9999.0 ||
-						1 / static_cast<double>(jter->second.infMatrix().at<double>(5,5)) >= 9999.0)
+					if (1 / static_cast<double>(iter->second.infMatrix().at<double>(3,3)) >= 9999.0 ||
+						1 / static_cast<double>(iter->second.infMatrix().at<double>(4,4)) >= 9999.0 ||
+						1 / static_cast<double>(iter->second.infMatrix().at<double>(5,5)) >= 9999.0)
 					{
-						initialEstimate.insert(iter->first, gtsam::Point3(iter->second.x(), iter->second.y(), iter->second.z()));
-						isLandmarkWithRotation.insert(std::make_pair(iter->first, false));
+						noiseModel::Diagonal::shared_ptr model = noiseModel::Diagonal::Precisions(Vector3(
+									iter->second.infMatrix().at<double>(0,0),
+									iter->second.infMatrix().at<double>(1,1),
+									iter->second.infMatrix().at<double>(2,2)));
+						graph.add(GPSPose3XYZFactor(id1, gtsam::Point3(iter->second.transform().x(), iter->second.transform().y(), iter->second.transform().z()), model));
 					}
 					else
 					{
-						initialEstimate.insert(iter->first, gtsam::Pose3(iter->second.toEigen4d()));
-						isLandmarkWithRotation.insert(std::make_pair(iter->first, true));
+						Eigen::Matrix<double, 6, 6> information = Eigen::Matrix<double, 6, 6>::Identity();
+						if(!opt.isCovarianceIgnored())
+						{
+							memcpy(information.data(), iter->second.infMatrix().data, iter->second.infMatrix().total()*sizeof(double));
+						}
+
+						Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
+						mgtsam.block(0,0,3,3) = information.block(3,3,3,3); // cov rotation
+						mgtsam.block(3,3,3,3) = information.block(0,0,3,3); // cov translation
+						mgtsam.block(0,3,3,3) = information.block(0,3,3,3); // off diagonal
+						mgtsam.block(3,0,3,3) = information.block(3,0,3,3); // off diagonal
+						gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(mgtsam);
+
+						graph.add(gtsam::PriorFactor<gtsam::Pose3>(id1, gtsam::Pose3(iter->second.transform().toEigen4d()), model));
 					}
 				}
 			}
+			else if(!opt.isSlam2d() && opt.gravitySigma() > 0 && iter->second.type() == Link::kGravity && poses.find(iter->first) != poses.end())
+			{
+				Vector3 r = gtsam::Pose3(iter->second.transform().toEigen4d()).rotation().xyz();
+				gtsam::Unit3 nG = gtsam::Rot3::RzRyRx(r.x(), r.y(), 0).rotate(gtsam::Unit3(0,0,-1));
+				gtsam::SharedNoiseModel model = gtsam::noiseModel::Isotropic::Sigmas(gtsam::Vector2(opt.gravitySigma(), 10));
+				graph.add(Pose3GravityFactor(iter->first, nG, model, Unit3(0,0,1)));
+			}
 		}
-
-		UDEBUG("fill edges to gtsam...");
-		int switchCounter = poses.rbegin()->first+1;
-		for(std::multimap<int, Link>::const_iterator iter=edgeConstraints.begin(); iter!=edgeConstraints.end(); ++iter)
+		else if(id1<0 || id2 < 0)
 		{
-			int id1 = iter->second.from();
-			int id2 = iter->second.to();
-			UASSERT(!iter->second.transform().isNull());
-			if(id1 == id2)
+			if(!opt.landmarksIgnored())
 			{
-				if(iter->second.type() == Link::kPosePrior && !priorsIgnored())
+				//landmarks
+				UASSERT((id1 < 0 && id2 > 0) || (id1 > 0 && id2 < 0));
+				Transform t;
+				if(id2 < 0)
+				{
+					t = iter->second.transform();
+				}
+				else
 				{
-					if(isSlam2d())
+					t = iter->second.transform().inverse();
+					std::swap(id1, id2); // should be node -> landmark
+				}
+				if(opt.isSlam2d())
+				{
+					if(isLandmarkWithRotation.at(id2))
 					{
-						if (1 / static_cast<double>(iter->second.infMatrix().at<double>(5,5)) >= 9999.0)
-						{
-							noiseModel::Diagonal::shared_ptr model = noiseModel::Diagonal::Variances(Vector2(
-									1/iter->second.infMatrix().at<double>(0,0),
-									1/iter->second.infMatrix().at<double>(1,1)));
-							graph.add(GPSPose2XYFactor(id1, gtsam::Point2(iter->second.transform().x(), iter->second.transform().y()), model));
-						}
-						else
+						Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
+						if(!opt.isCovarianceIgnored())
 						{
-							Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
-							if(!isCovarianceIgnored())
-							{
-								information(0,0) = iter->second.infMatrix().at<double>(0,0); // x-x
-								information(0,1) = iter->second.infMatrix().at<double>(0,1); // x-y
-								information(0,2) = iter->second.infMatrix().at<double>(0,5); // x-theta
-								information(1,0) = iter->second.infMatrix().at<double>(1,0); // y-x
-								information(1,1) = iter->second.infMatrix().at<double>(1,1); // y-y
-								information(1,2) = iter->second.infMatrix().at<double>(1,5); // y-theta
-								information(2,0) = iter->second.infMatrix().at<double>(5,0); // theta-x
-								information(2,1) = iter->second.infMatrix().at<double>(5,1); // theta-y
-								information(2,2) = iter->second.infMatrix().at<double>(5,5); // theta-theta
-							}
-
-							gtsam::noiseModel::Gaussian::shared_ptr model = gtsam::noiseModel::Gaussian::Information(information);
-							graph.add(gtsam::PriorFactor<gtsam::Pose2>(id1, gtsam::Pose2(iter->second.transform().x(), iter->second.transform().y(), iter->second.transform().theta()), model));
+							information(0,0) = iter->second.infMatrix().at<double>(0,0); // x-x
+							information(0,1) = iter->second.infMatrix().at<double>(0,1); // x-y
+							information(0,2) = iter->second.infMatrix().at<double>(0,5); // x-theta
+							information(1,0) = iter->second.infMatrix().at<double>(1,0); // y-x
+							information(1,1) = iter->second.infMatrix().at<double>(1,1); // y-y
+							information(1,2) = iter->second.infMatrix().at<double>(1,5); // y-theta
+							information(2,0) = iter->second.infMatrix().at<double>(5,0); // theta-x
+							information(2,1) = iter->second.infMatrix().at<double>(5,1); // theta-y
+							information(2,2) = iter->second.infMatrix().at<double>(5,5); // theta-theta
 						}
+						gtsam::noiseModel::Gaussian::shared_ptr model = gtsam::noiseModel::Gaussian::Information(information);
+						graph.add(gtsam::BetweenFactor<gtsam::Pose2>(id1, id2, gtsam::Pose2(t.x(), t.y(), t.theta()), model));
 					}
 					else
 					{
-						if (1 / static_cast<double>(iter->second.infMatrix().at<double>(3,3)) >= 9999.0 ||
-							1 / static_cast<double>(iter->second.infMatrix().at<double>(4,4)) >= 9999.0 ||
-							1 / static_cast<double>(iter->second.infMatrix().at<double>(5,5)) >= 9999.0)
+						Eigen::Matrix<double, 2, 2> information = Eigen::Matrix<double, 2, 2>::Identity();
+						if(!opt.isCovarianceIgnored())
 						{
-							noiseModel::Diagonal::shared_ptr model = noiseModel::Diagonal::Precisions(Vector3(
-										iter->second.infMatrix().at<double>(0,0),
-										iter->second.infMatrix().at<double>(1,1),
-										iter->second.infMatrix().at<double>(2,2)));
-							graph.add(GPSPose3XYZFactor(id1, gtsam::Point3(iter->second.transform().x(), iter->second.transform().y(), iter->second.transform().z()), model));
-						}
-						else
-						{
-							Eigen::Matrix<double, 6, 6> information = Eigen::Matrix<double, 6, 6>::Identity();
-							if(!isCovarianceIgnored())
-							{
-								memcpy(information.data(), iter->second.infMatrix().data, iter->second.infMatrix().total()*sizeof(double));
-							}
-
-							Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
-							mgtsam.block(0,0,3,3) = information.block(3,3,3,3); // cov rotation
-							mgtsam.block(3,3,3,3) = information.block(0,0,3,3); // cov translation
-							mgtsam.block(0,3,3,3) = information.block(0,3,3,3); // off diagonal
-							mgtsam.block(3,0,3,3) = information.block(3,0,3,3); // off diagonal
-							gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(mgtsam);
-
-							graph.add(gtsam::PriorFactor<gtsam::Pose3>(id1, gtsam::Pose3(iter->second.transform().toEigen4d()), model));
+							cv::Mat linearCov = cv::Mat(iter->second.infMatrix(), cv::Range(0,2), cv::Range(0,2)).clone();;
+							memcpy(information.data(), linearCov.data, linearCov.total()*sizeof(double));
 						}
+						gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(information);
+
+						gtsam::Point2 landmark(t.x(), t.y());
+						gtsam::Pose2 p;
+						graph.add(gtsam::BearingRangeFactor<gtsam::Pose2, gtsam::Point2>(id1, id2, p.bearing(landmark), p.range(landmark), model));
 					}
 				}
-				else if(!isSlam2d() && gravitySigma() > 0 && iter->second.type() == Link::kGravity && poses.find(iter->first) != poses.end())
-				{
-					Vector3 r = gtsam::Pose3(iter->second.transform().toEigen4d()).rotation().xyz();
-					gtsam::Unit3 nG = gtsam::Rot3::RzRyRx(r.x(), r.y(), 0).rotate(gtsam::Unit3(0,0,-1));
-					gtsam::SharedNoiseModel model = gtsam::noiseModel::Isotropic::Sigmas(gtsam::Vector2(gravitySigma(), 10));
-					graph.add(Pose3GravityFactor(iter->first, nG, model, Unit3(0,0,1)));
-				}
-			}
-			else if(id1<0 || id2 < 0)
-			{
-				if(!landmarksIgnored())
+				else
 				{
-					//landmarks
-					UASSERT((id1 < 0 && id2 > 0) || (id1 > 0 && id2 < 0));
-					Transform t;
-					if(id2 < 0)
-					{
-						t = iter->second.transform();
-					}
-					else
-					{
-						t = iter->second.transform().inverse();
-						std::swap(id1, id2); // should be node -> landmark
-					}
-					if(isSlam2d())
+					if(isLandmarkWithRotation.at(id2))
 					{
-						if(isLandmarkWithRotation.at(id2))
+						Eigen::Matrix<double, 6, 6> information = Eigen::Matrix<double, 6, 6>::Identity();
+						if(!opt.isCovarianceIgnored())
 						{
-							Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
-							if(!isCovarianceIgnored())
-							{
-								information(0,0) = iter->second.infMatrix().at<double>(0,0); // x-x
-								information(0,1) = iter->second.infMatrix().at<double>(0,1); // x-y
-								information(0,2) = iter->second.infMatrix().at<double>(0,5); // x-theta
-								information(1,0) = iter->second.infMatrix().at<double>(1,0); // y-x
-								information(1,1) = iter->second.infMatrix().at<double>(1,1); // y-y
-								information(1,2) = iter->second.infMatrix().at<double>(1,5); // y-theta
-								information(2,0) = iter->second.infMatrix().at<double>(5,0); // theta-x
-								information(2,1) = iter->second.infMatrix().at<double>(5,1); // theta-y
-								information(2,2) = iter->second.infMatrix().at<double>(5,5); // theta-theta
-							}
-							gtsam::noiseModel::Gaussian::shared_ptr model = gtsam::noiseModel::Gaussian::Information(information);
-							graph.add(gtsam::BetweenFactor<gtsam::Pose2>(id1, id2, gtsam::Pose2(t.x(), t.y(), t.theta()), model));
-						}
-						else
-						{
-							Eigen::Matrix<double, 2, 2> information = Eigen::Matrix<double, 2, 2>::Identity();
-							if(!isCovarianceIgnored())
-							{
-								cv::Mat linearCov = cv::Mat(iter->second.infMatrix(), cv::Range(0,2), cv::Range(0,2)).clone();;
-								memcpy(information.data(), linearCov.data, linearCov.total()*sizeof(double));
-							}
-							gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(information);
-
-							gtsam::Point2 landmark(t.x(), t.y());
-							gtsam::Pose2 p;
-							graph.add(gtsam::BearingRangeFactor<gtsam::Pose2, gtsam::Point2>(id1, id2, p.bearing(landmark), p.range(landmark), model));
+							memcpy(information.data(), iter->second.infMatrix().data, iter->second.infMatrix().total()*sizeof(double));
 						}
+
+						Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
+						mgtsam.block(0,0,3,3) = information.block(3,3,3,3); // cov rotation
+						mgtsam.block(3,3,3,3) = information.block(0,0,3,3); // cov translation
+						mgtsam.block(0,3,3,3) = information.block(0,3,3,3); // off diagonal
+						mgtsam.block(3,0,3,3) = information.block(3,0,3,3); // off diagonal
+						gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(mgtsam);
+						graph.add(gtsam::BetweenFactor<gtsam::Pose3>(id1, id2, gtsam::Pose3(t.toEigen4d()), model));
 					}
 					else
 					{
-						if(isLandmarkWithRotation.at(id2))
-						{
-							Eigen::Matrix<double, 6, 6> information = Eigen::Matrix<double, 6, 6>::Identity();
-							if(!isCovarianceIgnored())
-							{
-								memcpy(information.data(), iter->second.infMatrix().data, iter->second.infMatrix().total()*sizeof(double));
-							}
-
-							Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
-							mgtsam.block(0,0,3,3) = information.block(3,3,3,3); // cov rotation
-							mgtsam.block(3,3,3,3) = information.block(0,0,3,3); // cov translation
-							mgtsam.block(0,3,3,3) = information.block(0,3,3,3); // off diagonal
-							mgtsam.block(3,0,3,3) = information.block(3,0,3,3); // off diagonal
-							gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(mgtsam);
-							graph.add(gtsam::BetweenFactor<gtsam::Pose3>(id1, id2, gtsam::Pose3(t.toEigen4d()), model));
-						}
-						else
+						Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
+						if(!opt.isCovarianceIgnored())
 						{
-							Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
-							if(!isCovarianceIgnored())
-							{
-								cv::Mat linearCov = cv::Mat(iter->second.infMatrix(), cv::Range(0,3), cv::Range(0,3)).clone();;
-								memcpy(information.data(), linearCov.data, linearCov.total()*sizeof(double));
-							}
-							gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(information);
-
-							gtsam::Point3 landmark(t.x(), t.y(), t.z());
-							gtsam::Pose3 p;
-							graph.add(gtsam::BearingRangeFactor<gtsam::Pose3, gtsam::Point3>(id1, id2, p.bearing(landmark), p.range(landmark), model));
+							cv::Mat linearCov = cv::Mat(iter->second.infMatrix(), cv::Range(0,3), cv::Range(0,3)).clone();;
+							memcpy(information.data(), linearCov.data, linearCov.total()*sizeof(double));
 						}
+						gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(information);
+
+						gtsam::Point3 landmark(t.x(), t.y(), t.z());
+						gtsam::Pose3 p;
+						graph.add(gtsam::BearingRangeFactor<gtsam::Pose3, gtsam::Point3>(id1, id2, p.bearing(landmark), p.range(landmark), model));
 					}
 				}
 			}
-			else // id1 != id2
+		}
+		else // id1 != id2
+		{
+#ifdef RTABMAP_VERTIGO
+			if(opt.isRobust() &&
+			   iter->second.type() != Link::kNeighbor &&
+			   iter->second.type() != Link::kNeighborMerged)
+			{
+				// create new switch variable
+				// Sunderhauf IROS 2012:
+				// "Since it is reasonable to initially accept all loop closure constraints,
+				//  a proper and convenient initial value for all switch variables would be
+				//  sij = 1 when using the linear switch function"
+				double prior = 1.0;
+				initialEstimate.insert(gtsam::Symbol('s',switchCounter), vertigo::SwitchVariableLinear(prior));
+
+				// create switch prior factor
+				// "If the front-end is not able to assign sound individual values
+				//  for Ξij , it is save to set all Ξij = 1, since this value is close
+				//  to the individual optimal choice of Ξij for a large range of
+				//  outliers."
+				gtsam::noiseModel::Diagonal::shared_ptr switchPriorModel = gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector1(1.0));
+				graph.add(gtsam::PriorFactor<vertigo::SwitchVariableLinear> (gtsam::Symbol('s',switchCounter), vertigo::SwitchVariableLinear(prior), switchPriorModel));
+			}
+#endif
+
+			if(opt.isSlam2d())
 			{
+				Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
+				if(!opt.isCovarianceIgnored())
+				{
+					information(0,0) = iter->second.infMatrix().at<double>(0,0); // x-x
+					information(0,1) = iter->second.infMatrix().at<double>(0,1); // x-y
+					information(0,2) = iter->second.infMatrix().at<double>(0,5); // x-theta
+					information(1,0) = iter->second.infMatrix().at<double>(1,0); // y-x
+					information(1,1) = iter->second.infMatrix().at<double>(1,1); // y-y
+					information(1,2) = iter->second.infMatrix().at<double>(1,5); // y-theta
+					information(2,0) = iter->second.infMatrix().at<double>(5,0); // theta-x
+					information(2,1) = iter->second.infMatrix().at<double>(5,1); // theta-y
+					information(2,2) = iter->second.infMatrix().at<double>(5,5); // theta-theta
+				}
+				gtsam::noiseModel::Gaussian::shared_ptr model = gtsam::noiseModel::Gaussian::Information(information);
+
 #ifdef RTABMAP_VERTIGO
-				if(this->isRobust() &&
-				   iter->second.type() != Link::kNeighbor &&
+				if(opt.isRobust() &&
+				   iter->second.type()!=Link::kNeighbor &&
 				   iter->second.type() != Link::kNeighborMerged)
 				{
-					// create new switch variable
-					// Sunderhauf IROS 2012:
-					// "Since it is reasonable to initially accept all loop closure constraints,
-					//  a proper and convenient initial value for all switch variables would be
-					//  sij = 1 when using the linear switch function"
-					double prior = 1.0;
-					initialEstimate.insert(gtsam::Symbol('s',switchCounter), vertigo::SwitchVariableLinear(prior));
-
-					// create switch prior factor
-					// "If the front-end is not able to assign sound individual values
-					//  for Ξij , it is save to set all Ξij = 1, since this value is close
-					//  to the individual optimal choice of Ξij for a large range of
-					//  outliers."
-					gtsam::noiseModel::Diagonal::shared_ptr switchPriorModel = gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector1(1.0));
-					graph.add(gtsam::PriorFactor<vertigo::SwitchVariableLinear> (gtsam::Symbol('s',switchCounter), vertigo::SwitchVariableLinear(prior), switchPriorModel));
+					// create switchable edge factor
+					graph.add(vertigo::BetweenFactorSwitchableLinear<gtsam::Pose2>(id1, id2, gtsam::Symbol('s', switchCounter++), gtsam::Pose2(iter->second.transform().x(), iter->second.transform().y(), iter->second.transform().theta()), model));
 				}
+				else
 #endif
-
-				if(isSlam2d())
 				{
-					Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
-					if(!isCovarianceIgnored())
-					{
-						information(0,0) = iter->second.infMatrix().at<double>(0,0); // x-x
-						information(0,1) = iter->second.infMatrix().at<double>(0,1); // x-y
-						information(0,2) = iter->second.infMatrix().at<double>(0,5); // x-theta
-						information(1,0) = iter->second.infMatrix().at<double>(1,0); // y-x
-						information(1,1) = iter->second.infMatrix().at<double>(1,1); // y-y
-						information(1,2) = iter->second.infMatrix().at<double>(1,5); // y-theta
-						information(2,0) = iter->second.infMatrix().at<double>(5,0); // theta-x
-						information(2,1) = iter->second.infMatrix().at<double>(5,1); // theta-y
-						information(2,2) = iter->second.infMatrix().at<double>(5,5); // theta-theta
-					}
-					gtsam::noiseModel::Gaussian::shared_ptr model = gtsam::noiseModel::Gaussian::Information(information);
+					graph.add(gtsam::BetweenFactor<gtsam::Pose2>(id1, id2, gtsam::Pose2(iter->second.transform().x(), iter->second.transform().y(), iter->second.transform().theta()), model));
+				}
+			}
+			else
+			{
+				Eigen::Matrix<double, 6, 6> information = Eigen::Matrix<double, 6, 6>::Identity();
+				if(!opt.isCovarianceIgnored())
+				{
+					memcpy(information.data(), iter->second.infMatrix().data, iter->second.infMatrix().total()*sizeof(double));
+				}
+
+				Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
+				mgtsam.block(0,0,3,3) = information.block(3,3,3,3); // cov rotation
+				mgtsam.block(3,3,3,3) = information.block(0,0,3,3); // cov translation
+				mgtsam.block(0,3,3,3) = information.block(0,3,3,3); // off diagonal
+				mgtsam.block(3,0,3,3) = information.block(3,0,3,3); // off diagonal
+				gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(mgtsam);
 
 #ifdef RTABMAP_VERTIGO
-					if(this->isRobust() &&
-					   iter->second.type()!=Link::kNeighbor &&
-					   iter->second.type() != Link::kNeighborMerged)
+				if(opt.isRobust() &&
+				   iter->second.type() != Link::kNeighbor &&
+				   iter->second.type() != Link::kNeighborMerged)
+				{
+					// create switchable edge factor
+					graph.add(vertigo::BetweenFactorSwitchableLinear<gtsam::Pose3>(id1, id2, gtsam::Symbol('s', switchCounter++), gtsam::Pose3(iter->second.transform().toEigen4d()), model));
+				}
+				else
+#endif
+				{
+					graph.add(gtsam::BetweenFactor<gtsam::Pose3>(id1, id2, gtsam::Pose3(iter->second.transform().toEigen4d()), model));
+				}
+			}
+		}
+
+		if(factorLinks && graph.size() > graphSize)
+		{
+			// the factor of the link is the last one added (after its switch prior, if robust)
+			factorLinks->resize(graph.size(), 0);
+			factorLinks->back() = &iter->second;
+		}
+	}
+	if(factorLinks)
+	{
+		factorLinks->resize(graph.size(), 0);
+	}
+}
+
+std::map<int, Transform> valuesToPoses(
+		const OptimizerGTSAM & opt,
+		const gtsam::Values & values,
+		const std::map<int, Transform> & poses,
+		const std::map<int, bool> & isLandmarkWithRotation)
+{
+	std::map<int, Transform> optimizedPoses;
+	float x,y,z,roll,pitch,yaw;
+	for(gtsam::Values::const_iterator iter=values.begin(); iter!=values.end(); ++iter)
+	{
+		// ignore switch variables and poses removed from the graph (kept in iSAM2)
+		if(iter->value.dim() > 1 && poses.find((int)iter->key) != poses.end())
+		{
+			int key = (int)iter->key;
+			if(opt.isSlam2d())
+			{
+				if(key > 0)
+				{
+					gtsam::Pose2 p = iter->value.cast<gtsam::Pose2>();
+					optimizedPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), p.theta())));
+				}
+				else if(!opt.landmarksIgnored() && isLandmarkWithRotation.find(key)!=isLandmarkWithRotation.end())
+				{
+					if(isLandmarkWithRotation.at(key))
 					{
-						// create switchable edge factor
-						graph.add(vertigo::BetweenFactorSwitchableLinear<gtsam::Pose2>(id1, id2, gtsam::Symbol('s', switchCounter++), gtsam::Pose2(iter->second.transform().x(), iter->second.transform().y(), iter->second.transform().theta()), model));
+						poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+						gtsam::Pose2 p = iter->value.cast<gtsam::Pose2>();
+						optimizedPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), z, roll, pitch, p.theta())));
 					}
 					else
-#endif
 					{
-						graph.add(gtsam::BetweenFactor<gtsam::Pose2>(id1, id2, gtsam::Pose2(iter->second.transform().x(), iter->second.transform().y(), iter->second.transform().theta()), model));
+						poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+						gtsam::Point2 p = iter->value.cast<gtsam::Point2>();
+						optimizedPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), z,roll,pitch,yaw)));
 					}
 				}
-				else
+			}
+			else
+			{
+				if(key > 0)
 				{
-					Eigen::Matrix<double, 6, 6> information = Eigen::Matrix<double, 6, 6>::Identity();
-					if(!isCovarianceIgnored())
-					{
-						memcpy(information.data(), iter->second.infMatrix().data, iter->second.infMatrix().total()*sizeof(double));
-					}
-
-					Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
-					mgtsam.block(0,0,3,3) = information.block(3,3,3,3); // cov rotation
-					mgtsam.block(3,3,3,3) = information.block(0,0,3,3); // cov translation
-					mgtsam.block(0,3,3,3) = information.block(0,3,3,3); // off diagonal
-					mgtsam.block(3,0,3,3) = information.block(3,0,3,3); // off diagonal
-					gtsam::SharedNoiseModel model = gtsam::noiseModel::Gaussian::Information(mgtsam);
-
-#ifdef RTABMAP_VERTIGO
-					if(this->isRobust() &&
-					   iter->second.type() != Link::kNeighbor &&
-					   iter->second.type() != Link::kNeighborMerged)
+					gtsam::Pose3 p = iter->value.cast<gtsam::Pose3>();
+					optimizedPoses.insert(std::make_pair(key, Transform::fromEigen4d(p.matrix())));
+				}
+				else if(!opt.landmarksIgnored() && isLandmarkWithRotation.find(key)!=isLandmarkWithRotation.end())
+				{
+					if(isLandmarkWithRotation.at(key))
 					{
-						// create switchable edge factor
-						graph.add(vertigo::BetweenFactorSwitchableLinear<gtsam::Pose3>(id1, id2, gtsam::Symbol('s', switchCounter++), gtsam::Pose3(iter->second.transform().toEigen4d()), model));
+						gtsam::Pose3 p = iter->value.cast<gtsam::Pose3>();
+						optimizedPoses.insert(std::make_pair(key, Transform::fromEigen4d(p.matrix())));
 					}
 					else
-#endif
 					{
-						graph.add(gtsam::BetweenFactor<gtsam::Pose3>(id1, id2, gtsam::Pose3(iter->second.transform().toEigen4d()), model));
+						poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+						gtsam::Point3 p = iter->value.cast<gtsam::Point3>();
+						optimizedPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), p.z(), roll,pitch,yaw)));
 					}
 				}
 			}
 		}
+	}
+	return optimizedPoses;
+}
+
+void marginalToCovariance(bool slam2d, const gtsam::Matrix & info, cv::Mat & outputCovariance)
+{
+	if(slam2d && info.cols() == 3 && info.cols() == 3)
+	{
+		outputCovariance.at<double>(0,0) = info(0,0); // x-x
+		outputCovariance.at<double>(0,1) = info(0,1); // x-y
+		outputCovariance.at<double>(0,5) = info(0,2); // x-theta
+		outputCovariance.at<double>(1,0) = info(1,0); // y-x
+		outputCovariance.at<double>(1,1) = info(1,1); // y-y
+		outputCovariance.at<double>(1,5) = info(1,2); // y-theta
+		outputCovariance.at<double>(5,0) = info(2,0); // theta-x
+		outputCovariance.at<double>(5,1) = info(2,1); // theta-y
+		outputCovariance.at<double>(5,5) = info(2,2); // theta-theta
+	}
+	else if(!slam2d && info.cols() == 6 && info.cols() == 6)
+	{
+		Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
+		mgtsam.block(3,3,3,3) = info.block(0,0,3,3); // cov rotation
+		mgtsam.block(0,0,3,3) = info.block(3,3,3,3); // cov translation
+		mgtsam.block(0,3,3,3) = info.block(0,3,3,3); // off diagonal
+		mgtsam.block(3,0,3,3) = info.block(3,0,3,3); // off diagonal
+		memcpy(outputCovariance.data, mgtsam.data(), outputCovariance.total()*sizeof(double));
+	}
+	else
+	{
+		UWARN("GTSAM: Could not compute marginal covariance!");
+	}
+}
+
+} // namespace
+#endif // end RTABMAP_GTSAM
+
+bool OptimizerGTSAM::available()
+{
+#ifdef RTABMAP_GTSAM
+	return true;
+#else
+	return false;
+#endif
+}
+
+OptimizerGTSAM::~OptimizerGTSAM()
+{
+#ifdef RTABMAP_GTSAM
+	delete isam_;
+#endif
+}
+
+void OptimizerGTSAM::parseParameters(const ParametersMap & parameters)
+{
+	Optimizer::parseParameters(parameters);
+	Parameters::parse(parameters, Parameters::kGTSAMOptimizer(), optimizer_);
+	double relinearizeThreshold = relinearizeThreshold_;
+	int relinearizeSkip = relinearizeSkip_;
+	Parameters::parse(parameters, Parameters::kGTSAMIncRelinearizeThreshold(), relinearizeThreshold_);
+	Parameters::parse(parameters, Parameters::kGTSAMIncRelinearizeSkip(), relinearizeSkip_);
+	if(relinearizeThreshold != relinearizeThreshold_ || relinearizeSkip != relinearizeSkip_)
+	{
+		resetIncremental();
+	}
+}
+
+void OptimizerGTSAM::resetIncremental()
+{
+	Optimizer::resetIncremental();
+#ifdef RTABMAP_GTSAM
+	delete isam_;
+#endif
+	isam_ = 0;
+	isamRootId_ = 0;
+	isamGpsPriorOnly_ = false;
+	isamSwitchCounter_ = 0;
+	isamLandmarksWithRotation_.clear();
+	isamLinkFactors_.clear();
+	isamAnchors_.clear();
+}
+
+std::map<int, Transform> OptimizerGTSAM::optimize(
+		int rootId,
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & edgeConstraints,
+		cv::Mat & outputCovariance,
+		std::list<std::map<int, Transform> > * intermediateGraphes,
+		double * finalError,
+		int * iterationsDone)
+{
+	outputCovariance = cv::Mat::eye(6,6,CV_64FC1);
+	std::map<int, Transform> optimizedPoses;
+#ifdef RTABMAP_GTSAM
+
+#ifndef RTABMAP_VERTIGO
+	if(this->isRobust())
+	{
+		UWARN("Vertigo robust optimization is not available! Robust optimization is now disabled.");
+		setRobust(false);
+	}
+#endif
+
+	UDEBUG("Optimizing graph...");
+	if(edgeConstraints.size()>=1 && poses.size()>=2 && iterations() > 0)
+	{
+		gtsam::NonlinearFactorGraph graph;
+
+		bool gpsPriorOnly = false;
+		checkPriors(*this, edgeConstraints, rootId, gpsPriorOnly);
+		addRootPrior(*this, rootId, gpsPriorOnly, poses, graph);
+
+		UDEBUG("fill poses to gtsam... rootId=%d", rootId);
+		gtsam::Values initialEstimate;
+		std::map<int, bool> isLandmarkWithRotation;
+		addPoses(*this, poses, edgeConstraints, initialEstimate, isLandmarkWithRotation);
+
+		UDEBUG("fill edges to gtsam...");
+		int switchCounter = poses.rbegin()->first+1;
+		addFactors(*this, poses, edgeConstraints, isLandmarkWithRotation, graph, initialEstimate, switchCounter);
 
 		UDEBUG("create optimizer");
 		gtsam::NonlinearOptimizer * optimizer;
@@ -497,61 +681,7 @@ std::map<int, Transform> OptimizerGTSAM::optimize(
 		{
 			if(intermediateGraphes && i > 0)
 			{
-				float x,y,z,roll,pitch,yaw;
-				std::map<int, Transform> tmpPoses;
-				for(gtsam::Values::const_iterator iter=optimizer->values().begin(); iter!=optimizer->values().end(); ++iter)
-				{
-					if(iter->value.dim() > 1)
-					{
-						int key = (int)iter->key;
-						if(isSlam2d())
-						{
-							if(key > 0)
-							{
-								gtsam::Pose2 p = iter->value.cast<gtsam::Pose2>();
-								tmpPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), p.theta())));
-							}
-							else if(!landmarksIgnored() && isLandmarkWithRotation.find(key)!=isLandmarkWithRotation.end())
-							{
-								if(isLandmarkWithRotation.at(key))
-								{
-									poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-									gtsam::Pose2 p = iter->value.cast<gtsam::Pose2>();
-									tmpPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), z, roll, pitch, p.theta())));
-								}
-								else
-								{
-									poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-									gtsam::Point2 p = iter->value.cast<gtsam::Point2>();
-									tmpPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), z, roll,pitch,yaw)));
-								}
-							}
-						}
-						else
-						{
-							if(key > 0)
-							{
-								gtsam::Pose3 p = iter->value.cast<gtsam::Pose3>();
-								tmpPoses.insert(std::make_pair(key, Transform::fromEigen4d(p.matrix())));
-							}
-							else if(!landmarksIgnored() && isLandmarkWithRotation.find(key)!=isLandmarkWithRotation.end())
-							{
-								if(isLandmarkWithRotation.at(key))
-								{
-									gtsam::Pose3 p = iter->value.cast<gtsam::Pose3>();
-									tmpPoses.insert(std::make_pair(key, Transform::fromEigen4d(p.matrix())));
-								}
-								else
-								{
-									poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-									gtsam::Point3 p = iter->value.cast<gtsam::Point3>();
-									tmpPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), p.z(), roll,pitch,yaw)));
-								}
-							}
-						}
-					}
-				}
-				intermediateGraphes->push_back(tmpPoses);
+				intermediateGraphes->push_back(valuesToPoses(*this, optimizer->values(), poses, isLandmarkWithRotation));
 			}
 			try
 			{
@@ -600,60 +730,7 @@ std::map<int, Transform> OptimizerGTSAM::optimize(
 		}
 		UDEBUG("GTSAM optimizing end (%d iterations done, error=%f (initial=%f final=%f), time=%f s)",
 				optimizer->iterations(), optimizer->error(), graph.error(initialEstimate), graph.error(optimizer->values()), timer.ticks());
-
-		float x,y,z,roll,pitch,yaw;
-		for(gtsam::Values::const_iterator iter=optimizer->values().begin(); iter!=optimizer->values().end(); ++iter)
-		{
-			if(iter->value.dim() > 1)
-			{
-				int key = (int)iter->key;
-				if(isSlam2d())
-				{
-					if(key > 0)
-					{
-						gtsam::Pose2 p = iter->value.cast<gtsam::Pose2>();
-						optimizedPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), p.theta())));
-					}
-					else if(!landmarksIgnored() && isLandmarkWithRotation.find(key)!=isLandmarkWithRotation.end())
-					{
-						if(isLandmarkWithRotation.at(key))
-						{
-							poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-							gtsam::Pose2 p = iter->value.cast<gtsam::Pose2>();
-							optimizedPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), z, roll, pitch, p.theta())));
-						}
-						else
-						{
-							poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-							gtsam::Point2 p = iter->value.cast<gtsam::Point2>();
-							optimizedPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), z,roll,pitch,yaw)));
-						}
-					}
-				}
-				else
-				{
-					if(key > 0)
-					{
-						gtsam::Pose3 p = iter->value.cast<gtsam::Pose3>();
-						optimizedPoses.insert(std::make_pair(key, Transform::fromEigen4d(p.matrix())));
-					}
-					else if(!landmarksIgnored() && isLandmarkWithRotation.find(key)!=isLandmarkWithRotation.end())
-					{
-						if(isLandmarkWithRotation.at(key))
-						{
-							gtsam::Pose3 p = iter->value.cast<gtsam::Pose3>();
-							optimizedPoses.insert(std::make_pair(key, Transform::fromEigen4d(p.matrix())));
-						}
-						else
-						{
-							poses.at(key).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-							gtsam::Point3 p = iter->value.cast<gtsam::Point3>();
-							optimizedPoses.insert(std::make_pair(key, Transform(p.x(), p.y(), p.z(), roll,pitch,yaw)));
-						}
-					}
-				}
-			}
-		}
+		optimizedPoses = valuesToPoses(*this, optimizer->values(), poses, isLandmarkWithRotation);
 
 		// compute marginals
 		try {
@@ -662,31 +739,7 @@ std::map<int, Transform> OptimizerGTSAM::optimize(
 			gtsam::Marginals marginals(graph, optimizer->values());
 			gtsam::Matrix info = marginals.marginalCovariance(poses.rbegin()->first);
 			UDEBUG("Computed marginals = %fs (key=%d)", t.ticks(), poses.rbegin()->first);
-			if(isSlam2d() && info.cols() == 3 && info.cols() == 3)
-			{
-				outputCovariance.at<double>(0,0) = info(0,0); // x-x
-				outputCovariance.at<double>(0,1) = info(0,1); // x-y
-				outputCovariance.at<double>(0,5) = info(0,2); // x-theta
-				outputCovariance.at<double>(1,0) = info(1,0); // y-x
-				outputCovariance.at<double>(1,1) = info(1,1); // y-y
-				outputCovariance.at<double>(1,5) = info(1,2); // y-theta
-				outputCovariance.at<double>(5,0) = info(2,0); // theta-x
-				outputCovariance.at<double>(5,1) = info(2,1); // theta-y
-				outputCovariance.at<double>(5,5) = info(2,2); // theta-theta
-			}
-			else if(!isSlam2d() && info.cols() == 6 && info.cols() == 6)
-			{
-				Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
-				mgtsam.block(3,3,3,3) = info.block(0,0,3,3); // cov rotation
-				mgtsam.block(0,0,3,3) = info.block(3,3,3,3); // cov translation
-				mgtsam.block(0,3,3,3) = info.block(0,3,3,3); // off diagonal
-				mgtsam.block(3,0,3,3) = info.block(3,0,3,3); // off diagonal
-				memcpy(outputCovariance.data, mgtsam.data(), outputCovariance.total()*sizeof(double));
-			}
-			else
-			{
-				UWARN("GTSAM: Could not compute marginal covariance!");
-			}
+			marginalToCovariance(isSlam2d(), info, outputCovariance);
 		}
 		catch(gtsam::IndeterminantLinearSystemException & e)
 		{
@@ -714,4 +767,267 @@ std::map<int, Transform> OptimizerGTSAM::optimize(
 	return optimizedPoses;
 }
 
+std::map<int, Transform> OptimizerGTSAM::updateIncremental(
+		int rootId,
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & constraints,
+		const std::map<int, Transform> & newPoses,
+		const std::multimap<int, Link> & newConstraints,
+		const std::set<int> & removedPoses,
+		const std::multimap<int, Link> & removedConstraints,
+		cv::Mat & outputCovariance,
+		double * finalError,
+		int * iterationsDone)
+{
+	outputCovariance = cv::Mat::eye(6,6,CV_64FC1);
+	std::map<int, Transform> optimizedPoses;
+#ifdef RTABMAP_GTSAM
+
+#ifndef RTABMAP_VERTIGO
+	if(this->isRobust())
+	{
+		UWARN("Vertigo robust optimization is not available! Robust optimization is now disabled.");
+		setRobust(false);
+	}
+#endif
+
+	if(constraints.empty() || poses.size() < 2 || iterations() <= 0)
+	{
+		// iSAM2 will be restarted from the whole graph
+		delete isam_;
+		isam_ = 0;
+		return Optimizer::updateIncremental(rootId, poses, constraints, newPoses, newConstraints, removedPoses, removedConstraints, outputCovariance, finalError, iterationsDone);
+	}
+
+	// The root prior depends on the pose priors in the graph, restart if it changes
+	if(isam_)
+	{
+		bool priorsChanged = false;
+		for(std::multimap<int, Link>::const_iterator iter=newConstraints.begin(); !priorsChanged && iter!=newConstraints.end(); ++iter)
+		{
+			priorsChanged = iter->second.type() == Link::kPosePrior;
+		}
+		for(std::multimap<int, Link>::const_iterator iter=removedConstraints.begin(); !priorsChanged && iter!=removedConstraints.end(); ++iter)
+		{
+			priorsChanged = iter->second.type() == Link::kPosePrior;
+		}
+		if(priorsChanged)
+		{
+			int priorRootId = rootId;
+			bool gpsPriorOnly = false;
+			checkPriors(*this, constraints, priorRootId, gpsPriorOnly);
+			if((priorRootId==0) != (isamRootId_==0) || gpsPriorOnly != isamGpsPriorOnly_)
+			{
+				UDEBUG("Root prior changed, restarting iSAM2");
+				delete isam_;
+				isam_ = 0;
+			}
+		}
+	}
+	if(isam_ && isamRootId_ != 0 && removedPoses.find(isamRootId_) != removedPoses.end())
+	{
+		UDEBUG("Root %d has been removed, restarting iSAM2", isamRootId_);
+		delete isam_;
+		isam_ = 0;
+	}
+	if(isam_ && isamAnchors_.size() + removedPoses.size() > poses.size())
+	{
+		UDEBUG("More removed poses (%d) than poses in the graph (%d), restarting iSAM2",
+				(int)(isamAnchors_.size() + removedPoses.size()), (int)poses.size());
+		delete isam_;
+		isam_ = 0;
+	}
+
+	UTimer timer;
+	gtsam::NonlinearFactorGraph graph;
+	gtsam::Values initialEstimate;
+	gtsam::FactorIndices removedFactors;
+	std::vector<const Link *> factorLinks;
+	std::map<size_t, int> factorAnchors; // <factor, pose id>
+	if(isam_ == 0)
+	{
+		gtsam::ISAM2Params params;
+		if(optimizer_ == 2)
+		{
+			params.optimizationParams = gtsam::ISAM2DoglegParams();
+		}
+		else if(optimizer_ == 0)
+		{
+			UWARN("Levenberg optimizer is not available with iSAM2, GaussNewton is used.");
+		}
+		params.relinearizeThreshold = relinearizeThreshold_;
+		params.relinearizeSkip = relinearizeSkip_;
+		isam_ = new gtsam::ISAM2(params);
+
+		isamRootId_ = rootId;
+		checkPriors(*this, constraints, isamRootId_, isamGpsPriorOnly_);
+		addRootPrior(*this, isamRootId_, isamGpsPriorOnly_, poses, graph);
+		isamLandmarksWithRotation_.clear();
+		isamLinkFactors_.clear();
+		isamAnchors_.clear();
+		addPoses(*this, poses, constraints, initialEstimate, isamLandmarksWithRotation_);
+		isamSwitchCounter_ = poses.rbegin()->first+1;
+		addFactors(*this, poses, constraints, isamLandmarksWithRotation_, graph, initialEstimate, isamSwitchCounter_, &factorLinks);
+		UDEBUG("iSAM2 initialized with %d poses and %d links", (int)poses.size(), (int)constraints.size());
+	}
+	else
+	{
+		// Remove the factors of the removed (or modified) links
+		for(std::multimap<int, Link>::const_iterator iter=removedConstraints.begin(); iter!=removedConstraints.end(); ++iter)
+		{
+			for(std::multimap<int, std::pair<Link, size_t> >::iterator jter=isamLinkFactors_.lower_bound(iter->first);
+				jter!=isamLinkFactors_.end() && jter->first == iter->first;
+				++jter)
+			{
+				if(jter->second.first.to() == iter->second.to() && jter->second.first.type() == iter->second.type())
+				{
+					removedFactors.push_back(jter->second.second);
+					isamLinkFactors_.erase(jter);
+					break;
+				}
+			}
+		}
+
+		// All the factors of a removed pose are removed with its links, instead of
+		// marginalizing it (only possible for leaves of the Bayes tree), its variable
+		// is kept at its last estimate with a prior so that the system stays determinate.
+		for(std::set<int>::const_iterator iter=removedPoses.begin(); iter!=removedPoses.end(); ++iter)
+		{
+			if(!isam_->getLinearizationPoint().exists(*iter))
+			{
+				continue; // ignored landmark
+			}
+			if(isSlam2d() && (*iter > 0 || isamLandmarksWithRotation_.at(*iter)))
+			{
+				graph.add(gtsam::PriorFactor<gtsam::Pose2>(*iter, isam_->calculateEstimate<gtsam::Pose2>(*iter), gtsam::noiseModel::Isotropic::Sigma(3, 1.0)));
+			}
+			else if(isSlam2d())
+			{
+				graph.add(gtsam::PriorFactor<gtsam::Point2>(*iter, isam_->calculateEstimate<gtsam::Point2>(*iter), gtsam::noiseModel::Isotropic::Sigma(2, 1.0)));
+			}
+			else if(*iter > 0 || isamLandmarksWithRotation_.at(*iter))
+			{
+				graph.add(gtsam::PriorFactor<gtsam::Pose3>(*iter, isam_->calculateEstimate<gtsam::Pose3>(*iter), gtsam::noiseModel::Isotropic::Sigma(6, 1.0)));
+			}
+			else
+			{
+				graph.add(gtsam::PriorFactor<gtsam::Point3>(*iter, isam_->calculateEstimate<gtsam::Point3>(*iter), gtsam::noiseModel::Isotropic::Sigma(3, 1.0)));
+			}
+			factorAnchors.insert(std::make_pair(graph.size()-1, *iter));
+		}
+
+		// Poses coming back in the graph (e.g., retrieved from LTM) are still in iSAM2, just remove their prior
+		std::map<int, Transform> addedPoses;
+		for(std::map<int, Transform>::const_iterator iter=newPoses.begin(); iter!=newPoses.end(); ++iter)
+		{
+			std::map<int, size_t>::iterator jter = isamAnchors_.find(iter->first);
+			if(jter != isamAnchors_.end())
+			{
+				removedFactors.push_back(jter->second);
+				isamAnchors_.erase(jter);
+			}
+			else
+			{
+				addedPoses.insert(addedPoses.end(), *iter);
+			}
+		}
+
+		addPoses(*this, addedPoses, constraints, initialEstimate, isamLandmarksWithRotation_);
+		addFactors(*this, poses, newConstraints, isamLandmarksWithRotation_, graph, initialEstimate, isamSwitchCounter_, &factorLinks);
+		UDEBUG("iSAM2 update with %d new poses (%d back in the graph), %d new links, %d removed poses and %d removed links (%d removed poses in iSAM2)",
+				(int)newPoses.size(), (int)(newPoses.size()-addedPoses.size()), (int)newConstraints.size(),
+				(int)removedPoses.size(), (int)removedConstraints.size(), (int)(isamAnchors_.size()+factorAnchors.size()));
+	}
+
+	int it = 0;
+	double lastError = 0.0;
+	gtsam::Values values;
+	try
+	{
+		gtsam::ISAM2Result result = isam_->update(graph, initialEstimate, removedFactors);
+		++it;
+		UASSERT(result.newFactorsIndices.size() == graph.size());
+		for(size_t i=0; i<factorLinks.size(); ++i)
+		{
+			if(factorLinks[i])
+			{
+				isamLinkFactors_.insert(std::make_pair(factorLinks[i]->from(), std::make_pair(*factorLinks[i], (size_t)result.newFactorsIndices[i])));
+			}
+		}
+		for(std::map<size_t, int>::iterator iter=factorAnchors.begin(); iter!=factorAnchors.end(); ++iter)
+		{
+			isamAnchors_.insert(std::make_pair(iter->second, (size_t)result.newFactorsIndices[iter->first]));
+		}
+		values = isam_->calculateEstimate();
+		lastError = isam_->getFactorsUnsafe().error(values);
+		// Relinearize more if the error still decreases (e.g., after a loop closure)
+		for(int i=1; i<iterations(); ++i)
+		{
+			isam_->update();
+			++it;
+			values = isam_->calculateEstimate();
+			double error = isam_->getFactorsUnsafe().error(values);
+			UDEBUG("iteration %d error =%f", i+1, error);
+			double errorDelta = lastError - error;
+			lastError = error;
+			if(errorDelta < this->epsilon())
+			{
+				break;
+			}
+		}
+	}
+	catch(gtsam::IndeterminantLinearSystemException & e)
+	{
+		UWARN("GTSAM exception caught: %s\n Graph has %d edges and %d vertices", e.what(),
+				(int)constraints.size(),
+				(int)poses.size());
+		return optimizedPoses;
+	}
+	catch(std::exception & e)
+	{
+		UWARN("GTSAM exception caught: %s", e.what());
+		return optimizedPoses;
+	}
+	if(finalError)
+	{
+		*finalError = lastError;
+	}
+	if(iterationsDone)
+	{
+		*iterationsDone = it;
+	}
+	UDEBUG("iSAM2 update end (%d updates, error=%f, time=%f s)", it, lastError, timer.ticks());
+
+	optimizedPoses = valuesToPoses(*this, values, poses, isamLandmarksWithRotation_);
+
+	// The graph is anchored to the root of the first update, move it to the current root
+	if(isamRootId_ != 0 && rootId != 0 && rootId != isamRootId_ &&
+	   optimizedPoses.find(rootId) != optimizedPoses.end() && poses.find(rootId) != poses.end())
+	{
+		Transform t = poses.at(rootId) * optimizedPoses.at(rootId).inverse();
+		if(isSlam2d())
+		{
+			t = t.to3DoF();
+		}
+		for(std::map<int, Transform>::iterator iter=optimizedPoses.begin(); iter!=optimizedPoses.end(); ++iter)
+		{
+			iter->second = t * iter->second;
+		}
+	}
+
+	try
+	{
+		gtsam::Matrix info = isam_->marginalCovariance(poses.rbegin()->first);
+		marginalToCovariance(isSlam2d(), info, outputCovariance);
+	}
+	catch(std::exception& e)
+	{
+		UWARN("GTSAM exception caught: %s", e.what());
+	}
+#else
+	UERROR("Not built with GTSAM support!");
+#endif
+	return optimizedPoses;
+}
+
 } /* namespace rtabmap */
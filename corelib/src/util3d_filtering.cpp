@@ -45,11 +45,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/util3d_surface.h>
+#include <rtabmap/core/LaserScanChannels.h>
 
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UMath.h>
 #include <rtabmap/utilite/UConversion.h>
 
+#if __cplusplus >= 201103L
+#include <unordered_map>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #if PCL_VERSION_COMPARE(>=, 1, 8, 0)
 #include <pcl/impl/instantiate.hpp>
 #include <pcl/point_types.h>
@@ -94,46 +103,26 @@ LaserScan commonFiltering(
 
 		if(downsamplingStep > 1 || rangeMin > 0.0f || rangeMax > 0.0f)
 		{
-			cv::Mat tmp = cv::Mat(1, scan.size()/downsamplingStep, scan.dataType());
-			bool is2d = scan.is2d();
-			int oi = 0;
-			float rangeMinSqrd = rangeMin * rangeMin;
-			float rangeMaxSqrd = rangeMax * rangeMax;
-			for(int i=0; i<scan.size()-downsamplingStep+1; i+=downsamplingStep)
+			std::vector<int> indices;
+			if(downsamplingStep > 1)
 			{
-				const float * ptr = scan.data().ptr<float>(0, i);
-
-				if(rangeMin>0.0f || rangeMax>0.0f)
+				indices.resize(scan.size()/downsamplingStep);
+				for(unsigned int i=0; i<indices.size(); ++i)
 				{
-					float r;
-					if(is2d)
-					{
-						r = ptr[0]*ptr[0] + ptr[1]*ptr[1];
-					}
-					else
-					{
-						r = ptr[0]*ptr[0] + ptr[1]*ptr[1] + ptr[2]*ptr[2];
-					}
-
-					if(rangeMin > 0.0f && r < rangeMinSqrd)
-					{
-						continue;
-					}
-					if(rangeMax > 0.0f && r > rangeMaxSqrd)
-					{
-						continue;
-					}
+					indices[i] = i*downsamplingStep;
 				}
-
-				cv::Mat(scan.data(), cv::Range::all(), cv::Range(i,i+1)).copyTo(cv::Mat(tmp, cv::Range::all(), cv::Range(oi,oi+1)));
-				++oi;
 			}
+			if(rangeMin>0.0f || rangeMax>0.0f)
+			{
+				indices = LaserScanChannels(scan, false, downsamplingStep > 1?&indices:0).rangeFiltering(rangeMin, rangeMax);
+			}
+			cv::Mat tmp = LaserScanChannels::select(scan.data(), indices);
 			int previousSize = scan.size();
 			int scanMaxPtsTmp = scan.maxPoints();
 			if(scan.angleIncrement() > 0.0f)
 			{
 				scan = LaserScan(
-						cv::Mat(tmp, cv::Range::all(), cv::Range(0, oi)),
+						tmp,
 						scan.format(),
 						rangeMin>0.0f&&rangeMin>scan.rangeMin()?rangeMin:scan.rangeMin(),
 						rangeMax>0.0f&&rangeMax<scan.rangeMax()?rangeMax:scan.rangeMax(),
@@ -145,7 +134,7 @@ LaserScan commonFiltering(
 			else
 			{
 				scan = LaserScan(
-						cv::Mat(tmp, cv::Range::all(), cv::Range(0, oi)),
+						tmp,
 						scanMaxPtsTmp/downsamplingStep,
 						rangeMax>0.0f&&rangeMax<scan.rangeMax()?rangeMax:scan.rangeMax(),
 						scan.format(),
@@ -154,143 +143,16 @@ LaserScan commonFiltering(
 			UDEBUG("Downsampling scan (step=%d): %d -> %d (scanMaxPts=%d->%d)", downsamplingStep, previousSize, scan.size(), scanMaxPtsTmp, scan.maxPoints());
 		}
 
-		if(scan.size() && (voxelSize > 0.0f || ((normalK > 0 || normalRadius>0.0f) && !scan.hasNormals())))
+		if(scan.size() && voxelSize > 0.0f)
 		{
-			// convert to compatible PCL format and filter it
-			if(scan.hasRGB())
-			{
-				UASSERT(!scan.is2d());
-				pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = laserScanToPointCloudRGB(scan);
-				if(cloud->size())
-				{
-					int scanMaxPts = scan.maxPoints();
-					if(voxelSize > 0.0f)
-					{
-						cloud = voxelize(cloud, voxelSize);
-						float ratio = float(cloud->size()) / scan.size();
-						scanMaxPts = int(float(scanMaxPts) * ratio);
-						UDEBUG("Voxel filtering scan (voxel=%f m): %d -> %d (scanMaxPts=%d->%d)", voxelSize, scan.size(), cloud->size(), scan.maxPoints(), scanMaxPts);
-					}
-					if(cloud->size() && (normalK > 0 || normalRadius>0.0f))
-					{
-						pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(cloud, normalK, normalRadius);
-						scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scanMaxPts, scan.rangeMax(), LaserScan::kXYZRGBNormal, scan.localTransform());
-						UDEBUG("Normals computed (k=%d radius=%f)", normalK, normalRadius);
-					}
-					else
-					{
-						if(scan.hasNormals())
-						{
-							UWARN("Voxel filter is applied, but normal parameters are not set and input scan has normals. The returned scan has no normals.");
-						}
-						scan = LaserScan(laserScanFromPointCloud(*cloud), scanMaxPts, scan.rangeMax(), LaserScan::kXYZRGB, scan.localTransform());
-					}
-				}
-			}
-			else if(scan.hasIntensity())
-			{
-				pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = laserScanToPointCloudI(scan);
-				if(cloud->size())
-				{
-					int scanMaxPts = scan.maxPoints();
-					if(voxelSize > 0.0f)
-					{
-						cloud = voxelize(cloud, voxelSize);
-						float ratio = float(cloud->size()) / scan.size();
-						scanMaxPts = int(float(scanMaxPts) * ratio);
-						UDEBUG("Voxel filtering scan (voxel=%f m): %d -> %d (scanMaxPts=%d->%d)", voxelSize, scan.size(), cloud->size(), scan.maxPoints(), scanMaxPts);
-					}
-					if(cloud->size() && (normalK > 0 || normalRadius>0.0f))
-					{
-						pcl::PointCloud<pcl::Normal>::Ptr normals;
-						if(scan.is2d())
-						{
-							normals = util3d::computeNormals2D(cloud, normalK, normalRadius);
-							if(voxelSize == 0.0f && scan.angleIncrement() > 0.0f)
-							{
-								scan = LaserScan(laserScan2dFromPointCloud(*cloud, *normals), LaserScan::kXYINormal, scan.rangeMin(), scan.rangeMax(), scan.angleMin(), scan.angleMax(), scan.angleIncrement(), scan.localTransform());
-							}
-							else
-							{
-								scan = LaserScan(laserScan2dFromPointCloud(*cloud, *normals), scanMaxPts, scan.rangeMax(), LaserScan::kXYINormal, scan.localTransform());
-							}
-						}
-						else
-						{
-							normals = util3d::computeNormals(cloud, normalK, normalRadius);
-							scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scanMaxPts, scan.rangeMax(), LaserScan::kXYZINormal, scan.localTransform());
-						}
-						UDEBUG("Normals computed (k=%d radius=%f)", normalK, normalRadius);
-					}
-					else
-					{
-						if(scan.hasNormals())
-						{
-							UWARN("Voxel filter i applied, but normal parameters are not set and input scan has normals. The returned scan has no normals.");
-						}
-						if(scan.is2d())
-						{
-							scan = LaserScan(laserScan2dFromPointCloud(*cloud), scanMaxPts, scan.rangeMax(), LaserScan::kXYI, scan.localTransform());
-						}
-						else
-						{
-							scan = LaserScan(laserScanFromPointCloud(*cloud), scanMaxPts, scan.rangeMax(), LaserScan::kXYZI, scan.localTransform());
-						}
-					}
-				}
-			}
-			else
-			{
-				pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = laserScanToPointCloud(scan);
-				if(cloud->size())
-				{
-					int scanMaxPts = scan.maxPoints();
-					if(voxelSize > 0.0f)
-					{
-						cloud = voxelize(cloud, voxelSize);
-						float ratio = float(cloud->size()) / scan.size();
-						scanMaxPts = int(float(scanMaxPts) * ratio);
-						UDEBUG("Voxel filtering scan (voxel=%f m): %d -> %d (scanMaxPts=%d->%d)", voxelSize, scan.size(), cloud->size(), scan.maxPoints(), scanMaxPts);
-					}
-					if(cloud->size() && (normalK > 0 || normalRadius>0.0f))
-					{
-						pcl::PointCloud<pcl::Normal>::Ptr normals;
-						if(scan.is2d())
-						{
-							normals = util3d::computeNormals2D(cloud, normalK, normalRadius);
-							if(voxelSize == 0.0f && scan.angleIncrement() > 0.0f)
-							{
-								scan = LaserScan(laserScan2dFromPointCloud(*cloud, *normals), LaserScan::kXYNormal, scan.rangeMin(), scan.rangeMax(), scan.angleMin(), scan.angleMax(), scan.angleIncrement(), scan.localTransform());
-							}
-							else
-							{
-								scan = LaserScan(laserScan2dFromPointCloud(*cloud, *normals), scanMaxPts, scan.rangeMax(), LaserScan::kXYNormal, scan.localTransform());
-							}
-						}
-						else
-						{
-							normals = util3d::computeNormals(cloud, normalK, normalRadius);
-							scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scanMaxPts, scan.rangeMax(), LaserScan::kXYZNormal, scan.localTransform());
-						}
-						UDEBUG("Normals computed (k=%d radius=%f)", normalK, normalRadius);
-					}
-					else
-					{
-						if(scan.hasNormals())
-						{
-							UWARN("Voxel filter i applied, but normal parameters are not set and input scan has normals. The returned scan has no normals.");
-						}
-						if(scan.is2d())
-						{
-							scan = LaserScan(laserScan2dFromPointCloud(*cloud), scanMaxPts, scan.rangeMax(), LaserScan::kXY, scan.localTransform());
-						}
-						else
-						{
-							scan = LaserScan(laserScanFromPointCloud(*cloud), scanMaxPts, scan.rangeMax(), LaserScan::kXYZ, scan.localTransform());
-						}
-					}
-				}
-			}
+			// normals (if any) are averaged in the voxels
+			scan = util3d::voxelize(scan, voxelSize);
+		}
+
+		if(scan.size() && (normalK > 0 || normalRadius>0.0f) && (voxelSize > 0.0f || !scan.hasNormals()))
+		{
+			scan = util3d::computeNormals(scan, normalK, normalRadius);
+			UDEBUG("Normals computed (k=%d radius=%f)", normalK, normalRadius);
 		}
 
 		if(scan.size() && !scan.is2d() && scan.hasNormals() && forceGroundNormalsUp)
@@ -311,41 +173,14 @@ LaserScan rangeFiltering(
 	{
 		if(rangeMin > 0.0f || rangeMax > 0.0f)
 		{
-			cv::Mat output = cv::Mat(1, scan.size(), scan.dataType());
-			bool is2d = scan.is2d();
-			int oi = 0;
-			float rangeMinSqrd = rangeMin * rangeMin;
-			float rangeMaxSqrd = rangeMax * rangeMax;
-			for(int i=0; i<scan.size(); ++i)
-			{
-				const float * ptr = scan.data().ptr<float>(0, i);
-				float r;
-				if(is2d)
-				{
-					r = ptr[0]*ptr[0] + ptr[1]*ptr[1];
-				}
-				else
-				{
-					r = ptr[0]*ptr[0] + ptr[1]*ptr[1] + ptr[2]*ptr[2];
-				}
-
-				if(rangeMin > 0.0f && r < rangeMinSqrd)
-				{
-					continue;
-				}
-				if(rangeMax > 0.0f && r > rangeMaxSqrd)
-				{
-					continue;
-				}
-
-				cv::Mat(scan.data(), cv::Range::all(), cv::Range(i,i+1)).copyTo(cv::Mat(output, cv::Range::all(), cv::Range(oi,oi+1)));
-				++oi;
-			}
+			cv::Mat output = LaserScanChannels::select(
+					scan.data(),
+					LaserScanChannels(scan, false).rangeFiltering(rangeMin, rangeMax));
 			if(scan.angleIncrement() > 0.0f)
 			{
-				return LaserScan(cv::Mat(output, cv::Range::all(), cv::Range(0, oi)), scan.format(), scan.rangeMin(), scan.rangeMax(), scan.angleMin(), scan.angleMax(), scan.angleIncrement(), scan.localTransform());
+				return LaserScan(output, scan.format(), scan.rangeMin(), scan.rangeMax(), scan.angleMin(), scan.angleMax(), scan.angleIncrement(), scan.localTransform());
 			}
-			return LaserScan(cv::Mat(output, cv::Range::all(), cv::Range(0, oi)), scan.maxPoints(), scan.rangeMax(), scan.format(), scan.localTransform());
+			return LaserScan(output, scan.maxPoints(), scan.rangeMax(), scan.format(), scan.localTransform());
 		}
 	}
 
@@ -364,14 +199,12 @@ LaserScan downsample(
 	}
 	else
 	{
-		int finalSize = scan.size()/step;
-		cv::Mat output = cv::Mat(1, finalSize, scan.dataType());
-		int oi = 0;
-		for(int i=0; i<scan.size()-step+1; i+=step)
+		std::vector<int> indices(scan.size()/step);
+		for(unsigned int i=0; i<indices.size(); ++i)
 		{
-			cv::Mat(scan.data(), cv::Range::all(), cv::Range(i,i+1)).copyTo(cv::Mat(output, cv::Range::all(), cv::Range(oi,oi+1)));
-			++oi;
+			indices[i] = i*step;
 		}
+		cv::Mat output = LaserScanChannels::select(scan.data(), indices);
 		if(scan.angleIncrement() > 0.0f)
 		{
 			return LaserScan(output, scan.format(), scan.rangeMin(), scan.rangeMax(), scan.angleMin(), scan.angleMax(), scan.angleIncrement()*step, scan.localTransform());
@@ -428,6 +261,158 @@ pcl::PointCloud<pcl::PointXYZINormal>::Ptr downsample(const pcl::PointCloud<pcl:
 	return downsampleImpl<pcl::PointXYZINormal>(cloud, step);
 }
 
+LaserScan voxelize(
+		const LaserScan & scan,
+		float voxelSize)
+{
+	UASSERT(voxelSize > 0.0f);
+	if(scan.isEmpty())
+	{
+		return scan;
+	}
+
+	LaserScanChannels channels(scan, false);
+	const int n = channels.size();
+	std::vector<int> vx(n), vy(n), vz(n);
+	channels.voxelCoordinates(voxelSize, vx.data(), vy.data(), vz.data());
+
+	const float * x = channels.x();
+	const float * y = channels.y();
+	const float * z = channels.z();
+	int minVoxel[3] = {std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max()};
+	int maxVoxel[3] = {std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min()};
+	for(int i=0; i<n; ++i)
+	{
+		if(uIsFinite(x[i]) && uIsFinite(y[i]) && uIsFinite(z[i]))
+		{
+			minVoxel[0] = std::min(minVoxel[0], vx[i]);
+			minVoxel[1] = std::min(minVoxel[1], vy[i]);
+			minVoxel[2] = std::min(minVoxel[2], vz[i]);
+			maxVoxel[0] = std::max(maxVoxel[0], vx[i]);
+			maxVoxel[1] = std::max(maxVoxel[1], vy[i]);
+			maxVoxel[2] = std::max(maxVoxel[2], vz[i]);
+		}
+	}
+	for(int j=0; j<3; ++j)
+	{
+		// keys have 21 bits per coordinate, relative to the min bound
+		if(minVoxel[j] <= maxVoxel[j] && (long long)maxVoxel[j] - (long long)minVoxel[j] >= (1LL << 21))
+		{
+			// same behavior as pcl::VoxelGrid
+			UWARN("Voxel size (%f m) is too small for the input scan, integer indices would overflow. Returning the scan unchanged.", voxelSize);
+			return scan;
+		}
+	}
+
+	// group points by voxel, voxels are ordered by their first point
+	std::vector<int> voxelOfPoint(n, -1);
+	std::vector<int> voxelStart(1, 0);
+#if __cplusplus >= 201103L
+	std::unordered_map<long long, int> voxels;
+	voxels.reserve(n);
+#else
+	std::map<long long, int> voxels;
+#endif
+	for(int i=0; i<n; ++i)
+	{
+		if(uIsFinite(x[i]) && uIsFinite(y[i]) && uIsFinite(z[i]))
+		{
+			long long key =
+					((long long)(vx[i] - minVoxel[0]) << 42) |
+					((long long)(vy[i] - minVoxel[1]) << 21) |
+					(long long)(vz[i] - minVoxel[2]);
+#if __cplusplus >= 201103L
+			std::pair<std::unordered_map<long long, int>::iterator, bool> inserted = voxels.insert(std::make_pair(key, (int)voxels.size()));
+#else
+			std::pair<std::map<long long, int>::iterator, bool> inserted = voxels.insert(std::make_pair(key, (int)voxels.size()));
+#endif
+			if(inserted.second)
+			{
+				voxelStart.push_back(0);
+			}
+			voxelOfPoint[i] = inserted.first->second;
+			++voxelStart[voxelOfPoint[i]+1];
+		}
+	}
+	const int voxelsCount = (int)voxels.size();
+	for(int v=0; v<voxelsCount; ++v)
+	{
+		voxelStart[v+1] += voxelStart[v];
+	}
+	std::vector<int> voxelPoints(voxelStart.back());
+	std::vector<int> fill(voxelStart.begin(), voxelStart.end()-1);
+	for(int i=0; i<n; ++i)
+	{
+		if(voxelOfPoint[i] >= 0)
+		{
+			voxelPoints[fill[voxelOfPoint[i]]++] = i;
+		}
+	}
+
+	// average all channels of the points in each voxel
+	const int channelsCount = scan.channels();
+	const int rgbOffset = scan.getRGBOffset();
+	const int normalsOffset = scan.getNormalsOffset();
+	cv::Mat output(1, voxelsCount, scan.dataType());
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int v=0; v<voxelsCount; ++v)
+	{
+		double sum[10] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+		double rgb[3] = {0.0, 0.0, 0.0};
+		for(int j=voxelStart[v]; j<voxelStart[v+1]; ++j)
+		{
+			const float * ptr = scan.data().ptr<float>(0, voxelPoints[j]);
+			for(int c=0; c<channelsCount; ++c)
+			{
+				if(c == rgbOffset)
+				{
+					int packed = *(const int*)(ptr+c);
+					rgb[0] += (packed >> 16) & 0xFF;
+					rgb[1] += (packed >> 8) & 0xFF;
+					rgb[2] += packed & 0xFF;
+				}
+				else
+				{
+					sum[c] += ptr[c];
+				}
+			}
+		}
+		const double count = voxelStart[v+1] - voxelStart[v];
+		float * out = output.ptr<float>(0, v);
+		for(int c=0; c<channelsCount; ++c)
+		{
+			if(c == rgbOffset)
+			{
+				int packed =
+						(int(rgb[0]/count + 0.5) << 16) |
+						(int(rgb[1]/count + 0.5) << 8) |
+						int(rgb[2]/count + 0.5);
+				*(int*)(out+c) = packed;
+			}
+			else
+			{
+				out[c] = float(sum[c]/count);
+			}
+		}
+		if(normalsOffset >= 0)
+		{
+			float norm = std::sqrt(out[normalsOffset]*out[normalsOffset] + out[normalsOffset+1]*out[normalsOffset+1] + out[normalsOffset+2]*out[normalsOffset+2]);
+			if(norm > 0.0f)
+			{
+				out[normalsOffset] /= norm;
+				out[normalsOffset+1] /= norm;
+				out[normalsOffset+2] /= norm;
+			}
+		}
+	}
+
+	int maxPoints = int(float(scan.maxPoints()) * float(voxelsCount) / float(n));
+	UDEBUG("Voxel filtering scan (voxel=%f m): %d -> %d (scanMaxPts=%d->%d)", voxelSize, n, voxelsCount, scan.maxPoints(), maxPoints);
+	return LaserScan(output, maxPoints, scan.rangeMax(), scan.format(), scan.localTransform());
+}
+
 template<typename PointT>
 typename pcl::PointCloud<PointT>::Ptr voxelizeImpl(
 		const typename pcl::PointCloud<PointT>::Ptr & cloud,
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Memory.h"
 #include "rtabmap/core/DBDriver.h"
 #include "rtabmap/core/Compression.h"
+#include "rtabmap/core/LaserScanChannels.h"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UDirectory.h"
 #include "rtabmap/utilite/UFile.h"
@@ -46,6 +47,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/surface/mls.h>
 #include <pcl18/surface/texture_mapping.h>
 #include <pcl/features/integral_image_normal.h>
+#if __cplusplus >= 201103L
+#include <unordered_map>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef RTABMAP_ALICE_VISION
 #include <aliceVision/sfmData/SfMData.hpp>
@@ -2426,6 +2434,200 @@ bool multiBandTexturing(
 #endif
 }
 
+namespace {
+/**
+ * Voxel hash of scan points for neighbor searches in computeNormals(LaserScan).
+ */
+class ScanNeighborGrid
+{
+public:
+	ScanNeighborGrid(const float * x, const float * y, const float * z, int size, float cellSize) :
+		x_(x), y_(y), z_(z), cellSize_(cellSize)
+	{
+		UASSERT(cellSize > 0.0f);
+		std::vector<long long> keys(size, 0);
+		std::vector<int> cellOfPoint(size, -1);
+		std::vector<int> counts;
+#if __cplusplus >= 201103L
+		cells_.reserve(size);
+#endif
+		minCell_[0] = minCell_[1] = minCell_[2] = std::numeric_limits<int>::max();
+		maxCell_[0] = maxCell_[1] = maxCell_[2] = std::numeric_limits<int>::min();
+		for(int i=0; i<size; ++i)
+		{
+			if(uIsFinite(x[i]) && uIsFinite(y[i]) && uIsFinite(z[i]))
+			{
+				int c[3];
+				cell(x[i], y[i], z[i], c);
+				for(int j=0; j<3; ++j)
+				{
+					minCell_[j] = std::min(minCell_[j], c[j]);
+					maxCell_[j] = std::max(maxCell_[j], c[j]);
+				}
+#if __cplusplus >= 201103L
+				std::pair<std::unordered_map<long long, int>::iterator, bool> inserted =
+#else
+				std::pair<std::map<long long, int>::iterator, bool> inserted =
+#endif
+						cells_.insert(std::make_pair(cellKey(c[0], c[1], c[2]), (int)counts.size()));
+				if(inserted.second)
+				{
+					counts.push_back(0);
+				}
+				cellOfPoint[i] = inserted.first->second;
+				++counts[cellOfPoint[i]];
+			}
+		}
+		cellStart_.resize(counts.size()+1, 0);
+		for(unsigned int i=0; i<counts.size(); ++i)
+		{
+			cellStart_[i+1] = cellStart_[i] + counts[i];
+		}
+		points_.resize(cellStart_.back());
+		std::vector<int> fill(cellStart_.begin(), cellStart_.end()-1);
+		for(int i=0; i<size; ++i)
+		{
+			if(cellOfPoint[i]>=0)
+			{
+				points_[fill[cellOfPoint[i]]++] = i;
+			}
+		}
+	}
+
+	/**
+	 * Neighbors of point i (including itself). With radius > 0, all points
+	 * in radius are returned (only the k nearest ones if k > 0), otherwise
+	 * the k nearest points are returned.
+	 */
+	void search(int i, int k, float radius, std::vector<std::pair<float, int> > & neighbors) const
+	{
+		neighbors.clear();
+		int c[3];
+		cell(x_[i], y_[i], z_[i], c);
+		int maxRing = 0;
+		for(int j=0; j<3; ++j)
+		{
+			maxRing = std::max(maxRing, std::max(c[j]-minCell_[j], maxCell_[j]-c[j]));
+		}
+		if(radius > 0.0f)
+		{
+			int rings = std::min(maxRing, (int)std::ceil(radius / cellSize_));
+			for(int r=0; r<=rings; ++r)
+			{
+				addRing(i, c, r, neighbors);
+			}
+			float sqrRadius = radius*radius;
+			unsigned int oi = 0;
+			for(unsigned int j=0; j<neighbors.size(); ++j)
+			{
+				if(neighbors[j].first <= sqrRadius)
+				{
+					neighbors[oi++] = neighbors[j];
+				}
+			}
+			neighbors.resize(oi);
+			if(k > 0 && (int)neighbors.size() > k)
+			{
+				std::nth_element(neighbors.begin(), neighbors.begin()+k, neighbors.end());
+				neighbors.resize(k);
+			}
+		}
+		else
+		{
+			UASSERT(k > 0);
+			// Points in distance r*cellSize are all found after visiting ring r
+			for(int r=0; r<=maxRing; ++r)
+			{
+				addRing(i, c, r, neighbors);
+				if((int)neighbors.size() >= k)
+				{
+					std::nth_element(neighbors.begin(), neighbors.begin()+(k-1), neighbors.end());
+					float maxDistance = float(r)*cellSize_;
+					if(neighbors[k-1].first <= maxDistance*maxDistance)
+					{
+						break;
+					}
+				}
+			}
+			if((int)neighbors.size() > k)
+			{
+				std::nth_element(neighbors.begin(), neighbors.begin()+(k-1), neighbors.end());
+				neighbors.resize(k);
+			}
+		}
+	}
+
+private:
+	static long long cellKey(int x, int y, int z)
+	{
+		return ((long long)(x & 0x1FFFFF) << 42) | ((long long)(y & 0x1FFFFF) << 21) | (long long)(z & 0x1FFFFF);
+	}
+	void cell(float x, float y, float z, int * c) const
+	{
+		c[0] = (int)std::floor(x/cellSize_);
+		c[1] = (int)std::floor(y/cellSize_);
+		c[2] = (int)std::floor(z/cellSize_);
+	}
+	// add points of cells at exactly r cells (Chebyshev distance) from cell c
+	void addRing(int i, const int * c, int r, std::vector<std::pair<float, int> > & neighbors) const
+	{
+		int xMin = std::max(c[0]-r, minCell_[0]);
+		int xMax = std::min(c[0]+r, maxCell_[0]);
+		int yMin = std::max(c[1]-r, minCell_[1]);
+		int yMax = std::min(c[1]+r, maxCell_[1]);
+		int zMin = std::max(c[2]-r, minCell_[2]);
+		int zMax = std::min(c[2]+r, maxCell_[2]);
+		for(int cx=xMin; cx<=xMax; ++cx)
+		{
+			for(int cy=yMin; cy<=yMax; ++cy)
+			{
+				bool border = cx==c[0]-r || cx==c[0]+r || cy==c[1]-r || cy==c[1]+r;
+				for(int cz=zMin; cz<=zMax; ++cz)
+				{
+					if(!border && cz!=c[2]-r && cz!=c[2]+r)
+					{
+						// inside cells are already visited, jump to the top
+						cz = c[2]+r-1;
+						continue;
+					}
+#if __cplusplus >= 201103L
+					std::unordered_map<long long, int>::const_iterator iter = cells_.find(cellKey(cx, cy, cz));
+#else
+					std::map<long long, int>::const_iterator iter = cells_.find(cellKey(cx, cy, cz));
+#endif
+					if(iter != cells_.end())
+					{
+						for(int j=cellStart_[iter->second]; j<cellStart_[iter->second+1]; ++j)
+						{
+							int index = points_[j];
+							float dx = x_[index] - x_[i];
+							float dy = y_[index] - y_[i];
+							float dz = z_[index] - z_[i];
+							neighbors.push_back(std::make_pair(dx*dx + dy*dy + dz*dz, index));
+						}
+					}
+				}
+			}
+		}
+	}
+
+private:
+	const float * x_;
+	const float * y_;
+	const float * z_;
+	float cellSize_;
+	int minCell_[3];
+	int maxCell_[3];
+#if __cplusplus >= 201103L
+	std::unordered_map<long long, int> cells_;
+#else
+	std::map<long long, int> cells_;
+#endif
+	std::vector<int> cellStart_;
+	std::vector<int> points_;
+};
+}
+
 LaserScan computeNormals(
 		const LaserScan & laserScan,
 		int searchK,
@@ -2435,69 +2637,187 @@ LaserScan computeNormals(
 	{
 		return laserScan;
 	}
+	UASSERT(searchK>0 || searchRadius>0.0f);
+	UASSERT(!laserScan.is2d() || !laserScan.hasRGB());
+
+	LaserScanChannels channels(laserScan, false);
+	const int size = channels.size();
+	const float * x = channels.x();
+	const float * y = channels.y();
+	const float * z = channels.z();
 
-	pcl::PointCloud<pcl::Normal>::Ptr normals;
-	// convert to compatible PCL format and filter it
-	if(laserScan.hasRGB())
+	float cellSize = searchRadius;
+	if(cellSize <= 0.0f)
 	{
-		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = laserScanToPointCloudRGB(laserScan);
-		if(cloud->size())
+		// Cell size from the distance to the searchK-th neighbor of sampled
+		// points, so that a cell has around searchK points. Scan points lie on
+		// surfaces, so the bounding box cannot be used to estimate their density.
+		std::vector<int> validIndices;
+		validIndices.reserve(size);
+		for(int i=0; i<size; ++i)
 		{
-			UASSERT(!laserScan.is2d());
-			pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(cloud, searchK, searchRadius);
-			return LaserScan(laserScanFromPointCloud(*cloud, *normals), laserScan.maxPoints(), laserScan.rangeMax(), LaserScan::kXYZRGBNormal, laserScan.localTransform());
+			if(uIsFinite(x[i]) && uIsFinite(y[i]) && uIsFinite(z[i]))
+			{
+				validIndices.push_back(i);
+			}
 		}
-	}
-	else if(laserScan.hasIntensity())
-	{
-		pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = laserScanToPointCloudI(laserScan);
-		if(cloud->size())
+		const int validPoints = (int)validIndices.size();
+		if(validPoints > 1)
 		{
-			if(laserScan.is2d())
+			const int k = std::min(searchK, validPoints-1);
+			const int samples = std::min(validPoints, 64);
+			std::vector<float> sampleDistances(samples);
+#ifdef _OPENMP
+			#pragma omp parallel for if(validPoints > 4096)
+#endif
+			for(int s=0; s<samples; ++s)
 			{
-				pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals2D(cloud, searchK, searchRadius);
-				if(laserScan.angleIncrement() > 0.0f)
+				int i = validIndices[(long long)s * validPoints / samples];
+				std::vector<float> sqrDistances(validPoints);
+				for(int j=0; j<validPoints; ++j)
 				{
-					return LaserScan(laserScan2dFromPointCloud(*cloud, *normals), LaserScan::kXYINormal, laserScan.rangeMin(), laserScan.rangeMax(), laserScan.angleMin(), laserScan.angleMax(), laserScan.angleIncrement(), laserScan.localTransform());
+					int index = validIndices[j];
+					float dx = x[index] - x[i];
+					float dy = y[index] - y[i];
+					float dz = z[index] - z[i];
+					sqrDistances[j] = dx*dx + dy*dy + dz*dz;
 				}
-				else
-				{
-					return LaserScan(laserScan2dFromPointCloud(*cloud, *normals), laserScan.maxPoints(), laserScan.rangeMax(), LaserScan::kXYINormal, laserScan.localTransform());
-				}
-
-			}
-			else
-			{
-				pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(cloud, searchK, searchRadius);
-				return LaserScan(laserScanFromPointCloud(*cloud, *normals), laserScan.maxPoints(), laserScan.rangeMax(), LaserScan::kXYZINormal, laserScan.localTransform());
+				// the point itself is at index 0
+				std::nth_element(sqrDistances.begin(), sqrDistances.begin()+k, sqrDistances.end());
+				sampleDistances[s] = std::sqrt(sqrDistances[k]);
 			}
+			std::nth_element(sampleDistances.begin(), sampleDistances.begin()+samples/2, sampleDistances.end());
+			cellSize = sampleDistances[samples/2];
+		}
+		if(!(cellSize > 0.0f))
+		{
+			cellSize = 1.0f;
 		}
 	}
-	else
+	ScanNeighborGrid grid(x, y, z, size, cellSize);
+
+	LaserScan::Format format = laserScan.format();
+	if(!laserScan.hasNormals())
 	{
-		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = laserScanToPointCloud(laserScan);
-		if(cloud->size())
+		if(laserScan.is2d())
+		{
+			format = laserScan.hasIntensity()?LaserScan::kXYINormal:LaserScan::kXYNormal;
+		}
+		else
 		{
-			if(laserScan.is2d())
+			format = laserScan.hasRGB()?LaserScan::kXYZRGBNormal:laserScan.hasIntensity()?LaserScan::kXYZINormal:LaserScan::kXYZNormal;
+		}
+	}
+	const int leadingChannels = (laserScan.is2d()?2:3) + (laserScan.hasRGB() || laserScan.hasIntensity()?1:0);
+	cv::Mat output(1, size, CV_32FC(LaserScan::channels(format)));
+	const int normalsOffset = leadingChannels; // normals follow xyz and intensity/rgb
+	const float badPoint = std::numeric_limits<float>::quiet_NaN();
+	const bool is2d = laserScan.is2d();
+
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+		std::vector<std::pair<float, int> > neighbors;
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic, 256)
+#endif
+		for(int i=0; i<size; ++i)
+		{
+			const float * ptrIn = laserScan.data().ptr<float>(0, i);
+			float * ptrOut = output.ptr<float>(0, i);
+			memcpy(ptrOut, ptrIn, leadingChannels*sizeof(float));
+			ptrOut[normalsOffset] = ptrOut[normalsOffset+1] = ptrOut[normalsOffset+2] = badPoint;
+			if(!uIsFinite(x[i]) || !uIsFinite(y[i]) || !uIsFinite(z[i]))
+			{
+				continue;
+			}
+
+			grid.search(i, searchK, searchRadius, neighbors);
+
+			if(is2d)
 			{
-				pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals2D(cloud, searchK, searchRadius);
-				if(laserScan.angleIncrement() > 0.0f)
+				// Same estimation than computeNormals2D() with viewpoint at origin
+				Eigen::Vector3f direction(-x[i], -y[i], -z[i]);
+				Eigen::Vector3f meanNormal(0,0,0);
+				int count = 0;
+				for(unsigned int j=0; j<neighbors.size(); ++j)
 				{
-					return LaserScan(laserScan2dFromPointCloud(*cloud, *normals), LaserScan::kXYNormal, laserScan.rangeMin(), laserScan.rangeMax(), laserScan.angleMin(), laserScan.angleMax(), laserScan.angleIncrement(), laserScan.localTransform());
+					int index = neighbors[j].second;
+					if(index != i)
+					{
+						Eigen::Vector3f v(x[index]-x[i], y[index]-y[i], z[index]-z[i]);
+						Eigen::Vector3f n = v.cross(direction).cross(v);
+						n.normalize();
+						meanNormal += n;
+						++count;
+					}
 				}
-				else
+				if(count)
 				{
-					return LaserScan(laserScan2dFromPointCloud(*cloud, *normals), laserScan.maxPoints(), laserScan.rangeMax(), LaserScan::kXYNormal, laserScan.localTransform());
+					meanNormal /= (float)count;
+					meanNormal.normalize();
+					ptrOut[normalsOffset] = meanNormal[0];
+					ptrOut[normalsOffset+1] = meanNormal[1];
+					ptrOut[normalsOffset+2] = meanNormal[2];
 				}
 			}
-			else
+			else if(neighbors.size() >= 3)
 			{
-				pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(cloud, searchK, searchRadius);
-				return LaserScan(laserScanFromPointCloud(*cloud, *normals), laserScan.maxPoints(), laserScan.rangeMax(), LaserScan::kXYZNormal, laserScan.localTransform());
+				// Smallest eigen vector of the covariance (like pcl::NormalEstimation)
+				Eigen::Vector3d centroid(0,0,0);
+				for(unsigned int j=0; j<neighbors.size(); ++j)
+				{
+					int index = neighbors[j].second;
+					centroid += Eigen::Vector3d(x[index], y[index], z[index]);
+				}
+				centroid /= double(neighbors.size());
+				Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+				for(unsigned int j=0; j<neighbors.size(); ++j)
+				{
+					int index = neighbors[j].second;
+					Eigen::Vector3d d = Eigen::Vector3d(x[index], y[index], z[index]) - centroid;
+					covariance += d * d.transpose();
+				}
+				covariance /= double(neighbors.size());
+				Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+				solver.computeDirect(covariance);
+				Eigen::Vector3d n = solver.eigenvectors().col(0);
+				if(n.allFinite())
+				{
+					// flip toward viewpoint (origin)
+					if(-x[i]*n[0] - y[i]*n[1] - z[i]*n[2] < 0.0)
+					{
+						n = -n;
+					}
+					ptrOut[normalsOffset] = n[0];
+					ptrOut[normalsOffset+1] = n[1];
+					ptrOut[normalsOffset+2] = n[2];
+				}
 			}
 		}
 	}
-	return LaserScan();
+
+	// Like PCL conversion, points without normal are removed
+	std::vector<int> indices;
+	indices.reserve(size);
+	for(int i=0; i<size; ++i)
+	{
+		if(uIsFinite(output.ptr<float>(0, i)[normalsOffset]))
+		{
+			indices.push_back(i);
+		}
+	}
+	if((int)indices.size() < size)
+	{
+		output = LaserScanChannels::select(output, indices);
+	}
+
+	if(laserScan.angleIncrement() > 0.0f)
+	{
+		return LaserScan(output, format, laserScan.rangeMin(), laserScan.rangeMax(), laserScan.angleMin(), laserScan.angleMax(), laserScan.angleIncrement(), laserScan.localTransform());
+	}
+	return LaserScan(output, laserScan.maxPoints(), laserScan.rangeMax(), format, laserScan.localTransform());
 }
 
 template<typename PointT>
@@ -3139,6 +3459,9 @@ LaserScan adjustNormalsToViewPoint(
 		int ny = nx+1;
 		int nz = ny+1;
 		cv::Mat output = scan.data().clone();
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(static) if(scan.size() > 4096)
+#endif
 		for(int i=0; i<scan.size(); ++i)
 		{
 			float * ptr = output.ptr<float>(0, i);
@@ -3149,7 +3472,7 @@ LaserScan adjustNormalsToViewPoint(
 
 				float result = v.dot(n);
 				if(result < 0
-				 || (forceGroundNormalsUp && ptr[nz] < -0.8 && ptr[2] < viewpoint[3])) // some far velodyne rays on road can have normals toward ground
+				 || (forceGroundNormalsUp && ptr[nz] < -0.8 && ptr[2] < viewpoint[2])) // some far velodyne rays on road can have normals toward ground
 				{
 					//reverse normal
 					ptr[nx] *= -1.0f;
@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "rtabmap/core/util3d_transforms.h"
+#include "rtabmap/core/LaserScanChannels.h"
 
 #include <pcl/common/transforms.h>
 #include <rtabmap/utilite/ULogger.h>
@@ -38,50 +39,17 @@ namespace util3d
 
 LaserScan transformLaserScan(const LaserScan & laserScan, const Transform & transform)
 {
-	cv::Mat output = laserScan.data().clone();
+	cv::Mat output;
 
 	if(!transform.isNull() && !transform.isIdentity())
 	{
-		Eigen::Affine3f transform3f = transform.toEigen3f();
-		int nx = laserScan.getNormalsOffset();
-		int ny = nx+1;
-		int nz = ny+1;
-		for(int i=0; i<laserScan.size(); ++i)
-		{
-			const float * ptr = laserScan.data().ptr<float>(0, i);
-			float * out = output.ptr<float>(0, i);
-			if(nx == -1)
-			{
-				pcl::PointXYZ pt(ptr[0], ptr[1], laserScan.is2d()?0:ptr[2]);
-				pt = pcl::transformPoint(pt, transform3f);
-				out[0] = pt.x;
-				out[1] = pt.y;
-				if(!laserScan.is2d())
-				{
-					out[2] = pt.z;
-				}
-			}
-			else
-			{
-				pcl::PointNormal pt;
-				pt.x=ptr[0];
-				pt.y=ptr[1];
-				pt.z=laserScan.is2d()?0:ptr[2];
-				pt.normal_x=ptr[nx];
-				pt.normal_y=ptr[ny];
-				pt.normal_z=ptr[nz];
-				pt = util3d::transformPoint(pt, transform);
-				out[0] = pt.x;
-				out[1] = pt.y;
-				if(!laserScan.is2d())
-				{
-					out[2] = pt.z;
-				}
-				out[nx] = pt.normal_x;
-				out[ny] = pt.normal_y;
-				out[nz] = pt.normal_z;
-			}
-		}
+		LaserScanChannels channels(laserScan);
+		channels.transform(transform);
+		output = channels.data(laserScan);
+	}
+	else
+	{
+		output = laserScan.data().clone();
 	}
 	if(laserScan.angleIncrement() > 0.0f)
 	{
@@ -52,6 +52,7 @@ void showUsage()
 			"  -db \"input.db\"          Use database instead of camera (recorded with rtabmap-dataRecorder)\n"
 			"  -clouds #                 Maximum clouds shown (default 10, zero means inf)\n"
 			"  -sec #.#                  Delay (seconds) before reading the database (if set)\n"
+			"  -workers #                Camera post-processing threads (default 0, post-processing done in the camera thread)\n"
 			"%s\n",
 			rtabmap::Parameters::showUsage());
 	exit(1);
@@ -68,6 +69,7 @@ int main (int argc, char * argv[])
 	int driver = 0;
 	int maxClouds = 10;
 	float sec = 0.0f;
+	int workers = 0;
 
 	for(int i=1; i<argc; ++i)
 	{
@@ -157,6 +159,23 @@ int main (int argc, char * argv[])
 			}
 			continue;
 		}
+		if(strcmp(argv[i], "-workers") == 0)
+		{
+			++i;
+			if(i < argc)
+			{
+				workers = std::atoi(argv[i]);
+				if(workers < 0)
+				{
+					showUsage();
+				}
+			}
+			else
+			{
+				showUsage();
+			}
+			continue;
+		}
 		if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0)
 		{
 			showUsage();
@@ -312,6 +331,7 @@ int main (int argc, char * argv[])
 			rtabmap::CameraThread cameraThread(camera, parameters);
 
 			cameraThread.setScanParameters(icp, decimation<1?1:decimation, 0, maxDepth, voxelSize, normalsK, normalsRadius);
+			cameraThread.setPipelineWorkers(workers);
 
 			odomThread.start();
 			cameraThread.start();
@@ -62,6 +62,8 @@ void showUsage()
 			"     -g3         Assemble 3D cloud map and save it to \"[output]_map.pcd\".\n"
 			"     -o2         Assemble OctoMap 2D projection and save it to \"[output]_octomap.pgm\".\n"
 			"     -o3         Assemble OctoMap 3D cloud and save it to \"[output]_octomap.pcd\".\n"
+			"     -ra #       Read-ahead window: number of nodes loaded and decompressed\n"
+			"                       ahead in a background thread (default 0 = disabled).\n"
 			"%s\n"
 			"\n", Parameters::showUsage());
 	exit(1);
@@ -152,6 +154,7 @@ int main(int argc, char * argv[])
 	bool assemble2dOctoMap = false;
 	bool assemble3dOctoMap = false;
 	bool useDatabaseRate = false;
+	int readAhead = 0;
 	ParametersMap configParameters;
 	for(int i=1; i<argc-2; ++i)
 	{
@@ -205,6 +208,19 @@ int main(int argc, char * argv[])
 			printf("RTAB-Map is not built with OctoMap support, cannot set -o3 option!\n");
 #endif
 		}
+		else if(strcmp(argv[i], "-ra") == 0 || strcmp(argv[i], "--ra") == 0)
+		{
+			++i;
+			if(i < argc - 2 && uStr2Int(argv[i]) >= 0)
+			{
+				readAhead = uStr2Int(argv[i]);
+				printf("Read-ahead window set to %d nodes.\n", readAhead);
+			}
+			else
+			{
+				showUsage();
+			}
+		}
 	}
 
 	std::string inputDatabasePath = uReplaceChar(argv[argc-2], '~', UDirectory::homeDir());
@@ -323,6 +339,7 @@ int main(int argc, char * argv[])
 	Parameters::parse(parameters, Parameters::kRGBDEnabled(), rgbdEnabled);
 	bool odometryIgnored = !rgbdEnabled;
 	DBReader dbReader(inputDatabasePath, useDatabaseRate?-1:0, odometryIgnored);
+	dbReader.setReadAhead(readAhead);
 	dbReader.init();
 
 	OccupancyGrid grid(parameters);
@@ -23,12 +23,15 @@
 #include "rtabmap/utilite/UtiLiteExp.h" // DLL export/import defines
 
 #include "rtabmap/utilite/UEventsHandler.h"
+#include "rtabmap/utilite/UEvent.h"
 #include "rtabmap/utilite/UThreadNode.h"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UDestroyer.h"
 
 #include <list>
 #include <map>
+#include <vector>
+#include <typeinfo>
 
 // TODO Not implemented... for multithreading event handling
 class UEventDispatcher : public UThread
@@ -49,6 +52,28 @@ private:
 	std::vector<UEventsHandler*> _handlers;
 };
 
+/**
+ * Type of events subscribed by an handler, see UEventsManager::subscribe().
+ */
+class UEventFilter
+{
+public:
+	virtual ~UEventFilter() {}
+	/**
+	 * @return true if the event is of the subscribed type or of a class derived from it.
+	 */
+	virtual bool accept(const UEvent * event) const = 0;
+	virtual const std::type_info & type() const = 0;
+};
+
+template<class T>
+class UEventTypeFilter : public UEventFilter
+{
+public:
+	virtual bool accept(const UEvent * event) const {return dynamic_cast<const T*>(event) != 0;}
+	virtual const std::type_info & type() const {return typeid(T);}
+};
+
 /**
  * This class is used to post events between threads 
  * in the application. It is Thread-Safe and the events are sent 
@@ -109,6 +134,38 @@ public:
      */
     static void post(UEvent * event, bool async = true, const UEventsSender * sender = 0);
 
+    /**
+     * Subscribe an handler to a type of events. Once an handler
+     * has subscribed to at least one type, only events of the
+     * subscribed types, or of classes derived from them, are
+     * dispatched to it. Handlers without subscription receive all
+     * events (default). The handlers of each type of events are
+     * listed once, so no class name string is created and not
+     * all handlers are tested while dispatching.
+     *
+     * Subscriptions are done for the class of the handler at the
+     * time of the call (e.g., in its constructor). If the handler is
+     * an instance of a derived class which doesn't subscribe itself,
+     * the subscriptions are ignored and the handler receives all
+     * events, as the derived class may handle other events.
+     *
+     * @code
+     *  UEventsManager::subscribe<CameraEvent>(&handler);
+     * @endcode
+     *
+     * @param handler the handler.
+     * @param filter the type of events, ownership is transferred.
+     */
+    static void subscribe(const UEventsHandler * handler, UEventFilter * filter);
+    template<class T>
+    static void subscribe(const UEventsHandler * handler) {subscribe(handler, new UEventTypeFilter<T>());}
+
+    /**
+     * Remove all subscriptions of the handler, which
+     * will then receive all events.
+     */
+    static void unsubscribe(const UEventsHandler * handler);
+
     static void createPipe(
 		const UEventsSender * sender,
 		const UEventsHandler * receiver,
@@ -224,6 +281,15 @@ private:
     void _removeAllPipes(const UEventsSender * sender);
     void _removeNullPipes(const UEventsSender * sender);
 
+    void _subscribe(const UEventsHandler * handler, UEventFilter * filter);
+    void _unsubscribe(const UEventsHandler * handler);
+
+    /*
+     * Handlers receiving this type of events, to be called with handlersMutex_ locked.
+     */
+    const std::vector<UEventsHandler*> & getHandlers(const UEvent * event);
+    bool isHandlerStillAdded(UEventsHandler * handler, unsigned long version);
+
 private:
     
     class Pipe
@@ -239,15 +305,33 @@ private:
     	const std::string eventName_;
     };
 
+    class Subscription
+    {
+    public:
+    	Subscription() : handlerType_(0) {}
+    	const std::type_info * handlerType_; /* Class of the handler which subscribed. */
+    	std::vector<UEventFilter*> filters_;
+    };
+
+    struct TypeInfoLess
+    {
+    	bool operator()(const std::type_info * a, const std::type_info * b) const {return a->before(*b) != 0;}
+    };
+
+    class EventsQueue;
+
     static UEventsManager* instance_;            /* The EventsManager instance pointer. */
     static UDestroyer<UEventsManager> destroyer_; /* The EventsManager's destroyer. */
-    std::list<std::pair<UEvent*, const UEventsSender * > > events_; /* The events list. */
+    EventsQueue * events_;                      /* The posted events. */
+    std::vector<std::pair<UEvent*, const UEventsSender * > > eventsBuf_; /* Events being dispatched. */
     std::list<UEventsHandler*> handlers_;      /* The handlers list. */
-    UMutex eventsMutex_;                         /* The mutex of the events list, */
     UMutex handlersMutex_;                       /* The mutex of the handlers list. */
+    unsigned long handlersVersion_;              /* Incremented when an handler is removed. */
     USemaphore postEventSem_;                    /* Semaphore used to signal when an events is posted. */
     std::list<Pipe> pipes_;
     UMutex pipesMutex_;
+    std::map<const UEventsHandler*, Subscription> subscriptions_; /* Event types subscribed by handlers, protected by handlersMutex_. */
+    std::map<const std::type_info*, std::vector<UEventsHandler*>, TypeInfoLess> typeHandlers_; /* Handlers by type of events, cleared when handlers or subscriptions change. */
 };
 
 #endif // UEVENTSMANAGER_H
@@ -0,0 +1,193 @@
+/*
+*  utilite is a cross-platform library with
+*  useful utilities for fast and small developing.
+*  Copyright (C) 2010  Mathieu Labbe
+*
+*  utilite is free library: you can redistribute it and/or modify
+*  it under the terms of the GNU Lesser General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  utilite is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UTHREADPOOL_H
+#define UTHREADPOOL_H
+
+#include "rtabmap/utilite/UtiLiteExp.h" // DLL export/import defines
+
+#include "rtabmap/utilite/UThread.h"
+#include "rtabmap/utilite/UMutex.h"
+#include "rtabmap/utilite/USemaphore.h"
+#include "rtabmap/utilite/UDestroyer.h"
+
+#include <list>
+#include <vector>
+
+class UThreadPool;
+
+/**
+ * A task executed by a UThreadPool. Only run() needs to be implemented.
+ * The task acts as its own future: after start() (or UThreadPool::post()),
+ * wait() blocks until run() has been executed. If the task is
+ * still queued when wait() is called, it is removed from the queue and
+ * executed in the calling thread, so waiting on a task from a pool
+ * worker never deadlocks.
+ *
+ * Example:
+ * @code
+ * class SumTask : public UTask
+ * {
+ * public:
+ * 	SumTask(const std::vector<int> & v) : v_(v), sum_(0) {}
+ * 	virtual ~SumTask() {this->wait();}
+ * 	int sum() const {return sum_;}
+ * protected:
+ * 	virtual void run() {for(unsigned int i=0; i<v_.size(); ++i) sum_+=v_[i];}
+ * private:
+ * 	std::vector<int> v_;
+ * 	int sum_;
+ * };
+ *
+ * SumTask a(v1), b(v2);
+ * a.start(); // executed by UThreadPool::instance()
+ * b.start();
+ * a.wait();
+ * b.wait();
+ * int total = a.sum() + b.sum();
+ * @endcode
+ *
+ * The task object must stay valid until it is done. Like for UThread, inherited
+ * classes should call wait() in their destructor: if the task is still
+ * queued when UTask's destructor is reached, it is discarded without being executed.
+ */
+class UTILITE_EXP UTask
+{
+public:
+	UTask();
+	virtual ~UTask();
+
+	/**
+	 * Post the task to the shared pool UThreadPool::instance().
+	 * Does nothing if the task is already pending.
+	 */
+	void start();
+
+	/**
+	 * Block until the task is done. Returns immediately
+	 * if the task has never been started.
+	 */
+	void wait();
+
+	/**
+	 * @return true if the task is started and wait() has not been called yet.
+	 */
+	bool isPending() const;
+
+	/**
+	 * @return true if the task is started and run() is done, wait() would not block.
+	 */
+	bool isDone() const;
+
+protected:
+	/**
+	 * The work to do, called once per start() from a worker thread
+	 * of the pool (or from the thread calling wait()).
+	 */
+	virtual void run() = 0;
+
+private:
+	// Prevent copies
+	UTask(const UTask &);
+	UTask & operator=(const UTask &);
+
+private:
+	friend class UThreadPool;
+	UThreadPool * pool_;
+	bool pending_;
+	bool done_;
+	USemaphore doneSem_; // released when run() is done
+	mutable UMutex stateMutex_;
+};
+
+/**
+ * A pool of persistent worker threads executing UTask objects
+ * in FIFO order. Use UThreadPool::instance() to share the same workers
+ * across the application instead of creating a thread per job.
+ */
+class UTILITE_EXP UThreadPool
+{
+public:
+	/**
+	 * The shared pool, created on first call with
+	 * as many workers as there are CPU cores.
+	 */
+	static UThreadPool * instance();
+
+	/**
+	 * @return the number of CPU cores available (at least 1).
+	 */
+	static int hardwareConcurrency();
+
+public:
+	/**
+	 * @param threads number of workers, 0 means hardwareConcurrency().
+	 */
+	UThreadPool(int threads = 0);
+
+	/**
+	 * Stop the workers. Tasks still queued are executed
+	 * by the calling thread before returning.
+	 */
+	virtual ~UThreadPool();
+
+	/**
+	 * Queue the task. The caller keeps ownership of the task, which
+	 * must stay valid until UTask::wait() returns. Does nothing if
+	 * the task is already pending.
+	 */
+	void post(UTask * task);
+
+	int threads() const {return (int)workers_.size();}
+
+private:
+	class Worker : public UThread
+	{
+	public:
+		Worker(UThreadPool * pool) : pool_(pool) {}
+		virtual ~Worker() {this->join(true);}
+	private:
+		virtual void mainLoop();
+		virtual void mainLoopKill();
+	private:
+		UThreadPool * pool_;
+	};
+
+	// Return the next task to execute, blocking until one is
+	// available. Returns 0 if the worker is killed.
+	UTask * take(Worker * worker);
+	// Remove the task from the queue, returns false if
+	// the task is already taken by a worker.
+	bool remove(UTask * task);
+	static void execute(UTask * task);
+
+private:
+	friend class UTask;
+	friend class UDestroyer<UThreadPool>;
+	static UThreadPool * instance_;
+	static UDestroyer<UThreadPool> destroyer_;
+	static UMutex instanceMutex_;
+
+	std::vector<Worker*> workers_;
+	std::list<UTask*> tasks_;
+	UMutex tasksMutex_;
+	USemaphore tasksSem_;
+};
+
+#endif /* UTHREADPOOL_H */
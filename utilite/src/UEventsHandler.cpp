@@ -23,6 +23,7 @@
 UEventsHandler::~UEventsHandler()
 {
 	unregisterFromEventsManager();
+	UEventsManager::unsubscribe(this);
 }
 
 
@@ -22,9 +22,154 @@
 #include <list>
 #include "rtabmap/utilite/UStl.h"
 
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <thread>
+#endif
+
 UEventsManager* UEventsManager::instance_ = 0;
 UDestroyer<UEventsManager> UEventsManager::destroyer_;
 
+/*
+ * Posted events, waiting to be dispatched by the UEventsManager thread (single consumer).
+ */
+class UEventsManager::EventsQueue
+{
+public:
+	typedef std::pair<UEvent*, const UEventsSender*> Entry;
+
+#if __cplusplus >= 201103L
+	// Bounded ring buffer: producers reserve a cell by incrementing the tail,
+	// then publish it by setting its sequence number, so posting doesn't lock.
+	// When the ring is full, events go to the overflow list until the consumer
+	// empties it, so that events of a same sender are dispatched in order.
+	EventsQueue() :
+		tail_(0),
+		head_(0),
+		overflowSize_(0)
+	{
+		for(size_t i=0; i<kCapacity; ++i)
+		{
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	void push(UEvent * event, const UEventsSender * sender)
+	{
+		if(overflowSize_.load(std::memory_order_acquire) == 0)
+		{
+			size_t pos = tail_.load(std::memory_order_relaxed);
+			while(true)
+			{
+				Cell & cell = cells_[pos & (kCapacity-1)];
+				size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				if(sequence == pos)
+				{
+					if(tail_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+					{
+						cell.entry = Entry(event, sender);
+						cell.sequence.store(pos+1, std::memory_order_release);
+						return;
+					}
+				}
+				else if(sequence < pos)
+				{
+					// full
+					break;
+				}
+				else
+				{
+					pos = tail_.load(std::memory_order_relaxed);
+				}
+			}
+		}
+		overflowMutex_.lock();
+		overflow_.push_back(Entry(event, sender));
+		overflowSize_.store(overflow_.size(), std::memory_order_release);
+		overflowMutex_.unlock();
+	}
+
+	void popAll(std::vector<Entry> & entries)
+	{
+		if(overflowSize_.load(std::memory_order_acquire) == 0)
+		{
+			popRing(entries);
+		}
+		else
+		{
+			overflowMutex_.lock();
+			// Events put in the ring before the overflowed ones must
+			// be dispatched first: wait for cells reserved but not yet published.
+			size_t tail = tail_.load(std::memory_order_acquire);
+			while(head_ < tail)
+			{
+				popRing(entries);
+				if(head_ < tail)
+				{
+					std::this_thread::yield();
+				}
+			}
+			entries.insert(entries.end(), overflow_.begin(), overflow_.end());
+			overflow_.clear();
+			overflowSize_.store(0, std::memory_order_release);
+			overflowMutex_.unlock();
+		}
+	}
+
+private:
+	void popRing(std::vector<Entry> & entries)
+	{
+		while(true)
+		{
+			Cell & cell = cells_[head_ & (kCapacity-1)];
+			if(cell.sequence.load(std::memory_order_acquire) != head_+1)
+			{
+				// empty or not yet published
+				break;
+			}
+			entries.push_back(cell.entry);
+			cell.sequence.store(head_+kCapacity, std::memory_order_release);
+			++head_;
+		}
+	}
+
+	static const size_t kCapacity = 1024; // power of 2
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		Entry entry;
+	};
+	Cell cells_[kCapacity];
+	std::atomic<size_t> tail_;
+	size_t head_; // only used by the consumer
+	std::atomic<size_t> overflowSize_;
+	std::vector<Entry> overflow_;
+	UMutex overflowMutex_;
+#else
+	// Without C++11 atomics, the list is protected by a mutex, which
+	// is only held to append an event or to swap the list.
+	void push(UEvent * event, const UEventsSender * sender)
+	{
+		eventsMutex_.lock();
+		events_.push_back(Entry(event, sender));
+		eventsMutex_.unlock();
+	}
+
+	void popAll(std::vector<Entry> & entries)
+	{
+		std::list<Entry> events;
+		eventsMutex_.lock();
+		events.swap(events_);
+		eventsMutex_.unlock();
+		entries.insert(entries.end(), events.begin(), events.end());
+	}
+
+private:
+	std::list<Entry> events_;
+	UMutex eventsMutex_;
+#endif
+};
+
 void UEventsManager::addHandler(UEventsHandler* handler)
 {
 	if(!handler)
@@ -64,6 +209,33 @@ void UEventsManager::post(UEvent * event, bool async, const UEventsSender * send
 	}
 }
 
+void UEventsManager::subscribe(const UEventsHandler * handler, UEventFilter * filter)
+{
+	if(!handler || !filter)
+	{
+		UERROR("Handler and/or filter is null!");
+		delete filter;
+		return;
+	}
+	else
+	{
+		UEventsManager::getInstance()->_subscribe(handler, filter);
+	}
+}
+
+void UEventsManager::unsubscribe(const UEventsHandler * handler)
+{
+	if(!handler)
+	{
+		UERROR("Handler is null!");
+		return;
+	}
+	else
+	{
+		UEventsManager::getInstance()->_unsubscribe(handler);
+	}
+}
+
 void UEventsManager::createPipe(
 		const UEventsSender * sender,
 		const UEventsHandler * receiver,
@@ -133,7 +305,9 @@ UEventsManager* UEventsManager::getInstance()
     return instance_;
 }
 
-UEventsManager::UEventsManager()
+UEventsManager::UEventsManager() :
+	events_(new EventsQueue()),
+	handlersVersion_(0)
 {
 }
 
@@ -142,13 +316,25 @@ UEventsManager::~UEventsManager()
    	join(true);
 
     // Free memory
-    for(std::list<std::pair<UEvent*, const UEventsSender*> >::iterator it=events_.begin(); it!=events_.end(); ++it)
+    eventsBuf_.clear();
+    events_->popAll(eventsBuf_);
+    for(unsigned int i=0; i<eventsBuf_.size(); ++i)
     {
-        delete it->first;
+        delete eventsBuf_[i].first;
     }
-    events_.clear();
+    eventsBuf_.clear();
+    delete events_;
 
     handlers_.clear();
+    for(std::map<const UEventsHandler*, Subscription>::iterator iter=subscriptions_.begin(); iter!=subscriptions_.end(); ++iter)
+    {
+        for(unsigned int i=0; i<iter->second.filters_.size(); ++i)
+        {
+            delete iter->second.filters_[i];
+        }
+    }
+    subscriptions_.clear();
+    typeHandlers_.clear();
 
     instance_ = 0;
 }
@@ -169,77 +355,110 @@ void UEventsManager::mainLoopKill()
 
 void UEventsManager::dispatchEvents()
 {
-    if(events_.size() == 0)
-    {
-        return;
-    }
-
-    std::list<std::pair<UEvent*, const UEventsSender*> >::iterator it;
-    std::list<std::pair<UEvent*, const UEventsSender*> > eventsBuf;
-
-    // Copy events in a buffer :
+    // Move events in a buffer:
     // Other threads can post events 
     // while events are handled.
-    eventsMutex_.lock();
-    {
-        eventsBuf = events_;
-        events_.clear();
-    }
-    eventsMutex_.unlock();
+    eventsBuf_.clear();
+    events_->popAll(eventsBuf_);
 
 	// Past events to handlers
-	for(it=eventsBuf.begin(); it!=eventsBuf.end(); ++it)
+	for(unsigned int i=0; i<eventsBuf_.size(); ++i)
 	{
-		if(!dispatchEvent(it->first, it->second))
+		if(!dispatchEvent(eventsBuf_[i].first, eventsBuf_[i].second))
 		{
-			delete it->first;
+			delete eventsBuf_[i].first;
 		}
 	}
-    eventsBuf.clear();
+    eventsBuf_.clear();
 }
 
 bool UEventsManager::dispatchEvent(UEvent * event, const UEventsSender * sender)
 {
-	std::list<UEventsHandler*> handlers;
+	std::vector<UEventsHandler*> handlers;
 
 	// Verify if there are pipes with the sender for his type of event
 	if(sender)
 	{
-		handlers = getPipes(sender, event->getClassName());
+		pipesMutex_.lock();
+		bool hasPipes = !pipes_.empty();
+		pipesMutex_.unlock();
+		if(hasPipes)
+		{
+			std::list<UEventsHandler*> pipes = getPipes(sender, event->getClassName());
+			handlers.insert(handlers.end(), pipes.begin(), pipes.end());
+		}
 	}
 
 	handlersMutex_.lock();
 	if(handlers.size() == 0)
 	{
-		//No pipes, send to all handlers
-		handlers = handlers_;
+		//No pipes, send to handlers of this type of event
+		handlers = getHandlers(event);
 	}
+	unsigned long version = handlersVersion_;
+	handlersMutex_.unlock();
 
 	bool handled = false;
 
-	for(std::list<UEventsHandler*>::iterator it=handlers.begin(); it!=handlers.end() && !handled; ++it)
+	for(unsigned int i=0; i<handlers.size() && !handled; ++i)
 	{
+		UEventsHandler * handler = handlers[i];
+
 		// Check if the handler is still in the
 		// handlers_ list (may be changed if addHandler() or
 		// removeHandler() is called in EventsHandler::handleEvent())
-		if(std::find(handlers_.begin(), handlers_.end(), *it) != handlers_.end())
+		// Don't process event if the handler is the same as the sender
+		if(handler && handler != sender && isHandlerStillAdded(handler, version))
 		{
-			UEventsHandler * handler = *it;
-			handlersMutex_.unlock();
+			// To be able to add/remove an handler in a handleEvent call (without a deadlock)
+			// @see _addHandler(), _removeHandler()
+			handled = handler->handleEvent(event);
+		}
+	}
+	return handled;
+}
 
-			// Don't process event if the handler is the same as the sender
-			if(handler != sender)
+const std::vector<UEventsHandler*> & UEventsManager::getHandlers(const UEvent * event)
+{
+	const std::type_info & eventType = typeid(*event);
+	std::map<const std::type_info*, std::vector<UEventsHandler*>, TypeInfoLess>::iterator iter = typeHandlers_.find(&eventType);
+	if(iter == typeHandlers_.end())
+	{
+		// First event of this type since handlers or subscriptions changed, list its handlers
+		std::vector<UEventsHandler*> & handlers = typeHandlers_[&eventType];
+		for(std::list<UEventsHandler*>::iterator it=handlers_.begin(); it!=handlers_.end(); ++it)
+		{
+			bool accepted = true;
+			std::map<const UEventsHandler*, Subscription>::const_iterator jter = subscriptions_.find(*it);
+			// Subscriptions made by a parent class are ignored (see subscribe())
+			if(jter != subscriptions_.end() && *jter->second.handlerType_ == typeid(**it))
 			{
-				// To be able to add/remove an handler in a handleEvent call (without a deadlock)
-				// @see _addHandler(), _removeHandler()
-				handled = handler->handleEvent(event);
+				accepted = false;
+				for(unsigned int i=0; i<jter->second.filters_.size() && !accepted; ++i)
+				{
+					accepted = jter->second.filters_[i]->accept(event);
+				}
+			}
+			if(accepted)
+			{
+				handlers.push_back(*it);
 			}
-
-			handlersMutex_.lock();
 		}
+		return handlers;
+	}
+	return iter->second;
+}
+
+bool UEventsManager::isHandlerStillAdded(UEventsHandler * handler, unsigned long version)
+{
+	bool added = true;
+	handlersMutex_.lock();
+	if(version != handlersVersion_)
+	{
+		added = std::find(handlers_.begin(), handlers_.end(), handler) != handlers_.end();
 	}
 	handlersMutex_.unlock();
-	return handled;
+	return added;
 }
 
 void UEventsManager::_addHandler(UEventsHandler* handler)
@@ -260,6 +479,7 @@ void UEventsManager::_addHandler(UEventsHandler* handler)
         	if(!handlerFound)
         	{
         		handlers_.push_back(handler);
+        		typeHandlers_.clear();
         	}
         }
         handlersMutex_.unlock();
@@ -277,6 +497,8 @@ void UEventsManager::_removeHandler(UEventsHandler* handler)
                 if(*it == handler)
                 {
                     handlers_.erase(it);
+                    typeHandlers_.clear();
+                    ++handlersVersion_;
                     break;
                 }
             }
@@ -303,11 +525,7 @@ void UEventsManager::_postEvent(UEvent * event, bool async, const UEventsSender
     {
     	if(async)
     	{
-			eventsMutex_.lock();
-			{
-				events_.push_back(std::make_pair(event, sender));
-			}
-			eventsMutex_.unlock();
+			events_->push(event, sender);
 
 			// Signal the EventsManager that an Event is added
 			postEventSem_.release();
@@ -411,6 +629,45 @@ void UEventsManager::_createPipe(
 	pipesMutex_.unlock();
 }
 
+void UEventsManager::_subscribe(const UEventsHandler * handler, UEventFilter * filter)
+{
+	handlersMutex_.lock();
+	Subscription & subscription = subscriptions_[handler];
+	// The most derived class which subscribed, see subscribe()
+	subscription.handlerType_ = &typeid(*handler);
+	bool found = false;
+	for(unsigned int i=0; i<subscription.filters_.size() && !found; ++i)
+	{
+		found = subscription.filters_[i]->type() == filter->type();
+	}
+	if(!found)
+	{
+		subscription.filters_.push_back(filter);
+	}
+	else
+	{
+		delete filter;
+	}
+	typeHandlers_.clear();
+	handlersMutex_.unlock();
+}
+
+void UEventsManager::_unsubscribe(const UEventsHandler * handler)
+{
+	handlersMutex_.lock();
+	std::map<const UEventsHandler*, Subscription>::iterator iter = subscriptions_.find(handler);
+	if(iter != subscriptions_.end())
+	{
+		for(unsigned int i=0; i<iter->second.filters_.size(); ++i)
+		{
+			delete iter->second.filters_[i];
+		}
+		subscriptions_.erase(iter);
+		typeHandlers_.clear();
+	}
+	handlersMutex_.unlock();
+}
+
 void UEventsManager::_removePipe(
 		const UEventsSender * sender,
 		const UEventsHandler * receiver,
@@ -0,0 +1,252 @@
+/*
+*  utilite is a cross-platform library with
+*  useful utilities for fast and small developing.
+*  Copyright (C) 2010  Mathieu Labbe
+*
+*  utilite is free library: you can redistribute it and/or modify
+*  it under the terms of the GNU Lesser General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  utilite is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rtabmap/utilite/UThreadPool.h"
+#include "rtabmap/utilite/ULogger.h"
+
+#ifdef _WIN32
+#include "Windows.h"
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+////////////////////////////
+// UTask
+////////////////////////////
+UTask::UTask() :
+	pool_(0),
+	pending_(false),
+	done_(false)
+{
+}
+
+UTask::~UTask()
+{
+	// run() cannot be called anymore at this point (inherited
+	// classes are already destroyed), just make sure the task
+	// is not referenced by the pool anymore.
+	stateMutex_.lock();
+	UThreadPool * pool = pending_?pool_:0;
+	stateMutex_.unlock();
+	if(pool && !pool->remove(this))
+	{
+		doneSem_.acquire();
+	}
+}
+
+void UTask::start()
+{
+	UThreadPool::instance()->post(this);
+}
+
+void UTask::wait()
+{
+	stateMutex_.lock();
+	UThreadPool * pool = pending_?pool_:0;
+	stateMutex_.unlock();
+	if(pool)
+	{
+		// Not taken by a worker yet? do it ourself instead of waiting
+		if(pool->remove(this))
+		{
+			UThreadPool::execute(this);
+		}
+		doneSem_.acquire();
+
+		stateMutex_.lock();
+		pending_ = false;
+		pool_ = 0;
+		stateMutex_.unlock();
+	}
+}
+
+bool UTask::isPending() const
+{
+	UScopeMutex lock(stateMutex_);
+	return pending_;
+}
+
+bool UTask::isDone() const
+{
+	UScopeMutex lock(stateMutex_);
+	return pending_ && done_;
+}
+
+////////////////////////////
+// UThreadPool
+////////////////////////////
+UThreadPool * UThreadPool::instance_ = 0;
+UDestroyer<UThreadPool> UThreadPool::destroyer_;
+UMutex UThreadPool::instanceMutex_;
+
+UThreadPool * UThreadPool::instance()
+{
+	UScopeMutex lock(instanceMutex_);
+	if(!instance_)
+	{
+		instance_ = new UThreadPool();
+		destroyer_.setDoomed(instance_);
+	}
+	return instance_;
+}
+
+int UThreadPool::hardwareConcurrency()
+{
+	int n = 1;
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	n = (int)info.dwNumberOfProcessors;
+#else
+	n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return n>0?n:1;
+}
+
+UThreadPool::UThreadPool(int threads)
+{
+	if(threads <= 0)
+	{
+		threads = hardwareConcurrency();
+	}
+	UDEBUG("Starting %d workers", threads);
+	workers_.resize(threads);
+	for(unsigned int i=0; i<workers_.size(); ++i)
+	{
+		workers_[i] = new Worker(this);
+		workers_[i]->start();
+	}
+}
+
+UThreadPool::~UThreadPool()
+{
+	for(unsigned int i=0; i<workers_.size(); ++i)
+	{
+		workers_[i]->kill();
+	}
+	// Wake up workers that missed their kill signal
+	tasksSem_.release((int)workers_.size());
+	for(unsigned int i=0; i<workers_.size(); ++i)
+	{
+		delete workers_[i];
+	}
+	workers_.clear();
+
+	// Don't leave waiting tasks behind
+	tasksMutex_.lock();
+	std::list<UTask*> tasks;
+	tasks.swap(tasks_);
+	tasksMutex_.unlock();
+	for(std::list<UTask*>::iterator iter=tasks.begin(); iter!=tasks.end(); ++iter)
+	{
+		execute(*iter);
+	}
+
+	if(instance_ == this)
+	{
+		instance_ = 0;
+	}
+}
+
+void UThreadPool::post(UTask * task)
+{
+	UASSERT(task != 0);
+	task->stateMutex_.lock();
+	if(task->pending_)
+	{
+		task->stateMutex_.unlock();
+		return;
+	}
+	task->pending_ = true;
+	task->done_ = false;
+	task->pool_ = this;
+	task->stateMutex_.unlock();
+
+	if(workers_.empty())
+	{
+		// Pool is being destroyed
+		execute(task);
+		return;
+	}
+
+	tasksMutex_.lock();
+	tasks_.push_back(task);
+	tasksMutex_.unlock();
+	tasksSem_.release();
+}
+
+UTask * UThreadPool::take(Worker * worker)
+{
+	tasksSem_.acquire();
+	if(worker->isKilled())
+	{
+		return 0;
+	}
+	UTask * task = 0;
+	UScopeMutex lock(tasksMutex_);
+	// The queue can be empty if the task has been removed by UTask::wait()
+	if(!tasks_.empty())
+	{
+		task = tasks_.front();
+		tasks_.pop_front();
+	}
+	return task;
+}
+
+bool UThreadPool::remove(UTask * task)
+{
+	UScopeMutex lock(tasksMutex_);
+	std::list<UTask*>::iterator iter = std::find(tasks_.begin(), tasks_.end(), task);
+	if(iter != tasks_.end())
+	{
+		tasks_.erase(iter);
+		return true;
+	}
+	return false;
+}
+
+void UThreadPool::execute(UTask * task)
+{
+	task->run();
+	task->stateMutex_.lock();
+	task->done_ = true;
+	task->stateMutex_.unlock();
+	// After this, the task may be already deleted by the waiting thread
+	task->doneSem_.release();
+}
+
+////////////////////////////
+// UThreadPool::Worker
+////////////////////////////
+void UThreadPool::Worker::mainLoop()
+{
+	UTask * task = pool_->take(this);
+	if(task)
+	{
+		execute(task);
+	}
+}
+
+void UThreadPool::Worker::mainLoopKill()
+{
+	// wake up the worker
+	pool_->tasksSem_.release();
+}